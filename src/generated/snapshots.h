@@ -0,0 +1,13 @@
+// Generated by micro-model-3-host -w. Do not modify.
+
+#pragma once
+
+#include "trs80.h"
+
+extern const Trs80Snapshot GALAXY_INVASION_SNAPSHOT;
+extern const Trs80Snapshot OBSTACLE_RUN_SNAPSHOT;
+extern const Trs80Snapshot SCARFMAN2_SNAPSHOT;
+extern const Trs80Snapshot DEFENSE_COMMAND_SNAPSHOT;
+extern const Trs80Snapshot SEA_DRAGON_SNAPSHOT;
+extern const Trs80Snapshot BREAKDOWN_SNAPSHOT;
+extern const Trs80Snapshot EVER_GIVEN_SNAPSHOT;
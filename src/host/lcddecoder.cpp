@@ -0,0 +1,139 @@
+#include <cstring>
+
+#include "lcddecoder.h"
+#include "ili9341.h"
+
+// What a reset sets: the window all of the panel, not turned or mirrored.
+static void resetRegisters(LcdDecoder *decoder) {
+    decoder->columnBegin = 0;
+    decoder->columnEnd = ILI9341_TFTWIDTH - 1;
+    decoder->pageBegin = 0;
+    decoder->pageEnd = ILI9341_TFTHEIGHT - 1;
+    decoder->memoryAccess = 0;
+    decoder->command = ILI9341_NOP;
+    decoder->dataCount = 0;
+}
+
+// Where a column and page are in the framebuffer, or false if they're off
+// the panel. MV swaps columns and pages, then MY and MX mirror the panel's
+// long and short sides.
+static bool findSpot(LcdDecoder const *decoder, int column, int page, int *x, int *y) {
+    bool exchange = (decoder->memoryAccess & MADCTL_MV) != 0;
+    int along = exchange ? column : page;
+    int across = exchange ? page : column;
+
+    if (along < 0 || along >= LcdDecoderWidth || across < 0 || across >= LcdDecoderHeight) {
+        return false;
+    }
+
+    *x = (decoder->memoryAccess & MADCTL_MY) != 0 ? LcdDecoderWidth - 1 - along : along;
+    *y = (decoder->memoryAccess & MADCTL_MX) != 0 ? LcdDecoderHeight - 1 - across : across;
+    return true;
+}
+
+// Write a pixel and move to the next, a page at a time, going back to the
+// start after the last page like the LCD does.
+static void writePixel(LcdDecoder *decoder, uint16_t color) {
+    int x;
+    int y;
+    if (findSpot(decoder, decoder->column, decoder->page, &x, &y)) {
+        decoder->pixels[y*LcdDecoderWidth + x] = color;
+    } else {
+        decoder->stats.clipped++;
+    }
+    decoder->stats.pixels++;
+
+    decoder->column++;
+    if (decoder->column > decoder->columnEnd) {
+        decoder->column = decoder->columnBegin;
+        decoder->page++;
+        if (decoder->page > decoder->pageEnd) {
+            decoder->page = decoder->pageBegin;
+        }
+    }
+}
+
+void lcdDecoderReset(LcdDecoder *decoder) {
+    resetRegisters(decoder);
+    decoder->column = 0;
+    decoder->page = 0;
+    memset(decoder->pixels, 0, sizeof(decoder->pixels));
+    decoder->stats = {};
+}
+
+void lcdDecoderCommand(LcdDecoder *decoder, uint8_t command) {
+    // Does nothing, not even end a memory write.
+    if (command == ILI9341_NOP) {
+        return;
+    }
+
+    decoder->command = command;
+    decoder->dataCount = 0;
+    decoder->stats.commands++;
+
+    switch (command) {
+        case ILI9341_SWRESET:
+            resetRegisters(decoder);
+            break;
+
+        case ILI9341_RAMWR:
+            decoder->column = decoder->columnBegin;
+            decoder->page = decoder->pageBegin;
+            decoder->stats.windows++;
+            break;
+
+        case ILI9341_CASET:
+        case ILI9341_PASET:
+        case ILI9341_MADCTL:
+            break;
+
+        default:
+            decoder->stats.ignored++;
+            break;
+    }
+}
+
+void lcdDecoderData(LcdDecoder *decoder, uint8_t data) {
+    if (decoder->dataCount < (int) sizeof(decoder->data)) {
+        decoder->data[decoder->dataCount] = data;
+    }
+    decoder->dataCount++;
+
+    uint8_t const *d = decoder->data;
+    switch (decoder->command) {
+        case ILI9341_CASET:
+            if (decoder->dataCount == 4) {
+                decoder->columnBegin = d[0] << 8 | d[1];
+                decoder->columnEnd = d[2] << 8 | d[3];
+            }
+            break;
+
+        case ILI9341_PASET:
+            if (decoder->dataCount == 4) {
+                decoder->pageBegin = d[0] << 8 | d[1];
+                decoder->pageEnd = d[2] << 8 | d[3];
+            }
+            break;
+
+        case ILI9341_MADCTL:
+            if (decoder->dataCount == 1) {
+                decoder->memoryAccess = d[0];
+            }
+            break;
+
+        case ILI9341_RAMWR:
+            if (decoder->dataCount == 2) {
+                writePixel(decoder, d[0] << 8 | d[1]);
+                decoder->dataCount = 0;
+            }
+            break;
+    }
+}
+
+uint16_t lcdDecoderPixel(LcdDecoder const *decoder, int x, int y) {
+    return decoder->pixels[y*LcdDecoderWidth + x];
+}
+
+LcdDecoderStats lcdDecoderGetStats(LcdDecoder const *decoder) {
+    return decoder->stats;
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <stdint.h>
+
+// Stand-in for the ILI9341 on the host. Takes the bytes sent over SPI, each
+// as a command or as data depending on the DC pin, and does what the LCD
+// would with them, so what was drawn can be checked. It knows the commands
+// that draw (CASET, PASET, and RAMWR) and how MADCTL turns the picture, and
+// counts the rest without doing anything.
+
+// The panel as the device has it rotated (MADCTL's MV on).
+constexpr int LcdDecoderWidth = 320;
+constexpr int LcdDecoderHeight = 240;
+
+// What the decoder has been sent since the last reset.
+struct LcdDecoderStats {
+    // Commands other than NOP.
+    unsigned long commands;
+    // Memory writes, and the pixels in them.
+    unsigned long windows;
+    unsigned long long pixels;
+    // Commands that weren't understood, and pixels that fell off the panel.
+    unsigned long ignored;
+    unsigned long long clipped;
+};
+
+struct LcdDecoder {
+    // The address window, with its first and last column and page.
+    int columnBegin;
+    int columnEnd;
+    int pageBegin;
+    int pageEnd;
+
+    // How columns and pages map to the panel.
+    uint8_t memoryAccess;
+
+    // The command that data goes to, and its data so far. Pixels are two
+    // bytes, high byte first.
+    uint8_t command;
+    int dataCount;
+    uint8_t data[4];
+
+    // Where the next pixel of a memory write goes.
+    int column;
+    int page;
+
+    uint16_t pixels[LcdDecoderWidth*LcdDecoderHeight];
+
+    LcdDecoderStats stats;
+};
+
+// Start over with the panel black and the registers as after a reset.
+void lcdDecoderReset(LcdDecoder *decoder);
+
+// A byte sent with DC low.
+void lcdDecoderCommand(LcdDecoder *decoder, uint8_t command);
+
+// A byte sent with DC high.
+void lcdDecoderData(LcdDecoder *decoder, uint8_t data);
+
+// The color at a spot on the panel.
+uint16_t lcdDecoderPixel(LcdDecoder const *decoder, int x, int y);
+
+LcdDecoderStats lcdDecoderGetStats(LcdDecoder const *decoder);
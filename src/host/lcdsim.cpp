@@ -0,0 +1,306 @@
+#include <algorithm>
+#include <cstring>
+
+#include "lcdsim.h"
+#include "pico/stdlib.h"
+#include "hardware/spi.h"
+#include "hardware/dma.h"
+#include "hardware/irq.h"
+
+// The clock the SPI's clock is divided from, which the device leaves at the
+// default.
+constexpr uint32_t PERIPHERAL_HZ = 125000000;
+
+constexpr int GPIO_COUNT = 30;
+
+struct spi_inst {
+    spi_hw_t hw;
+    // The clock spi_init() got, and the bits in each frame.
+    uint hz;
+    int dataBits;
+    // When it'll be done sending what it has.
+    double busyUntil;
+};
+
+spi_inst_t gLcdSimSpi;
+dma_hw_t gLcdSimDmaHw;
+
+namespace {
+    // Microseconds since the reset.
+    double mNow;
+
+    bool mPins[GPIO_COUNT];
+    int mDcPin;
+    int mCsPin;
+
+    // The one DMA channel: whether a transfer is going, and when it ends.
+    bool mTransferBusy;
+    double mTransferDoneAt;
+    bool mTransferInterrupt;
+
+    irq_handler_t mDmaHandler;
+    bool mDmaHandlerEnabled;
+    bool mInInterrupt;
+
+    LcdDecoder mDecoder;
+    LcdSimStats mStats;
+
+    // Hand a byte to the LCD, if it's listening.
+    void sendByte(uint8_t byte) {
+        mStats.bytes++;
+        if (mPins[mCsPin]) {
+            mStats.deselectedBytes++;
+        } else if (mPins[mDcPin]) {
+            lcdDecoderData(&mDecoder, byte);
+        } else {
+            lcdDecoderCommand(&mDecoder, byte);
+        }
+    }
+
+    // Hand the LCD the bits of a frame the SPI sends, high byte first.
+    void sendFrame(uint32_t frame) {
+        if (gLcdSimSpi.dataBits > 8) {
+            sendByte(frame >> 8);
+        }
+        sendByte(frame);
+    }
+
+    // Put frames on the SPI after what it's sending already, and return when
+    // they'll be sent.
+    double queueFrames(size_t count) {
+        double micros = (double) count*gLcdSimSpi.dataBits*1e6/gLcdSimSpi.hz;
+
+        gLcdSimSpi.busyUntil = std::max(mNow, gLcdSimSpi.busyUntil) + micros;
+        mStats.busyMicros += micros;
+
+        return gLcdSimSpi.busyUntil;
+    }
+
+    // Let time pass, running the interrupt at the end of each transfer on the
+    // way. A transfer that ends during the interrupt waits for it to return.
+    void runUntil(double time) {
+        while (mTransferBusy && mTransferDoneAt <= time && !mInInterrupt) {
+            mNow = std::max(mNow, mTransferDoneAt);
+            mTransferBusy = false;
+
+            if (mTransferInterrupt && mDmaHandlerEnabled && mDmaHandler != nullptr) {
+                gLcdSimDmaHw.ints0 = 1;
+                mStats.interrupts++;
+                mInInterrupt = true;
+                mDmaHandler();
+                mInInterrupt = false;
+                gLcdSimDmaHw.ints0 = 0;
+            }
+        }
+
+        mNow = std::max(mNow, time);
+    }
+
+    // The CPU waits until then.
+    void waitUntil(double time) {
+        double begin = mNow;
+        runUntil(time);
+        mStats.waitMicros += mNow - begin;
+    }
+}
+
+void lcdSimReset(int dcPin, int csPin) {
+    mNow = 0;
+    memset(mPins, 0, sizeof(mPins));
+    mDcPin = dcPin;
+    mCsPin = csPin;
+    gLcdSimSpi = {};
+    gLcdSimDmaHw = {};
+    mTransferBusy = false;
+    mTransferInterrupt = false;
+    mDmaHandler = nullptr;
+    mDmaHandlerEnabled = false;
+    mInInterrupt = false;
+    lcdDecoderReset(&mDecoder);
+    mStats = {};
+}
+
+void lcdSimAdvance(double micros) {
+    runUntil(mNow + micros);
+}
+
+void lcdSimFinish() {
+    while (lcdSimIsBusy()) {
+        runUntil(std::max(gLcdSimSpi.busyUntil, mTransferBusy ? mTransferDoneAt : mNow));
+    }
+}
+
+bool lcdSimIsBusy() {
+    return mTransferBusy || gLcdSimSpi.busyUntil > mNow;
+}
+
+double lcdSimGetSpiHz() {
+    return gLcdSimSpi.hz;
+}
+
+LcdDecoder const *lcdSimGetDecoder() {
+    return &mDecoder;
+}
+
+LcdSimStats lcdSimGetStats() {
+    return mStats;
+}
+
+void gpio_init(uint gpio) {
+    gpio_put(gpio, false);
+}
+
+void gpio_set_dir([[maybe_unused]] uint gpio, [[maybe_unused]] bool out) {
+    // Nothing to do.
+}
+
+void gpio_put(uint gpio, bool value) {
+    if (gpio >= GPIO_COUNT) {
+        return;
+    }
+
+    if (value != mPins[gpio] && ((int) gpio == mDcPin || (int) gpio == mCsPin) &&
+            gLcdSimSpi.busyUntil > mNow) {
+
+        mStats.pinChangesWhileBusy++;
+    }
+    mPins[gpio] = value;
+}
+
+void gpio_set_function([[maybe_unused]] uint gpio, [[maybe_unused]] enum gpio_function fn) {
+    // Nothing to do.
+}
+
+void sleep_ms(uint32_t ms) {
+    runUntil(mNow + ms*1000.0);
+}
+
+void tight_loop_contents() {
+    // Spin until something happens.
+    double next = mNow + 1;
+    if (gLcdSimSpi.busyUntil > mNow) {
+        next = gLcdSimSpi.busyUntil;
+    }
+    if (mTransferBusy && !mInInterrupt) {
+        next = std::min(next, std::max(mNow, mTransferDoneAt));
+    }
+
+    waitUntil(next);
+}
+
+uint spi_init(spi_inst_t *spi, uint baudrate) {
+    // Find the dividers the way the SDK's spi_set_baudrate() does.
+    uint prescale;
+    for (prescale = 2; prescale <= 254; prescale += 2) {
+        if (PERIPHERAL_HZ < (prescale + 2)*256*(uint64_t) baudrate) {
+            break;
+        }
+    }
+    uint postdiv;
+    for (postdiv = 256; postdiv > 1; postdiv--) {
+        if (PERIPHERAL_HZ/(prescale*(postdiv - 1)) > baudrate) {
+            break;
+        }
+    }
+
+    spi->hz = PERIPHERAL_HZ/(prescale*postdiv);
+    spi->dataBits = 8;
+
+    return spi->hz;
+}
+
+void spi_set_format(spi_inst_t *spi, uint data_bits, [[maybe_unused]] spi_cpol_t cpol,
+        [[maybe_unused]] spi_cpha_t cpha, [[maybe_unused]] spi_order_t order) {
+    spi->dataBits = data_bits;
+}
+
+int spi_write_blocking([[maybe_unused]] spi_inst_t *spi, const uint8_t *src, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        sendFrame(src[i]);
+    }
+    waitUntil(queueFrames(len));
+
+    return len;
+}
+
+int spi_write16_blocking([[maybe_unused]] spi_inst_t *spi, const uint16_t *src, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        sendFrame(src[i]);
+    }
+    waitUntil(queueFrames(len));
+
+    return len;
+}
+
+bool spi_is_readable([[maybe_unused]] const spi_inst_t *spi) {
+    return false;
+}
+
+spi_hw_t *spi_get_hw(spi_inst_t *spi) {
+    spi->hw.sr = spi->busyUntil > mNow ? SPI_SSPSR_BSY_BITS : 0;
+    return &spi->hw;
+}
+
+uint spi_get_dreq([[maybe_unused]] spi_inst_t *spi, [[maybe_unused]] bool is_tx) {
+    return 0;
+}
+
+int dma_claim_unused_channel([[maybe_unused]] bool required) {
+    return 0;
+}
+
+void dma_channel_configure([[maybe_unused]] uint channel, const dma_channel_config *config,
+        volatile void *write_addr, const volatile void *read_addr,
+        uint transfer_count, bool trigger) {
+
+    if (!trigger || write_addr != &gLcdSimSpi.hw.dr) {
+        return;
+    }
+
+    // The SPI takes the low bits of each item, as many as are in a frame.
+    uint8_t const volatile *src = (uint8_t const volatile *) read_addr;
+    for (uint i = 0; i < transfer_count; i++) {
+        switch (config->size) {
+            case DMA_SIZE_8:
+                sendFrame(*src);
+                break;
+
+            case DMA_SIZE_16:
+                sendFrame(*(uint16_t const volatile *) src);
+                break;
+
+            case DMA_SIZE_32:
+                sendFrame(*(uint32_t const volatile *) src);
+                break;
+        }
+        if (config->readIncrement) {
+            src += 1 << config->size;
+        }
+    }
+
+    mTransferBusy = true;
+    mTransferDoneAt = queueFrames(transfer_count);
+    mStats.transfers++;
+}
+
+void dma_channel_wait_for_finish_blocking([[maybe_unused]] uint channel) {
+    if (mTransferBusy) {
+        waitUntil(mTransferDoneAt);
+    }
+}
+
+void dma_channel_set_irq0_enabled([[maybe_unused]] uint channel, bool enabled) {
+    mTransferInterrupt = enabled;
+}
+
+void irq_set_exclusive_handler(uint num, irq_handler_t handler) {
+    if (num == DMA_IRQ_0) {
+        mDmaHandler = handler;
+    }
+}
+
+void irq_set_enabled(uint num, bool enabled) {
+    if (num == DMA_IRQ_0) {
+        mDmaHandlerEnabled = enabled;
+    }
+}
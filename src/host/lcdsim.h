@@ -0,0 +1,53 @@
+#pragma once
+
+#include "lcddecoder.h"
+
+// A simulated SPI bus and DMA channel with an ILI9341 on the other end, so
+// that the device's LCD driver (ili9341.c) runs as is on the host, built
+// against the stand-in SDK headers in pico-sdk/. Each byte it sends goes to
+// a decoder as a command or as data, depending on the DC pin, and takes the
+// time it would at the clock that spi_init() really gets.
+//
+// Time only passes when the simulation is told to, or when the driver waits
+// for the SPI or DMA, sleeps, or spins in tight_loop_contents(). When it
+// passes the end of a DMA transfer the DMA interrupt runs, so batches go out
+// in the background like on the device. The CPU's own work takes no time.
+//
+// There's one SPI bus and one LCD, as on the device, so only one thread may
+// use them.
+
+// What the simulation has seen since the last reset.
+struct LcdSimStats {
+    // Bytes sent, and how long the SPI was busy sending them.
+    unsigned long long bytes;
+    double busyMicros;
+    // How long the CPU waited for the SPI or DMA.
+    double waitMicros;
+    // DMA transfers, and the interrupts for them.
+    unsigned long transfers;
+    unsigned long interrupts;
+    // Bytes sent with the LCD not selected, and DC or CS changed while the
+    // SPI was still sending. Both are driver bugs.
+    unsigned long long deselectedBytes;
+    unsigned long pinChangesWhileBusy;
+};
+
+// Start over at time zero with nothing sent, the SPI and DMA not set up, and
+// the LCD reset, its DC and CS on these pins.
+void lcdSimReset(int dcPin, int csPin);
+
+// Let this many microseconds pass.
+void lcdSimAdvance(double micros);
+
+// Let time pass until everything started is sent, including whatever the DMA
+// interrupt starts on the way.
+void lcdSimFinish();
+
+// Whether the SPI is sending or a DMA transfer is going.
+bool lcdSimIsBusy();
+
+// The SPI clock that spi_init() got.
+double lcdSimGetSpiHz();
+
+LcdDecoder const *lcdSimGetDecoder();
+LcdSimStats lcdSimGetStats();
@@ -0,0 +1,1162 @@
+#include <array>
+#include <atomic>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <time.h>
+
+#include "trs80.h"
+#include "obstacle_run_cmd.h"
+#include "scarfman2_cmd.h"
+#include "defense_command_cmd.h"
+#include "sea_dragon_cmd.h"
+#include "breakdown_cmd.h"
+#include "ever_given_cmd.h"
+#include "galaxy_invasion_cmd.h"
+#include "snapshots.h"
+#include "snapshot.h"
+#include "rewind.h"
+#include "display.h"
+#include "menu.h"
+#include "splash.h"
+#include "logos.h"
+#include "lcdsim.h"
+#include "ili9341.h"
+
+/**
+ * Headless runner for the emulator on the build machine. Boots the ROM,
+ * loads one of the bundled programs, runs it as fast as possible for a
+ * number of emulated seconds, and reports how fast it went. Each run has its
+ * own machine, so several can run at once on their own threads.
+ *
+ * It also makes the snapshots in src/generated/snapshots.cpp, which let the
+ * device start a game where it was just loaded instead of booting the ROM.
+ */
+
+constexpr float DEFAULT_SECONDS = 60;
+
+// For measuring input latency: how many ticks to watch the screen after
+// moving the joystick, how many times to try, and how far apart.
+constexpr int LATENCY_FRAMES = 30;
+constexpr int LATENCY_TRIALS = 20;
+constexpr float LATENCY_TRIAL_SECONDS = 0.5;
+
+// Bytes sent to the LCD to set up a window: the column and page address
+// commands with their two 16-bit arguments each, and the memory write
+// command, each command a 16-bit word.
+constexpr int LCD_WINDOW_BYTES = 14;
+
+// How the device has the LCD wired and turned, which the simulated one is
+// the same as.
+constexpr int LCD_DC_PIN = 20;
+constexpr int LCD_CS_PIN = 17;
+constexpr int LCD_RST_PIN = 21;
+constexpr int LCD_SCK_PIN = 18;
+constexpr int LCD_TX_PIN = 19;
+constexpr int LCD_ROTATION = 1;
+
+/**
+ * A program we can run.
+ */
+struct Program {
+    // Name on the command line.
+    const char *name;
+    // .CMD image, or null to stay in the ROM.
+    uint8_t *cmd;
+    size_t cmdSize;
+    // Name of the program's snapshot in the generated source, and the
+    // snapshot itself if the program has one.
+    const char *snapshotName;
+    Trs80Snapshot const *snapshot;
+    // Keys that get from the program's first screen to playing it.
+    const char *startKeys;
+};
+
+namespace {
+    const std::vector<Program> gProgramList = {
+        { "rom", nullptr, 0, nullptr, nullptr, "" },
+        { "galaxy-invasion", GALAXY_INVASION_CMD, GALAXY_INVASION_CMD_SIZE,
+            "GALAXY_INVASION_SNAPSHOT", &GALAXY_INVASION_SNAPSHOT, "\\1" },
+        { "obstacle-run", OBSTACLE_RUN_CMD, OBSTACLE_RUN_CMD_SIZE,
+            "OBSTACLE_RUN_SNAPSHOT", &OBSTACLE_RUN_SNAPSHOT, "\\1" },
+        { "scarfman", SCARFMAN2_CMD, SCARFMAN2_CMD_SIZE,
+            "SCARFMAN2_SNAPSHOT", &SCARFMAN2_SNAPSHOT, "" },
+        { "defense-command", DEFENSE_COMMAND_CMD, DEFENSE_COMMAND_CMD_SIZE,
+            "DEFENSE_COMMAND_SNAPSHOT", &DEFENSE_COMMAND_SNAPSHOT, "1" },
+        { "sea-dragon", SEA_DRAGON_CMD, SEA_DRAGON_CMD_SIZE,
+            "SEA_DRAGON_SNAPSHOT", &SEA_DRAGON_SNAPSHOT, "\n10" },
+        { "breakdown", BREAKDOWN_CMD, BREAKDOWN_CMD_SIZE,
+            "BREAKDOWN_SNAPSHOT", &BREAKDOWN_SNAPSHOT, "" },
+        { "ever-given", EVER_GIVEN_CMD, EVER_GIVEN_CMD_SIZE,
+            "EVER_GIVEN_SNAPSHOT", &EVER_GIVEN_SNAPSHOT, "\n" },
+    };
+
+    // Whether to take a snapshot of each program when it's loaded.
+    bool mTakeSnapshots = false;
+    // Directories to load each program's saved state from before running it,
+    // and to save it to afterward, or null.
+    const char *mLoadDir = nullptr;
+    const char *mSaveDir = nullptr;
+    // Size of the rewind ring in bytes, or zero to not keep one.
+    size_t mRewindSize = 0;
+    // Timer ticks to run ahead.
+    int mRunAheadFrames = 0;
+    // Whether to run at the speed of the real machine.
+    bool mThrottle = false;
+    // Pages of RAM each machine can copy on write.
+    int mRamPages = Trs80RamPageCount;
+    // Timer ticks between display flushes, or zero to not draw the screen.
+    int mDisplayTicks = 0;
+    // What the simulated LCD's DMA interrupt hands back to.
+    LcdQueue *mLcdQueue = nullptr;
+
+    /**
+     * What was sent to the simulated LCD, a frame at a time.
+     */
+    struct LcdFrames {
+        unsigned long frames;
+        // Frames the SPI was still sending when the next one began.
+        unsigned long late;
+        unsigned long long bytes;
+        unsigned long windows;
+        // How long the SPI took to send them.
+        double busyMicros;
+        double mostBusyMicros;
+        // Commands queued for them, and times the queue was full.
+        unsigned long commands;
+        unsigned long mostCommands;
+        unsigned long stalls;
+        unsigned long mostStalls;
+        // Where the frame being sent began.
+        LcdSimStats begin;
+        unsigned long beginWindows;
+        LcdQueueStats beginQueue;
+    };
+
+    /**
+     * One run of a program on its own machine, and what came of it.
+     */
+    struct Run {
+        Program const *program;
+        Trs80Machine *machine;
+        // Number of characters that changed on the screen.
+        long long screenWrites;
+        // The screen as the callbacks were told it is.
+        uint8_t screen[Trs80ScreenSize];
+        // Screen at each tick while measuring latency.
+        std::vector<std::array<uint8_t, Trs80ScreenSize>> frames;
+        RewindRing rewind;
+        // The screen as drawn on the simulated LCD.
+        Display display;
+        LcdQueue lcdQueue;
+        LcdFrames lcdFrames;
+        // Snapshot of the program once it was loaded, if we're taking them.
+        std::unique_ptr<Trs80Snapshot> snapshot;
+        // How long it ran for.
+        double emulatedSeconds;
+        // What we have to say about it, printed once it's done.
+        std::string output;
+        bool done;
+        // Whether the simulated LCD ended up showing something else than the
+        // screen, or the driver sent to it wrong.
+        bool lcdWrong;
+    };
+
+    void usage(const char *argv0) {
+        fprintf(stderr, "Usage: %s [-s SECONDS] [-d] [-r] [-w DIR] [-L DIR] [-S DIR] [-b KB] [-a FRAMES] [-D TICKS] [-t] [-p PAGES] [-l] [-m] [-j THREADS] [-n COPIES] [PROGRAM...]\n", argv0);
+        fprintf(stderr, "\n");
+        fprintf(stderr, "    -s SECONDS    emulated seconds to run (default %g)\n", DEFAULT_SECONDS);
+        fprintf(stderr, "    -d            dump the screen when done\n");
+        fprintf(stderr, "    -r            start programs from their snapshot instead of booting\n");
+        fprintf(stderr, "    -w DIR        write snapshots of the programs once loaded to DIR/snapshots.*\n");
+        fprintf(stderr, "    -L DIR        resume programs from their state in DIR/PROGRAM.sav\n");
+        fprintf(stderr, "    -S DIR        save the state of programs when done to DIR/PROGRAM.sav\n");
+        fprintf(stderr, "    -b KB         keep a rewind ring of this size and report its cost\n");
+        fprintf(stderr, "    -a FRAMES     run ahead this many timer ticks and report its cost\n");
+        fprintf(stderr, "    -D TICKS      draw the screen every TICKS timer ticks and report the LCD traffic\n");
+        fprintf(stderr, "    -t            run at the speed of the real machine and report the time to spare\n");
+        fprintf(stderr, "    -p PAGES      pages of RAM each machine can copy on write (default %d)\n", Trs80RamPageCount);
+        fprintf(stderr, "    -l            measure the input latency of programs, with and without -a\n");
+        fprintf(stderr, "    -m            measure scrolling through the game menu instead of running programs\n");
+        fprintf(stderr, "    -j THREADS    run this many programs at once (default 1)\n");
+        fprintf(stderr, "    -n COPIES     run each program this many times (default 1)\n");
+        fprintf(stderr, "\n");
+        fprintf(stderr, "Programs (default all):");
+        for (Program const &program : gProgramList) {
+            fprintf(stderr, " %s", program.name);
+        }
+        fprintf(stderr, "\n");
+        exit(1);
+    }
+
+    Program const *findProgram(const char *name) {
+        for (Program const &program : gProgramList) {
+            if (strcmp(program.name, name) == 0) {
+                return &program;
+            }
+        }
+
+        return nullptr;
+    }
+
+    Run *getRun(Trs80Machine *machine) {
+        return (Run *) trs80_getUserData(machine);
+    }
+
+    /**
+     * Add to what we'll print about the run, or print it now if there's no
+     * run.
+     */
+    __attribute__((format(printf, 2, 3)))
+    void print(Run *run, const char *format, ...) {
+        char line[256];
+        va_list args;
+
+        va_start(args, format);
+        vsnprintf(line, sizeof(line), format, args);
+        va_end(args);
+
+        if (run != nullptr) {
+            run->output += line;
+        } else {
+            fputs(line, stdout);
+        }
+    }
+
+    void screenCallback(Trs80Machine *machine, int position, uint8_t ch) {
+        Run *run = getRun(machine);
+
+        run->screenWrites += 1;
+        run->screen[position] = ch;
+        if (mDisplayTicks != 0) {
+            displayMark(&run->display, position, ch);
+        }
+    }
+
+    void screenRangeCallback(Trs80Machine *machine, int begin, int end) {
+        Run *run = getRun(machine);
+
+        run->screenWrites += end - begin;
+        for (int position = begin; position < end; position++) {
+            run->screen[position] = readMemoryByte(machine, Trs80ScreenBegin + position);
+            if (mDisplayTicks != 0) {
+                displayMark(&run->display, position, run->screen[position]);
+            }
+        }
+    }
+
+    // The queue drives the device's LCD driver, as on the device, but on the
+    // simulated SPI bus.
+    void startLcdCommands([[maybe_unused]] LcdQueue *queue, LcdCommand const *commands, int count) {
+        LCD_startCommands(commands, count);
+    }
+
+    // Called from the simulated DMA interrupt.
+    void lcdTransferDone() {
+        lcdQueueTransferDone(mLcdQueue);
+    }
+
+    void waitForLcd([[maybe_unused]] LcdQueue *queue) {
+        tight_loop_contents();
+    }
+
+    /**
+     * Start the simulated LCD over and set it up the way the device does,
+     * with the queue sending to it.
+     */
+    void startLcd(LcdQueue *queue) {
+        lcdSimReset(LCD_DC_PIN, LCD_CS_PIN);
+        LCD_setPins(LCD_DC_PIN, LCD_CS_PIN, LCD_RST_PIN, LCD_SCK_PIN, LCD_TX_PIN);
+        LCD_initDisplay();
+        LCD_setRotation(LCD_ROTATION);
+        LCD_fillRect(0, 0, LCD_getWidth(), LCD_getHeight(), ILI9341_BLACK);
+
+        queue->startCommands = startLcdCommands;
+        queue->wait = waitForLcd;
+        lcdQueueReset(queue);
+        mLcdQueue = queue;
+        LCD_setTransferDoneHandler(lcdTransferDone);
+    }
+
+    void beginLcdFrame(LcdFrames *frames) {
+        frames->begin = lcdSimGetStats();
+        frames->beginWindows = lcdDecoderGetStats(lcdSimGetDecoder()).windows;
+        frames->beginQueue = lcdQueueGetStats(mLcdQueue);
+    }
+
+    void endLcdFrame(LcdFrames *frames, bool late) {
+        LcdSimStats sim = lcdSimGetStats();
+        double busyMicros = sim.busyMicros - frames->begin.busyMicros;
+        LcdQueueStats queue = lcdQueueGetStats(mLcdQueue);
+        unsigned long commands = queue.commands - frames->beginQueue.commands;
+        unsigned long stalls = queue.stalls - frames->beginQueue.stalls;
+
+        frames->frames++;
+        frames->late += late;
+        frames->bytes += sim.bytes - frames->begin.bytes;
+        frames->windows += lcdDecoderGetStats(lcdSimGetDecoder()).windows - frames->beginWindows;
+        frames->busyMicros += busyMicros;
+        frames->mostBusyMicros = std::max(frames->mostBusyMicros, busyMicros);
+        frames->commands += commands;
+        frames->mostCommands = std::max(frames->mostCommands, commands);
+        frames->stalls += stalls;
+        frames->mostStalls = std::max(frames->mostStalls, stalls);
+    }
+
+    /**
+     * Report what the frames took, given how far apart they start, or zero
+     * if each starts once the last is sent.
+     */
+    void printLcdFrames(Run *run, const char *name, LcdFrames const &frames, double frameMicros) {
+        double count = std::max(frames.frames, 1UL);
+        double busyMs = frames.busyMicros/count/1000;
+        char share[64];
+        if (frameMicros != 0) {
+            snprintf(share, sizeof(share), "%.1f%% of %.1f ms", 100*busyMs*1000/frameMicros, frameMicros/1000);
+        } else {
+            snprintf(share, sizeof(share), "%.0f fps", busyMs == 0 ? 0.0 : 1000/busyMs);
+        }
+
+        print(run, "%-16s lcd %lu frames, %.1f KB in %.1f windows and %.2f ms (%s) a frame, %.2f ms at most, %lu late, %.0f ms in all\n",
+                name, frames.frames, frames.bytes/1024.0/count, frames.windows/count, busyMs, share,
+                frames.mostBusyMicros/1000, frames.late, frames.busyMicros/1000);
+        print(run, "%-16s lcd queue %.1f commands and %.2f stalls a frame, %lu commands and %lu stalls at most\n",
+                name, frames.commands/count, frames.stalls/count, frames.mostCommands, frames.mostStalls);
+    }
+
+    // Wait while throttling, on the monotonic clock like the machine.
+    void sleepCallback([[maybe_unused]] Trs80Machine *machine, uint32_t micros) {
+        timespec duration;
+        duration.tv_sec = micros/1000000;
+        duration.tv_nsec = (micros % 1000000)*1000;
+        clock_nanosleep(CLOCK_MONOTONIC, 0, &duration, nullptr);
+    }
+
+    void timerCallback(Trs80Machine *machine) {
+        Run *run = getRun(machine);
+
+        if (mRewindSize != 0) {
+            rewindTick(&run->rewind);
+        }
+        if (mDisplayTicks != 0) {
+            // The LCD has had a tick to send what was drawn. A frame is what's
+            // sent from one flush to the next.
+            lcdSimAdvance(1e6/Trs80TimerHz);
+            if (run->display.ticks + 1 >= run->display.flushTicks) {
+                endLcdFrame(&run->lcdFrames, lcdSimIsBusy());
+                beginLcdFrame(&run->lcdFrames);
+            }
+            displayTick(&run->display);
+        }
+    }
+
+    void launchProgram(Trs80Machine *machine, [[maybe_unused]] int data) {
+        Run *run = getRun(machine);
+
+        // Turn off blinking cursor.
+        writeMemoryByte(machine, 16412, 1);
+
+        if (run->program->cmd != nullptr) {
+            loadCmdProgram(machine, run->program->cmd, run->program->cmdSize);
+
+            if (mTakeSnapshots) {
+                run->snapshot.reset(new Trs80Snapshot);
+                trs80_saveSnapshot(machine, run->snapshot.get());
+            }
+        }
+    }
+
+    void exitCallback(Trs80Machine *machine, [[maybe_unused]] int data) {
+        trs80_exit(machine);
+    }
+
+    void keyCallback(Trs80Machine *machine, int ch) {
+        handleKeypress(machine, ch, true);
+        handleKeypress(machine, ch, false);
+    }
+
+    /**
+     * Print the TRS-80 screen as text.
+     */
+    void dumpScreen(Run *run) {
+        for (int y = 0; y < Trs80RowCount; y++) {
+            char line[Trs80ColumnCount + 1];
+
+            for (int x = 0; x < Trs80ColumnCount; x++) {
+                uint8_t ch = readMemoryByte(run->machine, Trs80ScreenBegin + y*Trs80ColumnCount + x);
+                line[x] = ch >= 32 && ch < 127 ? ch : ch == 128 ? ' ' : '#';
+            }
+            line[Trs80ColumnCount] = '\0';
+
+            print(run, "|%s|\n", line);
+        }
+    }
+
+    /**
+     * Write the bytes as the body of a C array.
+     */
+    void writeBytes(FILE *f, uint8_t const *bytes, size_t size) {
+        for (size_t i = 0; i < size; i++) {
+            fprintf(f, "%s0x%02X,%s", i % 16 == 0 ? "        " : "",
+                    bytes[i], i % 16 == 15 || i == size - 1 ? "\n" : " ");
+        }
+    }
+
+    /**
+     * Write the snapshots the runs took as C++ source and header files in
+     * the directory, one per program.
+     */
+    bool writeSnapshots(std::vector<std::unique_ptr<Run>> const &runs, const char *dir) {
+        // Only the first copy of each program.
+        std::vector<Run const *> snapshotRuns;
+        for (auto const &run : runs) {
+            bool seen = false;
+            for (Run const *other : snapshotRuns) {
+                seen = seen || other->program == run->program;
+            }
+            if (run->snapshot != nullptr && !seen) {
+                snapshotRuns.push_back(run.get());
+            }
+        }
+
+        std::string headerPathname = std::string(dir) + "/snapshots.h";
+        std::string sourcePathname = std::string(dir) + "/snapshots.cpp";
+
+        FILE *h = fopen(headerPathname.c_str(), "w");
+        if (h == nullptr) {
+            perror(headerPathname.c_str());
+            return false;
+        }
+        fprintf(h, "// Generated by micro-model-3-host -w. Do not modify.\n\n");
+        fprintf(h, "#pragma once\n\n");
+        fprintf(h, "#include \"trs80.h\"\n\n");
+        for (Run const *run : snapshotRuns) {
+            fprintf(h, "extern const Trs80Snapshot %s;\n", run->program->snapshotName);
+        }
+        fclose(h);
+
+        FILE *f = fopen(sourcePathname.c_str(), "w");
+        if (f == nullptr) {
+            perror(sourcePathname.c_str());
+            return false;
+        }
+        fprintf(f, "// Generated by micro-model-3-host -w. Do not modify.\n\n");
+        fprintf(f, "#include \"snapshots.h\"\n");
+        for (Run const *run : snapshotRuns) {
+            Trs80Snapshot const *s = run->snapshot.get();
+
+            fprintf(f, "\n");
+            fprintf(f, "// \"%s\" just after loading.\n", run->program->name);
+            fprintf(f, "const Trs80Snapshot %s = {\n", run->program->snapshotName);
+            fprintf(f, "    %u, %lldLL, %lldLL,\n", s->version, s->clock, s->timerClock);
+            fprintf(f, "    %d,\n", s->status);
+            fprintf(f, "    {");
+            for (uint16_t value : s->registers) {
+                fprintf(f, " 0x%04X,", value);
+            }
+            fprintf(f, " },\n");
+            fprintf(f, "    {");
+            for (uint16_t value : s->alternates) {
+                fprintf(f, " 0x%04X,", value);
+            }
+            fprintf(f, " },\n");
+            fprintf(f, "    0x%04X, 0x%02X, 0x%02X, %d, %d, %d,\n",
+                    s->pc, s->i, s->r, s->iff1, s->iff2, s->im);
+            fprintf(f, "    0x%02X, 0x%02X, 0x%02X, 0x%02X, %s, 0x%02X,\n",
+                    s->irqMask, s->irqLatch, s->nmiMask, s->nmiLatch,
+                    s->nmiSeen ? "true" : "false", s->modeImage);
+            fprintf(f, "    {");
+            for (uint8_t value : s->keys) {
+                fprintf(f, " 0x%02X,", value);
+            }
+            fprintf(f, " },\n");
+            fprintf(f, "    %d, %s, %s, %lldLL, 0x%02X,\n",
+                    s->shiftForce,
+                    s->leftShiftPressed ? "true" : "false",
+                    s->rightShiftPressed ? "true" : "false",
+                    s->keyProcessMinClock, s->joystick);
+            // Leave out the zeros at the end, which the compiler fills in.
+            size_t ramSize = sizeof(s->ram);
+            while (ramSize > 0 && s->ram[ramSize - 1] == 0) {
+                ramSize--;
+            }
+            fprintf(f, "    {\n");
+            writeBytes(f, s->ram, ramSize);
+            fprintf(f, "    },\n");
+            fprintf(f, "};\n");
+        }
+        fclose(f);
+
+        return true;
+    }
+
+
+    /**
+     * Microseconds since the given time.
+     */
+    double microsSince(std::chrono::steady_clock::time_point startTime) {
+        auto endTime = std::chrono::steady_clock::now();
+        return std::chrono::duration<double, std::micro>(endTime - startTime).count();
+    }
+
+    /**
+     * Save the state of the machine as its differences from the program's
+     * snapshot, to DIR/PROGRAM.sav.
+     */
+    void saveState(Run *run, const char *dir) {
+        std::string pathname = std::string(dir) + "/" + run->program->name + ".sav";
+        std::unique_ptr<Trs80Snapshot> snapshot(new Trs80Snapshot);
+        std::vector<uint8_t> buffer(Trs80CompressedSnapshotMaxSize);
+
+        auto startTime = std::chrono::steady_clock::now();
+        trs80_saveSnapshot(run->machine, snapshot.get());
+        size_t size = compressSnapshot(snapshot.get(), run->program->snapshot, buffer.data(), buffer.size());
+        double micros = microsSince(startTime);
+
+        FILE *f = fopen(pathname.c_str(), "wb");
+        if (f == nullptr) {
+            perror(pathname.c_str());
+            return;
+        }
+        fwrite(buffer.data(), 1, size, f);
+        fclose(f);
+
+        print(run, "%-16s saved %zu bytes (%.1f%% of RAM) in %.0f us\n",
+                "", size, 100.0*size/sizeof(snapshot->ram), micros);
+    }
+
+    /**
+     * Restore the state of the machine from DIR/PROGRAM.sav. Returns whether
+     * it was restored.
+     */
+    bool loadState(Run *run, const char *dir) {
+        std::string pathname = std::string(dir) + "/" + run->program->name + ".sav";
+        std::unique_ptr<Trs80Snapshot> snapshot(new Trs80Snapshot);
+        std::vector<uint8_t> buffer(Trs80CompressedSnapshotMaxSize);
+
+        FILE *f = fopen(pathname.c_str(), "rb");
+        if (f == nullptr) {
+            perror(pathname.c_str());
+            return false;
+        }
+        size_t size = fread(buffer.data(), 1, buffer.size(), f);
+        fclose(f);
+
+        // Share the program's snapshot first, as the device does, so that
+        // only the pages the program changed are copied.
+        auto startTime = std::chrono::steady_clock::now();
+        bool success = decompressSnapshot(buffer.data(), size, run->program->snapshot, snapshot.get()) &&
+            (run->program->snapshot == nullptr || trs80_shareSnapshot(run->machine, run->program->snapshot)) &&
+            trs80_restoreSnapshot(run->machine, snapshot.get());
+        double micros = microsSince(startTime);
+
+        if (!success) {
+            fprintf(stderr, "Can't restore state from %s\n", pathname.c_str());
+            return false;
+        }
+
+        print(run, "%-16s loaded %zu bytes in %.0f us\n", run->program->name, size, micros);
+
+        return true;
+    }
+
+    /**
+     * Count the screen cells that the simulated LCD doesn't show right.
+     */
+    int countBadCells(Run const *run) {
+        LcdDecoder const *lcd = lcdSimGetDecoder();
+        int badCells = 0;
+
+        for (int position = 0; position < Trs80ScreenSize; position++) {
+            uint16_t const *glyph = displayGlyph(run->screen[position]);
+            int left = run->display.left + position % Trs80ColumnCount*DisplayGlyphWidth;
+            int top = run->display.top + position / Trs80ColumnCount*DisplayGlyphHeight;
+
+            for (int i = 0; i < DisplayGlyphSize; i++) {
+                if (lcdDecoderPixel(lcd, left + i % DisplayGlyphWidth, top + i / DisplayGlyphWidth) != glyph[i]) {
+                    badCells++;
+                    break;
+                }
+            }
+        }
+
+        return badCells;
+    }
+
+    /**
+     * Run a program for the given number of emulated seconds and
+     * report the speed.
+     */
+    void runProgram(Run *run, float seconds, bool dump, bool restore) {
+        Trs80Machine *machine = run->machine;
+        Program const *program = run->program;
+
+        if (mDisplayTicks != 0) {
+            startLcd(&run->lcdQueue);
+            beginLcdFrame(&run->lcdFrames);
+            run->display.queue = &run->lcdQueue;
+            displayReset(&run->display, mDisplayTicks);
+        }
+
+        if ((mLoadDir != nullptr && loadState(run, mLoadDir)) ||
+                (restore && program->snapshot != nullptr && trs80_shareSnapshot(machine, program->snapshot))) {
+
+            // Stop at the same clock as when booting.
+            queueEvent(machine, seconds - (double) trs80_getClock(machine)/Trs80ClockHz, exitCallback, 0);
+        } else {
+            queueEvent(machine, 0.1, launchProgram, 0);
+            queueEvent(machine, seconds, exitCallback, 0);
+        }
+
+        std::unique_ptr<Trs80Snapshot> rewindSnapshot;
+        std::vector<uint8_t> rewindBuffer;
+        if (mRewindSize != 0) {
+            rewindSnapshot.reset(new Trs80Snapshot);
+            rewindBuffer.resize(mRewindSize);
+            rewindReset(&run->rewind, machine, rewindSnapshot.get(), rewindBuffer.data(), rewindBuffer.size());
+        }
+        if (mRewindSize != 0 || mDisplayTicks != 0) {
+            trs80_setTimerCallback(machine, timerCallback);
+        }
+
+        std::unique_ptr<Trs80Snapshot> runAheadSnapshot(new Trs80Snapshot);
+        trs80_setRunAhead(machine, mRunAheadFrames, runAheadSnapshot.get());
+
+        auto startTime = std::chrono::steady_clock::now();
+        trs80_main(machine);
+        auto endTime = std::chrono::steady_clock::now();
+
+        double wallSeconds = std::chrono::duration<double>(endTime - startTime).count();
+        clk_t clock = trs80_getClock(machine);
+        double emulatedSeconds = (double) clock / Trs80ClockHz;
+        double mhz = clock / wallSeconds / 1e6;
+        run->emulatedSeconds = emulatedSeconds;
+
+        print(run, "%-16s %6.1f emulated s in %7.3f s, %8.2f MHz, %6.1fx real time, %lld screen writes\n",
+                program->name, emulatedSeconds, wallSeconds, mhz,
+                emulatedSeconds / wallSeconds, run->screenWrites);
+
+        print(run, "%-16s idle %5.1f%% of cycles skipped\n",
+                "", clock == 0 ? 0.0 : 100.0*trs80_getIdleClock(machine)/clock);
+
+        Trs80MemoryStats memory = trs80_getMemoryStats(machine);
+        print(run, "%-16s memory %zu KB, copied %d of %d pages of RAM into a pool of %d%s\n",
+                "", memory.bytes/1024, memory.ownPages, memory.ownPages + memory.sharedPages,
+                memory.poolPages, memory.outOfPages ? ", ran out" : "");
+
+        Trs80LogStats log = trs80_getLogStats(machine);
+        if (log.dropped != 0) {
+            print(run, "%-16s log dropped %lu of %lu records\n", "", log.dropped, log.records);
+        }
+
+        Trs80BlockCacheStats stats = trs80_getBlockCacheStats(machine);
+        if (stats.enabled) {
+            unsigned long lookups = stats.hits + stats.misses;
+            print(run, "%-16s block cache %5.1f%% hits, %lu decoded, %lu native, %lu invalidations, %lu fallbacks, %lu flushes\n",
+                    "", lookups == 0 ? 0.0 : 100.0*stats.hits/lookups, stats.misses, stats.natives,
+                    stats.invalidations, stats.fallbacks, stats.flushes);
+        }
+
+        if (mRewindSize != 0) {
+            RewindStats rewind = rewindGetStats(&run->rewind);
+            print(run, "%-16s rewind %lu checkpoints of %.0f bytes, %.1f s in %zu bytes, %.3f%% of run time\n",
+                    "", rewind.checkpoints,
+                    rewind.checkpoints == 0 ? 0.0 : (double) rewind.totalBytes/rewind.checkpoints,
+                    (double) rewind.history/Trs80ClockHz, rewind.usedBytes,
+                    100.0*rewind.captureMicros/1e6/wallSeconds);
+        }
+
+        if (mDisplayTicks != 0) {
+            // The last frame, with what changed since the last tick.
+            displayFlush(&run->display);
+            lcdQueueFlush(&run->lcdQueue);
+            endLcdFrame(&run->lcdFrames, false);
+
+            // What drawing each character as it changed would have sent,
+            // and what was sent since the LCD was set up.
+            unsigned long long charBytes = run->screenWrites*(LCD_WINDOW_BYTES + 2*DisplayGlyphSize);
+            unsigned long long bytes = run->lcdFrames.bytes;
+            DisplayStats display = displayGetStats(&run->display);
+            print(run, "%-16s display %lu flushes, %lu cells in %lu windows (%lu filled), %llu KB sent, %.1f%% of %llu KB a character at a time\n",
+                    "", display.flushes, display.cells, run->lcdFrames.windows, display.fills,
+                    bytes/1024, charBytes == 0 ? 0.0 : 100.0*bytes/charBytes,
+                    charBytes/1024);
+            LcdQueueStats queue = lcdQueueGetStats(&run->lcdQueue);
+            print(run, "%-16s lcd queue %lu commands in %lu batches, depth up to %d, %lu stalls for %.1f ms\n",
+                    "", queue.commands, queue.batches, queue.maxDepth, queue.stalls, queue.stallMicros/1000);
+            printLcdFrames(run, "", run->lcdFrames, 1e6*mDisplayTicks/Trs80TimerHz);
+            LcdSimStats sim = lcdSimGetStats();
+            print(run, "%-16s lcd spi at %.2f MHz busy %.1f%% of the run, cpu waited %.1f ms, %lu interrupts\n",
+                    "", lcdSimGetSpiHz()/1e6, 100*sim.busyMicros/1e6/emulatedSeconds,
+                    sim.waitMicros/1000, sim.interrupts);
+            LcdDecoderStats lcd = lcdDecoderGetStats(lcdSimGetDecoder());
+            int badCells = countBadCells(run);
+            if (badCells != 0 || lcd.clipped != 0 || sim.deselectedBytes != 0 || sim.pinChangesWhileBusy != 0) {
+                run->lcdWrong = true;
+                print(run, "%-16s lcd shows %d cells wrong, %llu pixels clipped, %llu bytes deselected, %lu pin changes while sending\n",
+                        "", badCells, lcd.clipped, sim.deselectedBytes, sim.pinChangesWhileBusy);
+            }
+        }
+        trs80_setTimerCallback(machine, nullptr);
+
+        if (mRunAheadFrames != 0) {
+            Trs80RunAheadStats runAhead = trs80_getRunAheadStats(machine);
+            print(run, "%-16s run-ahead %d frames at %lu ticks (%lu skipped), %.0f%% more cycles emulated\n",
+                    "", mRunAheadFrames, runAhead.frames, runAhead.skipped,
+                    clock == 0 ? 0.0 : 100.0*runAhead.clock/clock);
+        }
+        trs80_setRunAhead(machine, 0, nullptr);
+
+        if (mThrottle) {
+            Trs80PacingStats pacing = trs80_getPacingStats(machine);
+            double frameMicros = 1e6/Trs80TimerHz;
+            double spareMicros = pacing.frames == 0 ? 0.0 : pacing.spareMicros/pacing.frames;
+            print(run, "%-16s pacing %lu ticks, %.2f ms (%.0f%%) spare per tick, %.2f ms least, %lu resyncs\n",
+                    "", pacing.frames, spareMicros/1000, 100*spareMicros/frameMicros,
+                    pacing.leastSpareMicros/1000, pacing.resyncs);
+        }
+
+        if (mSaveDir != nullptr) {
+            saveState(run, mSaveDir);
+        }
+
+        if (dump) {
+            dumpScreen(run);
+        }
+    }
+
+    /**
+     * Timer callback that records the screen as shown, until we have
+     * LATENCY_FRAMES of them.
+     */
+    void recordFrame(Trs80Machine *machine) {
+        Run *run = getRun(machine);
+
+        run->frames.emplace_back();
+        memcpy(run->frames.back().data(), run->screen, Trs80ScreenSize);
+        if (run->frames.size() == LATENCY_FRAMES) {
+            trs80_exit(machine);
+        }
+    }
+
+    /**
+     * Record LATENCY_FRAMES screens starting from the snapshot with the
+     * joystick held.
+     */
+    void recordFrames(Run *run, Trs80Snapshot const *start, uint8_t joystick) {
+        run->frames.clear();
+        trs80_restoreSnapshot(run->machine, start);
+        setJoystick(run->machine, joystick);
+        trs80_setTimerCallback(run->machine, recordFrame);
+        trs80_main(run->machine);
+        trs80_setTimerCallback(run->machine, nullptr);
+    }
+
+    /**
+     * Run the program from its snapshot for the given number of emulated
+     * seconds, typing its start keys a second apart, then several times compare the screens shown after leaving
+     * the joystick alone and after pushing it each way, and report how many
+     * ticks it took for the fastest of them to show. Done without and then
+     * with run-ahead.
+     */
+    void measureLatency(Run *run, float seconds) {
+        Trs80Machine *machine = run->machine;
+        Program const *program = run->program;
+
+        if (program->snapshot == nullptr) {
+            return;
+        }
+
+        std::unique_ptr<Trs80Snapshot> runAheadSnapshot(new Trs80Snapshot);
+        std::unique_ptr<Trs80Snapshot> start(new Trs80Snapshot);
+        std::vector<std::array<uint8_t, Trs80ScreenSize>> baseline;
+        const uint8_t inputs[] = {
+            JOYSTICK_LEFT_MASK, JOYSTICK_RIGHT_MASK, JOYSTICK_UP_MASK,
+            JOYSTICK_DOWN_MASK, JOYSTICK_FIRE_MASK,
+        };
+
+        for (int frames : { 0, mRunAheadFrames }) {
+            if (frames == mRunAheadFrames && frames == 0 && !baseline.empty()) {
+                break;
+            }
+
+            trs80_reset(machine);
+            trs80_shareSnapshot(machine, program->snapshot);
+            trs80_setRunAhead(machine, frames, runAheadSnapshot.get());
+            for (int i = 0; program->startKeys[i] != '\0'; i++) {
+                queueEvent(machine, 1 + i, keyCallback, program->startKeys[i]);
+            }
+            queueEvent(machine, seconds - (double) trs80_getClock(machine)/Trs80ClockHz, exitCallback, 0);
+            trs80_main(machine);
+
+            int trials = 0;
+            int total = 0;
+            int minimum = LATENCY_FRAMES;
+            int maximum = 0;
+            for (int trial = 0; trial < LATENCY_TRIALS; trial++) {
+                trs80_saveSnapshot(machine, start.get());
+                recordFrames(run, start.get(), 0);
+                baseline = run->frames;
+
+                int latency = LATENCY_FRAMES + 1;
+                for (uint8_t input : inputs) {
+                    recordFrames(run, start.get(), input);
+                    for (int i = 0; i < LATENCY_FRAMES && i + 1 < latency; i++) {
+                        if (run->frames[i] != baseline[i]) {
+                            latency = i + 1;
+                            break;
+                        }
+                    }
+                }
+                if (latency <= LATENCY_FRAMES) {
+                    trials++;
+                    total += latency;
+                    minimum = latency < minimum ? latency : minimum;
+                    maximum = latency > maximum ? latency : maximum;
+                }
+
+                // Move on to the next trial without touching the joystick.
+                trs80_restoreSnapshot(machine, start.get());
+                setJoystick(machine, 0);
+                queueEvent(machine, LATENCY_TRIAL_SECONDS, exitCallback, 0);
+                trs80_main(machine);
+            }
+            trs80_setRunAhead(machine, 0, nullptr);
+
+            if (trials == 0) {
+                print(run, "%-16s latency with %d frames of run-ahead: no response to the joystick\n",
+                        program->name, frames);
+            } else {
+                print(run, "%-16s latency with %d frames of run-ahead: %.2f ticks (%d to %d) over %d trials\n",
+                        program->name, frames, (double) total/trials, minimum, maximum, trials);
+            }
+        }
+    }
+
+    /**
+     * Take runs off the list until there are none left, printing each in
+     * order once it and the ones before it are done.
+     */
+    void runWorker(std::vector<std::unique_ptr<Run>> *runs, std::atomic<size_t> *nextRun,
+            size_t *nextPrint, std::mutex *printMutex,
+            float seconds, bool dump, bool restore, bool latency) {
+
+        while (true) {
+            size_t index = (*nextRun)++;
+            if (index >= runs->size()) {
+                break;
+            }
+
+            Run *run = (*runs)[index].get();
+            run->machine = trs80_newMachine(mRamPages);
+            if (run->machine == nullptr) {
+                print(run, "%-16s out of memory\n", run->program->name);
+            } else {
+                trs80_setUserData(run->machine, run);
+                trs80_setScreenCallback(run->machine, screenCallback);
+                trs80_setScreenRangeCallback(run->machine, screenRangeCallback);
+                trs80_setThrottle(run->machine, mThrottle);
+                trs80_setSleepCallback(run->machine, sleepCallback);
+
+                if (latency) {
+                    measureLatency(run, seconds);
+                } else {
+                    runProgram(run, seconds, dump, restore);
+                }
+
+                trs80_deleteMachine(run->machine);
+                run->machine = nullptr;
+            }
+
+            std::lock_guard<std::mutex> lock(*printMutex);
+            run->done = true;
+            while (*nextPrint < runs->size() && (*runs)[*nextPrint]->done) {
+                fputs((*runs)[*nextPrint]->output.c_str(), stdout);
+                fflush(stdout);
+                (*nextPrint)++;
+            }
+        }
+    }
+
+    /**
+     * Say so if, since the simulated LCD was started, the driver drew off
+     * its edges, sent to it deselected, or changed DC or CS while sending.
+     * Returns whether it did none of these.
+     */
+    bool checkLcdSent(const char *name) {
+        LcdDecoderStats lcd = lcdDecoderGetStats(lcdSimGetDecoder());
+        LcdSimStats sim = lcdSimGetStats();
+        if (lcd.clipped == 0 && sim.deselectedBytes == 0 && sim.pinChangesWhileBusy == 0) {
+            return true;
+        }
+
+        printf("%-16s lcd %llu pixels clipped, %llu bytes deselected, %lu pin changes while sending\n",
+                name, lcd.clipped, sim.deselectedBytes, sim.pinChangesWhileBusy);
+        return false;
+    }
+
+    /**
+     * Scroll through the device's game menu from the first game to the last
+     * and back, once a text row at a time through the display (the way the
+     * menu used to) and once a line of pixels at a time through the menu, and
+     * report what each sent to the simulated LCD. Each frame is sent in full
+     * before the next is drawn, so the frame rates are what the SPI allows.
+     * Returns whether both ended up showing the same, with nothing sent
+     * wrong on the way.
+     */
+    bool measureMenu() {
+        // The games' logos in the device's order.
+        static const struct {
+            uint8_t const *logo;
+            int logoRows;
+        } GAMES[] = {
+            { GALAXY_INVASION_LOGO, GALAXY_INVASION_LOGO_ROWS },
+            { OBSTACLE_RUN_LOGO, OBSTACLE_RUN_LOGO_ROWS },
+            { SCARFMAN_LOGO, SCARFMAN_LOGO_ROWS },
+            { DEFENSE_COMMAND_LOGO, DEFENSE_COMMAND_LOGO_ROWS },
+            { SEA_DRAGON_LOGO, SEA_DRAGON_LOGO_ROWS },
+            { BREAKDOWN_LOGO, BREAKDOWN_LOGO_ROWS },
+            { EVER_GIVEN_LOGO, EVER_GIVEN_LOGO_ROWS },
+        };
+        int gameCount = sizeof(GAMES)/sizeof(GAMES[0]);
+
+        std::unique_ptr<LcdQueue> queue(new LcdQueue {});
+
+        // Laid out like chooseGame() does.
+        std::unique_ptr<Menu> menu(new Menu {});
+        menu->queue = queue.get();
+        menuReset(menu.get());
+        std::vector<int> gameRow;
+        int marginLines = Trs80RowCount - SPLASH_ROWS;
+        menuAddBlankRows(menu.get(), marginLines / 2);
+        menuAddRows(menu.get(), SPLASH, SPLASH_ROWS);
+        menuAddBlankRows(menu.get(), marginLines - marginLines / 2);
+        for (int i = 0; i < gameCount; i++) {
+            gameRow.push_back(menu->rows.size());
+            menuAddRows(menu.get(), GAMES[i].logo, GAMES[i].logoRows);
+            menuAddBlankRows(menu.get(), 2);
+        }
+        menuAddBlankRows(menu.get(), Trs80RowCount);
+
+        // Down the list and back up.
+        std::vector<int> visits;
+        for (int i = 0; i < gameCount; i++) {
+            visits.push_back(i);
+        }
+        for (int i = gameCount - 2; i >= 0; i--) {
+            visits.push_back(i);
+        }
+
+        // A text row at a time.
+        std::unique_ptr<Display> display(new Display {});
+        display->queue = queue.get();
+        displayReset(display.get(), 1);
+        startLcd(queue.get());
+        LcdFrames byRows = {};
+        int scroll = 0;
+        for (size_t visit = 0; visit < visits.size(); visit++) {
+            int game = visits[visit];
+            int targetScroll = menuCenter(gameRow[game], GAMES[game].logoRows)/DisplayGlyphHeight;
+            if (visit == 0) {
+                scroll = targetScroll;
+            }
+
+            do {
+                scroll += scroll < targetScroll ? 1 : scroll > targetScroll ? -1 : 0;
+
+                beginLcdFrame(&byRows);
+                for (int position = 0; position < Trs80ScreenSize; position++) {
+                    int row = position / Trs80ColumnCount;
+                    bool highlighted = scroll + row >= gameRow[game] - 1 &&
+                        scroll + row < gameRow[game] + GAMES[game].logoRows + 1;
+                    displayMark(display.get(), position,
+                            menu->rows[scroll + row][position % Trs80ColumnCount] ^ (highlighted ? 0x3F : 0x00));
+                }
+                displayFlush(display.get());
+                lcdSimFinish();
+                if (visit > 0) {
+                    endLcdFrame(&byRows, false);
+                }
+            } while (scroll != targetScroll);
+        }
+        bool rowsSentRight = checkLcdSent("menu by rows");
+        LcdDecoder const *lcd = lcdSimGetDecoder();
+        std::vector<uint16_t> rowsPixels(lcd->pixels, lcd->pixels + LcdDecoderWidth*LcdDecoderHeight);
+
+        // A line of pixels at a time.
+        lcdQueueFlush(queue.get());
+        startLcd(queue.get());
+        LcdFrames byLines = {};
+        for (size_t visit = 0; visit < visits.size(); visit++) {
+            int game = visits[visit];
+            int targetScroll = menuCenter(gameRow[game], GAMES[game].logoRows);
+            if (visit == 0) {
+                scroll = targetScroll;
+            }
+
+            do {
+                scroll = menuStepScroll(scroll, targetScroll);
+
+                beginLcdFrame(&byLines);
+                menuDraw(menu.get(), scroll, gameRow[game] - 1, GAMES[game].logoRows + 2);
+                lcdSimFinish();
+                if (visit > 0) {
+                    endLcdFrame(&byLines, false);
+                }
+            } while (scroll != targetScroll);
+        }
+
+        bool linesSentRight = checkLcdSent("menu by lines");
+
+        printLcdFrames(nullptr, "menu by rows", byRows, 0);
+        printLcdFrames(nullptr, "menu by lines", byLines, 0);
+
+        // They should end up showing the same thing.
+        int badPixels = 0;
+        for (int i = 0; i < LcdDecoderWidth*LcdDecoderHeight; i++) {
+            badPixels += lcd->pixels[i] != rowsPixels[i];
+        }
+        if (badPixels != 0) {
+            printf("%-16s %d pixels differ at the end\n", "menu", badPixels);
+        }
+
+        return badPixels == 0 && rowsSentRight && linesSentRight;
+    }
+}
+
+int main(int argc, char *argv[]) {
+    float seconds = DEFAULT_SECONDS;
+    bool dump = false;
+    bool restore = false;
+    bool latency = false;
+    bool menu = false;
+    int threadCount = 1;
+    int copies = 1;
+    const char *snapshotDir = nullptr;
+    std::vector<Program const *> programs;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+            seconds = atof(argv[++i]);
+        } else if (strcmp(argv[i], "-d") == 0) {
+            dump = true;
+        } else if (strcmp(argv[i], "-r") == 0) {
+            restore = true;
+        } else if (strcmp(argv[i], "-w") == 0 && i + 1 < argc) {
+            snapshotDir = argv[++i];
+            mTakeSnapshots = true;
+        } else if (strcmp(argv[i], "-L") == 0 && i + 1 < argc) {
+            mLoadDir = argv[++i];
+        } else if (strcmp(argv[i], "-S") == 0 && i + 1 < argc) {
+            mSaveDir = argv[++i];
+        } else if (strcmp(argv[i], "-b") == 0 && i + 1 < argc) {
+            mRewindSize = atoi(argv[++i])*1024;
+        } else if (strcmp(argv[i], "-a") == 0 && i + 1 < argc) {
+            mRunAheadFrames = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-D") == 0 && i + 1 < argc) {
+            mDisplayTicks = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-t") == 0) {
+            mThrottle = true;
+        } else if (strcmp(argv[i], "-p") == 0 && i + 1 < argc) {
+            mRamPages = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-l") == 0) {
+            latency = true;
+        } else if (strcmp(argv[i], "-m") == 0) {
+            menu = true;
+        } else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+            threadCount = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            copies = atoi(argv[++i]);
+        } else if (argv[i][0] == '-') {
+            usage(argv[0]);
+        } else {
+            Program const *program = findProgram(argv[i]);
+            if (program == nullptr) {
+                fprintf(stderr, "Unknown program \"%s\"\n", argv[i]);
+                usage(argv[0]);
+            }
+            programs.push_back(program);
+        }
+    }
+
+    if (seconds <= 0 || mRunAheadFrames < 0 || mDisplayTicks < 0 || threadCount < 1 || copies < 1 ||
+            mRamPages < 0 || mRamPages > Trs80RamPageCount) {
+        usage(argv[0]);
+    }
+
+    if (menu) {
+        return measureMenu() ? 0 : 1;
+    }
+
+    // There's only the one simulated LCD.
+    if (mDisplayTicks != 0 && threadCount > 1) {
+        fprintf(stderr, "Can't draw the screen (-D) on more than one thread\n");
+        usage(argv[0]);
+    }
+
+    if (programs.empty()) {
+        for (Program const &program : gProgramList) {
+            programs.push_back(&program);
+        }
+    }
+
+    // Copies of a program run next to each other, so save them only once.
+    if (mSaveDir != nullptr && copies > 1) {
+        fprintf(stderr, "Can't save state (-S) of more than one copy\n");
+        usage(argv[0]);
+    }
+
+    std::vector<std::unique_ptr<Run>> runs;
+    for (Program const *program : programs) {
+        for (int copy = 0; copy < copies; copy++) {
+            runs.emplace_back(new Run {});
+            runs.back()->program = program;
+        }
+    }
+
+    std::atomic<size_t> nextRun(0);
+    size_t nextPrint = 0;
+    std::mutex printMutex;
+
+    auto startTime = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (int i = 1; i < threadCount; i++) {
+        threads.emplace_back(runWorker, &runs, &nextRun, &nextPrint, &printMutex,
+                seconds, dump, restore, latency);
+    }
+    runWorker(&runs, &nextRun, &nextPrint, &printMutex, seconds, dump, restore, latency);
+    for (std::thread &thread : threads) {
+        thread.join();
+    }
+    double wallSeconds = microsSince(startTime)/1e6;
+
+    if (runs.size() > 1 && !latency) {
+        double emulatedSeconds = 0;
+        for (auto const &run : runs) {
+            emulatedSeconds += run->emulatedSeconds;
+        }
+        printf("%-16s %6.1f emulated s in %7.3f s on %d threads, %6.1fx real time\n",
+                "total", emulatedSeconds, wallSeconds, threadCount,
+                emulatedSeconds / wallSeconds);
+    }
+
+    if (snapshotDir != nullptr && !writeSnapshots(runs, snapshotDir)) {
+        return 1;
+    }
+
+    for (auto const &run : runs) {
+        if (run->lcdWrong) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
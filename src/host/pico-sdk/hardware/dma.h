@@ -0,0 +1,67 @@
+#pragma once
+
+#include "pico/stdlib.h"
+
+enum dma_channel_transfer_size {
+    DMA_SIZE_8 = 0,
+    DMA_SIZE_16 = 1,
+    DMA_SIZE_32 = 2,
+};
+
+typedef struct {
+    enum dma_channel_transfer_size size;
+    bool readIncrement;
+    bool writeIncrement;
+    uint dreq;
+} dma_channel_config;
+
+// The interrupt status. The handler writes the channel's bit to clear it.
+typedef struct {
+    volatile uint32_t ints0;
+} dma_hw_t;
+
+#define dma_hw (&gLcdSimDmaHw)
+
+static inline dma_channel_config dma_channel_get_default_config(uint channel) {
+    (void) channel;
+    dma_channel_config config = { DMA_SIZE_32, true, false, 0 };
+    return config;
+}
+
+static inline void channel_config_set_transfer_data_size(dma_channel_config *c,
+        enum dma_channel_transfer_size size) {
+
+    c->size = size;
+}
+
+static inline void channel_config_set_dreq(dma_channel_config *c, uint dreq) {
+    c->dreq = dreq;
+}
+
+static inline void channel_config_set_read_increment(dma_channel_config *c, bool incr) {
+    c->readIncrement = incr;
+}
+
+static inline void channel_config_set_write_increment(dma_channel_config *c, bool incr) {
+    c->writeIncrement = incr;
+}
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern dma_hw_t gLcdSimDmaHw;
+
+int dma_claim_unused_channel(bool required);
+
+// Only transfers to the SPI's data register are simulated. The data is sent
+// when the transfer starts, and it takes the time the SPI would.
+void dma_channel_configure(uint channel, const dma_channel_config *config,
+        volatile void *write_addr, const volatile void *read_addr,
+        uint transfer_count, bool trigger);
+void dma_channel_wait_for_finish_blocking(uint channel);
+void dma_channel_set_irq0_enabled(uint channel, bool enabled);
+
+#ifdef __cplusplus
+}
+#endif
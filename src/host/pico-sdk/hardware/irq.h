@@ -0,0 +1,19 @@
+#pragma once
+
+#include "pico/stdlib.h"
+
+typedef void (*irq_handler_t)(void);
+
+#define DMA_IRQ_0 11
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// The handler is called when simulated time passes the end of a transfer.
+void irq_set_exclusive_handler(uint num, irq_handler_t handler);
+void irq_set_enabled(uint num, bool enabled);
+
+#ifdef __cplusplus
+}
+#endif
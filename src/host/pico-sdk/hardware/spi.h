@@ -0,0 +1,65 @@
+#pragma once
+
+#include "pico/stdlib.h"
+
+typedef struct spi_inst spi_inst_t;
+
+// The SPI's registers. Reading sr through spi_get_hw() says whether it's
+// still sending; the rest are only there to be written to.
+typedef struct {
+    volatile uint32_t cr0;
+    volatile uint32_t cr1;
+    volatile uint32_t dr;
+    volatile uint32_t sr;
+    volatile uint32_t cpsr;
+    volatile uint32_t imsc;
+    volatile uint32_t ris;
+    volatile uint32_t mis;
+    volatile uint32_t icr;
+    volatile uint32_t dmacr;
+} spi_hw_t;
+
+#define SPI_SSPSR_BSY_BITS 0x00000010
+#define SPI_SSPICR_RORIC_BITS 0x00000001
+
+typedef enum {
+    SPI_CPHA_0 = 0,
+    SPI_CPHA_1 = 1,
+} spi_cpha_t;
+
+typedef enum {
+    SPI_CPOL_0 = 0,
+    SPI_CPOL_1 = 1,
+} spi_cpol_t;
+
+typedef enum {
+    SPI_LSB_FIRST = 0,
+    SPI_MSB_FIRST = 1,
+} spi_order_t;
+
+// There's only the one SPI, which the LCD is on.
+#define spi0 (&gLcdSimSpi)
+#define spi_default spi0
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern spi_inst_t gLcdSimSpi;
+
+// Returns the clock it gets, which is as close under the baud rate as the
+// peripheral clock's dividers allow.
+uint spi_init(spi_inst_t *spi, uint baudrate);
+void spi_set_format(spi_inst_t *spi, uint data_bits, spi_cpol_t cpol, spi_cpha_t cpha, spi_order_t order);
+
+// These wait until the data is sent.
+int spi_write_blocking(spi_inst_t *spi, const uint8_t *src, size_t len);
+int spi_write16_blocking(spi_inst_t *spi, const uint16_t *src, size_t len);
+
+bool spi_is_readable(const spi_inst_t *spi);
+spi_hw_t *spi_get_hw(spi_inst_t *spi);
+uint spi_get_dreq(spi_inst_t *spi, bool is_tx);
+
+#ifdef __cplusplus
+}
+#endif
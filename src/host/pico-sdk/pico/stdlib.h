@@ -0,0 +1,41 @@
+#pragma once
+
+// Stand-ins for the parts of the Pico SDK that the LCD driver (ili9341.c)
+// uses, so that it builds on the host and sends to the simulated SPI bus in
+// lcdsim.cpp. They have the SDK's names and arguments, but only do what the
+// simulation needs.
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef unsigned int uint;
+
+// The Pico board's default SPI pins.
+#define PICO_DEFAULT_SPI_SCK_PIN 18
+#define PICO_DEFAULT_SPI_TX_PIN 19
+#define PICO_DEFAULT_SPI_CSN_PIN 17
+
+#define GPIO_OUT 1
+#define GPIO_IN 0
+
+enum gpio_function {
+    GPIO_FUNC_SPI = 1,
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void gpio_init(uint gpio);
+void gpio_set_dir(uint gpio, bool out);
+void gpio_put(uint gpio, bool value);
+void gpio_set_function(uint gpio, enum gpio_function fn);
+
+// Let simulated time pass.
+void sleep_ms(uint32_t ms);
+void tight_loop_contents(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,182 @@
+#include <cstring>
+
+#include "display.h"
+#include "fonts.h"
+
+// Dirty bits for a whole row.
+constexpr uint64_t ALL_COLUMNS = ~(uint64_t) 0 >> (64 - Trs80ColumnCount);
+
+// What a character in the font looks like on the LCD.
+struct Glyphs {
+    uint16_t pixels[DisplayGlyphCount*DisplayGlyphSize];
+    // The color of each glyph if it's all one color, or -1.
+    int32_t color[DisplayGlyphCount];
+
+    Glyphs() {
+        // Color to use for the four possible horizontal values of two pixels.
+        static const uint16_t COLORS[4] = { BLACK, GRAY, GRAY, WHITE };
+        uint16_t *p = pixels;
+
+        for (int ch = 0; ch < DisplayGlyphCount; ch++) {
+            uint16_t const *glyph = p;
+            for (int y = 0; y < DisplayGlyphHeight; y++) {
+                uint8_t b = Trs80FontBits[ch*Trs80FontHeight + y];
+                for (int x = 0; x < DisplayGlyphWidth; x++) {
+                    int gray = (b >> (x*2)) & 0x03;
+                    *p++ = COLORS[gray];
+                }
+            }
+
+            color[ch] = glyph[0];
+            for (int i = 1; i < DisplayGlyphSize; i++) {
+                if (glyph[i] != glyph[0]) {
+                    color[ch] = -1;
+                    break;
+                }
+            }
+        }
+    }
+};
+
+static_assert(sizeof(Glyphs) == DisplayGlyphsBytes, "DisplayGlyphsBytes is wrong");
+
+static Glyphs const &getGlyphs() {
+    static Glyphs glyphs;
+    return glyphs;
+}
+
+// A fill waiting to see if the same span on the next row can join it.
+struct PendingFill {
+    int row;
+    int rowCount;
+    int begin;
+    int end;
+    uint16_t color;
+};
+
+static void fillCells(Display *display, PendingFill const *fill) {
+    if (fill->rowCount > 0) {
+        lcdQueueFill(display->queue,
+                display->left + fill->begin*DisplayGlyphWidth,
+                display->top + fill->row*DisplayGlyphHeight,
+                (fill->end - fill->begin)*DisplayGlyphWidth,
+                fill->rowCount*DisplayGlyphHeight,
+                fill->color);
+        display->stats.fills++;
+    }
+}
+
+// Draw the cells of a row from begin up to (but not including) end in one window.
+static void drawCells(Display *display, Glyphs const &glyphs, int row, int begin, int end) {
+    uint8_t const *cells = &display->cells[row*Trs80ColumnCount];
+    int width = (end - begin)*DisplayGlyphWidth;
+    uint16_t *pixels = lcdQueueReserve(display->queue, width*DisplayGlyphHeight);
+    uint16_t *p = pixels;
+
+    for (int y = 0; y < DisplayGlyphHeight; y++) {
+        for (int column = begin; column < end; column++) {
+            memcpy(p, &glyphs.pixels[cells[column]*DisplayGlyphSize + y*DisplayGlyphWidth],
+                    DisplayGlyphWidth*sizeof(uint16_t));
+            p += DisplayGlyphWidth;
+        }
+    }
+
+    lcdQueueBitmap(display->queue,
+            display->left + begin*DisplayGlyphWidth,
+            display->top + row*DisplayGlyphHeight,
+            width, DisplayGlyphHeight, pixels);
+    display->stats.bitmaps++;
+}
+
+void displayReset(Display *display, int flushTicks) {
+    display->flushTicks = flushTicks;
+    display->ticks = 0;
+
+    // A space is all black.
+    memset(display->cells, ' ', sizeof(display->cells));
+    memset(display->shown, ' ', sizeof(display->shown));
+    memset(display->dirty, 0, sizeof(display->dirty));
+    display->redraw = false;
+    display->stats = {};
+}
+
+void displayMark(Display *display, int position, uint8_t ch) {
+    uint64_t bit = (uint64_t) 1 << (position % Trs80ColumnCount);
+    uint64_t &dirty = display->dirty[position / Trs80ColumnCount];
+
+    display->cells[position] = ch;
+    if (ch != display->shown[position]) {
+        dirty |= bit;
+    } else {
+        // Changed back before it was drawn.
+        dirty &= ~bit;
+    }
+}
+
+void displayTick(Display *display) {
+    display->ticks++;
+    if (display->ticks >= display->flushTicks) {
+        display->ticks = 0;
+        displayFlush(display);
+    }
+}
+
+void displayFlush(Display *display) {
+    Glyphs const &glyphs = getGlyphs();
+    PendingFill fill = {};
+
+    for (int row = 0; row < Trs80RowCount; row++) {
+        uint64_t dirty = display->redraw ? ALL_COLUMNS : display->dirty[row];
+        uint8_t const *cells = &display->cells[row*Trs80ColumnCount];
+
+        while (dirty != 0) {
+            // Find the next run of dirty cells.
+            int begin = __builtin_ctzll(dirty);
+            int end = begin;
+            while (end < Trs80ColumnCount && (dirty & ((uint64_t) 1 << end)) != 0) {
+                dirty &= ~((uint64_t) 1 << end);
+                end++;
+            }
+            display->stats.cells += end - begin;
+
+            // See if it's all one color.
+            int32_t color = glyphs.color[cells[begin]];
+            for (int column = begin + 1; column < end && color >= 0; column++) {
+                if (glyphs.color[cells[column]] != color) {
+                    color = -1;
+                }
+            }
+
+            if (color < 0) {
+                drawCells(display, glyphs, row, begin, end);
+            } else if (fill.rowCount > 0 && fill.row + fill.rowCount == row &&
+                    fill.begin == begin && fill.end == end && fill.color == color) {
+
+                fill.rowCount++;
+            } else {
+                fillCells(display, &fill);
+                fill = { row, 1, begin, end, (uint16_t) color };
+            }
+        }
+
+        memcpy(&display->shown[row*Trs80ColumnCount], cells, Trs80ColumnCount);
+        display->dirty[row] = 0;
+    }
+    fillCells(display, &fill);
+    lcdQueueSubmit(display->queue);
+    display->redraw = false;
+
+    display->stats.flushes++;
+}
+
+void displayRedraw(Display *display) {
+    display->redraw = true;
+}
+
+DisplayStats displayGetStats(Display const *display) {
+    return display->stats;
+}
+
+uint16_t const *displayGlyph(uint8_t ch) {
+    return &getGlyphs().pixels[ch*DisplayGlyphSize];
+}
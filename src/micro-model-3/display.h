@@ -0,0 +1,93 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "trs80.h"
+#include "lcdqueue.h"
+
+// Drawing the TRS-80 screen on the LCD. Writes to the screen only mark its
+// cells dirty, and displayFlush() draws them together, normally once a timer
+// tick: a cell written many times in a tick is drawn once, each run of dirty
+// cells on a row is drawn as one window, and runs of a single color (like
+// cleared lines) are filled instead, merged with the same run on the rows
+// below. Clearing the screen is then one fill instead of 1024 windows. They're
+// drawn through a queue, each flush as one batch of commands, so the LCD
+// catches up while the emulator runs on.
+
+// Convert from RGB888 to RGB565:
+#define RGB888TO565(r, g, b) ((((r) & 0xF8) << 8) | (((g) & 0xFC) << 3) | ((b) >> 3))
+#define BLACK RGB888TO565(0x00, 0x00, 0x00)
+#define GRAY RGB888TO565(0x80, 0x80, 0x80)
+#define WHITE RGB888TO565(0xFF, 0xFF, 0xFF)
+
+// Each character is drawn this big, two of the TRS-80's pixels to one of ours
+// horizontally.
+constexpr int DisplayGlyphWidth = 4;
+constexpr int DisplayGlyphHeight = 12;
+constexpr int DisplayGlyphSize = DisplayGlyphWidth*DisplayGlyphHeight;
+
+// The glyphs of every character, made the first time they're drawn and kept
+// in RAM from then on.
+constexpr int DisplayGlyphCount = 256;
+constexpr size_t DisplayGlyphsBytes = DisplayGlyphCount*(DisplayGlyphSize*sizeof(uint16_t) + sizeof(int32_t));
+
+// Timer ticks (see Trs80TimerHz) between flushes, unless told otherwise.
+constexpr int DisplayFlushTicks = 1;
+
+// What the display has drawn since the last reset.
+struct DisplayStats {
+    unsigned long flushes;
+    // Cells drawn, and the windows and fills they took.
+    unsigned long cells;
+    unsigned long bitmaps;
+    unsigned long fills;
+};
+
+struct Display {
+    // Where the screen's top-left corner is on the LCD.
+    int left;
+    int top;
+
+    // Where to send what's drawn.
+    LcdQueue *queue;
+
+    // Timer ticks between flushes, and since the last one.
+    int flushTicks;
+    int ticks;
+
+    // What each cell should show, what the LCD shows, and a bit for each
+    // cell (by column) where they differ.
+    uint8_t cells[Trs80ScreenSize];
+    uint8_t shown[Trs80ScreenSize];
+    uint64_t dirty[Trs80RowCount];
+    // Whether to draw every cell at the next flush.
+    bool redraw;
+
+    DisplayStats stats;
+};
+
+static_assert(Trs80ColumnCount <= 64, "dirty bits don't fit in a row");
+static_assert(Trs80ColumnCount*DisplayGlyphSize < LcdQueuePixels, "a row doesn't fit in the queue");
+
+// Start over with the LCD cleared to black. The position and queue are kept.
+void displayReset(Display *display, int flushTicks);
+
+// Note that the screen cell at the position now has the character. Meant to
+// be called from the trs80 screen callback.
+void displayMark(Display *display, int position, uint8_t ch);
+
+// Count a timer tick, and flush every flushTicks. Meant to be called from the
+// trs80 timer callback.
+void displayTick(Display *display);
+
+// Draw the cells that changed since the last flush.
+void displayFlush(Display *display);
+
+// Draw every cell at the next flush, since something else drew on the LCD.
+void displayRedraw(Display *display);
+
+DisplayStats displayGetStats(Display const *display);
+
+// How a character is drawn: DisplayGlyphSize pixels, a row at a time.
+uint16_t const *displayGlyph(uint8_t ch);
@@ -1,6 +1,7 @@
 #include "pico/stdlib.h"
 #include "hardware/spi.h"
 #include "hardware/dma.h"
+#include "hardware/irq.h"
 
 #include "ili9341.h"
 
@@ -18,6 +19,13 @@ uint16_t ili9341_pinTX = PICO_DEFAULT_SPI_TX_PIN;
 
 static uint gDmaChannel;
 static dma_channel_config gDmaConfig;
+// Commands left to send, after the one whose pixels are going by DMA.
+static LcdCommand const *gCommands;
+static int gCommandsLeft;
+// Called from the DMA interrupt once the commands from LCD_startCommands()
+// are sent, and whether they're still going.
+static void (*gTransferDoneHandler)(void);
+static volatile bool gTransferPending;
 
 // Clean up SPI after a DMA write. This code is copied from spi_write16_blocking().
 static void flush_spi(spi_inst_t *spi) {
@@ -81,7 +89,7 @@ void LCD_setSPIperiph(spi_inst_t *s)
 void initSPI()
 {
 	spi_init(ili9341_spi, 1000 * 40000);
-	spi_set_format(ili9341_spi, 16, SPI_CPOL_1, SPI_CPOL_1, SPI_MSB_FIRST);
+	spi_set_format(ili9341_spi, 16, SPI_CPOL_1, SPI_CPHA_1, SPI_MSB_FIRST);
 	gpio_set_function(ili9341_pinSCK, GPIO_FUNC_SPI);
 	gpio_set_function(ili9341_pinTX, GPIO_FUNC_SPI);
 
@@ -140,14 +148,14 @@ void ILI9341_RegData()
 void ILI9341_WriteCommand(uint8_t cmd)
 {
 	ILI9341_RegCommand();
-	spi_set_format(ili9341_spi, 8, SPI_CPOL_1, SPI_CPOL_1, SPI_MSB_FIRST);
+	spi_set_format(ili9341_spi, 8, SPI_CPOL_1, SPI_CPHA_1, SPI_MSB_FIRST);
 	spi_write_blocking(ili9341_spi, &cmd, sizeof(cmd));
 }
 
 void ILI9341_WriteData(uint8_t const *buff, size_t buff_size)
 {
 	ILI9341_RegData();
-	spi_set_format(ili9341_spi, 8, SPI_CPOL_1, SPI_CPOL_1, SPI_MSB_FIRST);
+	spi_set_format(ili9341_spi, 8, SPI_CPOL_1, SPI_CPHA_1, SPI_MSB_FIRST);
 	spi_write_blocking(ili9341_spi, buff, buff_size);
 }
 
@@ -177,7 +185,6 @@ void LCD_initDisplay()
 
 	uint8_t const *addr = initcmd;
 	uint8_t numCommands, cmd, numArgs;
-	uint16_t ms;
 	numCommands = *(addr++); // Number of commands to follow
 	while (numCommands--)
 	{					 // For each command...
@@ -244,50 +251,121 @@ void LCD_setAddrWindow(uint16_t x, uint16_t y, uint16_t w, uint16_t h)
 	ILI9341_WriteCommand(ILI9341_RAMWR);
 }
 
-void LCD_writeBitmap(uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint16_t *bitmap)
+// Send commands until one has pixels, and start the DMA for those. Returns
+// whether it did, or false if there are no commands left. The SPI must be
+// set to 16 bits and the LCD selected.
+static bool sendCommands()
 {
+	while (gCommandsLeft > 0)
+	{
+		LcdCommand const *command = gCommands++;
+		gCommandsLeft--;
+
+		// Let the last pixels out before switching to a command.
+		flush_spi(ili9341_spi);
+		uint16_t word = command->command;
+		ILI9341_RegCommand();
+		spi_write16_blocking(ili9341_spi, &word, 1);
+		ILI9341_RegData();
+		spi_write16_blocking(ili9341_spi, command->args, command->argCount);
+
+		if (command->pixelCount > 0)
+		{
+			bool increment = command->pixels != NULL;
+			channel_config_set_read_increment(&gDmaConfig, increment);
+			channel_config_set_write_increment(&gDmaConfig, false);
+			dma_channel_configure(gDmaChannel, &gDmaConfig,
+					&spi_get_hw(ili9341_spi)->dr,
+					increment ? command->pixels : &command->color,
+					command->pixelCount,
+					true);
+			return true;
+		}
+	}
+
+	return false;
+}
+
+static void beginCommands(LcdCommand const *commands, int count)
+{
+	gCommands = commands;
+	gCommandsLeft = count;
 	ILI9341_Select();
-	LCD_setAddrWindow(x, y, w, h); // Clipped area
-	ILI9341_RegData();
-	spi_set_format(ili9341_spi, 16, SPI_CPOL_1, SPI_CPOL_1, SPI_MSB_FIRST);
-
-#if 1
-        channel_config_set_read_increment(&gDmaConfig, true);
-        channel_config_set_write_increment(&gDmaConfig, false);
-	dma_channel_configure(gDmaChannel, &gDmaConfig,
-                &spi_get_hw(ili9341_spi)->dr,
-                bitmap,
-                (uint) w * h,
-                true);
-	dma_channel_wait_for_finish_blocking(gDmaChannel);
-
-        flush_spi(ili9341_spi);
-#else
-        spi_write16_blocking(ili9341_spi, bitmap, (size_t) w*h);
-#endif
+	spi_set_format(ili9341_spi, 16, SPI_CPOL_1, SPI_CPHA_1, SPI_MSB_FIRST);
+}
+
+// Once the DMA is done, wait for the last pixels to go out.
+static void finishCommands()
+{
+	flush_spi(ili9341_spi);
 
 	ILI9341_DeSelect();
 }
 
-void LCD_fillRect(uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint16_t color)
+static void dmaInterruptHandler()
 {
-	ILI9341_Select();
-	LCD_setAddrWindow(x, y, w, h); // Clipped area
-	ILI9341_RegData();
-	spi_set_format(ili9341_spi, 16, SPI_CPOL_1, SPI_CPOL_1, SPI_MSB_FIRST);
+	dma_hw->ints0 = 1u << gDmaChannel;
 
-        channel_config_set_read_increment(&gDmaConfig, false);
-        channel_config_set_write_increment(&gDmaConfig, false);
-	dma_channel_configure(gDmaChannel, &gDmaConfig,
-                &spi_get_hw(ili9341_spi)->dr,
-                &color,
-                (int) w * h,
-                true);
-	dma_channel_wait_for_finish_blocking(gDmaChannel);
+	if (gTransferPending && !sendCommands())
+	{
+		gTransferPending = false;
+		finishCommands();
+		gTransferDoneHandler();
+	}
+}
 
-        flush_spi(ili9341_spi);
+void LCD_sendCommands(LcdCommand const *commands, int count)
+{
+	beginCommands(commands, count);
+	while (sendCommands())
+	{
+		dma_channel_wait_for_finish_blocking(gDmaChannel);
+	}
+	finishCommands();
+}
 
-	ILI9341_DeSelect();
+void LCD_setTransferDoneHandler(void (*handler)(void))
+{
+	gTransferDoneHandler = handler;
+
+	dma_channel_set_irq0_enabled(gDmaChannel, true);
+	irq_set_exclusive_handler(DMA_IRQ_0, dmaInterruptHandler);
+	irq_set_enabled(DMA_IRQ_0, true);
+}
+
+void LCD_startCommands(LcdCommand const *commands, int count)
+{
+	beginCommands(commands, count);
+	gTransferPending = true;
+	if (!sendCommands())
+	{
+		// Nothing to wait for.
+		gTransferPending = false;
+		finishCommands();
+		gTransferDoneHandler();
+	}
+}
+
+// Draw a window of pixels, or of one color if there are none.
+static void writeWindow(uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint16_t const *pixels, uint16_t color)
+{
+	LcdCommand commands[3] = {
+		{ ILI9341_CASET, 2, { x, x + w - 1, 0 }, NULL, 0, 0 },
+		{ ILI9341_PASET, 2, { y, y + h - 1, 0 }, NULL, 0, 0 },
+		{ ILI9341_RAMWR, 0, { 0, 0, 0 }, pixels, (uint32_t) w * h, color },
+	};
+
+	LCD_sendCommands(commands, 3);
+}
+
+void LCD_writeBitmap(uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint16_t *bitmap)
+{
+	writeWindow(x, y, w, h, bitmap, 0);
+}
+
+void LCD_fillRect(uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint16_t color)
+{
+	writeWindow(x, y, w, h, NULL, color);
 }
 
 void LCD_writePixel(int x, int y, uint16_t color)
@@ -295,7 +373,7 @@ void LCD_writePixel(int x, int y, uint16_t color)
 	ILI9341_Select();
 	LCD_setAddrWindow(x, y, 1, 1); // Clipped area
 	ILI9341_RegData();
-	spi_set_format(ili9341_spi, 16, SPI_CPOL_1, SPI_CPOL_1, SPI_MSB_FIRST);
+	spi_set_format(ili9341_spi, 16, SPI_CPOL_1, SPI_CPHA_1, SPI_MSB_FIRST);
 	spi_write16_blocking(ili9341_spi, &color, 1);
 	ILI9341_DeSelect();
 }
@@ -3,6 +3,8 @@
 #include "pico/stdlib.h"
 #include "hardware/spi.h"
 
+#include "lcdcommands.h"
+
 // Use DMA?
 //#define USE_DMA 1
 
@@ -40,15 +42,11 @@
 #define ILI9341_DISPOFF 0x28  ///< Display OFF
 #define ILI9341_DISPON 0x29   ///< Display ON
 
-#define ILI9341_CASET 0x2A ///< Column Address Set
-#define ILI9341_PASET 0x2B ///< Page Address Set
-#define ILI9341_RAMWR 0x2C ///< Memory Write
+// CASET, PASET, RAMWR, VSCRDEF, and VSCRSADD are in lcdcommands.h.
 #define ILI9341_RAMRD 0x2E ///< Memory Read
 
 #define ILI9341_PTLAR 0x30    ///< Partial Area
-#define ILI9341_VSCRDEF 0x33  ///< Vertical Scrolling Definition
 #define ILI9341_MADCTL 0x36   ///< Memory Access Control
-#define ILI9341_VSCRSADD 0x37 ///< Vertical Scrolling Start Address
 #define ILI9341_PIXFMT 0x3A   ///< COLMOD: Pixel Format Set
 
 #define ILI9341_FRMCTR1                                                        \
@@ -104,6 +102,18 @@ void LCD_writePixel(int x, int y, uint16_t col);
 void LCD_writeBitmap(uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint16_t *bitmap);
 void LCD_fillRect(uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint16_t color);
 
+// Send a batch of commands (see lcdcommands.h) in one go, without switching
+// the SPI format, and wait for them to be sent.
+void LCD_sendCommands(LcdCommand const *commands, int count);
+
+// Sending without waiting. LCD_startCommands() sends the commands up to the
+// first with pixels, starts the DMA for those, and returns. The DMA interrupt
+// sends the rest the same way, and then calls the handler (which may start
+// another batch). The commands and their pixels must stay put until then,
+// and only one batch may be going at a time.
+void LCD_setTransferDoneHandler(void (*handler)(void));
+void LCD_startCommands(LcdCommand const *commands, int count);
+
 #ifdef __cplusplus
 };
 #endif
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <stdint.h>
+
+// ILI9341 commands as data, so that a batch of them can be worked out once and
+// then sent by one routine in the driver (or decoded on the host). Shared with
+// the C driver, so plain C.
+//
+// Everything in a batch is sent as 16-bit SPI words, to not switch the SPI
+// format between the command, its arguments, and its pixels. The command goes
+// out as 0x00 (a no-op) followed by the command byte, and each argument as two
+// bytes, high byte first, which is how CASET, PASET, VSCRDEF, and VSCRSADD
+// take them anyway.
+
+#define ILI9341_CASET 0x2A    ///< Column Address Set
+#define ILI9341_PASET 0x2B    ///< Page Address Set
+#define ILI9341_RAMWR 0x2C    ///< Memory Write
+#define ILI9341_VSCRDEF 0x33  ///< Vertical Scrolling Definition
+#define ILI9341_VSCRSADD 0x37 ///< Vertical Scrolling Start Address
+
+// Most arguments a command can have.
+#define LCD_COMMAND_MAX_ARGS 3
+
+typedef struct {
+    uint8_t command;
+    uint8_t argCount;
+    uint16_t args[LCD_COMMAND_MAX_ARGS];
+    // For RAMWR, the pixels to write after it: pixelCount of them from pixels,
+    // or of color if pixels is null. They must stay put until it's sent.
+    uint16_t const *pixels;
+    uint32_t pixelCount;
+    uint16_t color;
+} LcdCommand;
@@ -0,0 +1,184 @@
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+#include "lcdqueue.h"
+
+static uint32_t lock(LcdQueue *queue) {
+    return queue->lock != nullptr ? queue->lock(queue) : 0;
+}
+
+static void unlock(LcdQueue *queue, uint32_t state) {
+    if (queue->unlock != nullptr) {
+        queue->unlock(queue, state);
+    }
+}
+
+// Where in the staging ring the pixels can go, or null if there's no room
+// until more is sent. Pixels are never put right up to those still in use,
+// so that the ring is only ever empty when the head meets them.
+static uint16_t *findRoom(LcdQueue *queue, size_t count) {
+    if (lcdQueueDepth(queue) == 0) {
+        queue->pixelHead = 0;
+        return queue->pixels;
+    }
+
+    size_t head = queue->pixelHead;
+    size_t tail = queue->pixelBegin[queue->finished.load() % LcdQueueSize];
+    if (head < tail) {
+        return tail - head > count ? &queue->pixels[head] : nullptr;
+    }
+
+    // Free from the head to the end, and from the start to the tail.
+    if (LcdQueuePixels - head > count || (LcdQueuePixels - head == count && tail > 0)) {
+        return &queue->pixels[head];
+    }
+    return tail > count ? queue->pixels : nullptr;
+}
+
+// Wait while the queue has no room, counting it as a stall. What's queued is
+// submitted first, since that's what will make room.
+template <typename HasRoom>
+static void waitForRoom(LcdQueue *queue, HasRoom hasRoom) {
+    if (hasRoom()) {
+        return;
+    }
+
+    auto startTime = std::chrono::steady_clock::now();
+    lcdQueueSubmit(queue);
+    do {
+        queue->wait(queue);
+    } while (!hasRoom());
+    auto endTime = std::chrono::steady_clock::now();
+
+    queue->stats.stalls++;
+    queue->stats.stallMicros += std::chrono::duration<double, std::micro>(endTime - startTime).count();
+}
+
+// Hand the backend the submitted commands that are next, up to the end of
+// the ring. Only one batch is sent at a time.
+static void startBatch(LcdQueue *queue) {
+    uint32_t finished = queue->finished.load();
+    int index = finished % LcdQueueSize;
+    int count = std::min<uint32_t>(queue->submitted.load() - finished, LcdQueueSize - index);
+
+    queue->sending.store(count);
+    queue->stats.batches++;
+    queue->startCommands(queue, &queue->commands[index], count);
+}
+
+static void push(LcdQueue *queue, LcdCommand const &command, size_t pixelBegin) {
+    waitForRoom(queue, [queue]() { return lcdQueueDepth(queue) < LcdQueueSize; });
+
+    uint32_t queued = queue->queued.load();
+    queue->commands[queued % LcdQueueSize] = command;
+    queue->pixelBegin[queued % LcdQueueSize] = pixelBegin;
+    queue->queued.store(queued + 1);
+
+    queue->stats.commands++;
+    int depth = lcdQueueDepth(queue);
+    if (depth > queue->stats.maxDepth) {
+        queue->stats.maxDepth = depth;
+    }
+}
+
+// Queue what sets the window, leaving out the column or page range if it's
+// already set, then the memory write that fills it.
+static void pushWindow(LcdQueue *queue, uint16_t x, uint16_t y, uint16_t w, uint16_t h,
+        uint16_t const *pixels, uint16_t color, size_t pixelBegin) {
+
+    uint16_t window[4] = { x, (uint16_t) (x + w - 1), y, (uint16_t) (y + h - 1) };
+    bool known = queue->windowKnown;
+
+    if (!known || window[0] != queue->window[0] || window[1] != queue->window[1]) {
+        push(queue, { ILI9341_CASET, 2, { window[0], window[1], 0 }, nullptr, 0, 0 }, pixelBegin);
+    }
+    if (!known || window[2] != queue->window[2] || window[3] != queue->window[3]) {
+        push(queue, { ILI9341_PASET, 2, { window[2], window[3], 0 }, nullptr, 0, 0 }, pixelBegin);
+    }
+    memcpy(queue->window, window, sizeof(window));
+    queue->windowKnown = true;
+
+    push(queue, { ILI9341_RAMWR, 0, { 0, 0, 0 }, pixels, (uint32_t) w*h, color }, pixelBegin);
+    queue->stats.windows++;
+}
+
+void lcdQueueReset(LcdQueue *queue) {
+    queue->queued.store(0);
+    queue->submitted.store(0);
+    queue->finished.store(0);
+    queue->sending.store(0);
+    queue->pixelHead = 0;
+    queue->windowKnown = false;
+    queue->stats = {};
+}
+
+uint16_t *lcdQueueReserve(LcdQueue *queue, size_t count) {
+    uint16_t *pixels = nullptr;
+
+    waitForRoom(queue, [queue, count, &pixels]() {
+        pixels = findRoom(queue, count);
+        return pixels != nullptr;
+    });
+
+    return pixels;
+}
+
+void lcdQueueBitmap(LcdQueue *queue, uint16_t x, uint16_t y, uint16_t w, uint16_t h,
+        uint16_t const *pixels) {
+
+    size_t begin = pixels - queue->pixels;
+    pushWindow(queue, x, y, w, h, pixels, 0, begin);
+
+    queue->pixelHead = begin + (size_t) w*h;
+    if (queue->pixelHead == LcdQueuePixels) {
+        queue->pixelHead = 0;
+    }
+}
+
+void lcdQueueFill(LcdQueue *queue, uint16_t x, uint16_t y, uint16_t w, uint16_t h,
+        uint16_t color) {
+
+    pushWindow(queue, x, y, w, h, nullptr, color, queue->pixelHead);
+}
+
+void lcdQueueSubmit(LcdQueue *queue) {
+    // Start a batch if nothing is being sent, or the interrupt will get to it.
+    uint32_t state = lock(queue);
+    queue->submitted.store(queue->queued.load());
+    bool idle = queue->sending.load() == 0 && lcdQueueDepth(queue) != 0;
+    unlock(queue, state);
+
+    if (idle) {
+        startBatch(queue);
+    }
+}
+
+void lcdQueueTransferDone(LcdQueue *queue) {
+    uint32_t finished = queue->finished.load() + queue->sending.load();
+    queue->finished.store(finished);
+
+    if (finished != queue->submitted.load()) {
+        startBatch(queue);
+    } else {
+        queue->sending.store(0);
+    }
+}
+
+int lcdQueueDepth(LcdQueue const *queue) {
+    return queue->queued.load() - queue->finished.load();
+}
+
+void lcdQueueFlush(LcdQueue *queue) {
+    lcdQueueSubmit(queue);
+    while (lcdQueueDepth(queue) != 0) {
+        queue->wait(queue);
+    }
+
+    // Whoever draws next may set a window of their own.
+    queue->windowKnown = false;
+}
+
+LcdQueueStats lcdQueueGetStats(LcdQueue const *queue) {
+    return queue->stats;
+}
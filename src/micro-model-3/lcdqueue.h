@@ -0,0 +1,106 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+
+#include "lcdcommands.h"
+
+// Drawing waiting to be sent to the LCD, so that drawing doesn't wait for
+// SPI. Each rectangle is queued as the LCD commands that draw it: setting the
+// window (left out when it's the window already set) and writing either its
+// pixels, kept in a ring of staging memory until they're sent, or a color to
+// fill it with. Nothing is sent until lcdQueueSubmit(), and then the backend
+// is handed everything queued so far as one batch. Its lcdQueueTransferDone()
+// (normally called from the DMA interrupt) starts the next batch, so the
+// caller only waits when the queue is full. The queue doesn't touch the
+// hardware itself.
+
+// Commands that can wait at once, enough for a busy frame: up to about 60
+// windows of up to three commands each. Redrawing the whole screen takes more,
+// but then the SPI is what holds it up. About 6 KB on the device.
+constexpr int LcdQueueSize = 256;
+// Staging memory, enough for two full rows of characters.
+constexpr size_t LcdQueuePixels = 2*64*48;
+
+// How the queue has done since the last reset.
+struct LcdQueueStats {
+    // Commands sent, the rectangles they drew, and the batches they went in.
+    unsigned long commands;
+    unsigned long windows;
+    unsigned long batches;
+    // Most commands ever waiting, including those being sent.
+    int maxDepth;
+    // Times the queue was full and we waited for room, and for how long.
+    unsigned long stalls;
+    double stallMicros;
+};
+
+struct LcdQueue {
+    // Start sending a batch of commands, and call lcdQueueTransferDone() when
+    // they're sent. The commands stay put until then.
+    void (*startCommands)(LcdQueue *queue, LcdCommand const *commands, int count);
+    // Wait a little for a batch to finish, while the queue is full.
+    void (*wait)(LcdQueue *queue);
+    // Keep lcdQueueTransferDone() from being called until unlocked, like
+    // turning off interrupts. May be null if it's never called from an
+    // interrupt.
+    uint32_t (*lock)(LcdQueue *queue);
+    void (*unlock)(LcdQueue *queue, uint32_t state);
+    // For the callbacks.
+    void *userData;
+
+    LcdCommand commands[LcdQueueSize];
+    // Where each command's pixels start in the staging ring. Those without
+    // pixels take no room there.
+    size_t pixelBegin[LcdQueueSize];
+    // Commands queued, submitted, and sent so far, and how many are being
+    // sent. Those submitted but not sent are waiting for the backend.
+    std::atomic<uint32_t> queued;
+    std::atomic<uint32_t> submitted;
+    std::atomic<uint32_t> finished;
+    std::atomic<int> sending;
+
+    // Staging ring, and where the next pixels go in it.
+    uint16_t pixels[LcdQueuePixels];
+    size_t pixelHead;
+
+    // The window the queued commands leave set, if known, as the first and
+    // last column and page.
+    bool windowKnown;
+    uint16_t window[4];
+
+    LcdQueueStats stats;
+};
+
+// Start over with nothing queued. The callbacks and user data are kept.
+void lcdQueueReset(LcdQueue *queue);
+
+// Room in the staging ring for this many pixels (less than LcdQueuePixels),
+// waiting for it if needed. They must be queued by lcdQueueBitmap() before
+// asking for more.
+uint16_t *lcdQueueReserve(LcdQueue *queue, size_t count);
+
+// Queue pixels from lcdQueueReserve() to be drawn in a w by h window.
+void lcdQueueBitmap(LcdQueue *queue, uint16_t x, uint16_t y, uint16_t w, uint16_t h,
+        uint16_t const *pixels);
+
+// Queue a rectangle to be filled with a color.
+void lcdQueueFill(LcdQueue *queue, uint16_t x, uint16_t y, uint16_t w, uint16_t h,
+        uint16_t color);
+
+// Send what's been queued since the last submit, once what's before it is sent.
+void lcdQueueSubmit(LcdQueue *queue);
+
+// The batch being sent is done, so start the next.
+void lcdQueueTransferDone(LcdQueue *queue);
+
+// Commands waiting, including those being sent.
+int lcdQueueDepth(LcdQueue const *queue);
+
+// Submit and wait until everything queued has been sent. After this the LCD
+// may be drawn on directly.
+void lcdQueueFlush(LcdQueue *queue);
+
+LcdQueueStats lcdQueueGetStats(LcdQueue const *queue);
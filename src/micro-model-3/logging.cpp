@@ -0,0 +1,141 @@
+#include <stdio.h>
+#include <cstring>
+
+#include "logging.h"
+
+// Longest line we print at once; longer ones are cut short.
+constexpr size_t LOG_LINE_SIZE = 160;
+
+// Format one conversion, from the "%" up to and including its letter, with
+// its argument. Returns what snprintf() does.
+static int formatConversion(char *buffer, size_t size, char const *spec, LogArg const *arg) {
+    size_t length = strlen(spec);
+    char conversion = spec[length - 1];
+    // Length modifiers, between the flags, width and precision and the letter.
+    bool isLongLong = length >= 3 && spec[length - 2] == 'l' && spec[length - 3] == 'l';
+    bool isLong = !isLongLong && length >= 2 && spec[length - 2] == 'l';
+    bool isSize = length >= 2 && spec[length - 2] == 'z';
+
+    if (arg == nullptr) {
+        return snprintf(buffer, size, "<?>");
+    }
+
+    switch (conversion) {
+        case 'd':
+        case 'i':
+            if (isLongLong) {
+                return snprintf(buffer, size, spec, arg->i);
+            } else if (isLong) {
+                return snprintf(buffer, size, spec, (long) arg->i);
+            } else if (isSize) {
+                return snprintf(buffer, size, spec, (size_t) arg->i);
+            } else {
+                return snprintf(buffer, size, spec, (int) arg->i);
+            }
+
+        case 'u':
+        case 'x':
+        case 'X':
+        case 'o':
+            if (isLongLong) {
+                return snprintf(buffer, size, spec, (unsigned long long) arg->i);
+            } else if (isLong) {
+                return snprintf(buffer, size, spec, (unsigned long) arg->i);
+            } else if (isSize) {
+                return snprintf(buffer, size, spec, (size_t) arg->i);
+            } else {
+                return snprintf(buffer, size, spec, (unsigned int) arg->i);
+            }
+
+        case 'c':
+            return snprintf(buffer, size, spec, (int) arg->i);
+
+        case 'f':
+        case 'F':
+        case 'e':
+        case 'E':
+        case 'g':
+        case 'G':
+            return snprintf(buffer, size, spec, arg->d);
+
+        case 's':
+            return snprintf(buffer, size, spec, (char const *) arg->p);
+
+        case 'p':
+            return snprintf(buffer, size, spec, arg->p);
+
+        default:
+            return snprintf(buffer, size, "%s", spec);
+    }
+}
+
+// Format a record into a line as printf() would.
+static void formatRecord(LogRecord const *record, char *line, size_t size) {
+    char const *s = record->format;
+    size_t position = 0;
+    int argIndex = 0;
+
+    while (*s != '\0' && position < size - 1) {
+        if (*s != '%') {
+            line[position++] = *s++;
+            continue;
+        }
+
+        if (s[1] == '%') {
+            line[position++] = '%';
+            s += 2;
+            continue;
+        }
+
+        // Find the end of the conversion.
+        char spec[16];
+        size_t length = 0;
+        do {
+            spec[length++] = *s++;
+        } while (*s != '\0' && strchr("diuxXocfFeEgGsp", *s) == nullptr && length < sizeof(spec) - 2);
+        if (*s != '\0') {
+            spec[length++] = *s++;
+        }
+        spec[length] = '\0';
+
+        LogArg const *arg = argIndex < record->argCount ? &record->args[argIndex] : nullptr;
+        argIndex++;
+        int written = formatConversion(line + position, size - position, spec, arg);
+        if (written > 0) {
+            position += written;
+        }
+    }
+
+    if (position > size - 1) {
+        position = size - 1;
+    }
+    line[position] = '\0';
+}
+
+bool logPending(LogRing const *ring) {
+    return ring->drained.load(std::memory_order_relaxed) != ring->written.load(std::memory_order_acquire);
+}
+
+void logDrain(LogRing *ring) {
+    uint32_t drained = ring->drained.load(std::memory_order_relaxed);
+    uint32_t written = ring->written.load(std::memory_order_acquire);
+
+    while (drained != written) {
+        char line[LOG_LINE_SIZE];
+        formatRecord(&ring->records[drained & (LogRingSize - 1)], line, sizeof(line));
+        printf("%s", line);
+
+        // Let the writer have the slot back.
+        drained++;
+        ring->drained.store(drained, std::memory_order_release);
+    }
+}
+
+Trs80LogStats logGetStats(LogRing const *ring) {
+    Trs80LogStats stats;
+
+    stats.records = ring->written.load(std::memory_order_relaxed);
+    stats.dropped = ring->dropped.load(std::memory_order_relaxed);
+
+    return stats;
+}
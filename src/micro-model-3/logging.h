@@ -0,0 +1,128 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <atomic>
+#include <type_traits>
+
+#include "trs80.h"
+
+// Logging from code that can't wait for the output, like the emulator's
+// inner loop, where printing over USB can hold it up for milliseconds. A
+// record is only the format string, kept by pointer (so it must be a
+// literal), and up to LogMaxArgs arguments, copied into a ring. They're
+// formatted and printed later by logDrain(), when there's time to spare.
+// One thread writes to a ring and one drains it, so it needs no lock. When
+// the ring is full, records are dropped and counted.
+//
+// Formats take printf conversions, without "*" widths or precisions.
+
+#define TRS80_LOG_LEVEL_NONE 0
+#define TRS80_LOG_LEVEL_ERROR 1
+#define TRS80_LOG_LEVEL_WARN 2
+#define TRS80_LOG_LEVEL_INFO 3
+#define TRS80_LOG_LEVEL_DEBUG 4
+
+// Records above this level compile to nothing, arguments and all.
+#ifndef TRS80_LOG_LEVEL
+#define TRS80_LOG_LEVEL TRS80_LOG_LEVEL_INFO
+#endif
+
+#if TRS80_LOG_LEVEL >= TRS80_LOG_LEVEL_ERROR
+#define TRS80_LOG_ERROR(ring, ...) logRecord((ring), __VA_ARGS__)
+#else
+#define TRS80_LOG_ERROR(ring, ...) ((void) 0)
+#endif
+
+#if TRS80_LOG_LEVEL >= TRS80_LOG_LEVEL_WARN
+#define TRS80_LOG_WARN(ring, ...) logRecord((ring), __VA_ARGS__)
+#else
+#define TRS80_LOG_WARN(ring, ...) ((void) 0)
+#endif
+
+#if TRS80_LOG_LEVEL >= TRS80_LOG_LEVEL_INFO
+#define TRS80_LOG_INFO(ring, ...) logRecord((ring), __VA_ARGS__)
+#else
+#define TRS80_LOG_INFO(ring, ...) ((void) 0)
+#endif
+
+#if TRS80_LOG_LEVEL >= TRS80_LOG_LEVEL_DEBUG
+#define TRS80_LOG_DEBUG(ring, ...) logRecord((ring), __VA_ARGS__)
+#else
+#define TRS80_LOG_DEBUG(ring, ...) ((void) 0)
+#endif
+
+// Records in a ring, a power of two.
+constexpr uint32_t LogRingSize = 32;
+constexpr int LogMaxArgs = 5;
+
+static_assert((LogRingSize & (LogRingSize - 1)) == 0, "ring size must be a power of two");
+
+// An argument as passed, which the conversion that takes it knows how to
+// read back.
+union LogArg {
+    long long i;
+    double d;
+    void const *p;
+};
+
+struct LogRecord {
+    char const *format;
+    int argCount;
+    LogArg args[LogMaxArgs];
+};
+
+struct LogRing {
+    LogRecord records[LogRingSize];
+    // Records written to the ring and drained from it so far. Each only
+    // goes up, and wraps around.
+    std::atomic<uint32_t> written{};
+    std::atomic<uint32_t> drained{};
+    // Records that didn't fit.
+    std::atomic<uint32_t> dropped{};
+};
+
+template <typename T>
+LogArg makeLogArg(T value) {
+    LogArg arg;
+    if constexpr (std::is_floating_point<T>::value) {
+        arg.d = value;
+    } else if constexpr (std::is_pointer<T>::value) {
+        arg.p = value;
+    } else {
+        arg.i = (long long) value;
+    }
+    return arg;
+}
+
+// Add a record to the ring, or count it as dropped if there's no room. Only
+// one thread may do this.
+template <typename... Args>
+void logRecord(LogRing *ring, char const *format, Args... args) {
+    static_assert(sizeof...(args) <= LogMaxArgs, "too many arguments to log");
+
+    uint32_t written = ring->written.load(std::memory_order_relaxed);
+    if (written - ring->drained.load(std::memory_order_acquire) >= LogRingSize) {
+        ring->dropped.store(ring->dropped.load(std::memory_order_relaxed) + 1,
+                std::memory_order_relaxed);
+        return;
+    }
+
+    LogRecord &record = ring->records[written & (LogRingSize - 1)];
+    record.format = format;
+    record.argCount = sizeof...(args);
+    int i = 0;
+    ((record.args[i++] = makeLogArg(args)), ...);
+    (void) i;
+
+    // Publish the record only once it's all there.
+    ring->written.store(written + 1, std::memory_order_release);
+}
+
+// Whether there are records to drain.
+bool logPending(LogRing const *ring);
+
+// Format and print the records in the ring. Only one thread may do this.
+void logDrain(LogRing *ring);
+
+Trs80LogStats logGetStats(LogRing const *ring);
@@ -5,13 +5,15 @@
 
 #include "pico/stdlib.h"
 #include "hardware/gpio.h"
+#include "hardware/sync.h"
 #include "pico/binary_info.h"
 #include "pico/rand.h"
 
 #include "ili9341.h"
 #include "trs80.h"
 #include "main.h"
-#include "fonts.h"
+#include "display.h"
+#include "menu.h"
 #include "obstacle_run_cmd.h"
 #include "scarfman2_cmd.h"
 #include "defense_command_cmd.h"
@@ -19,6 +21,10 @@
 #include "breakdown_cmd.h"
 #include "ever_given_cmd.h"
 #include "galaxy_invasion_cmd.h"
+#include "snapshots.h"
+#include "snapshot.h"
+#include "saveslots.h"
+#include "rewind.h"
 #include "splash.h"
 #include "logos.h"
 
@@ -31,23 +37,32 @@
 
 #define TFT_ROTATION    1
 
-#define BLANK_CHARACTER 128
-
+// Holding fire this long takes the joystick away from the game. Letting go
+// of fire then leaves the game, unless left was pressed in the meantime to
+// rewind it, a checkpoint every step.
 constexpr uint64_t LONG_HOLD_EXIT_GAME_MS = 1000;
+constexpr uint64_t LONG_HOLD_RESUME_GAME_MS = 1000;
+constexpr uint64_t REWIND_STEP_MS = 100;
+// RAM for rewinding, which also holds saved games while compressing them.
+constexpr size_t REWIND_BUFFER_SIZE = 24*1024;
+static_assert(REWIND_BUFFER_SIZE >= SAVE_SLOT_SIZE, "rewind buffer can't hold a saved game");
+// Pages of RAM the machine can copy on write. The bundled games copy up to 63
+// of them when started from their snapshots, and up to 105 when booted and
+// loaded.
+constexpr int RAM_PAGES = 128;
+// Timer ticks to run ahead of the game to hide its input latency (see
+// trs80_setRunAhead()). Each one costs another tick of emulation per tick, and
+// it needs a snapshot's worth of RAM that we don't have next to the rewind
+// ring, so it's off for now. The emulator skips it when behind anyway.
+#define RUN_AHEAD_FRAMES 0
+// How often to look at the joystick while waiting on it, sleeping in between.
+constexpr uint32_t INPUT_POLL_MS = 10;
 constexpr uint64_t IDLE_AUTO_PLAY_MS = 20*1000;
 constexpr uint64_t IDLE_DEMO_RETURN_TO_MENU_MS = 5*60*1000;
 constexpr uint64_t IDLE_NO_DEMO_RETURN_TO_MENU_MS = 30*1000;
 
-// .CMD chunk types.
-#define CMD_LOAD_BLOCK 0x01
-#define CMD_TRANSFER_ADDRESS 0x02
-#define CMD_LOAD_MODULE_HEADER 0x05
-
-// Convert from RGB888 to RGB565:
-#define RGB888TO565(r, g, b) ((((r) & 0xF8) << 8) | (((g) & 0xFC) << 3) | ((b) >> 3))
-#define BLACK RGB888TO565(0x00, 0x00, 0x00)
-#define GRAY RGB888TO565(0x80, 0x80, 0x80)
-#define WHITE RGB888TO565(0xFF, 0xFF, 0xFF)
+// Timer ticks between drawing what changed on the screen.
+constexpr int DISPLAY_FLUSH_TICKS = DisplayFlushTicks;
 
 // Centered:
 // #define LEFT_MARGIN 32
@@ -64,11 +79,6 @@ const uint LED_PIN = 25;
 #define JOYSTICK_RIGHT_PIN 4
 #define JOYSTICK_FIRE_PIN 5
 
-#define FONT_CHAR_COUNT 256
-#define FONT_WIDTH 4
-#define FONT_HEIGHT 12
-#define FONT_CHAR_SIZE (FONT_WIDTH*FONT_HEIGHT)
-
 /**
  * A key we should handle in a menu.
  */
@@ -87,6 +97,8 @@ struct MenuKey {
 struct Game {
     size_t cmdSize;
     uint8_t *cmd;
+    // The machine just after loading the program, so we don't have to boot.
+    Trs80Snapshot const *snapshot;
     uint8_t *logo;
     int logoRows;
     bool hasDemo;
@@ -94,18 +106,24 @@ struct Game {
 };
 
 namespace {
-    uint16_t gFontGlyphs[FONT_CHAR_COUNT*FONT_CHAR_SIZE];
-    // Color to use for the four possible horizontal values of two pixels.
-    const uint16_t COLORS[4] = { BLACK, GRAY, GRAY, WHITE };
+    Display gDisplay;
+    LcdQueue gLcdQueue;
     bool mFirePressed = false;
     bool mFireSwallowed = false;
-
-    const std::vector<uint8_t> BLANK_LINE(Trs80ColumnCount, BLANK_CHARACTER);
+    // Whether fire was held long enough to leave or rewind the game, and
+    // whether left has been up since, so that fire and left held while
+    // playing don't rewind.
+    bool mFireHeld = false;
+    bool mLeftReleased = false;
+    // Whether we've rewound while fire was held, and when we last stepped back.
+    bool mRewinding = false;
+    uint64_t mTimeAtRewind = 0;
 
     const std::vector<Game> gGameList = {
         {
             .cmdSize = GALAXY_INVASION_CMD_SIZE,
             .cmd = GALAXY_INVASION_CMD,
+            .snapshot = &GALAXY_INVASION_SNAPSHOT,
             .logo = GALAXY_INVASION_LOGO,
             .logoRows = GALAXY_INVASION_LOGO_ROWS,
             .hasDemo = true,
@@ -133,6 +151,7 @@ namespace {
         {
             .cmdSize = OBSTACLE_RUN_CMD_SIZE,
             .cmd = OBSTACLE_RUN_CMD,
+            .snapshot = &OBSTACLE_RUN_SNAPSHOT,
             .logo = OBSTACLE_RUN_LOGO,
             .logoRows = OBSTACLE_RUN_LOGO_ROWS,
             .hasDemo = true,
@@ -160,6 +179,7 @@ namespace {
         {
             .cmdSize = SCARFMAN2_CMD_SIZE,
             .cmd = SCARFMAN2_CMD,
+            .snapshot = &SCARFMAN2_SNAPSHOT,
             .logo = SCARFMAN_LOGO,
             .logoRows = SCARFMAN_LOGO_ROWS,
             .hasDemo = false,
@@ -175,6 +195,7 @@ namespace {
         {
             .cmdSize = DEFENSE_COMMAND_CMD_SIZE,
             .cmd = DEFENSE_COMMAND_CMD,
+            .snapshot = &DEFENSE_COMMAND_SNAPSHOT,
             .logo = DEFENSE_COMMAND_LOGO,
             .logoRows = DEFENSE_COMMAND_LOGO_ROWS,
             .hasDemo = true,
@@ -190,6 +211,7 @@ namespace {
         {
             .cmdSize = SEA_DRAGON_CMD_SIZE,
             .cmd = SEA_DRAGON_CMD,
+            .snapshot = &SEA_DRAGON_SNAPSHOT,
             .logo = SEA_DRAGON_LOGO,
             .logoRows = SEA_DRAGON_LOGO_ROWS,
             .hasDemo = false,
@@ -217,6 +239,7 @@ namespace {
         {
             .cmdSize = BREAKDOWN_CMD_SIZE,
             .cmd = BREAKDOWN_CMD,
+            .snapshot = &BREAKDOWN_SNAPSHOT,
             .logo = BREAKDOWN_LOGO,
             .logoRows = BREAKDOWN_LOGO_ROWS,
             .hasDemo = false,
@@ -227,6 +250,7 @@ namespace {
         {
             .cmdSize = EVER_GIVEN_CMD_SIZE,
             .cmd = EVER_GIVEN_CMD,
+            .snapshot = &EVER_GIVEN_SNAPSHOT,
             .logo = EVER_GIVEN_LOGO,
             .logoRows = EVER_GIVEN_LOGO_ROWS,
             .hasDemo = false,
@@ -243,6 +267,31 @@ namespace {
     Game const *mGame = nullptr;
     uint64_t mTimeAtFire = 0;
     uint64_t mTimeAtInput = 0;
+    // Whether the player left the game by holding the fire button, as
+    // opposed to it timing out.
+    bool mPlayerExited = false;
+    // The emulated machine.
+    Trs80Machine *gMachine = nullptr;
+    // Latest rewind checkpoint, also used for saving and resuming games.
+    RewindRing gRewind;
+    Trs80Snapshot gSnapshot;
+    uint8_t gRewindBuffer[REWIND_BUFFER_SIZE];
+#if RUN_AHEAD_FRAMES > 0
+    Trs80Snapshot gRunAheadSnapshot;
+#endif
+
+    // The machine and its pages (on the heap), the big globals, and the
+    // display's glyphs (made on first use) have to fit in the RP2040's 256 KB
+    // of main SRAM (the stacks are in the two 4 KB banks after it), with room
+    // left for the SDK and the heap's small things.
+    constexpr size_t MAIN_SRAM_SIZE = 256*1024;
+    constexpr size_t SMALL_RAM_RESERVE = 16*1024;
+    static_assert(Trs80MachineBudget + RAM_PAGES*Trs80PageSize + sizeof(gSnapshot) + sizeof(gRewindBuffer) +
+#if RUN_AHEAD_FRAMES > 0
+            sizeof(gRunAheadSnapshot) +
+#endif
+            sizeof(gDisplay) + DisplayGlyphsBytes + sizeof(gLcdQueue) + SMALL_RAM_RESERVE <= MAIN_SRAM_SIZE,
+            "not enough RAM");
 
     void configureGpio() {
         gpio_init(LED_PIN);
@@ -269,25 +318,44 @@ namespace {
         gpio_pull_up(JOYSTICK_FIRE_PIN);
     }
 
+    void startLcdCommands(LcdQueue *queue, LcdCommand const *commands, int count) {
+        LCD_startCommands(commands, count);
+    }
+
+    // Called from the DMA interrupt.
+    void lcdTransferDone() {
+        lcdQueueTransferDone(&gLcdQueue);
+    }
+
+    void waitForLcd(LcdQueue *queue) {
+        tight_loop_contents();
+    }
+
+    uint32_t lockLcdQueue(LcdQueue *queue) {
+        return save_and_disable_interrupts();
+    }
+
+    void unlockLcdQueue(LcdQueue *queue, uint32_t state) {
+        restore_interrupts(state);
+    }
+
     void configureLcd() {
         LCD_setPins(TFT_DC, TFT_CS, TFT_RST, TFT_SCLK, TFT_MOSI);
         LCD_initDisplay();
         LCD_setRotation(TFT_ROTATION);
         LCD_fillRect(0, 0, LCD_getWidth(), LCD_getHeight(), BLACK);
-    }
-
-    void prepareFontBitmaps() {
-        uint16_t *p = gFontGlyphs;
 
-        for (int ch = 0; ch < FONT_CHAR_COUNT; ch++) {
-            for (int y = 0; y < FONT_HEIGHT; y++) {
-                uint8_t b = Trs80FontBits[ch*FONT_HEIGHT + y];
-                for (int x = 0; x < FONT_WIDTH; x++) {
-                    int gray = (b >> (x*2)) & 0x03;
-                    *p++ = COLORS[gray];
-                }
-            }
-        }
+        gLcdQueue.startCommands = startLcdCommands;
+        gLcdQueue.wait = waitForLcd;
+        gLcdQueue.lock = lockLcdQueue;
+        gLcdQueue.unlock = unlockLcdQueue;
+        lcdQueueReset(&gLcdQueue);
+        LCD_setTransferDoneHandler(lcdTransferDone);
+
+        gDisplay.left = LEFT_MARGIN;
+        gDisplay.top = TOP_MARGIN;
+        gDisplay.queue = &gLcdQueue;
+        displayReset(&gDisplay, DISPLAY_FLUSH_TICKS);
     }
 
     void showSplashScreen() {
@@ -299,7 +367,7 @@ namespace {
         // Top margin.
         for (int line = 0; line < topMarginLines; line++) {
             for (int x = 0; x < Trs80ColumnCount; x++) {
-                writeMemoryByte(addr++, ' ');
+                writeMemoryByte(gMachine, addr++, ' ');
             }
         }
 
@@ -307,24 +375,26 @@ namespace {
         uint8_t *s = SPLASH;
         for (int line = 0; line < SPLASH_ROWS; line++) {
             for (int x = 0; x < Trs80ColumnCount; x++) {
-                writeMemoryByte(addr++, *s++);
+                writeMemoryByte(gMachine, addr++, *s++);
             }
         }
 
         // Bottom margin.
         for (int line = 0; line < bottomMarginLines; line++) {
             for (int x = 0; x < Trs80ColumnCount; x++) {
-                writeMemoryByte(addr++, ' ');
+                writeMemoryByte(gMachine, addr++, ' ');
             }
         }
+
+        displayFlush(&gDisplay);
     }
 
-    void keyCallback(int ch) {
-        handleKeypress(ch, true);
-        handleKeypress(ch, false);
+    void keyCallback(Trs80Machine *machine, int ch) {
+        handleKeypress(machine, ch, true);
+        handleKeypress(machine, ch, false);
     }
 
-    void launchProgram(int gameIndex) {
+    void launchProgram(Trs80Machine *machine, int gameIndex) {
         if (gameIndex < 0 || gameIndex >= gGameList.size()) {
             gameIndex = 0;
         }
@@ -332,60 +402,70 @@ namespace {
         mGame = &gGameList[gameIndex];
 
         // Turn off blinking cursor.
-        writeMemoryByte(16412, 1);
+        writeMemoryByte(machine, 16412, 1);
 
-        int size = mGame->cmdSize;
-        uint8_t *binary = mGame->cmd;
+        loadCmdProgram(machine, mGame->cmd, mGame->cmdSize);
+    }
 
-        int i = 0;
-        while (true) {
-            if (i >= size) {
-                printf("CMD program ran off the end (%d >= %d)\n", i, size);
-                return;
-            }
+    /**
+     * Restore the game saved in the slot. Returns whether there was a saved
+     * game and it could be restored.
+     */
+    bool resumeGame(int gameIndex) {
+        size_t size;
+        uint8_t const *data = readSaveSlot(gameIndex, &size);
+        if (data == nullptr) {
+            return false;
+        }
 
-            int chunkType = binary[i++];
-            int chunkLength = binary[i++];
+        // Share the game's snapshot first, so that only the pages the game
+        // changed are copied.
+        uint64_t startTime = to_us_since_boot(get_absolute_time());
+        bool success = decompressSnapshot(data, size, gGameList[gameIndex].snapshot, &gSnapshot) &&
+            trs80_shareSnapshot(gMachine, gGameList[gameIndex].snapshot) &&
+            trs80_restoreSnapshot(gMachine, &gSnapshot);
+        uint64_t endTime = to_us_since_boot(get_absolute_time());
 
-            // Adjust load block length.
-            if (chunkType == CMD_LOAD_BLOCK && chunkLength <= 2) {
-                chunkLength += 256;
-            } else if (chunkType == CMD_LOAD_MODULE_HEADER && chunkLength == 0) {
-                chunkLength = 256;
-            }
+        printf("Resuming %zu bytes took %llu us (%s)\n", size, endTime - startTime,
+                success ? "ok" : "failed");
 
-            uint8_t *data = &binary[i];
-            i += chunkLength;
+        return success;
+    }
 
-            switch (chunkType) {
-                case CMD_LOAD_BLOCK: {
-                    uint16_t address = data[0] | (data[1] << 8);
-                    int dataLength = chunkLength - 2;
-                    // printf("CMD loading %d bytes at 0x%04X\n", dataLength, address);
-                    for (int i = 0; i < dataLength; i++) {
-                        writeMemoryByte(address + i, data[2 + i]);
-                    }
-                    break;
-                }
+    /**
+     * Save the state of the current game to its slot, as its differences from
+     * the game's snapshot.
+     */
+    void saveGame() {
+        int gameIndex = mGame - gGameList.data();
+
+        uint64_t startTime = to_us_since_boot(get_absolute_time());
+        // We're done rewinding, so use its memory.
+        trs80_saveSnapshot(gMachine, &gSnapshot);
+        size_t size = compressSnapshot(&gSnapshot, mGame->snapshot, gRewindBuffer, saveSlotCapacity());
+        uint64_t compressTime = to_us_since_boot(get_absolute_time());
+        bool success = size != 0 && writeSaveSlot(gameIndex, gRewindBuffer, size);
+        uint64_t endTime = to_us_since_boot(get_absolute_time());
+
+        printf("Saving %zu bytes took %llu us to compress and %llu us to write (%s)\n",
+                size, compressTime - startTime, endTime - compressTime,
+                success ? "ok" : "failed");
+    }
 
-                case CMD_TRANSFER_ADDRESS: {
-                    uint16_t address = data[0] | (data[1] << 8);
-                    // printf("CMD jumping to 0x%04X\n", address);
-                    jumpToAddress(address);
-                    // Stop parsing.
-                    return;
-                }
+    /**
+     * Get the machine ready to run the game, from its saved state or its
+     * snapshot if we can, otherwise by booting the ROM and loading the game.
+     */
+    void startGame(int gameIndex, bool resume) {
+        trs80_reset(gMachine);
 
-                case CMD_LOAD_MODULE_HEADER: {
-                    std::string name((char *) data, chunkLength);
-                    // printf("CMD loading \"%s\"\n", name.c_str());
-                    break;
-                }
+        if (gameIndex >= 0 && gameIndex < gGameList.size() &&
+                ((resume && resumeGame(gameIndex)) ||
+                 trs80_shareSnapshot(gMachine, gGameList[gameIndex].snapshot))) {
 
-                default:
-                    printf("Unknown CMD chunk type %d\n", chunkType);
-                    return;
-            }
+            mGame = &gGameList[gameIndex];
+        } else {
+            queueEvent(gMachine, 0.1, launchProgram, gameIndex);
         }
     }
 
@@ -403,7 +483,7 @@ namespace {
     bool textIsAt(char const *s, int position) {
         // printf("textIsAt()\n");
         while (*s != '\0') {
-            uint8_t mem = readMemoryByte(Trs80ScreenBegin + position);
+            uint8_t mem = readMemoryByte(gMachine, Trs80ScreenBegin + position);
             // printf("    position = %04x, s = %d, screen = %d\n", position, (int) *s, (int) mem);
             if (normalizeChar(mem) != normalizeChar(*s)) {
                 return false;
@@ -415,57 +495,11 @@ namespace {
     }
 
     /**
-     * Add this many blank lines to the list of menu rows.
+     * Get the scroll of the menu that centers the given game's logo in the
+     * screen.
      */
-    void addBlankLines(std::vector<const uint8_t *> &rows, int rowCount) {
-        while (rowCount--) {
-            rows.push_back(BLANK_LINE.data());
-        }
-    }
-
-    /**
-     * Add the logo to the list of menu rows.
-     */
-    void addLogo(std::vector<const uint8_t *> &rows, uint8_t *logo, int logoRows) {
-        while (logoRows--) {
-            rows.push_back(logo);
-            logo += Trs80ColumnCount;
-        }
-    }
-
-    /**
-     * Draw the rows to the display, starting at the specified row.
-     */
-    void updateDisplay(std::vector<const uint8_t *> &rows, int startRow,
-            int highlightBegin, int highlightCount) {
-
-        uint16_t addr = Trs80ScreenBegin;
-
-        for (int i = 0; i < Trs80RowCount; i++) {
-            int row = startRow + i;
-            uint8_t highlight = row >= highlightBegin && row < highlightBegin + highlightCount
-                ? 0x3F : 0x00;
-
-            const uint8_t *s = rows[row];
-            for (int x = 0; x < Trs80ColumnCount; x++) {
-                writeMemoryByte(addr++, *s++ ^ highlight);
-            }
-        }
-    }
-
-    /**
-     * Get the top (offset) row of the display, given that we want
-     * to center the given game's logo in the screen.
-     */
-    int targetRowOfGame(std::vector<int> gameRow, int gameIndex) {
-        Game const *game = &gGameList[gameIndex];
-        int row = gameRow[gameIndex];
-
-        int marginLines = Trs80RowCount - game->logoRows;
-        int topMarginLines = marginLines / 2;
-        int bottomMarginLines = marginLines - topMarginLines;
-
-        return row - topMarginLines;
+    int targetScrollOfGame(std::vector<int> const &gameRow, int gameIndex) {
+        return menuCenter(gameRow[gameIndex], gGameList[gameIndex].logoRows);
     }
 
     /**
@@ -480,48 +514,59 @@ namespace {
      * Show the menu and have the user choose the game.
      *
      * The parameter is the initial game to center on, or -1 to
-     * show the splash screen first.
+     * show the splash screen first. Sets resume if the user held
+     * the fire button to pick up where they left off.
      */
-    int chooseGame(int gameIndex) {
+    int chooseGame(int gameIndex, bool *resume) {
+        *resume = false;
+
+        // The menu draws over the screen, so draw all of it once we're back.
+        displayRedraw(&gDisplay);
+
         // Make the menu.
-        std::vector<const uint8_t *> rows;
+        Menu menu {};
+        menu.left = LEFT_MARGIN;
+        menu.top = TOP_MARGIN;
+        menu.queue = &gLcdQueue;
+        menuReset(&menu);
+
         std::vector<int> gameRow;
         int marginLines = Trs80RowCount - SPLASH_ROWS;
         int topMarginLines = marginLines / 2;
         int bottomMarginLines = marginLines - topMarginLines;
 
-        addBlankLines(rows, topMarginLines);
-        addLogo(rows, SPLASH, SPLASH_ROWS);
-        addBlankLines(rows, bottomMarginLines);
+        menuAddBlankRows(&menu, topMarginLines);
+        menuAddRows(&menu, SPLASH, SPLASH_ROWS);
+        menuAddBlankRows(&menu, bottomMarginLines);
 
         for (int i = 0; i < gGameList.size(); i++) {
             Game const *game = &gGameList[i];
 
-            gameRow.push_back(rows.size());
-            addLogo(rows, game->logo, game->logoRows);
-            addBlankLines(rows, 2);
+            gameRow.push_back(menu.rows.size());
+            menuAddRows(&menu, game->logo, game->logoRows);
+            menuAddBlankRows(&menu, 2);
         }
 
-        addBlankLines(rows, Trs80RowCount);
+        menuAddBlankRows(&menu, Trs80RowCount);
 
-        // Display the menu.
+        // Display the menu, scrolled by lines of pixels.
         int scroll;
         int targetScroll;
 
         if (gameIndex == -1) {
             scroll = 0;
-            updateDisplay(rows, scroll, -1, 0);
+            menuDraw(&menu, scroll, -1, 0);
             sleep_ms(2000);
             gameIndex = 0;
-            targetScroll = targetRowOfGame(gameRow, gameIndex);
+            targetScroll = targetScrollOfGame(gameRow, gameIndex);
         } else {
-            scroll = targetScroll = targetRowOfGame(gameRow, gameIndex);
-            updateDisplay(rows, scroll, gameRow[gameIndex] - 1, gGameList[gameIndex].logoRows + 2);
+            scroll = targetScroll = targetScrollOfGame(gameRow, gameIndex);
+            menuDraw(&menu, scroll, gameRow[gameIndex] - 1, gGameList[gameIndex].logoRows + 2);
         }
 
         // Wait for fire to be released.
         while (getPin(JOYSTICK_FIRE_PIN)) {
-            // Nothing.
+            sleep_ms(INPUT_POLL_MS);
         }
 
         // When the display was initially displayed.
@@ -530,12 +575,8 @@ namespace {
         bool previousUp = false;
         bool previousDown = false;
         while (!getPin(JOYSTICK_FIRE_PIN)) {
-            if (targetScroll < scroll) {
-                scroll -= 1;
-            } else if (targetScroll > scroll) {
-                scroll += 1;
-            }
-            updateDisplay(rows, scroll, gameRow[gameIndex] - 1, gGameList[gameIndex].logoRows + 2);
+            scroll = menuStepScroll(scroll, targetScroll);
+            menuDraw(&menu, scroll, gameRow[gameIndex] - 1, gGameList[gameIndex].logoRows + 2);
 
             // Get user input.
             bool up = getPin(JOYSTICK_UP_PIN) || getPin(JOYSTICK_LEFT_PIN);
@@ -550,7 +591,7 @@ namespace {
             } else if (downPressed && gameIndex < gGameList.size() - 1) {
                 gameIndex += 1;
             }
-            targetScroll = targetRowOfGame(gameRow, gameIndex);
+            targetScroll = targetScrollOfGame(gameRow, gameIndex);
 
             // See if we've been idle for a while.
             uint64_t now = to_ms_since_boot(get_absolute_time());
@@ -567,25 +608,51 @@ namespace {
 
             previousUp = up;
             previousDown = down;
+
+            // Scroll as fast as we can draw, but otherwise don't spin.
+            if (scroll == targetScroll) {
+                sleep_ms(INPUT_POLL_MS);
+            }
+        }
+
+        // See how long the fire button is held.
+        uint64_t fireTime = to_ms_since_boot(get_absolute_time());
+        while (getPin(JOYSTICK_FIRE_PIN)) {
+            sleep_ms(INPUT_POLL_MS);
         }
+        *resume = to_ms_since_boot(get_absolute_time()) - fireTime >= LONG_HOLD_RESUME_GAME_MS;
 
         return gameIndex;
     }
 }
 
-void writeScreenChar(int x, int y, uint8_t ch) {
-    LCD_writeBitmap(
-            LEFT_MARGIN + x*FONT_WIDTH,
-            TOP_MARGIN + y*FONT_HEIGHT,
-            FONT_WIDTH,
-            FONT_HEIGHT,
-            &gFontGlyphs[ch*FONT_CHAR_SIZE]);
+/**
+ * Note the change to the screen, to be drawn at the next flush.
+ */
+void writeScreenChar(Trs80Machine *machine, int position, uint8_t ch) {
+    displayMark(&gDisplay, position, ch);
 }
 
-void writeScreenChar(int position, uint8_t ch) {
-    int x = position % Trs80ColumnCount;
-    int y = position / Trs80ColumnCount;
-    writeScreenChar(x, y, ch);
+void writeScreenRange(Trs80Machine *machine, int begin, int end) {
+    for (int position = begin; position < end; position++) {
+        displayMark(&gDisplay, position, readMemoryByte(machine, Trs80ScreenBegin + position));
+    }
+}
+
+/**
+ * Count timer ticks for rewinding and drawing the screen.
+ */
+void timerTick(Trs80Machine *machine) {
+    rewindTick(&gRewind);
+    displayTick(&gDisplay);
+}
+
+/**
+ * Wait while the emulator is ahead of real time. This sleeps on a timer alarm
+ * rather than spinning.
+ */
+void sleepMicros(Trs80Machine *machine, uint32_t micros) {
+    sleep_us(micros);
 }
 
 /**
@@ -594,12 +661,15 @@ void writeScreenChar(int position, uint8_t ch) {
 void pollReset() {
     mFirePressed = false;
     mFireSwallowed = false;
+    mFireHeld = false;
+    mRewinding = false;
+    mPlayerExited = false;
 }
 
 /**
  * Poll the input and update the TRS-80 state based on it.
  */
-void pollInput() {
+void pollInput(Trs80Machine *machine) {
     uint64_t now = to_ms_since_boot(get_absolute_time());
 
     // Get GPIO state.
@@ -617,7 +687,7 @@ void pollInput() {
         mTimeAtInput = now;
     } else if (mTimeAtInput != 0 && now - mTimeAtInput >= idleReturnToMenuMs) {
         // Idle too long, exit game.
-        trs80_exit();
+        trs80_exit(machine);
     }
 
     // Simulate various keys.
@@ -630,23 +700,35 @@ void pollInput() {
                 // See if we're in a menu and should submit a special key.
                 for (MenuKey const &menuKey : mGame->menuKeys) {
                     if (textIsAt(menuKey.text, menuKey.position)) {
-                        handleKeypress(menuKey.key, true);
-                        handleKeypress(menuKey.key, false);
+                        handleKeypress(machine, menuKey.key, true);
+                        handleKeypress(machine, menuKey.key, false);
                         mFireSwallowed = true;
                         break;
                     }
                 }
             }
-        } else {
+        } else if (!mFireHeld) {
             // See how long we've been holding down the fire button.
-            uint64_t elapsedMs = now - mTimeAtFire;
-
-            if (elapsedMs >= LONG_HOLD_EXIT_GAME_MS) {
-                trs80_exit();
+            if (now - mTimeAtFire >= LONG_HOLD_EXIT_GAME_MS) {
+                mFireHeld = true;
+                mLeftReleased = !left;
             }
+        } else if (!left) {
+            mLeftReleased = true;
+        } else if (mLeftReleased && now - mTimeAtRewind >= REWIND_STEP_MS) {
+            // Step back while left is pressed, until fire is released.
+            rewindStep(&gRewind);
+            mTimeAtRewind = now;
+            mRewinding = true;
         }
     } else {
+        if (mFireHeld && !mRewinding) {
+            mPlayerExited = true;
+            trs80_exit(machine);
+        }
         mFireSwallowed = false;
+        mFireHeld = false;
+        mRewinding = false;
     }
     mFirePressed = fire;
 
@@ -657,30 +739,74 @@ void pollInput() {
         (right ? JOYSTICK_RIGHT_MASK : 0) |
         (fire && !mFireSwallowed ? JOYSTICK_FIRE_MASK : 0);
 
-    setJoystick(joystick);
+    // The game doesn't see the joystick once fire is held to leave or rewind.
+    setJoystick(machine, mFireHeld ? 0 : joystick);
 }
 
 int main() {
     stdio_init_all();
 
     configureGpio();
-    prepareFontBitmaps();
     configureLcd();
 
+    if (!saveSlotsReserved()) {
+        printf("Save slots aren't reserved in flash, not saving games\n");
+    }
+
+    gMachine = trs80_newMachine(RAM_PAGES);
+    if (gMachine == nullptr) {
+        printf("Not enough memory for the machine\n");
+        while (true) {
+            // Nothing.
+        }
+    }
+    trs80_setScreenCallback(gMachine, writeScreenChar);
+    trs80_setScreenRangeCallback(gMachine, writeScreenRange);
+    trs80_setPollCallback(gMachine, pollInput);
+    trs80_setTimerCallback(gMachine, timerTick);
+    trs80_setSleepCallback(gMachine, sleepMicros);
+
 #if 0
     // Basic ROM:
-    queueEvent(1, keyCallback, 'L');
-    queueEvent(2, keyCallback, '0');
-    queueEvent(3, keyCallback, '\n');
+    queueEvent(gMachine, 1, keyCallback, 'L');
+    queueEvent(gMachine, 2, keyCallback, '0');
+    queueEvent(gMachine, 3, keyCallback, '\n');
 #endif
 
     int gameIndex = -1;
     while (true) {
-        gameIndex = chooseGame(gameIndex);
-        trs80_reset();
+        bool resume;
+        gameIndex = chooseGame(gameIndex, &resume);
         pollReset();
         mTimeAtInput = to_ms_since_boot(get_absolute_time());
-        queueEvent(0.1, launchProgram, gameIndex);
-        trs80_main();
+        startGame(gameIndex, resume);
+        rewindReset(&gRewind, gMachine, &gSnapshot, gRewindBuffer, sizeof(gRewindBuffer));
+#if RUN_AHEAD_FRAMES > 0
+        trs80_setRunAhead(gMachine, RUN_AHEAD_FRAMES, &gRunAheadSnapshot);
+#endif
+        trs80_main(gMachine);
+#if RUN_AHEAD_FRAMES > 0
+        Trs80RunAheadStats runAhead = trs80_getRunAheadStats(gMachine);
+        printf("Ran ahead at %lu ticks, skipped %lu\n", runAhead.frames, runAhead.skipped);
+#endif
+        Trs80PacingStats pacing = trs80_getPacingStats(gMachine);
+        printf("Spare time %.1f ms per tick, %.1f ms least, %lu resyncs\n",
+                pacing.frames == 0 ? 0.0 : pacing.spareMicros/pacing.frames/1000,
+                pacing.leastSpareMicros/1000, pacing.resyncs);
+        LcdQueueStats lcd = lcdQueueGetStats(&gLcdQueue);
+        printf("LCD queue since startup: %lu windows, %lu commands in %lu batches, depth up to %d, %lu stalls for %.1f ms\n",
+                lcd.windows, lcd.commands, lcd.batches, lcd.maxDepth, lcd.stalls, lcd.stallMicros/1000);
+        Trs80LogStats log = trs80_getLogStats(gMachine);
+        if (log.dropped != 0) {
+            printf("Dropped %lu of %lu log records\n", log.dropped, log.records);
+        }
+        Trs80MemoryStats memory = trs80_getMemoryStats(gMachine);
+        printf("Copied %d of %d pages of RAM%s\n", memory.ownPages, memory.poolPages,
+                memory.outOfPages ? ", ran out" : "");
+
+        // Keep the player's progress for next time.
+        if (mPlayerExited && mGame != nullptr) {
+            saveGame();
+        }
     }
 }
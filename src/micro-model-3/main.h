@@ -3,6 +3,10 @@
 
 #include <stdint.h>
 
-void writeScreenChar(int x, int y, uint8_t ch);
-void writeScreenChar(int position, uint8_t ch);
-void pollInput();
+#include "trs80.h"
+
+void writeScreenChar(Trs80Machine *machine, int position, uint8_t ch);
+void writeScreenRange(Trs80Machine *machine, int begin, int end);
+void timerTick(Trs80Machine *machine);
+void sleepMicros(Trs80Machine *machine, uint32_t micros);
+void pollInput(Trs80Machine *machine);
@@ -0,0 +1,163 @@
+#include <algorithm>
+#include <cstring>
+
+#include "menu.h"
+#include "fonts.h"
+
+// Most pixels to draw in one window, so that the next can be drawn into the
+// queue's staging ring while this one is sent.
+constexpr int MAX_WINDOW_PIXELS = LcdQueuePixels/2;
+
+static const std::vector<uint8_t> BLANK_ROW(Trs80ColumnCount, MenuBlankCharacter);
+
+// A line of pixels in the menu: the row it's in, which line of the glyphs it
+// is, and what to flip in each character to highlight it.
+struct Line {
+    uint8_t const *row;
+    int glyphLine;
+    uint8_t invert;
+};
+
+static Line getLine(Menu const *menu, int line, int highlightBegin, int highlightCount) {
+    int row = line / DisplayGlyphHeight;
+    bool highlighted = row >= highlightBegin && row < highlightBegin + highlightCount;
+
+    return { menu->rows[row], line % DisplayGlyphHeight, (uint8_t) (highlighted ? 0x3F : 0x00) };
+}
+
+static uint8_t getCharacter(Line const &line, int column) {
+    return line.row[column] ^ line.invert;
+}
+
+// How the character in the column looks on the line. Characters that look the
+// same there have the same bits.
+static uint8_t getFontBits(Line const &line, int column) {
+    return Trs80FontBits[getCharacter(line, column)*Trs80FontHeight + line.glyphLine];
+}
+
+// Lines on the screen to draw in one window, and the columns from begin up to
+// (but not including) end.
+struct Window {
+    int y;
+    int lineCount;
+    int begin;
+    int end;
+};
+
+static void drawWindow(Menu *menu, Window const *window, int scroll,
+        int highlightBegin, int highlightCount) {
+
+    if (window->lineCount == 0) {
+        return;
+    }
+
+    int width = (window->end - window->begin)*DisplayGlyphWidth;
+    int count = width*window->lineCount;
+    uint16_t *pixels = lcdQueueReserve(menu->queue, count);
+    uint16_t *p = pixels;
+
+    for (int i = 0; i < window->lineCount; i++) {
+        Line line = getLine(menu, scroll + window->y + i, highlightBegin, highlightCount);
+        for (int column = window->begin; column < window->end; column++) {
+            memcpy(p, displayGlyph(getCharacter(line, column)) + line.glyphLine*DisplayGlyphWidth,
+                    DisplayGlyphWidth*sizeof(uint16_t));
+            p += DisplayGlyphWidth;
+        }
+    }
+
+    uint16_t x = menu->left + window->begin*DisplayGlyphWidth;
+    uint16_t y = menu->top + window->y;
+    if (std::all_of(pixels, pixels + count, [pixels](uint16_t pixel) { return pixel == pixels[0]; })) {
+        lcdQueueFill(menu->queue, x, y, width, window->lineCount, pixels[0]);
+        menu->stats.fills++;
+    } else {
+        lcdQueueBitmap(menu->queue, x, y, width, window->lineCount, pixels);
+        menu->stats.bitmaps++;
+    }
+    menu->stats.lines += window->lineCount;
+}
+
+void menuReset(Menu *menu) {
+    menu->rows.clear();
+    menu->drawn = false;
+    menu->stats = {};
+}
+
+void menuAddRows(Menu *menu, uint8_t const *rows, int rowCount) {
+    while (rowCount--) {
+        menu->rows.push_back(rows);
+        rows += Trs80ColumnCount;
+    }
+}
+
+void menuAddBlankRows(Menu *menu, int rowCount) {
+    while (rowCount--) {
+        menu->rows.push_back(BLANK_ROW.data());
+    }
+}
+
+int menuCenter(int row, int rowCount) {
+    int marginLines = Trs80RowCount - rowCount;
+    int topMarginLines = marginLines / 2;
+
+    return (row - topMarginLines)*DisplayGlyphHeight;
+}
+
+int menuStepScroll(int scroll, int targetScroll) {
+    return scroll < targetScroll ? std::min(scroll + MenuScrollLines, targetScroll)
+        : std::max(scroll - MenuScrollLines, targetScroll);
+}
+
+void menuDraw(Menu *menu, int scroll, int highlightBegin, int highlightCount) {
+    Window window = {};
+
+    for (int y = 0; y < MenuHeight; y++) {
+        Line line = getLine(menu, scroll + y, highlightBegin, highlightCount);
+
+        // Find the columns that look different from what was drawn here.
+        int begin = 0;
+        int end = Trs80ColumnCount;
+        if (menu->drawn) {
+            Line drawn = getLine(menu, menu->drawnScroll + y,
+                    menu->drawnHighlightBegin, menu->drawnHighlightCount);
+            while (begin < end && getFontBits(line, begin) == getFontBits(drawn, begin)) {
+                begin++;
+            }
+            while (end > begin && getFontBits(line, end - 1) == getFontBits(drawn, end - 1)) {
+                end--;
+            }
+        }
+
+        if (begin == end) {
+            drawWindow(menu, &window, scroll, highlightBegin, highlightCount);
+            window = {};
+            continue;
+        }
+
+        // Add it to the window unless that makes it too big.
+        if (window.lineCount > 0) {
+            int windowBegin = std::min(window.begin, begin);
+            int windowEnd = std::max(window.end, end);
+            if ((windowEnd - windowBegin)*DisplayGlyphWidth*(window.lineCount + 1) <= MAX_WINDOW_PIXELS) {
+                window.lineCount++;
+                window.begin = windowBegin;
+                window.end = windowEnd;
+                continue;
+            }
+            drawWindow(menu, &window, scroll, highlightBegin, highlightCount);
+        }
+        window = { y, 1, begin, end };
+    }
+    drawWindow(menu, &window, scroll, highlightBegin, highlightCount);
+    lcdQueueSubmit(menu->queue);
+
+    menu->drawn = true;
+    menu->drawnScroll = scroll;
+    menu->drawnHighlightBegin = highlightBegin;
+    menu->drawnHighlightCount = highlightCount;
+    menu->stats.frames++;
+}
+
+MenuStats menuGetStats(Menu const *menu) {
+    return menu->stats;
+}
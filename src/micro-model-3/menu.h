@@ -0,0 +1,85 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <vector>
+
+#include "trs80.h"
+#include "display.h"
+#include "lcdqueue.h"
+
+// Drawing the game menu on the LCD, scrolled to any line of pixels so that it
+// moves smoothly. The menu is a list of rows of characters, usually taller
+// than the screen, drawn in the screen's place with the same glyphs. Only the
+// lines of pixels that look different from what was drawn last are drawn
+// again, each run of them in one window. Most of the menu is block graphics,
+// whose lines repeat four at a time, so scrolling by a line only redraws the
+// lines where the blocks change.
+//
+// The LCD's own vertical scrolling (VSCRSADD) would be cheaper still, but it
+// moves the picture along the panel's long side, which is across the screen
+// the way the panel is turned here.
+
+// The character that blank rows are made of.
+constexpr uint8_t MenuBlankCharacter = 128;
+
+// Lines of pixels the menu scrolls each frame. Any more than one and most
+// lines change, since block graphics only change every four lines.
+constexpr int MenuScrollLines = 1;
+
+// Size of the menu on the LCD, in pixels.
+constexpr int MenuWidth = Trs80ColumnCount*DisplayGlyphWidth;
+constexpr int MenuHeight = Trs80RowCount*DisplayGlyphHeight;
+
+// What the menu has drawn since the last reset.
+struct MenuStats {
+    unsigned long frames;
+    // Lines of pixels drawn, and the windows and fills they took.
+    unsigned long lines;
+    unsigned long bitmaps;
+    unsigned long fills;
+};
+
+struct Menu {
+    // Where the menu's top-left corner is on the LCD.
+    int left;
+    int top;
+
+    // Where to send what's drawn.
+    LcdQueue *queue;
+
+    // Each row is Trs80ColumnCount characters.
+    std::vector<uint8_t const *> rows;
+
+    // What the LCD shows, if anything we know of: the scroll and the rows
+    // that were highlighted.
+    bool drawn;
+    int drawnScroll;
+    int drawnHighlightBegin;
+    int drawnHighlightCount;
+
+    MenuStats stats;
+};
+
+// Start over with no rows, and nothing known to be on the LCD. The position
+// and queue are kept.
+void menuReset(Menu *menu);
+
+// Add rows of characters, one after the other in memory.
+void menuAddRows(Menu *menu, uint8_t const *rows, int rowCount);
+
+// Add rows of blank characters.
+void menuAddBlankRows(Menu *menu, int rowCount);
+
+// The scroll, in lines of pixels, that puts these rows in the middle of the
+// screen.
+int menuCenter(int row, int rowCount);
+
+// The scroll for the next frame, on the way to the target.
+int menuStepScroll(int scroll, int targetScroll);
+
+// Draw the menu scrolled down this many lines of pixels (which must keep the
+// screen within the rows), with the rows from highlightBegin inverted.
+void menuDraw(Menu *menu, int scroll, int highlightBegin, int highlightCount);
+
+MenuStats menuGetStats(Menu const *menu);
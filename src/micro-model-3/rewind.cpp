@@ -0,0 +1,187 @@
+#include <chrono>
+#include <cstddef>
+#include <cstring>
+
+#include "rewind.h"
+#include "snapshot.h"
+
+// Each checkpoint in the ring is, in order:
+//
+//     its length (two bytes, little-endian),
+//     the fields of the checkpoint before it (the start of a Trs80Snapshot),
+//     for each page that changed after that: its number and its encoding,
+//     END_OF_PAGES,
+//     its length again, so we can find its start from the end.
+//
+// The ring wraps, so a checkpoint may be split between its end and start.
+constexpr uint8_t END_OF_PAGES = 0xFF;
+constexpr size_t FIELDS_SIZE = offsetof(Trs80Snapshot, ram);
+
+static_assert((MEMSIZE - ROMSIZE)/Trs80PageSize < END_OF_PAGES, "too many pages");
+
+static size_t wrap(RewindRing const *ring, size_t position) {
+    return position % ring->size;
+}
+
+static uint8_t peekByte(RewindRing const *ring, size_t position) {
+    return ring->buffer[wrap(ring, position)];
+}
+
+static size_t peekWord(RewindRing const *ring, size_t position) {
+    return peekByte(ring, position) | (peekByte(ring, position + 1) << 8);
+}
+
+// Copy bytes out of the ring.
+static void peekBytes(RewindRing const *ring, size_t position, uint8_t *data, size_t size) {
+    for (size_t i = 0; i < size; i++) {
+        data[i] = peekByte(ring, position + i);
+    }
+}
+
+// Forget the oldest checkpoint.
+static void dropOldest(RewindRing *ring) {
+    size_t start = wrap(ring, ring->head + ring->size - ring->used);
+    ring->used -= peekWord(ring, start);
+    ring->count--;
+}
+
+// Add bytes to the checkpoint being written, dropping old ones to make room.
+static void putBytes(RewindRing *ring, uint8_t const *data, size_t size) {
+    if (ring->overflow) {
+        return;
+    }
+
+    while (ring->size - ring->used < size) {
+        if (ring->count == 0) {
+            ring->overflow = true;
+            return;
+        }
+        dropOldest(ring);
+    }
+
+    for (size_t i = 0; i < size; i++) {
+        ring->buffer[ring->head] = data[i];
+        ring->head = wrap(ring, ring->head + 1);
+    }
+    ring->used += size;
+    ring->entryBytes += size;
+}
+
+static void putWord(RewindRing *ring, size_t value) {
+    uint8_t data[2] = { (uint8_t) value, (uint8_t) (value >> 8) };
+    putBytes(ring, data, sizeof(data));
+}
+
+// Record a page that changed since the previous checkpoint.
+static void recordPage(void *data, int page, uint8_t const *before, uint8_t const *after) {
+    RewindRing *ring = (RewindRing *) data;
+    uint8_t encoded[Trs80PageSize + 4];
+    size_t size = compressSnapshotPage(after, before, encoded, sizeof(encoded));
+    uint8_t number = page;
+
+    putBytes(ring, &number, 1);
+    putBytes(ring, encoded, size);
+}
+
+void rewindReset(RewindRing *ring, Trs80Machine *machine,
+        Trs80Snapshot *snapshot, uint8_t *buffer, size_t size) {
+
+    *ring = {};
+    ring->machine = machine;
+    ring->snapshot = snapshot;
+    ring->buffer = buffer;
+    ring->size = size;
+
+    // Also forgets the pages written so far.
+    trs80_saveSnapshot(machine, snapshot);
+    trs80_updateSnapshot(machine, snapshot, nullptr, nullptr);
+}
+
+void rewindTick(RewindRing *ring) {
+    ring->ticks++;
+    if (ring->ticks >= RewindCheckpointTicks) {
+        ring->ticks = 0;
+        rewindCapture(ring);
+    }
+}
+
+void rewindCapture(RewindRing *ring) {
+    auto startTime = std::chrono::steady_clock::now();
+
+    ring->entryStart = ring->head;
+    ring->entryBytes = 0;
+    ring->overflow = false;
+
+    putWord(ring, 0);
+    putBytes(ring, (uint8_t const *) ring->snapshot, FIELDS_SIZE);
+    trs80_updateSnapshot(ring->machine, ring->snapshot, recordPage, ring);
+    putBytes(ring, &END_OF_PAGES, 1);
+    putWord(ring, ring->entryBytes + 2);
+
+    if (ring->overflow) {
+        // Too big for the ring, so we can't go back past this checkpoint.
+        ring->head = 0;
+        ring->used = 0;
+        ring->count = 0;
+    } else {
+        ring->buffer[ring->entryStart] = ring->entryBytes;
+        ring->buffer[wrap(ring, ring->entryStart + 1)] = ring->entryBytes >> 8;
+        ring->count++;
+    }
+
+    auto endTime = std::chrono::steady_clock::now();
+    ring->stats.checkpoints++;
+    ring->stats.totalBytes += ring->entryBytes;
+    ring->stats.captureMicros += std::chrono::duration<double, std::micro>(endTime - startTime).count();
+}
+
+bool rewindStep(RewindRing *ring) {
+    if (ring->count == 0) {
+        return false;
+    }
+
+    size_t length = peekWord(ring, ring->head + ring->size - 2);
+    size_t start = wrap(ring, ring->head + ring->size - length);
+    size_t end = start + length - 3;
+    size_t position = start + 2;
+
+    // Go back to the previous checkpoint's fields, then undo each page.
+    peekBytes(ring, position, (uint8_t *) ring->snapshot, FIELDS_SIZE);
+    position += FIELDS_SIZE;
+    while (position < end) {
+        int page = peekByte(ring, position++);
+
+        uint8_t encoded[Trs80PageSize + 4];
+        size_t size = end - position < sizeof(encoded) ? end - position : sizeof(encoded);
+        peekBytes(ring, position, encoded, size);
+
+        uint8_t *p = &ring->snapshot->ram[page*Trs80PageSize];
+        size_t used = decompressSnapshotPage(encoded, size, p, p);
+        if (used == 0) {
+            break;
+        }
+        position += used;
+    }
+
+    ring->head = start;
+    ring->used -= length;
+    ring->count--;
+
+    return trs80_restoreSnapshot(ring->machine, ring->snapshot);
+}
+
+RewindStats rewindGetStats(RewindRing const *ring) {
+    RewindStats stats = ring->stats;
+
+    stats.available = ring->count;
+    stats.usedBytes = ring->used;
+    if (ring->count > 0) {
+        // The oldest checkpoint's fields are those of the one before it.
+        clk_t clock;
+        size_t start = wrap(ring, ring->head + ring->size - ring->used);
+        peekBytes(ring, start + 2 + offsetof(Trs80Snapshot, clock), (uint8_t *) &clock, sizeof(clock));
+        stats.history = ring->snapshot->clock - clock;
+    }
+
+    return stats;
+}
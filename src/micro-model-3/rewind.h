@@ -0,0 +1,74 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "trs80.h"
+
+// Rewinding a game through recent checkpoints. The latest checkpoint is kept
+// in full in a snapshot, which trs80_updateSnapshot() keeps current by only
+// copying the pages written since. Each earlier checkpoint is stored in a
+// ring as the rest of its state and the pages that changed after it, encoded
+// as in snapshot.h, so taking one costs about what the game wrote. When the
+// ring is full the oldest checkpoints are dropped.
+
+// Timer ticks (see Trs80TimerHz) between checkpoints.
+constexpr int RewindCheckpointTicks = 6;
+
+// How the rewind ring has done since the last reset.
+struct RewindStats {
+    // Checkpoints taken, and how many can still be rewound to.
+    unsigned long checkpoints;
+    int available;
+    // Bytes of all checkpoints taken, and bytes in the ring now.
+    unsigned long long totalBytes;
+    size_t usedBytes;
+    // Emulated cycles between the oldest checkpoint and the latest.
+    clk_t history;
+    // Time spent taking checkpoints.
+    double captureMicros;
+};
+
+// A machine's checkpoints.
+struct RewindRing {
+    Trs80Machine *machine;
+
+    // The latest checkpoint.
+    Trs80Snapshot *snapshot;
+
+    // The ring of earlier checkpoints. The next byte goes at head, and the
+    // oldest checkpoint starts used bytes before that.
+    uint8_t *buffer;
+    size_t size;
+    size_t head;
+    size_t used;
+    // Number of whole checkpoints in the ring.
+    int count;
+
+    // Checkpoint being written, and whether it ran out of room.
+    size_t entryStart;
+    size_t entryBytes;
+    bool overflow;
+
+    int ticks;
+    RewindStats stats;
+};
+
+// Start over from the machine's current state. The snapshot and buffer are
+// used until the next reset; the size of the buffer sets how far back we can
+// go.
+void rewindReset(RewindRing *ring, Trs80Machine *machine,
+        Trs80Snapshot *snapshot, uint8_t *buffer, size_t size);
+
+// Count a timer tick, and take a checkpoint every RewindCheckpointTicks.
+// Meant to be called from the trs80 timer callback.
+void rewindTick(RewindRing *ring);
+
+// Take a checkpoint now.
+void rewindCapture(RewindRing *ring);
+
+// Put the machine back to the checkpoint before the latest one, which
+// becomes the latest. Returns false if there's no earlier checkpoint.
+bool rewindStep(RewindRing *ring);
+
+RewindStats rewindGetStats(RewindRing const *ring);
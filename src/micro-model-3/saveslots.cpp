@@ -0,0 +1,87 @@
+#include <cstring>
+
+#include "pico/stdlib.h"
+#include "hardware/flash.h"
+#include "hardware/sync.h"
+
+#include "saveslots.h"
+
+// Identifies a written slot, "M3SL".
+constexpr uint32_t SAVE_SLOT_MAGIC = 0x4C53334D;
+
+// At the start of each slot.
+struct SaveSlotHeader {
+    uint32_t magic;
+    uint32_t size;
+};
+
+static_assert(SAVE_SLOT_SIZE % FLASH_SECTOR_SIZE == 0, "slots must be whole sectors");
+
+// The flash the linker left for the slots (see flash.ld), and the end of the
+// program.
+extern "C" uint8_t __save_slots_start[];
+extern "C" uint8_t __save_slots_end[];
+extern "C" uint8_t __flash_binary_end[];
+
+// Offset of the slot from the start of flash.
+static uint32_t slotOffset(int slot) {
+    return (uint32_t) ((uintptr_t) __save_slots_start - XIP_BASE) + slot*SAVE_SLOT_SIZE;
+}
+
+bool saveSlotsReserved() {
+    uintptr_t begin = (uintptr_t) __save_slots_start;
+    uintptr_t end = (uintptr_t) __save_slots_end;
+
+    return end - begin == SAVE_SLOT_COUNT*SAVE_SLOT_SIZE &&
+        (uintptr_t) __flash_binary_end <= begin &&
+        (begin - XIP_BASE) % FLASH_SECTOR_SIZE == 0;
+}
+
+size_t saveSlotCapacity() {
+    return SAVE_SLOT_SIZE - sizeof(SaveSlotHeader);
+}
+
+bool writeSaveSlot(int slot, uint8_t const *data, size_t size) {
+    if (slot < 0 || slot >= SAVE_SLOT_COUNT || size > saveSlotCapacity() || !saveSlotsReserved()) {
+        return false;
+    }
+
+    uint32_t offset = slotOffset(slot);
+    SaveSlotHeader header = { SAVE_SLOT_MAGIC, (uint32_t) size };
+    size_t total = sizeof(header) + size;
+
+    // Flash is programmed a page at a time, from RAM.
+    uint8_t page[FLASH_PAGE_SIZE];
+
+    uint32_t interrupts = save_and_disable_interrupts();
+    flash_range_erase(offset, SAVE_SLOT_SIZE);
+    for (size_t pageBegin = 0; pageBegin < total; pageBegin += FLASH_PAGE_SIZE) {
+        memset(page, 0xFF, sizeof(page));
+        for (size_t i = 0; i < FLASH_PAGE_SIZE && pageBegin + i < total; i++) {
+            size_t position = pageBegin + i;
+            page[i] = position < sizeof(header)
+                ? ((uint8_t const *) &header)[position]
+                : data[position - sizeof(header)];
+        }
+        flash_range_program(offset + pageBegin, page, FLASH_PAGE_SIZE);
+    }
+    restore_interrupts(interrupts);
+
+    return true;
+}
+
+uint8_t const *readSaveSlot(int slot, size_t *size) {
+    if (slot < 0 || slot >= SAVE_SLOT_COUNT || !saveSlotsReserved()) {
+        return nullptr;
+    }
+
+    uint8_t const *p = (uint8_t const *) (XIP_BASE + slotOffset(slot));
+    SaveSlotHeader header;
+    memcpy(&header, p, sizeof(header));
+    if (header.magic != SAVE_SLOT_MAGIC || header.size > saveSlotCapacity()) {
+        return nullptr;
+    }
+
+    *size = header.size;
+    return p + sizeof(header);
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Saved games, kept in the last sectors of flash so they survive power
+// cycles. There's one slot per game. The linker reserves the space for them
+// (see flash.ld).
+constexpr int SAVE_SLOT_COUNT = 8;
+constexpr size_t SAVE_SLOT_SIZE = 16*1024;
+
+// Whether the space the linker reserved matches the slots and comes after
+// the program. If not, nothing is read or written.
+bool saveSlotsReserved();
+
+// Largest amount of data a slot can hold.
+size_t saveSlotCapacity();
+
+// Replace the contents of the slot. Returns false if the data doesn't fit.
+// Interrupts are off while flash is written, so only call this when the
+// emulator isn't running.
+bool writeSaveSlot(int slot, uint8_t const *data, size_t size);
+
+// Get the contents of the slot, or null if nothing was saved there.
+uint8_t const *readSaveSlot(int slot, size_t *size);
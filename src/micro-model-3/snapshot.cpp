@@ -0,0 +1,250 @@
+#include <cstring>
+
+#include "snapshot.h"
+
+// Identifies our encoding, "M3S2". The first one ("M3SS") copied the fields
+// as laid out in memory, padding and all.
+constexpr uint32_t SNAPSHOT_MAGIC = 0x3253334D;
+
+// Magic number and checksum of the baseline, before the snapshot's fields.
+constexpr size_t SNAPSHOT_HEADER_SIZE = 8;
+
+// Pages of RAM, after the ROM.
+constexpr int RAM_PAGE_COUNT = (MEMSIZE - ROMSIZE)/Trs80PageSize;
+
+// Control bytes of a page's encoding. The low seven bits are one less than
+// the number of bytes in the run.
+constexpr uint8_t RUN_LITERAL = 0x00;
+constexpr uint8_t RUN_UNCHANGED = 0x80;
+constexpr int RUN_MAX_LENGTH = 128;
+
+static uint8_t const ZERO_PAGE[Trs80PageSize] = {};
+
+static void writeWord(uint8_t *p, uint32_t value) {
+    p[0] = value;
+    p[1] = value >> 8;
+    p[2] = value >> 16;
+    p[3] = value >> 24;
+}
+
+static uint32_t readWord(uint8_t const *p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+// Write a field in little-endian order, advancing the pointer.
+template <typename T>
+static void writeField(uint8_t *&p, T value) {
+    for (size_t i = 0; i < sizeof(T); i++) {
+        *p++ = (uint64_t) value >> (8*i);
+    }
+}
+
+template <typename T>
+static void readField(uint8_t const *&p, T &value) {
+    uint64_t v = 0;
+    for (size_t i = 0; i < sizeof(T); i++) {
+        v |= (uint64_t) *p++ << (8*i);
+    }
+    value = (T) v;
+}
+
+// Call the function with each of the snapshot's fields other than RAM, in
+// the order they're encoded. They're encoded one at a time, rather than as
+// the struct is laid out, so that no padding gets saved.
+template <typename Snapshot, typename Function>
+static void forEachField(Snapshot *snapshot, Function function) {
+    function(snapshot->version);
+    function(snapshot->clock);
+    function(snapshot->timerClock);
+    function(snapshot->status);
+    for (auto &value : snapshot->registers) {
+        function(value);
+    }
+    for (auto &value : snapshot->alternates) {
+        function(value);
+    }
+    function(snapshot->pc);
+    function(snapshot->i);
+    function(snapshot->r);
+    function(snapshot->iff1);
+    function(snapshot->iff2);
+    function(snapshot->im);
+    function(snapshot->irqMask);
+    function(snapshot->irqLatch);
+    function(snapshot->nmiMask);
+    function(snapshot->nmiLatch);
+    function(snapshot->nmiSeen);
+    function(snapshot->modeImage);
+    for (auto &value : snapshot->keys) {
+        function(value);
+    }
+    function(snapshot->shiftForce);
+    function(snapshot->leftShiftPressed);
+    function(snapshot->rightShiftPressed);
+    function(snapshot->keyProcessMinClock);
+    function(snapshot->joystick);
+}
+
+// Bytes of the encoded fields, which is no more than offsetof(Trs80Snapshot,
+// ram) since they're packed. Only the types of the snapshot's fields matter.
+static size_t fieldsSize(Trs80Snapshot const *snapshot) {
+    size_t size = 0;
+
+    forEachField(snapshot, [&size](auto const &value) { size += sizeof(value); });
+
+    return size;
+}
+
+// The baseline's page, or zeros if there's no baseline.
+static uint8_t const *baselinePage(Trs80Snapshot const *baseline, int page) {
+    return baseline == nullptr ? ZERO_PAGE : &baseline->ram[page*Trs80PageSize];
+}
+
+// FNV-1a hash of the baseline's RAM, so that we don't decode against the
+// wrong one.
+static uint32_t baselineChecksum(Trs80Snapshot const *baseline) {
+    uint32_t hash = 2166136261u;
+
+    for (int page = 0; page < RAM_PAGE_COUNT; page++) {
+        uint8_t const *p = baselinePage(baseline, page);
+        for (int i = 0; i < Trs80PageSize; i++) {
+            hash = (hash ^ p[i])*16777619u;
+        }
+    }
+
+    return hash;
+}
+
+size_t compressSnapshotPage(uint8_t const *page, uint8_t const *base, uint8_t *buffer, size_t size) {
+    size_t n = 0;
+    int i = 0;
+
+    while (i < Trs80PageSize) {
+        int begin = i;
+
+        if (page[i] == base[i]) {
+            while (i < Trs80PageSize && i - begin < RUN_MAX_LENGTH && page[i] == base[i]) {
+                i++;
+            }
+            if (n + 1 > size) {
+                return 0;
+            }
+            buffer[n++] = RUN_UNCHANGED | (i - begin - 1);
+        } else {
+            // Take single unchanged bytes along, but stop at two in a row.
+            while (i < Trs80PageSize && i - begin < RUN_MAX_LENGTH &&
+                    (page[i] != base[i] || (i + 1 < Trs80PageSize && page[i + 1] != base[i + 1]))) {
+                i++;
+            }
+            if (n + 1 + (i - begin) > size) {
+                return 0;
+            }
+            buffer[n++] = RUN_LITERAL | (i - begin - 1);
+            for (int j = begin; j < i; j++) {
+                buffer[n++] = page[j] ^ base[j];
+            }
+        }
+    }
+
+    return n;
+}
+
+size_t decompressSnapshotPage(uint8_t const *buffer, size_t size, uint8_t const *base, uint8_t *page) {
+    size_t n = 0;
+    int i = 0;
+
+    while (i < Trs80PageSize) {
+        if (n >= size) {
+            return 0;
+        }
+        uint8_t control = buffer[n++];
+        int length = (control & ~RUN_UNCHANGED) + 1;
+        if (i + length > Trs80PageSize) {
+            return 0;
+        }
+
+        if ((control & RUN_UNCHANGED) != 0) {
+            if (page != base) {
+                memcpy(&page[i], &base[i], length);
+            }
+        } else {
+            if (n + length > size) {
+                return 0;
+            }
+            for (int j = 0; j < length; j++) {
+                page[i + j] = base[i + j] ^ buffer[n++];
+            }
+        }
+        i += length;
+    }
+
+    return n;
+}
+
+size_t compressSnapshot(Trs80Snapshot const *snapshot, Trs80Snapshot const *baseline,
+        uint8_t *buffer, size_t size) {
+
+    size_t bitmapSize = RAM_PAGE_COUNT/8;
+    size_t n = SNAPSHOT_HEADER_SIZE + fieldsSize(snapshot) + bitmapSize;
+    if (n > size) {
+        return 0;
+    }
+
+    writeWord(&buffer[0], SNAPSHOT_MAGIC);
+    writeWord(&buffer[4], baselineChecksum(baseline));
+    uint8_t *p = &buffer[SNAPSHOT_HEADER_SIZE];
+    forEachField(snapshot, [&p](auto value) { writeField(p, value); });
+
+    // One bit per page that changed, followed by the changed pages.
+    uint8_t *bitmap = p;
+    memset(bitmap, 0, bitmapSize);
+    for (int page = 0; page < RAM_PAGE_COUNT; page++) {
+        uint8_t const *p = &snapshot->ram[page*Trs80PageSize];
+        uint8_t const *base = baselinePage(baseline, page);
+
+        if (memcmp(p, base, Trs80PageSize) != 0) {
+            size_t pageSize = compressSnapshotPage(p, base, &buffer[n], size - n);
+            if (pageSize == 0) {
+                return 0;
+            }
+            bitmap[page/8] |= 1 << (page % 8);
+            n += pageSize;
+        }
+    }
+
+    return n;
+}
+
+bool decompressSnapshot(uint8_t const *buffer, size_t size, Trs80Snapshot const *baseline,
+        Trs80Snapshot *snapshot) {
+
+    size_t bitmapSize = RAM_PAGE_COUNT/8;
+    size_t n = SNAPSHOT_HEADER_SIZE + fieldsSize(snapshot) + bitmapSize;
+    if (n > size ||
+            readWord(&buffer[0]) != SNAPSHOT_MAGIC ||
+            readWord(&buffer[4]) != baselineChecksum(baseline)) {
+
+        return false;
+    }
+
+    uint8_t const *p = &buffer[SNAPSHOT_HEADER_SIZE];
+    forEachField(snapshot, [&p](auto &value) { readField(p, value); });
+
+    uint8_t const *bitmap = p;
+    for (int page = 0; page < RAM_PAGE_COUNT; page++) {
+        uint8_t *p = &snapshot->ram[page*Trs80PageSize];
+        uint8_t const *base = baselinePage(baseline, page);
+
+        if ((bitmap[page/8] & (1 << (page % 8))) != 0) {
+            size_t pageSize = decompressSnapshotPage(&buffer[n], size - n, base, p);
+            if (pageSize == 0) {
+                return false;
+            }
+            n += pageSize;
+        } else {
+            memcpy(p, base, Trs80PageSize);
+        }
+    }
+
+    return n == size;
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "trs80.h"
+
+// Compact encoding of a Trs80Snapshot, for saving the state of a game. The
+// snapshot's RAM is stored as its differences from a baseline snapshot,
+// normally the one the game was started from: pages that didn't change are
+// left out, and each changed page is run-length encoded as its exclusive-or
+// with the baseline, so the bytes that stayed the same become runs of zeros.
+
+// Room for the encoding even if every page of RAM changed: a header, the
+// snapshot's other fields, a bitmap of changed pages, and a few control bytes
+// per page.
+constexpr size_t Trs80CompressedSnapshotMaxSize = 8 + offsetof(Trs80Snapshot, ram) +
+    (MEMSIZE - ROMSIZE)/Trs80PageSize/8 + (MEMSIZE - ROMSIZE)/Trs80PageSize*(Trs80PageSize + 4);
+
+// Encode the snapshot as its differences from the baseline, which may be
+// null to compare against zeros. Returns the number of bytes written to the
+// buffer, or zero if they didn't fit.
+size_t compressSnapshot(Trs80Snapshot const *snapshot, Trs80Snapshot const *baseline,
+        uint8_t *buffer, size_t size);
+
+// Decode a snapshot encoded by compressSnapshot() against the same baseline.
+// Returns false if the data is corrupt or was made against another baseline.
+bool decompressSnapshot(uint8_t const *buffer, size_t size, Trs80Snapshot const *baseline,
+        Trs80Snapshot *snapshot);
+
+// Encode the differences between a page of RAM and the same page of the
+// baseline, as done for each changed page above. Returns the number of bytes
+// written, or zero if they didn't fit. Trs80PageSize + 4 bytes is always
+// enough.
+size_t compressSnapshotPage(uint8_t const *page, uint8_t const *base, uint8_t *buffer, size_t size);
+
+// Decode a page encoded by compressSnapshotPage() against the same base, which
+// may be the page itself. Returns the number of bytes read, or zero if they're
+// corrupt.
+size_t decompressSnapshotPage(uint8_t const *buffer, size_t size, uint8_t const *base, uint8_t *page);
@@ -1,26 +1,23 @@
 #include <stdio.h>
+#include <algorithm>
 #include <cstring>
 #include <chrono>
 #include <map>
 #include <deque>
+#include <new>
 #include <vector>
 #include "fonts.h"
-#include "z80user.h"
 #include "z80emu.h"
+#include "z80block.h"
 #include "model3_rom.h"
 #include "trs80.h"
-#include "main.h"
+#include "logging.h"
 
 /**
  * Emulator for a TRS-80 Model III. Based on the TypeScript version available here:
  * https://github.com/lkesteloot/trs80/tree/master/packages/trs80-emulator
  */
 
-typedef long long clk_t;
-
-constexpr clk_t Trs80ClockHz = 2027520;
-constexpr clk_t Trs80TimerHz = 30;
-
 // Handle keyboard mapping. The TRS-80 Model III keyboard has keys in different
 // places, so we must occasionally fake a Shift key being up or down when it's
 // really not.
@@ -34,6 +31,13 @@ constexpr int Trs80KeyboardBankCount = 4;
 constexpr int Trs80KeyboardBegin = 0x3800;
 constexpr int Trs80KeyboardEnd = Trs80KeyboardBegin + Trs80KeyboardBankSize*Trs80KeyboardBankCount;
 constexpr int Trs80KeyboardThrottleCycles = 50000;
+// How far behind real time we can fall before we give up catching up.
+constexpr clk_t Trs80MaxLagCycles = Trs80ClockHz/4;
+
+// .CMD chunk types.
+#define CMD_LOAD_BLOCK 0x01
+#define CMD_TRANSFER_ADDRESS 0x02
+#define CMD_LOAD_MODULE_HEADER 0x05
 
 // Use these two for the byteIndex field of the KeyInfo:
 // Use the unshifted data when shifted.
@@ -67,16 +71,58 @@ struct KeyEvent {
     KeyEvent(int key, bool isPress) : key(key), isPress(isPress) {}
 };
 
+// Everything that happens at a given clock rather than when the Z80 does
+// something goes through one schedule, and the Z80 is run from one to the
+// next, so each happens on its cycle.
+enum EventKind {
+    // The 30 Hz timer interrupt.
+    EVENT_TIMER,
+    // The keyboard can take the next queued key (see readKeyboard()).
+    EVENT_KEYBOARD,
+    // Time to call the poll callback.
+    EVENT_POLL,
+    // A callback from queueEvent().
+    EVENT_CALLBACK,
+};
+
+// Cycles between timer interrupts, and between calls to the poll callback,
+// which is also the longest the Z80 runs without coming back to the loop.
+// Polls fall on timer ticks too, so they don't split the slices between them.
+constexpr clk_t Trs80TimerCycles = Trs80ClockHz / Trs80TimerHz;
+constexpr clk_t Trs80PollCycles = Trs80TimerCycles / 6;
+
 struct QueuedEvent {
     clk_t clock;
-    void (*callback)(int data);
+    // Order it was scheduled in, for events on the same clock.
+    unsigned long sequence;
+    EventKind kind;
+    void (*callback)(Trs80Machine *machine, int data);
     int data;
-
-    QueuedEvent(clk_t clock, void (*callback)(int data), int data) :
-        clock(clock), callback(callback), data(data) {}
 };
 
-static std::vector<QueuedEvent> gQueuedEvents;
+// How a machine is hooked up to the hardware we're running on, which is kept
+// when it's reset. Any callback may be null.
+struct Trs80Settings {
+    void (*screenCallback)(Trs80Machine *machine, int position, uint8_t ch);
+    void (*screenRangeCallback)(Trs80Machine *machine, int begin, int end);
+    void (*pollCallback)(Trs80Machine *machine);
+    void (*timerCallback)(Trs80Machine *machine);
+    void (*sleepCallback)(Trs80Machine *machine, uint32_t micros);
+    void *userData;
+
+    // Whether to slow the emulator down to the speed of the real machine.
+    bool throttle = true;
+
+    // Timer ticks to run ahead, and where to keep the machine meanwhile (see
+    // trs80_setRunAhead()).
+    int runAheadFrames;
+    Trs80Snapshot *runAheadSnapshot;
+
+    // Room for the pages of RAM the machine copies on write, and how many
+    // pages it holds (see trs80_newMachine()).
+    uint8_t *pagePool;
+    int pagePoolSize;
+};
 
 // IRQs
 // constexpr uint8_t M1_TIMER_IRQ_MASK = 0x80;
@@ -94,11 +140,72 @@ constexpr uint8_t RESET_NMI_MASK = 0x20;
 // constexpr uint8_t DISK_MOTOR_OFF_NMI_MASK = 0x40;
 // constexpr uint8_t DISK_INTRQ_NMI_MASK = 0x80;
 
+// Bits of Trs80Bus::dirtyPages, one for each copy of RAM kept up to date
+// from it. Writes set them all.
+constexpr uint8_t DIRTY_SNAPSHOT = 0x01;
+constexpr uint8_t DIRTY_RUN_AHEAD = 0x02;
+constexpr uint8_t DIRTY_ALL = 0xFF;
+
+// Print every memory and I/O access by the Z80.
+#define TRS80_DEBUG 0
+
+// What the Z80 sees of the machine. This is the Bus the Z80 core is
+// instantiated with (see z80user.h), and its functions are inlined into the
+// interpreter loop. Plain RAM and ROM accesses are a page table lookup and a
+// load; pages with a null pointer are memory-mapped I/O (or, for writes, ROM
+// or a page that's still shared) and go through Trs80ReadByte() and
+// Trs80WriteByte().
+struct Trs80Bus {
+    // Where each page of memory is. Code is never executed from
+    // memory-mapped I/O, so opcode fetches read straight from here.
+    uint8_t const *pages[Trs80PageCount];
+
+    // Where to read and write each page, or null for memory-mapped I/O.
+    uint8_t const *readPages[Trs80PageCount];
+    uint8_t *writePages[Trs80PageCount];
+
+    // For each page, the DIRTY_* bits of the copies it was written since.
+    uint8_t dirtyPages[Trs80PageCount];
+
+    Trs80Machine *machine;
+
+    uint8_t peekByte(uint16_t address) const;
+    uint8_t fetchByte(uint16_t address);
+    uint8_t readByte(uint16_t address);
+    void writeByte(uint16_t address, uint8_t value);
+    uint8_t readPort(uint8_t port);
+    void writePort(uint8_t port, uint8_t value);
+    int moveBytes(uint16_t destination, uint16_t source, int count, int step);
+    int scanBytes(uint16_t address, int count, int step, uint8_t value);
+    bool interruptPending() const;
+};
+
 // Holds the state of the physical machine.
-typedef struct Trs80Machine {
+struct Trs80Machine {
+    Trs80Settings settings;
+
     clk_t clock;
+    // When the last timer interrupt went off.
+    clk_t timerClock;
     Z80_STATE z80;
-    uint8_t memory[MEMSIZE];
+    // Memory is copied on write. Until the machine writes to a page, it reads
+    // it from the ROM, a snapshot shared with other machines (see
+    // trs80_shareSnapshot()), or a page of zeros.
+    uint8_t const *sharedPages[Trs80PageCount];
+    // The machine's own copy of each page it has written, or null. The
+    // screen is always its own, and kept in one piece for the callbacks.
+    uint8_t *ownPages[Trs80PageCount];
+    uint8_t screen[Trs80ScreenSize];
+    // Pages of the settings' page pool handed out so far, in order, and
+    // whether a write found it empty.
+    int pagePoolUsed;
+    bool outOfPages;
+    // Page map of memory as seen by the Z80. This is the emulator's context.
+    Trs80Bus bus;
+#ifdef Z80_USE_BLOCK_CACHE
+    // Predecoded Z80 code.
+    Z80_BLOCK_CACHE blocks;
+#endif
 
     // 8 bytes, each a bitfield of keys currently pressed.
     uint8_t keys[8];
@@ -111,6 +218,9 @@ typedef struct Trs80Machine {
     // We queue up key events so that we don't overwhelm the ROM polling
     // routines.
     std::deque<KeyEvent> keyQueue;
+    // Events to handle, a min-heap on clock (see laterEvent()).
+    std::vector<QueuedEvent> events;
+    unsigned long eventSequence;
     // See JOYSTICK_*_MASK:
     uint8_t joystick{};
 
@@ -127,16 +237,47 @@ typedef struct Trs80Machine {
     // Latch that mostly does nothing.
     uint8_t modeImage;
 
+    // Cycles skipped in idle loops (see runZ80()).
+    clk_t idleClock;
+    // Slices to wait before looking for an idle loop again, and how many to
+    // wait after the next miss.
+    int idleProbeCountdown;
+    int idleProbeDelay;
+
+    // Whether the clock was changed by restoring a snapshot, so throttling
+    // must start over from it.
+    bool clockReset;
+
+    // When running ahead, the screen as the callbacks were last told it was.
+    uint8_t shownScreen[Trs80ScreenSize];
+    Trs80RunAheadStats runAheadStats;
+
+    Trs80PacingStats pacingStats;
+
+    // Records to print when there's time.
+    LogRing log;
+
     // Whether we should exit the loop.
     bool exit;
-} Trs80Machine;
+};
+
+#ifdef TRS80_MACHINE_BUDGET
+static_assert(sizeof(Trs80Machine) <= Trs80MachineBudget,
+        "machine doesn't fit in its budget");
+#endif
+
+// What RAM reads as after a reset, shared by all machines.
+static const uint8_t ZERO_PAGE[Trs80PageSize] = {};
 
-static Trs80Machine gMachine;
+static bool isScreenPage(int page) {
+    int address = page << Trs80PageShift;
+    return address >= Trs80ScreenBegin && address < Trs80ScreenEnd;
+}
 
 // Generate the map from Rosa's keycap enum to the TRS-80's memory-mapped
 // keyboard bytes.
-static void initializeKeyboardMap() {
-    auto &m = gMachine.keyMap;
+static void initializeKeyboardMap(Trs80Machine *machine) {
+    auto &m = machine->keyMap;
 
     m['0'] = { 4, 0, ST_NEUTRAL, 5, 1, ST_FORCE_DOWN };
     m['1'] = { 4, 1 };
@@ -206,47 +347,157 @@ static void initializeKeyboardMap() {
     */
 }
 
+// Heap order for QueuedEvent, so that the earliest is at the front.
+static bool laterEvent(QueuedEvent const &a, QueuedEvent const &b) {
+    return a.clock != b.clock ? a.clock > b.clock : a.sequence > b.sequence;
+}
+
+static void scheduleEvent(Trs80Machine *machine, clk_t clock, EventKind kind,
+        void (*callback)(Trs80Machine *machine, int data) = nullptr, int data = 0) {
+
+    machine->events.push_back({ clock, machine->eventSequence++, kind, callback, data });
+    std::push_heap(machine->events.begin(), machine->events.end(), laterEvent);
+}
+
+static QueuedEvent popEvent(Trs80Machine *machine) {
+    std::pop_heap(machine->events.begin(), machine->events.end(), laterEvent);
+    QueuedEvent event = machine->events.back();
+    machine->events.pop_back();
+
+    return event;
+}
+
+// Schedule the machine's own events again from its clocks, after they were
+// set by a reset or restoring a snapshot. Queued callbacks are kept.
+static void scheduleMachineEvents(Trs80Machine *machine) {
+    std::vector<QueuedEvent> &events = machine->events;
+
+    events.erase(std::remove_if(events.begin(), events.end(), [](QueuedEvent const &event) {
+        return event.kind != EVENT_CALLBACK;
+    }), events.end());
+    std::make_heap(events.begin(), events.end(), laterEvent);
+
+    scheduleEvent(machine, machine->timerClock + Trs80TimerCycles, EVENT_TIMER);
+    clk_t sinceTimer = machine->clock - machine->timerClock;
+    scheduleEvent(machine, machine->clock + Trs80PollCycles - sinceTimer % Trs80PollCycles, EVENT_POLL);
+    if (!machine->keyQueue.empty()) {
+        scheduleEvent(machine, machine->keyProcessMinClock + 1, EVENT_KEYBOARD);
+    }
+}
+
+// Update the page map for a page after it was shared from elsewhere or
+// copied. ROM pages can be read directly but not written; keyboard pages
+// are memory-mapped I/O for reading; video pages are memory-mapped I/O for
+// writing so we can update the screen; shared pages are copied on the first
+// write.
+static void mapPage(Trs80Machine *machine, int page) {
+    Trs80Bus &bus = machine->bus;
+    int address = page << Trs80PageShift;
+    uint8_t *own = machine->ownPages[page];
+
+    bool isKeyboard = address >= Trs80KeyboardBegin && address < Trs80KeyboardEnd;
+    bool isRom = address < ROMSIZE;
+
+    bus.pages[page] = own != nullptr ? own : machine->sharedPages[page];
+    bus.readPages[page] = isKeyboard ? nullptr : bus.pages[page];
+    bus.writePages[page] = isRom || isScreenPage(page) ? nullptr : own;
+}
+
+// Build the page map of memory, with the ROM and zeros for RAM.
+static void initializeMemoryMap(Trs80Machine *machine) {
+    machine->bus.machine = machine;
+
+    for (int page = 0; page < Trs80PageCount; page++) {
+        int address = page << Trs80PageShift;
+
+        machine->sharedPages[page] = address < ROMSIZE ? &MODEL3_ROM[address] : ZERO_PAGE;
+        if (isScreenPage(page)) {
+            machine->ownPages[page] = &machine->screen[address - Trs80ScreenBegin];
+        }
+        mapPage(machine, page);
+    }
+}
+
+// Make the RAM page the machine's own so it can be written, copying it from
+// where it was shared into the next page of the pool. If the pool is used
+// up, stops the machine and returns null, and the write is lost.
+static uint8_t *ownPage(Trs80Machine *machine, int page) {
+    uint8_t *own = machine->ownPages[page];
+
+    if (own == nullptr) {
+        Trs80Settings const &settings = machine->settings;
+        if (machine->pagePoolUsed == settings.pagePoolSize) {
+            if (!machine->outOfPages) {
+                TRS80_LOG_ERROR(&machine->log, "Out of pages of RAM (%d), stopping\n", settings.pagePoolSize);
+                machine->outOfPages = true;
+            }
+            machine->exit = true;
+            return nullptr;
+        }
+
+        own = &settings.pagePool[machine->pagePoolUsed*Trs80PageSize];
+        machine->pagePoolUsed++;
+        memcpy(own, machine->sharedPages[page], Trs80PageSize);
+        machine->ownPages[page] = own;
+        mapPage(machine, page);
+    }
+
+    return own;
+}
+
+// Go back to reading the page from the given shared data, dropping the
+// machine's copy. The screen stays its own, so the data is copied there.
+static void sharePage(Trs80Machine *machine, int page, uint8_t const *data) {
+    if (isScreenPage(page)) {
+        memcpy(machine->ownPages[page], data, Trs80PageSize);
+    } else {
+        machine->ownPages[page] = nullptr;
+        machine->sharedPages[page] = data;
+        mapPage(machine, page);
+    }
+}
+
 // Release all keys.
-static void clearKeyboard() {
-    memset(gMachine.keys, 0, sizeof(gMachine.keys));
-    gMachine.shiftForce = ST_NEUTRAL;
-    gMachine.leftShiftPressed = false;
-    gMachine.rightShiftPressed = false;
-    gMachine.keyProcessMinClock = 0;
+static void clearKeyboard(Trs80Machine *machine) {
+    memset(machine->keys, 0, sizeof(machine->keys));
+    machine->shiftForce = ST_NEUTRAL;
+    machine->leftShiftPressed = false;
+    machine->rightShiftPressed = false;
+    machine->keyProcessMinClock = 0;
 }
 
 // Process the next queued key event, if available. Returns whether a key was
 // dequeued.
-static bool processKeyQueue() {
-    if (gMachine.keyQueue.empty()) {
+static bool processKeyQueue(Trs80Machine *machine) {
+    if (machine->keyQueue.empty()) {
         return false;
     }
 
-    KeyEvent const &keyEvent = gMachine.keyQueue.front();
-    gMachine.keyQueue.pop_front();
+    KeyEvent const &keyEvent = machine->keyQueue.front();
+    machine->keyQueue.pop_front();
     int key = keyEvent.key;
     bool isPress = keyEvent.isPress;
 
     // Remember shift state.
     /*
     if (key == KEYCAP_LEFTSHIFT) {
-        gMachine.leftShiftPressed = isPress;
+        machine->leftShiftPressed = isPress;
     }
     if (key == KEYCAP_RIGHTSHIFT) {
-        gMachine.rightShiftPressed = isPress;
+        machine->rightShiftPressed = isPress;
     }
     */
 
     // Find the info for this keycap.
-    auto itr = gMachine.keyMap.find(key);
-    if (itr != gMachine.keyMap.end()) {
+    auto itr = machine->keyMap.find(key);
+    if (itr != machine->keyMap.end()) {
         KeyInfo &keyInfo = itr->second;
 
         // Remember shifted state for the release, in case the user releases
         // Shift before releasing the key.
         bool shiftPressed;
         if (isPress) {
-            shiftPressed = gMachine.leftShiftPressed || gMachine.rightShiftPressed;
+            shiftPressed = machine->leftShiftPressed || machine->rightShiftPressed;
             keyInfo.shiftPressed = shiftPressed;
         } else {
             shiftPressed = keyInfo.shiftPressed;
@@ -264,14 +515,14 @@ static bool processKeyQueue() {
 
         if (byteIndex != KEYBOARD_IGNORE) {
             // Update the keyboard matrix bit.
-            gMachine.shiftForce = useShiftedData
+            machine->shiftForce = useShiftedData
                 ? keyInfo.shiftedShiftForce
                 : keyInfo.shiftForce;
             uint8_t bit = 1 << bitNumber;
             if (isPress) {
-                gMachine.keys[byteIndex] |= bit;
+                machine->keys[byteIndex] |= bit;
             } else {
-                gMachine.keys[byteIndex] &= ~bit;
+                machine->keys[byteIndex] &= ~bit;
             }
         }
     }
@@ -283,14 +534,17 @@ static bool processKeyQueue() {
 // bits in the address map to the various bytes, and you can read the OR'ed
 // addresses to read more than one byte at a time. For the last byte we fake
 // the Shift key if necessary.
-static uint8_t readKeyboard(uint16_t addr) {
+static uint8_t readKeyboard(Trs80Machine *machine, uint16_t addr) {
     addr = (addr - Trs80KeyboardBegin) % Trs80KeyboardBankSize;
 
-    // Dequeue if necessary.
-    if (gMachine.clock > gMachine.keyProcessMinClock) {
-        bool keyWasPressed = processKeyQueue();
+    // Dequeue if necessary, and wake up for the next key.
+    if (machine->clock > machine->keyProcessMinClock) {
+        bool keyWasPressed = processKeyQueue(machine);
         if (keyWasPressed) {
-            gMachine.keyProcessMinClock = gMachine.clock + Trs80KeyboardThrottleCycles;
+            machine->keyProcessMinClock = machine->clock + Trs80KeyboardThrottleCycles;
+            if (!machine->keyQueue.empty()) {
+                scheduleEvent(machine, machine->keyProcessMinClock + 1, EVENT_KEYBOARD);
+            }
         }
     }
 
@@ -301,15 +555,15 @@ static uint8_t readKeyboard(uint16_t addr) {
     uint8_t b = 0;
     for (int i = 0; i < 8; i++) {
         if ((addr & (1 << i)) != 0) {
-            uint8_t keys = gMachine.keys[i];
+            uint8_t keys = machine->keys[i];
 
             if (i == 6) {
-                keys |= gMachine.joystick;
+                keys |= machine->joystick;
             }
 
             if (i == 7) {
                 // Modify keys based on the shift force.
-                switch (gMachine.shiftForce) {
+                switch (machine->shiftForce) {
                     case ST_NEUTRAL:
                         // Nothing.
                         break;
@@ -330,113 +584,138 @@ static uint8_t readKeyboard(uint16_t addr) {
     }
 
     if (b != 0) {
-        printf("Reading keyboard at 0x%04x got 0x%02x\n", addr, b);
+        TRS80_LOG_DEBUG(&machine->log, "Reading keyboard at 0x%04x got 0x%02x\n", addr, b);
     }
 
     return b;
 }
 
 // Handle a keypress on the real machine, update memory-mapped I/O.
-void handleKeypress(int key, bool isPress) {
-    gMachine.keyQueue.emplace_back(key, isPress);
+void handleKeypress(Trs80Machine *machine, int key, bool isPress) {
+    if (machine->keyQueue.empty() && machine->keyProcessMinClock >= machine->clock) {
+        scheduleEvent(machine, machine->keyProcessMinClock + 1, EVENT_KEYBOARD);
+    }
+    machine->keyQueue.emplace_back(key, isPress);
 }
 
 /**
  * Set the mask for IRQ (regular) interrupts.
  */
-static void setIrqMask(uint8_t irqMask) {
-    gMachine.irqMask = irqMask;
+static void setIrqMask(Trs80Machine *machine, uint8_t irqMask) {
+    machine->irqMask = irqMask;
 }
 
 // Reset whether we've seen this NMI interrupt if the mask and latch no longer overlap.
-static void updateNmiSeen() {
-    if ((gMachine.nmiLatch & gMachine.nmiMask) == 0) {
-        gMachine.nmiSeen = false;
+static void updateNmiSeen(Trs80Machine *machine) {
+    if ((machine->nmiLatch & machine->nmiMask) == 0) {
+        machine->nmiSeen = false;
     }
 }
 
 /**
  * Set the mask for non-maskable interrupts. (Yes.)
  */
-static void setNmiMask(uint8_t nmiMask) {
+static void setNmiMask(Trs80Machine *machine, uint8_t nmiMask) {
     // Reset is always allowed:
-    gMachine.nmiMask = nmiMask | RESET_NMI_MASK;
-    updateNmiSeen();
+    machine->nmiMask = nmiMask | RESET_NMI_MASK;
+    updateNmiSeen(machine);
 }
 
-static uint8_t interruptLatchRead() {
-    return ~gMachine.irqLatch;
+static uint8_t interruptLatchRead(Trs80Machine *machine) {
+    return ~machine->irqLatch;
 }
 
 // Set or reset the timer interrupt.
-void setTimerInterrupt(bool state) {
+static void setTimerInterrupt(Trs80Machine *machine, bool state) {
     if (state) {
-        gMachine.irqLatch |= M3_TIMER_IRQ_MASK;
+        machine->irqLatch |= M3_TIMER_IRQ_MASK;
     } else {
-        gMachine.irqLatch &= ~M3_TIMER_IRQ_MASK;
+        machine->irqLatch &= ~M3_TIMER_IRQ_MASK;
     }
 }
 
 // Set the state of the reset button interrupt.
-void resetButtonInterrupt(bool state) {
+static void resetButtonInterrupt(Trs80Machine *machine, bool state) {
     if (state) {
-        gMachine.nmiLatch |= RESET_NMI_MASK;
+        machine->nmiLatch |= RESET_NMI_MASK;
     } else {
-        gMachine.nmiLatch &= ~RESET_NMI_MASK;
+        machine->nmiLatch &= ~RESET_NMI_MASK;
     }
-    updateNmiSeen();
+    updateNmiSeen(machine);
 }
 
 // What to do when the hardware timer goes off.
-static void handleTimer() {
-    setTimerInterrupt(true);
+static void handleTimer(Trs80Machine *machine) {
+    setTimerInterrupt(machine, true);
 }
 
-static void resetMachine() {
-    gMachine.clock = 0;
-    gMachine.modeImage = 0x80;
-    setIrqMask(0);
-    gMachine.irqLatch = 0;
-    setNmiMask(0);
-    gMachine.nmiLatch = 0;
+static void resetMachine(Trs80Machine *machine) {
+    machine->clock = 0;
+    machine->timerClock = 0;
+    machine->idleClock = 0;
+    machine->idleProbeCountdown = 0;
+    machine->idleProbeDelay = 0;
+    machine->modeImage = 0x80;
+    setIrqMask(machine, 0);
+    machine->irqLatch = 0;
+    setNmiMask(machine, 0);
+    machine->nmiLatch = 0;
     // resetCassette();
-    clearKeyboard();
-    setTimerInterrupt(false);
-    Z80Reset(&gMachine.z80);
+    clearKeyboard(machine);
+    setTimerInterrupt(machine, false);
+    Z80Reset(&machine->z80);
+#ifdef Z80_USE_BLOCK_CACHE
+    Z80ResetBlockCache(&machine->blocks);
+#endif
+    scheduleMachineEvents(machine);
 }
 
-uint8_t Trs80ReadByte(Trs80Machine *machine, uint16_t address) {
+// Slow paths for the pages the bus can't map directly. Kept out of line so
+// they don't bloat every memory access in the interpreter loop.
+__attribute__((noinline)) static uint8_t Trs80ReadByte(Trs80Machine *machine, uint16_t address) {
     if (address >= Trs80KeyboardBegin && address < Trs80KeyboardEnd) {
-        return readKeyboard(address);
+        return readKeyboard(machine, address);
     }
 
-    return gMachine.memory[address];
+    return machine->bus.peekByte(address);
 }
 
-void Trs80WriteByte(Trs80Machine *machine, uint16_t address, uint8_t value) {
+__attribute__((noinline)) static void Trs80WriteByte(Trs80Machine *machine, uint16_t address, uint8_t value) {
     if (address >= ROMSIZE) {
         if (address >= Trs80ScreenBegin &&
                 address < Trs80ScreenEnd &&
-                gMachine.memory[address] != value) {
+                machine->screen[address - Trs80ScreenBegin] != value &&
+                machine->settings.screenCallback != nullptr &&
+                machine->settings.runAheadFrames == 0) {
 
-            writeScreenChar(address - Trs80ScreenBegin, value);
+            machine->settings.screenCallback(machine, address - Trs80ScreenBegin, value);
+        }
+        uint8_t *page = ownPage(machine, address >> Trs80PageShift);
+        if (page == nullptr) {
+            return;
         }
-        gMachine.memory[address] = value;
+        page[address & (Trs80PageSize - 1)] = value;
+        machine->bus.dirtyPages[address >> Trs80PageShift] = DIRTY_ALL;
+#ifdef Z80_USE_BLOCK_CACHE
+        if (Z80BlockCacheIsCode(&machine->blocks, address)) {
+            Z80BlockCacheWrite(&machine->blocks, address);
+        }
+#endif
     }
 }
 
-uint8_t Trs80ReadPort(Trs80Machine *machine, uint8_t address) {
+static uint8_t Trs80ReadPort(Trs80Machine *machine, uint8_t address) {
     uint8_t value = 0xFF;
 
     switch (address) {
         case 0xE0:
             // IRQ latch read.
-            value = interruptLatchRead();
+            value = interruptLatchRead(machine);
             break;
 
         case 0xE4:
             // NMI latch read.
-            value = ~gMachine.nmiLatch;
+            value = ~machine->nmiLatch;
             break;
 
         case 0xEC:
@@ -444,7 +723,7 @@ uint8_t Trs80ReadPort(Trs80Machine *machine, uint8_t address) {
         case 0xEE:
         case 0xEF:
             // Acknowledge timer.
-            setTimerInterrupt(false);
+            setTimerInterrupt(machine, false);
             break;
 
         case 0xF8:
@@ -454,27 +733,23 @@ uint8_t Trs80ReadPort(Trs80Machine *machine, uint8_t address) {
 
         case 0xFF:
             // Cassette and various flags.
-            value = gMachine.modeImage & 0x7E;
+            value = machine->modeImage & 0x7E;
             // value |= this.getCassetteByte();
             break;
     }
 
-#if 0
-    printf("Read port 0x%02X to get 0x%02X\n", address, value);
-#endif
+    TRS80_LOG_DEBUG(&machine->log, "Read port 0x%02X to get 0x%02X\n", address, value);
 
     return value;
 }
 
-void Trs80WritePort(Trs80Machine *machine, uint8_t address, uint8_t value) {
-#if 0
-    printf("Write port 0x%02X value 0x%02X\n", address, value);
-#endif
+static void Trs80WritePort(Trs80Machine *machine, uint8_t address, uint8_t value) {
+    TRS80_LOG_DEBUG(&machine->log, "Write port 0x%02X value 0x%02X\n", address, value);
 
     switch (address) {
         case 0xE0:
             // Set interrupt mask.
-            setIrqMask(value);
+            setIrqMask(machine, value);
             break;
 
         case 0xE4:
@@ -482,7 +757,7 @@ void Trs80WritePort(Trs80Machine *machine, uint8_t address, uint8_t value) {
         case 0xE6:
         case 0xE7:
             // Set NMI state.
-            setNmiMask(value);
+            setNmiMask(machine, value);
             break;
 
         case 0xEC:
@@ -490,7 +765,7 @@ void Trs80WritePort(Trs80Machine *machine, uint8_t address, uint8_t value) {
         case 0xEE:
         case 0xEF:
             // Various controls.
-            gMachine.modeImage = value;
+            machine->modeImage = value;
             // this.setCassetteMotor((value & 0x02) != 0);
             // this.screen.setExpandedCharacters((value & 0x04) != 0);
             // this.screen.setAlternateCharacters((value & 0x08) == 0);
@@ -498,123 +773,1047 @@ void Trs80WritePort(Trs80Machine *machine, uint8_t address, uint8_t value) {
     }
 }
 
-void queueEvent(float seconds, void (*callback)(int data), int data) {
-    clk_t clock = gMachine.clock + seconds*Trs80ClockHz;
-    gQueuedEvents.emplace_back(clock, callback, data);
+// Byte in memory at the address, ignoring memory-mapped I/O.
+inline uint8_t Trs80Bus::peekByte(uint16_t address) const {
+    return pages[address >> Trs80PageShift][address & (Trs80PageSize - 1)];
 }
 
-void writeMemoryByte(uint16_t address, uint8_t value) {
-    Trs80WriteByte(&gMachine, address, value);
+inline uint8_t Trs80Bus::fetchByte(uint16_t address) {
+    return peekByte(address);
+}
+
+inline uint8_t Trs80Bus::readByte(uint16_t address) {
+    uint8_t const *page = readPages[address >> Trs80PageShift];
+    uint8_t value = page != nullptr
+        ? page[address & (Trs80PageSize - 1)]
+        : Trs80ReadByte(machine, address);
+
+    if (TRS80_DEBUG) {
+        printf("Reading %02x from %04x\n", value, address);
+    }
+
+    return value;
 }
 
-uint8_t readMemoryByte(uint16_t address) {
-    return Trs80ReadByte(&gMachine, address);
+inline void Trs80Bus::writeByte(uint16_t address, uint8_t value) {
+    uint8_t *page = writePages[address >> Trs80PageShift];
+
+    if (TRS80_DEBUG) {
+        printf("Writing %02x to %04x\n", value, address);
+    }
+
+    if (page != nullptr) {
+        page[address & (Trs80PageSize - 1)] = value;
+        dirtyPages[address >> Trs80PageShift] = DIRTY_ALL;
+#ifdef Z80_USE_BLOCK_CACHE
+        // Overwriting code the cache has decoded.
+        if (Z80BlockCacheIsCode(&machine->blocks, address)) {
+            Z80BlockCacheWrite(&machine->blocks, address);
+        }
+#endif
+    } else {
+        Trs80WriteByte(machine, address, value);
+    }
 }
 
-void jumpToAddress(uint16_t pc) {
-    gMachine.z80.pc = pc;
+inline uint8_t Trs80Bus::readPort(uint8_t port) {
+    uint8_t value = Trs80ReadPort(machine, port);
+
+    if (TRS80_DEBUG) {
+        printf("Reading %02x from port %02x\n", value, port);
+    }
+
+    return value;
 }
 
-void setJoystick(uint8_t joystick) {
-    gMachine.joystick = joystick;
+inline void Trs80Bus::writePort(uint8_t port, uint8_t value) {
+    if (TRS80_DEBUG) {
+        printf("Writing %02x to port %02x\n", value, port);
+    }
+
+    Trs80WritePort(machine, port, value);
 }
 
-void trs80_reset() {
-    gMachine = {};
+// Whether runSlice() would take an interrupt now. The Z80 stops when one of
+// its instructions makes this true, so the interrupt isn't put off until the
+// next event.
+inline bool Trs80Bus::interruptPending() const {
+    return ((machine->nmiLatch & machine->nmiMask) != 0 && !machine->nmiSeen) ||
+        ((machine->irqLatch & machine->irqMask) != 0 && machine->z80.iff1);
 }
 
-void trs80_exit() {
-    gMachine.exit = true;
+// Whether the two ranges of addresses overlap.
+static bool rangesOverlap(int begin1, int end1, int begin2, int end2) {
+    return begin1 < end2 && begin2 < end1;
 }
 
-int trs80_main() {
-    // Read the ROM.
-    if (MODEL3_ROM_SIZE != ROMSIZE) {
-        printf("ROM is wrong size (%zd bytes)\n", MODEL3_ROM_SIZE);
-        while (1) {}
+// Report the characters of the screen from begin to end (positions) that are
+// different from before, which starts at begin. Runs of them go to the range
+// callback if there is one.
+static void reportScreenChanges(Trs80Machine *machine, int begin, int end, uint8_t const *before) {
+    uint8_t const *screen = machine->screen;
+    int runBegin = -1;
+
+    for (int position = begin; position <= end; position++) {
+        bool changed = position < end && screen[position] != before[position - begin];
+        if (changed && machine->settings.screenRangeCallback == nullptr) {
+            if (machine->settings.screenCallback != nullptr) {
+                machine->settings.screenCallback(machine, position, screen[position]);
+            }
+        } else if (changed && runBegin == -1) {
+            runBegin = position;
+        } else if (!changed && runBegin != -1) {
+            machine->settings.screenRangeCallback(machine, runBegin, position);
+            runBegin = -1;
+        }
     }
-    memcpy(gMachine.memory, MODEL3_ROM, MODEL3_ROM_SIZE);
+}
 
-    initializeKeyboardMap();
-    resetMachine();
+// Copy bytes for LDIR (step 1) or LDDR (step -1). Source and destination are
+// plain memory, or the screen for the destination, whose changed characters
+// are then reported a run at a time. Returns the number of bytes copied, which
+// is zero if the range isn't one we can do at once.
+int Trs80Bus::moveBytes(uint16_t destination, uint16_t source, int count, int step) {
+    int sourceBegin = step > 0 ? source : source - count + 1;
+    int destinationBegin = step > 0 ? destination : destination - count + 1;
+    int firstPage = destinationBegin >> Trs80PageShift;
+    int lastPage = (destinationBegin + count - 1) >> Trs80PageShift;
+
+    if (count == 0 ||
+            sourceBegin < 0 || sourceBegin + count > MEMSIZE ||
+            destinationBegin < ROMSIZE || destinationBegin + count > MEMSIZE ||
+            rangesOverlap(sourceBegin, sourceBegin + count, Trs80KeyboardBegin, Trs80KeyboardEnd)) {
+
+        return 0;
+    }
+
+    // Copy any shared pages we're writing to first, which also points the
+    // source at the copies if it overlaps. Without room for them, leave the
+    // writes to the Z80, which loses them.
+    for (int page = firstPage; page <= lastPage; page++) {
+        if (ownPage(machine, page) == nullptr) {
+            return 0;
+        }
+    }
+    uint8_t **ownPages = machine->ownPages;
+
+    // Part of the screen we're writing to, and what was there before.
+    int screenBegin = destinationBegin > Trs80ScreenBegin ? destinationBegin : Trs80ScreenBegin;
+    int screenEnd = destinationBegin + count < Trs80ScreenEnd ? destinationBegin + count : Trs80ScreenEnd;
+    if (machine->settings.runAheadFrames > 0) {
+        // The screen is shown at each timer tick instead.
+        screenEnd = screenBegin;
+    }
+    uint8_t before[Trs80ScreenSize];
+    if (screenBegin < screenEnd) {
+        memcpy(before, &machine->screen[screenBegin - Trs80ScreenBegin], screenEnd - screenBegin);
+    }
+
+    // A destination just ahead of the source repeats the bytes, like the
+    // usual LD (HL),n; LD DE,HL+1; LDIR fill, so must go a byte at a time.
+    // Otherwise copy the whole range as memmove() would, a run within a
+    // page at a time, going down if the destination is above the source.
+    int distance = (destination - source)*step;
+    if (distance > 0 && distance < count) {
+        for (int i = 0; i < count; i++) {
+            uint16_t address = destination + i*step;
+            ownPages[address >> Trs80PageShift][address & (Trs80PageSize - 1)] = peekByte(source + i*step);
+        }
+    } else if (destinationBegin <= sourceBegin) {
+        for (int done = 0; done < count; ) {
+            int from = sourceBegin + done;
+            int to = destinationBegin + done;
+            int size = count - done;
+            size = std::min(size, Trs80PageSize - (from & (Trs80PageSize - 1)));
+            size = std::min(size, Trs80PageSize - (to & (Trs80PageSize - 1)));
+            memmove(&ownPages[to >> Trs80PageShift][to & (Trs80PageSize - 1)],
+                    &pages[from >> Trs80PageShift][from & (Trs80PageSize - 1)], size);
+            done += size;
+        }
+    } else {
+        for (int left = count; left > 0; ) {
+            int fromEnd = sourceBegin + left;
+            int toEnd = destinationBegin + left;
+            int size = left;
+            size = std::min(size, ((fromEnd - 1) & (Trs80PageSize - 1)) + 1);
+            size = std::min(size, ((toEnd - 1) & (Trs80PageSize - 1)) + 1);
+            int from = fromEnd - size;
+            int to = toEnd - size;
+            memmove(&ownPages[to >> Trs80PageShift][to & (Trs80PageSize - 1)],
+                    &pages[from >> Trs80PageShift][from & (Trs80PageSize - 1)], size);
+            left -= size;
+        }
+    }
+    memset(&dirtyPages[firstPage], DIRTY_ALL, lastPage - firstPage + 1);
+
+    if (screenBegin < screenEnd) {
+        reportScreenChanges(machine, screenBegin - Trs80ScreenBegin, screenEnd - Trs80ScreenBegin, before);
+    }
+
+#ifdef Z80_USE_BLOCK_CACHE
+    // Same order as the Z80, since the first write flushes the cache.
+    for (int i = 0; i < count; i++) {
+        int address = destination + i*step;
+        if (Z80BlockCacheIsCode(&machine->blocks, address)) {
+            Z80BlockCacheWrite(&machine->blocks, address);
+        }
+    }
+#endif
+
+    return count;
+}
+
+// Count the bytes before the first one equal to value, for CPIR (step 1)
+// or CPDR (step -1), up to count. Returns zero if the range isn't plain
+// memory.
+int Trs80Bus::scanBytes(uint16_t address, int count, int step, uint8_t value) {
+    int begin = step > 0 ? address : address - count + 1;
 
-    clk_t previousTimerClock = 0;
+    if (begin < 0 || begin + count > MEMSIZE ||
+            rangesOverlap(begin, begin + count, Trs80KeyboardBegin, Trs80KeyboardEnd)) {
 
-    auto emulationStartTime = std::chrono::system_clock::now();
+        return 0;
+    }
+
+    int i = 0;
+    while (i < count && peekByte(address + i*step) != value) {
+        i++;
+    }
 
-    while (!gMachine.exit) {
-        clk_t cyclesToDo = 10000;
+    return i;
+}
+
+// The Z80 core, instantiated for our bus.
+#include "z80emu_impl.h"
+
+// Idle loops. The ROM and some games wait for a key or the timer by polling in
+// a tight loop. Nothing outside the Z80 changes until the next event, so if
+// one pass around the loop has no side effects and leaves the Z80 as it found
+// it, every pass until the event will do the same, and the clock can jump
+// there at once. Counted delay loops change a register on each pass, so they
+// aren't idle; the Z80 core skips those itself (Z80_SKIP_DELAY_LOOPS).
+
+// Longest pass we look for, in cycles.
+constexpr int Trs80IdleProbeCycles = 1000;
+// Most slices to wait between probes when we keep missing.
+constexpr int Trs80IdleMaxProbeDelay = 64;
+
+// Bus for single-stepping one pass of a loop. Forwards to the real bus and
+// notes anything the pass does that a skipped pass would not.
+struct Trs80ProbeBus {
+    Trs80Bus *bus;
+    bool sideEffect;
+
+    uint8_t fetchByte(uint16_t address) {
+        return bus->fetchByte(address);
+    }
+
+    uint8_t readByte(uint16_t address) {
+        // Of memory-mapped I/O, only the keyboard is read without side
+        // effects, as long as no key is waiting (see runZ80()).
+        if (bus->readPages[address >> Trs80PageShift] == nullptr &&
+                (address < Trs80KeyboardBegin || address >= Trs80KeyboardEnd)) {
+
+            sideEffect = true;
+        }
+
+        return bus->readByte(address);
+    }
+
+    void writeByte(uint16_t address, uint8_t value) {
+        // Storing the same value again (like pushing and popping) is harmless.
+        if (address >= ROMSIZE && bus->peekByte(address) != value) {
+            sideEffect = true;
+        }
+
+        bus->writeByte(address, value);
+    }
+
+    uint8_t readPort(uint8_t port) {
+        // Reading these acknowledges the timer.
+        if (port >= 0xEC && port <= 0xEF) {
+            sideEffect = true;
+        }
+
+        return bus->readPort(port);
+    }
+
+    void writePort(uint8_t port, uint8_t value) {
+        sideEffect = true;
+        bus->writePort(port, value);
+    }
 
-        // See if we should interrupt the emulator early for our timer interrupt.
-        clk_t nextTimerClock = previousTimerClock + Trs80ClockHz / Trs80TimerHz;
-        if (nextTimerClock >= gMachine.clock) {
-            clk_t clocksUntilTimer = nextTimerClock - gMachine.clock;
-            if (cyclesToDo > clocksUntilTimer) {
-                cyclesToDo = clocksUntilTimer;
+    // Only one instruction is run at a time, so there's no run to cut short,
+    // and these decline to do the work in bulk.
+    int moveBytes(uint16_t, uint16_t, int, int) {
+        return 0;
+    }
+
+    int scanBytes(uint16_t, int, int, uint8_t) {
+        return 0;
+    }
+
+    bool interruptPending() const {
+        return bus->interruptPending();
+    }
+};
+
+// Whether the two states are the same, except for the refresh register,
+// which no idle loop looks at.
+static bool sameZ80State(Z80_STATE const &a, Z80_STATE const &b) {
+    return memcmp(a.registers.word, b.registers.word, sizeof(a.registers.word)) == 0 &&
+        memcmp(a.alternates, b.alternates, sizeof(a.alternates)) == 0 &&
+        a.i == b.i &&
+        a.pc == b.pc &&
+        a.iff1 == b.iff1 &&
+        a.iff2 == b.iff2 &&
+        a.im == b.im;
+}
+
+// Single-step the Z80 from its PC until it comes back there, for up to the
+// given number of cycles. If the pass was idle, skip the whole passes that
+// fit in the rest of them, leaving part of one so the Z80 stops where it
+// would have. Returns the cycles run and skipped, from zero to all of them.
+static int skipIdleLoop(Trs80Machine *machine, int cycles) {
+    Z80_STATE &z80 = machine->z80;
+    Z80_STATE start = z80;
+    Trs80ProbeBus probeBus = { &machine->bus, false };
+    int limit = std::min(cycles, Trs80IdleProbeCycles);
+    int elapsed = 0;
+
+    do {
+        uint16_t pc = z80.pc & 0xFFFF;
+        uint8_t opcode = machine->bus.peekByte(pc);
+
+        // HALT already skips to the event, and LD A,R and LD R,A would see or
+        // change the refresh register we're about to make up.
+        if (opcode == 0x76 || (opcode == 0xED &&
+                    (machine->bus.peekByte(pc + 1) == 0x5F || machine->bus.peekByte(pc + 1) == 0x4F))) {
+
+            return elapsed;
+        }
+
+        elapsed += Z80Emulate(&z80, 1, &probeBus);
+        if (probeBus.sideEffect) {
+            return elapsed;
+        }
+    } while (z80.pc != start.pc && elapsed < limit);
+
+    if (!sameZ80State(z80, start)) {
+        return elapsed;
+    }
+
+    int passCycles = elapsed;
+    int passes = (cycles - elapsed - 1)/passCycles;
+    if (passes <= 0) {
+        return elapsed;
+    }
+    int r = z80.r - start.r;
+    z80.r = (z80.r & 0x80) | ((z80.r + passes*r) & 0x7F);
+    elapsed += passes*passCycles;
+    machine->idleClock += passes*passCycles;
+
+    return elapsed;
+}
+
+// Emulate the Z80 for about the given number of cycles, which run to the next
+// event, skipping idle loops. Returns the number of cycles actually emulated.
+static int runZ80(Trs80Machine *machine, int cycles) {
+    int doneCycles = 0;
+
+    // Reading the keyboard takes the next key, so don't skip while keys are
+    // waiting. Back off while the Z80 is busy, so probing doesn't slow it down.
+    if (machine->keyQueue.empty()) {
+        if (machine->idleProbeCountdown > 0) {
+            machine->idleProbeCountdown--;
+        } else {
+            clk_t idleClock = machine->idleClock;
+            doneCycles = skipIdleLoop(machine, cycles);
+
+            if (machine->idleClock > idleClock) {
+                machine->idleProbeDelay = 0;
+            } else {
+                machine->idleProbeDelay = std::min(std::max(machine->idleProbeDelay*2, 1),
+                        Trs80IdleMaxProbeDelay);
             }
+            machine->idleProbeCountdown = machine->idleProbeDelay;
         }
+    }
 
-        // See if we should slow down if we're going too fast.
-        auto now = std::chrono::system_clock::now();
-        auto microsSinceStart = std::chrono::duration_cast<std::chrono::microseconds>(now - emulationStartTime);
-        clk_t expectedClock = Trs80ClockHz * microsSinceStart.count() / 1000000;
-        if (expectedClock < gMachine.clock) {
-#if 0
-            printf("Skipping because %lld < %lld (%d left)\n",
-                    expectedClock, gMachine.clock, gMachine.clock - expectedClock);
+    if (doneCycles < cycles) {
+#ifdef Z80_USE_BLOCK_CACHE
+        doneCycles += Z80EmulateBlocks(&machine->z80, &machine->blocks, cycles - doneCycles, &machine->bus);
+#else
+        doneCycles += Z80Emulate(&machine->z80, cycles - doneCycles, &machine->bus);
 #endif
-            continue;
+    }
+
+    return doneCycles;
+}
+
+void queueEvent(Trs80Machine *machine, float seconds,
+        void (*callback)(Trs80Machine *machine, int data), int data) {
+    clk_t clock = machine->clock + seconds*Trs80ClockHz;
+    scheduleEvent(machine, clock, EVENT_CALLBACK, callback, data);
+}
+
+void writeMemoryByte(Trs80Machine *machine, uint16_t address, uint8_t value) {
+    Trs80WriteByte(machine, address, value);
+}
+
+uint8_t readMemoryByte(Trs80Machine *machine, uint16_t address) {
+    return Trs80ReadByte(machine, address);
+}
+
+void jumpToAddress(Trs80Machine *machine, uint16_t pc) {
+    machine->z80.pc = pc;
+}
+
+void setJoystick(Trs80Machine *machine, uint8_t joystick) {
+    machine->joystick = joystick;
+}
+
+void trs80_setUserData(Trs80Machine *machine, void *userData) {
+    machine->settings.userData = userData;
+}
+
+void *trs80_getUserData(Trs80Machine *machine) {
+    return machine->settings.userData;
+}
+
+void trs80_setScreenCallback(Trs80Machine *machine,
+        void (*callback)(Trs80Machine *machine, int position, uint8_t ch)) {
+
+    machine->settings.screenCallback = callback;
+}
+
+void trs80_setScreenRangeCallback(Trs80Machine *machine,
+        void (*callback)(Trs80Machine *machine, int begin, int end)) {
+
+    machine->settings.screenRangeCallback = callback;
+}
+
+void trs80_setPollCallback(Trs80Machine *machine, void (*callback)(Trs80Machine *machine)) {
+    machine->settings.pollCallback = callback;
+}
+
+void trs80_setTimerCallback(Trs80Machine *machine, void (*callback)(Trs80Machine *machine)) {
+    machine->settings.timerCallback = callback;
+}
+
+void trs80_setThrottle(Trs80Machine *machine, bool throttle) {
+    machine->settings.throttle = throttle;
+}
+
+void trs80_setSleepCallback(Trs80Machine *machine,
+        void (*callback)(Trs80Machine *machine, uint32_t micros)) {
+
+    machine->settings.sleepCallback = callback;
+}
+
+Trs80PacingStats trs80_getPacingStats(Trs80Machine *machine) {
+    return machine->pacingStats;
+}
+
+void trs80_drainLog(Trs80Machine *machine) {
+    logDrain(&machine->log);
+}
+
+Trs80LogStats trs80_getLogStats(Trs80Machine *machine) {
+    return logGetStats(&machine->log);
+}
+
+void trs80_setRunAhead(Trs80Machine *machine, int frames, Trs80Snapshot *snapshot) {
+    machine->settings.runAheadFrames = frames;
+    machine->settings.runAheadSnapshot = snapshot;
+
+    if (frames > 0) {
+        // Copy all of RAM at the next tick, and start from the screen as
+        // it is.
+        for (uint8_t &dirty : machine->bus.dirtyPages) {
+            dirty |= DIRTY_RUN_AHEAD;
         }
+        memcpy(machine->shownScreen, machine->screen, Trs80ScreenSize);
+    }
+}
 
-        // Emulate!
-        int doneCycles = Z80Emulate(&gMachine.z80, cyclesToDo, &gMachine);
-        gMachine.clock += doneCycles;
-#if 0
-        printf("E %llu 0x%04X %lld %d\n", gMachine.clock, gMachine.z80.pc, cyclesToDo, doneCycles);
-#endif
+Trs80RunAheadStats trs80_getRunAheadStats(Trs80Machine *machine) {
+    return machine->runAheadStats;
+}
+
+clk_t trs80_getClock(Trs80Machine *machine) {
+    return machine->clock;
+}
+
+clk_t trs80_getIdleClock(Trs80Machine *machine) {
+    return machine->idleClock;
+}
 
-        // Handle non-maskable interrupts.
-        if ((gMachine.nmiLatch & gMachine.nmiMask) != 0 && !gMachine.nmiSeen) {
-#if 0
-            printf("N %llu 0x%04X\n", gMachine.clock, gMachine.z80.pc);
+Trs80BlockCacheStats trs80_getBlockCacheStats([[maybe_unused]] Trs80Machine *machine) {
+    Trs80BlockCacheStats stats{};
+
+#ifdef Z80_USE_BLOCK_CACHE
+    stats.enabled = true;
+    stats.hits = machine->blocks.hits;
+    stats.misses = machine->blocks.misses;
+    stats.invalidations = machine->blocks.invalidations;
+    stats.fallbacks = machine->blocks.fallbacks;
+    stats.flushes = machine->blocks.flushes;
+    stats.natives = machine->blocks.natives;
 #endif
-            gMachine.clock += Z80NonMaskableInterrupt(&gMachine.z80, &gMachine);
-            gMachine.nmiSeen = true;
 
-            // Simulate the reset button being released.
-            resetButtonInterrupt(false);
+    return stats;
+}
+
+// Load a .CMD program into memory and jump to its transfer address. Returns
+// whether the program was loaded successfully.
+bool loadCmdProgram(Trs80Machine *machine, uint8_t const *binary, size_t size) {
+    size_t i = 0;
+    while (true) {
+        if (i >= size) {
+            printf("CMD program ran off the end (%zu >= %zu)\n", i, size);
+            return false;
+        }
+
+        int chunkType = binary[i++];
+        int chunkLength = binary[i++];
+
+        // Adjust load block length.
+        if (chunkType == CMD_LOAD_BLOCK && chunkLength <= 2) {
+            chunkLength += 256;
+        } else if (chunkType == CMD_LOAD_MODULE_HEADER && chunkLength == 0) {
+            chunkLength = 256;
+        }
+
+        uint8_t const *data = &binary[i];
+        i += chunkLength;
+
+        switch (chunkType) {
+            case CMD_LOAD_BLOCK: {
+                uint16_t address = data[0] | (data[1] << 8);
+                int dataLength = chunkLength - 2;
+                // printf("CMD loading %d bytes at 0x%04X\n", dataLength, address);
+                for (int i = 0; i < dataLength; i++) {
+                    writeMemoryByte(machine, address + i, data[2 + i]);
+                }
+                break;
+            }
+
+            case CMD_TRANSFER_ADDRESS: {
+                uint16_t address = data[0] | (data[1] << 8);
+                // printf("CMD jumping to 0x%04X\n", address);
+                jumpToAddress(machine, address);
+                // Stop parsing.
+                return true;
+            }
+
+            case CMD_LOAD_MODULE_HEADER: {
+                // printf("CMD loading \"%.*s\"\n", chunkLength, (char const *) data);
+                break;
+            }
+
+            default:
+                printf("Unknown CMD chunk type %d\n", chunkType);
+                return false;
+        }
+    }
+}
+
+// Report the whole screen to the screen callbacks, after it was changed
+// behind their back.
+static void redrawScreen(Trs80Machine *machine) {
+    if (machine->settings.screenRangeCallback != nullptr) {
+        machine->settings.screenRangeCallback(machine, 0, Trs80ScreenSize);
+    } else if (machine->settings.screenCallback != nullptr) {
+        for (int position = 0; position < Trs80ScreenSize; position++) {
+            machine->settings.screenCallback(machine, position, machine->screen[position]);
+        }
+    }
+    memcpy(machine->shownScreen, machine->screen, Trs80ScreenSize);
+}
+
+// When running ahead, report what changed on the screen since it was last
+// shown.
+static void showScreen(Trs80Machine *machine) {
+    reportScreenChanges(machine, 0, Trs80ScreenSize, machine->shownScreen);
+    memcpy(machine->shownScreen, machine->screen, Trs80ScreenSize);
+}
+
+// Save everything but RAM to the snapshot.
+static void saveSnapshotFields(Trs80Machine *machine, Trs80Snapshot *snapshot) {
+    Z80_STATE const &z80 = machine->z80;
+
+    snapshot->version = Trs80SnapshotVersion;
+    snapshot->clock = machine->clock;
+    snapshot->timerClock = machine->timerClock;
+
+    snapshot->status = z80.status;
+    memcpy(snapshot->registers, z80.registers.word, sizeof(snapshot->registers));
+    memcpy(snapshot->alternates, z80.alternates, sizeof(snapshot->alternates));
+    snapshot->pc = z80.pc;
+    snapshot->i = z80.i;
+    snapshot->r = z80.r;
+    snapshot->iff1 = z80.iff1;
+    snapshot->iff2 = z80.iff2;
+    snapshot->im = z80.im;
+
+    snapshot->irqMask = machine->irqMask;
+    snapshot->irqLatch = machine->irqLatch;
+    snapshot->nmiMask = machine->nmiMask;
+    snapshot->nmiLatch = machine->nmiLatch;
+    snapshot->nmiSeen = machine->nmiSeen;
+    snapshot->modeImage = machine->modeImage;
+
+    memcpy(snapshot->keys, machine->keys, sizeof(snapshot->keys));
+    snapshot->shiftForce = machine->shiftForce;
+    snapshot->leftShiftPressed = machine->leftShiftPressed;
+    snapshot->rightShiftPressed = machine->rightShiftPressed;
+    snapshot->keyProcessMinClock = machine->keyProcessMinClock;
+    snapshot->joystick = machine->joystick;
+}
+
+void trs80_saveSnapshot(Trs80Machine *machine, Trs80Snapshot *snapshot) {
+    saveSnapshotFields(machine, snapshot);
+    for (int page = ROMSIZE >> Trs80PageShift; page < Trs80PageCount; page++) {
+        memcpy(&snapshot->ram[(page << Trs80PageShift) - ROMSIZE], machine->bus.pages[page], Trs80PageSize);
+    }
+}
+
+void trs80_updateSnapshot(Trs80Machine *machine, Trs80Snapshot *snapshot,
+        void (*pageCallback)(void *data, int page, uint8_t const *before, uint8_t const *after),
+        void *data) {
+
+    saveSnapshotFields(machine, snapshot);
+
+    uint8_t *dirtyPages = machine->bus.dirtyPages;
+    for (int page = ROMSIZE >> Trs80PageShift; page < Trs80PageCount; page++) {
+        if ((dirtyPages[page] & DIRTY_SNAPSHOT) != 0) {
+            dirtyPages[page] &= ~DIRTY_SNAPSHOT;
+
+            int offset = (page << Trs80PageShift) - ROMSIZE;
+            uint8_t *before = &snapshot->ram[offset];
+            uint8_t const *after = machine->bus.pages[page];
+            if (memcmp(before, after, Trs80PageSize) != 0) {
+                if (pageCallback != nullptr) {
+                    pageCallback(data, offset >> Trs80PageShift, before, after);
+                }
+                memcpy(before, after, Trs80PageSize);
+            }
         }
+    }
+}
+
+// Restore everything but RAM from the snapshot.
+static void restoreSnapshotFields(Trs80Machine *machine, Trs80Snapshot const *snapshot) {
+    Z80_STATE &z80 = machine->z80;
+
+    machine->clock = snapshot->clock;
+    machine->timerClock = snapshot->timerClock;
+
+    z80.status = snapshot->status;
+    memcpy(z80.registers.word, snapshot->registers, sizeof(snapshot->registers));
+    memcpy(z80.alternates, snapshot->alternates, sizeof(snapshot->alternates));
+    z80.pc = snapshot->pc;
+    z80.i = snapshot->i;
+    z80.r = snapshot->r;
+    z80.iff1 = snapshot->iff1;
+    z80.iff2 = snapshot->iff2;
+    z80.im = snapshot->im;
+
+    machine->irqMask = snapshot->irqMask;
+    machine->irqLatch = snapshot->irqLatch;
+    machine->nmiMask = snapshot->nmiMask;
+    machine->nmiLatch = snapshot->nmiLatch;
+    machine->nmiSeen = snapshot->nmiSeen;
+    machine->modeImage = snapshot->modeImage;
+
+    memcpy(machine->keys, snapshot->keys, sizeof(machine->keys));
+    machine->shiftForce = (ShiftState) snapshot->shiftForce;
+    machine->leftShiftPressed = snapshot->leftShiftPressed;
+    machine->rightShiftPressed = snapshot->rightShiftPressed;
+    machine->keyProcessMinClock = snapshot->keyProcessMinClock;
+    machine->joystick = snapshot->joystick;
+}
+
+// Put the machine back to the snapshot, either copying its RAM or reading it
+// from the snapshot until it's written.
+static bool restoreSnapshot(Trs80Machine *machine, Trs80Snapshot const *snapshot, bool share) {
+    if (snapshot->version != Trs80SnapshotVersion) {
+        printf("Snapshot has wrong version (%u != %u)\n", snapshot->version, Trs80SnapshotVersion);
+        return false;
+    }
 
-        // Handle interrupts.
-        if ((gMachine.irqLatch & gMachine.irqMask) != 0) {
-#if 0
-            printf("I %llu 0x%04X 0x%02X 0x%02X %d\n", gMachine.clock, gMachine.z80.pc,
-                    gMachine.irqLatch, gMachine.irqMask, gMachine.z80.iff1);
+    restoreSnapshotFields(machine, snapshot);
+    scheduleMachineEvents(machine);
+    machine->clockReset = true;
+
+    // Only mark the pages that differ as dirty, and only copy those.
+    for (int page = ROMSIZE >> Trs80PageShift; page < Trs80PageCount; page++) {
+        uint8_t const *p = &snapshot->ram[(page << Trs80PageShift) - ROMSIZE];
+        bool changed = memcmp(machine->bus.pages[page], p, Trs80PageSize) != 0;
+
+        if (share) {
+            sharePage(machine, page, p);
+        } else if (changed) {
+            uint8_t *own = ownPage(machine, page);
+            if (own == nullptr) {
+                return false;
+            }
+            memcpy(own, p, Trs80PageSize);
+        }
+        if (changed) {
+            machine->bus.dirtyPages[page] = DIRTY_ALL;
+        }
+    }
+    if (share) {
+        // The machine dropped all its copies, so the whole pool is free.
+        machine->pagePoolUsed = 0;
+    }
+#ifdef Z80_USE_BLOCK_CACHE
+    // The code in memory has changed without going through the bus.
+    Z80ResetBlockCache(&machine->blocks);
 #endif
-            gMachine.clock += Z80Interrupt(&gMachine.z80, 0, &gMachine);
+
+    redrawScreen(machine);
+
+    return true;
+}
+
+bool trs80_restoreSnapshot(Trs80Machine *machine, Trs80Snapshot const *snapshot) {
+    return restoreSnapshot(machine, snapshot, false);
+}
+
+bool trs80_shareSnapshot(Trs80Machine *machine, Trs80Snapshot const *snapshot) {
+    return restoreSnapshot(machine, snapshot, true);
+}
+
+Trs80MemoryStats trs80_getMemoryStats(Trs80Machine *machine) {
+    Trs80MemoryStats stats{};
+
+    for (int page = ROMSIZE >> Trs80PageShift; page < Trs80PageCount; page++) {
+        if (isScreenPage(page)) {
+            // Part of the machine.
+        } else if (machine->ownPages[page] != nullptr) {
+            stats.ownPages++;
+        } else {
+            stats.sharedPages++;
+        }
+    }
+    stats.poolPages = machine->settings.pagePoolSize;
+    stats.outOfPages = machine->outOfPages;
+    stats.bytes = sizeof(Trs80Machine) + stats.poolPages*Trs80PageSize;
+
+    return stats;
+}
+
+Trs80Machine *trs80_newMachine(int ramPages) {
+    if (ramPages < 0 || ramPages > Trs80RamPageCount) {
+        return nullptr;
+    }
+
+    Trs80Machine *machine = new (std::nothrow) Trs80Machine();
+    if (machine == nullptr) {
+        return nullptr;
+    }
+
+    machine->settings.pagePool = new (std::nothrow) uint8_t[ramPages*Trs80PageSize];
+    if (machine->settings.pagePool == nullptr) {
+        delete machine;
+        return nullptr;
+    }
+    machine->settings.pagePoolSize = ramPages;
+    trs80_reset(machine);
+
+    return machine;
+}
+
+void trs80_deleteMachine(Trs80Machine *machine) {
+    delete[] machine->settings.pagePool;
+    delete machine;
+}
+
+void trs80_reset(Trs80Machine *machine) {
+    // Print what was logged before it's forgotten.
+    logDrain(&machine->log);
+
+    // Start over from zero in place, since the machine is too big for the
+    // stack, keeping how it's hooked up.
+    Trs80Settings settings = machine->settings;
+    machine->~Trs80Machine();
+    new (machine) Trs80Machine();
+    machine->settings = settings;
+
+    // The ROM is read in place.
+    if (MODEL3_ROM_SIZE != ROMSIZE) {
+        printf("ROM is wrong size (%d bytes)\n", MODEL3_ROM_SIZE);
+        while (1) {}
+    }
+
+    initializeMemoryMap(machine);
+    initializeKeyboardMap(machine);
+    resetMachine(machine);
+
+    // Nothing we copied from RAM is current anymore.
+    memset(machine->bus.dirtyPages, DIRTY_ALL, sizeof(machine->bus.dirtyPages));
+}
+
+void trs80_exit(Trs80Machine *machine) {
+    machine->exit = true;
+}
+
+// Handle the events that are due. While running ahead only the machine's own
+// are handled, and the others are dropped, since the schedule is put back
+// afterward. Callbacks are left for next time once we've been told to exit.
+// Returns whether the timer went off.
+static bool handleEvents(Trs80Machine *machine, bool ahead) {
+    bool ticked = false;
+
+    while (!machine->events.empty() && machine->events.front().clock <= machine->clock) {
+        EventKind kind = machine->events.front().kind;
+        if (machine->exit && !ahead && (kind == EVENT_POLL || kind == EVENT_CALLBACK)) {
+            break;
+        }
+
+        QueuedEvent event = popEvent(machine);
+        switch (event.kind) {
+            case EVENT_TIMER:
+                TRS80_LOG_DEBUG(&machine->log, "T %llu 0x%04X\n", machine->clock, machine->z80.pc);
+                handleTimer(machine);
+                machine->timerClock = event.clock;
+                scheduleEvent(machine, event.clock + Trs80TimerCycles, EVENT_TIMER);
+                ticked = true;
+                break;
+
+            case EVENT_KEYBOARD:
+                // Only here so the Z80 stops to look at the clock.
+                break;
+
+            case EVENT_POLL:
+                scheduleEvent(machine, event.clock + Trs80PollCycles, EVENT_POLL);
+                if (!ahead && machine->settings.pollCallback != nullptr) {
+                    machine->settings.pollCallback(machine);
+                }
+                break;
+
+            case EVENT_CALLBACK:
+                if (!ahead) {
+                    TRS80_LOG_DEBUG(&machine->log, "Calling event (%d) (%llu <= %llu)\n",
+                            event.data, event.clock, machine->clock);
+                    event.callback(machine, event.data);
+                }
+                break;
         }
+    }
+
+    return ticked;
+}
 
-        // Set off a timer interrupt.
-        if (gMachine.clock > nextTimerClock) {
-#if 0
-            printf("T %llu 0x%04X\n", gMachine.clock, gMachine.z80.pc);
+// Emulate up to the next event, handle the events then due, and then
+// interrupts, so that one set off by an event is taken on its cycle. The Z80
+// stops early when it enables interrupts or unmasks one that's pending (see
+// Trs80Bus::interruptPending()), so that one is taken on its cycle too.
+// Idle slices are skipped: while the Z80 is halted, and while it spins in an
+// idle loop (see runZ80()), the clock goes straight to the event.
+// Returns whether the timer went off.
+static bool runSlice(Trs80Machine *machine, bool ahead) {
+    // There's always a timer event, so never an empty schedule.
+    clk_t cyclesToDo = machine->events.front().clock - machine->clock;
+
+    // Emulate!
+    if (cyclesToDo > 0) {
+        Z80_STATE &z80 = machine->z80;
+        int doneCycles = z80.status == Z80_STATUS_HALT ? 0 : runZ80(machine, cyclesToDo);
+
+        // Halted, the Z80 fetches NOPs until an interrupt. It stays halted
+        // across slices, and its PC is already past the HALT for the return
+        // address.
+        if (z80.status == Z80_STATUS_HALT) {
+            int idleCycles = cyclesToDo - doneCycles;
+            z80.r = (z80.r & 0x80) | ((z80.r + idleCycles/4) & 0x7F);
+            machine->idleClock += idleCycles;
+            doneCycles = cyclesToDo;
+        }
+
+        machine->clock += doneCycles;
+        TRS80_LOG_DEBUG(&machine->log, "E %llu 0x%04X %lld %d\n",
+                machine->clock, machine->z80.pc, cyclesToDo, doneCycles);
+    }
+
+    bool ticked = handleEvents(machine, ahead);
+
+    // Handle non-maskable interrupts.
+    if ((machine->nmiLatch & machine->nmiMask) != 0 && !machine->nmiSeen) {
+        TRS80_LOG_DEBUG(&machine->log, "N %llu 0x%04X\n", machine->clock, machine->z80.pc);
+        machine->clock += Z80NonMaskableInterrupt(&machine->z80, &machine->bus);
+        machine->nmiSeen = true;
+
+        // Simulate the reset button being released.
+        resetButtonInterrupt(machine, false);
+    }
+
+    // Handle interrupts. Only try when they're enabled, since trying clears
+    // the halted state.
+    if ((machine->irqLatch & machine->irqMask) != 0 && machine->z80.iff1) {
+        TRS80_LOG_DEBUG(&machine->log, "I %llu 0x%04X 0x%02X 0x%02X %d\n", machine->clock, machine->z80.pc,
+                machine->irqLatch, machine->irqMask, machine->z80.iff1);
+        machine->clock += Z80Interrupt(&machine->z80, 0, &machine->bus);
+    }
+
+    return ticked;
+}
+
+// Save the machine, emulate its run-ahead frames of timer ticks with the
+// input as it is, show the screen, and put the machine back. Nothing outside
+// the machine (callbacks, queued events) sees the ticks in between.
+static void runAhead(Trs80Machine *machine) {
+    Trs80Snapshot *snapshot = machine->settings.runAheadSnapshot;
+    uint8_t *dirtyPages = machine->bus.dirtyPages;
+
+    // Bring the snapshot up to date with the pages written since last time.
+    saveSnapshotFields(machine, snapshot);
+    for (int page = ROMSIZE >> Trs80PageShift; page < Trs80PageCount; page++) {
+        if ((dirtyPages[page] & DIRTY_RUN_AHEAD) != 0) {
+            dirtyPages[page] &= ~DIRTY_RUN_AHEAD;
+            memcpy(&snapshot->ram[(page << Trs80PageShift) - ROMSIZE],
+                    machine->bus.pages[page], Trs80PageSize);
+        }
+    }
+
+    clk_t clock = machine->clock;
+    std::vector<QueuedEvent> events = machine->events;
+    unsigned long eventSequence = machine->eventSequence;
+    for (int ticks = 0; ticks < machine->settings.runAheadFrames; ) {
+        if (runSlice(machine, true)) {
+            ticks++;
+        }
+    }
+    showScreen(machine);
+    machine->runAheadStats.frames++;
+    machine->runAheadStats.clock += machine->clock - clock;
+
+    // Put back the pages written while running ahead, which are all the
+    // machine's own by now.
+    [[maybe_unused]] bool codeChanged = false;
+    for (int page = ROMSIZE >> Trs80PageShift; page < Trs80PageCount; page++) {
+        if ((dirtyPages[page] & DIRTY_RUN_AHEAD) != 0) {
+            dirtyPages[page] &= ~DIRTY_RUN_AHEAD;
+
+            int address = page << Trs80PageShift;
+            uint8_t *p = machine->ownPages[page];
+            uint8_t const *saved = &snapshot->ram[address - ROMSIZE];
+            for (int i = 0; i < Trs80PageSize; i++) {
+                if (p[i] != saved[i]) {
+#ifdef Z80_USE_BLOCK_CACHE
+                    if (Z80BlockCacheIsCode(&machine->blocks, address + i)) {
+                        codeChanged = true;
+                    }
 #endif
-            handleTimer();
-            previousTimerClock = gMachine.clock;
+                    p[i] = saved[i];
+                }
+            }
         }
+    }
+#ifdef Z80_USE_BLOCK_CACHE
+    // Code decoded while running ahead may not be there anymore.
+    if (codeChanged) {
+        Z80FlushBlockCache(&machine->blocks);
+    }
+#endif
+    restoreSnapshotFields(machine, snapshot);
+    machine->events.swap(events);
+    machine->eventSequence = eventSequence;
+}
+
+// Record the time to spare in a tick that ran while throttling.
+static void countPacedFrame(Trs80Machine *machine, double spareMicros) {
+    Trs80PacingStats &stats = machine->pacingStats;
+
+    if (stats.frames == 0 || spareMicros < stats.leastSpareMicros) {
+        stats.leastSpareMicros = spareMicros;
+    }
+    stats.frames++;
+    stats.spareMicros += spareMicros;
+}
+
+int trs80_main(Trs80Machine *machine) {
+    // We may be resuming a snapshot, so throttle from wherever the clock is.
+    // Everything is measured from here, so waking up late from one wait
+    // doesn't add up, and against a clock that doesn't jump when the time of
+    // day is set.
+    clk_t emulationStartClock = machine->clock;
+    auto emulationStartTime = std::chrono::steady_clock::now();
+    // Time to spare before this slice, and in this tick so far.
+    bool sliceWaited = false;
+    double frameSpareMicros = 0;
+
+    while (!machine->exit) {
+        // See if we should slow down if we're going too fast.
+        if (machine->clockReset) {
+            emulationStartClock = machine->clock;
+            emulationStartTime = std::chrono::steady_clock::now();
+            machine->clockReset = false;
+        }
+        clk_t expectedClock = machine->clock;
+        if (machine->settings.throttle) {
+            auto now = std::chrono::steady_clock::now();
+            auto microsSinceStart = std::chrono::duration_cast<std::chrono::microseconds>(now - emulationStartTime);
+            expectedClock = emulationStartClock + Trs80ClockHz * microsSinceStart.count() / 1000000;
+            if (expectedClock - machine->clock > Trs80MaxLagCycles) {
+                // We were held up, so don't run flat out to make up for it.
+                emulationStartClock = machine->clock;
+                emulationStartTime = now;
+                expectedClock = machine->clock;
+                machine->pacingStats.resyncs++;
+            } else if (expectedClock < machine->clock) {
+                clk_t aheadCycles = machine->clock - expectedClock;
+                if (!sliceWaited) {
+                    frameSpareMicros += 1e6*aheadCycles/Trs80ClockHz;
+                    sliceWaited = true;
+                }
+                if (logPending(&machine->log)) {
+                    // Print while we have the time, then see how much is left.
+                    logDrain(&machine->log);
+                } else if (machine->settings.sleepCallback != nullptr) {
+                    // Round up so we don't wake up just short of it.
+                    machine->settings.sleepCallback(machine,
+                            (aheadCycles*1000000 + Trs80ClockHz - 1)/Trs80ClockHz);
+                }
+                continue;
+            }
+        }
+        sliceWaited = false;
 
-        // Check user input.
-        pollInput();
+        if (runSlice(machine, false)) {
+            if (machine->settings.throttle) {
+                countPacedFrame(machine, frameSpareMicros);
+                frameSpareMicros = 0;
+            } else {
+                // We're never idle, so print as we go.
+                logDrain(&machine->log);
+            }
 
-        if (!gQueuedEvents.empty() && gQueuedEvents[0].clock < gMachine.clock) {
-            QueuedEvent *e = &gQueuedEvents.front();
+            if (machine->settings.runAheadFrames > 0) {
+                // Don't fall further behind, and don't let keys be dequeued
+                // and then forgotten.
+                bool behind = expectedClock - machine->clock > Trs80TimerCycles;
+                if (behind || !machine->keyQueue.empty()) {
+                    showScreen(machine);
+                    machine->runAheadStats.skipped++;
+                } else {
+                    runAhead(machine);
+                }
+            }
 
-            printf("Calling event (%d) (%llu < %llu)\n", 
-                    e->data, e->clock, gMachine.clock);
-            e->callback(e->data);
-            gQueuedEvents.erase(gQueuedEvents.begin());
+            if (machine->settings.timerCallback != nullptr) {
+                machine->settings.timerCallback(machine);
+            }
         }
     }
 
+    logDrain(&machine->log);
+
+    // So that we can be called again.
+    machine->exit = false;
+
     return 0;
 }
@@ -1,6 +1,7 @@
 
 #pragma once
 
+#include <stddef.h>
 #include <stdint.h>
 
 // These match the TRS-80 byte 6 keyboard bits.
@@ -10,22 +11,227 @@
 #define JOYSTICK_RIGHT_MASK (1 << 6)
 #define JOYSTICK_FIRE_MASK (1 << 7)
 
+typedef long long clk_t;
+
+constexpr clk_t Trs80ClockHz = 2027520;
+constexpr clk_t Trs80TimerHz = 30;
+
+#define MEMSIZE (64*1024)
+#define ROMSIZE (14*1024)
+
+// Memory is mapped in 256-byte pages.
+constexpr int Trs80PageShift = 8;
+constexpr int Trs80PageSize = 1 << Trs80PageShift;
+constexpr int Trs80PageCount = MEMSIZE >> Trs80PageShift;
+
 constexpr int Trs80ColumnCount = 64;
 constexpr int Trs80RowCount = 16;
 constexpr int Trs80ScreenSize = Trs80ColumnCount*Trs80RowCount;
 constexpr int Trs80ScreenBegin = 15*1024;
 constexpr int Trs80ScreenEnd = Trs80ScreenBegin + Trs80ScreenSize;
+// Pages of RAM a machine can copy on write, which is all of it but the
+// screen.
+constexpr int Trs80RamPageCount = (MEMSIZE - ROMSIZE - Trs80ScreenSize) >> Trs80PageShift;
 constexpr int Trs80CharWidth = 8;
 constexpr int Trs80CharHeight = 12;
 
-void trs80_reset();
-int trs80_main();
-void trs80_exit();
-void queueEvent(float seconds, void (*callback)(int data), int data);
-void handleKeypress(int key, bool isPress);
-void writeMemoryByte(uint16_t address, uint8_t value);
-uint8_t readMemoryByte(uint16_t address);
-void jumpToAddress(uint16_t pc);
-void setJoystick(uint8_t joystick);
+// How the Z80 block cache has done since the last reset.
+struct Trs80BlockCacheStats {
+    // Whether the cache is compiled in at all.
+    bool enabled;
+    // Blocks found already decoded, and blocks decoded.
+    unsigned long hits;
+    unsigned long misses;
+    // Writes to decoded code (self-modifying code, or code being loaded).
+    unsigned long invalidations;
+    // Instructions the cache left to the interpreter.
+    unsigned long fallbacks;
+    // Times the cache filled up and was emptied.
+    unsigned long flushes;
+    // Blocks run from code translated when building.
+    unsigned long natives;
+};
+
+// How run-ahead (see trs80_setRunAhead()) has done since the last reset.
+struct Trs80RunAheadStats {
+    // Timer ticks at which we ran ahead, and those at which we didn't because
+    // we were behind real time or keys were waiting.
+    unsigned long frames;
+    unsigned long skipped;
+    // Cycles emulated ahead and then thrown away.
+    clk_t clock;
+};
+
+// How keeping to real time (see trs80_setThrottle()) has gone since the last
+// reset.
+struct Trs80PacingStats {
+    // Timer ticks run while throttling.
+    unsigned long frames;
+    // Time we were ahead of real time and waited, over all ticks and in the
+    // tick that had the least to spare.
+    double spareMicros;
+    double leastSpareMicros;
+    // Times we fell so far behind that we started over from real time
+    // instead of catching up.
+    unsigned long resyncs;
+};
+
+// How the machine's log (see logging.h) has done since the last reset.
+struct Trs80LogStats {
+    // Records logged, and those dropped because the log was full.
+    unsigned long records;
+    unsigned long dropped;
+};
+
+// How much memory a machine is using. Pages of RAM are copied on the first
+// write into the machine's pool, and until then shared with the ROM, a
+// snapshot, or a page of zeros.
+struct Trs80MemoryStats {
+    // Pages of RAM (not counting the screen) the machine has copied, and
+    // those it still shares.
+    int ownPages;
+    int sharedPages;
+    // Pages in the pool, and whether a write found it used up.
+    int poolPages;
+    bool outOfPages;
+    // All of the machine's memory, its pool included.
+    size_t bytes;
+};
+
+#ifdef TRS80_MACHINE_BUDGET
+// The most RAM a machine may take, not counting its pool of pages. The
+// firmware build sets it so that main.cpp can add up the device's RAM.
+constexpr size_t Trs80MachineBudget = TRS80_MACHINE_BUDGET;
+#endif
+
+// Bumped whenever Trs80Snapshot or what its fields mean changes (like the
+// timer's period), so that old snapshots are refused.
+constexpr uint32_t Trs80SnapshotVersion = 2;
+
+// State of the machine, enough to later resume it exactly where it was. It
+// leaves out what's rebuilt on restore (the ROM, the page map, the keyboard
+// map, and the Z80 block cache), as well as queued events and keys, which
+// the caller is expected to have let drain.
+struct Trs80Snapshot {
+    // Trs80SnapshotVersion when the snapshot was taken.
+    uint32_t version;
+
+    clk_t clock;
+    // When the last timer interrupt went off.
+    clk_t timerClock;
+
+    // Z80 registers, see Z80_STATE.
+    int32_t status;
+    uint16_t registers[7];
+    uint16_t alternates[4];
+    uint16_t pc;
+    uint8_t i;
+    uint8_t r;
+    uint8_t iff1;
+    uint8_t iff2;
+    uint8_t im;
+
+    // Interrupt masks and latches.
+    uint8_t irqMask;
+    uint8_t irqLatch;
+    uint8_t nmiMask;
+    uint8_t nmiLatch;
+    bool nmiSeen;
+    uint8_t modeImage;
+
+    // Keyboard matrix.
+    uint8_t keys[8];
+    uint8_t shiftForce;
+    bool leftShiftPressed;
+    bool rightShiftPressed;
+    clk_t keyProcessMinClock;
+    uint8_t joystick;
+
+    // Memory after the ROM.
+    uint8_t ram[MEMSIZE - ROMSIZE];
+};
 
+// One emulated machine. Each has all of its own state, so any number can be
+// run at once as long as each is only used by one thread at a time.
+struct Trs80Machine;
 
+// Make a machine in its reset state, with no callbacks (null if there's no
+// memory for it), or free one. The machine can copy up to ramPages pages of
+// RAM on write (at most Trs80RamPageCount). A write that needs another page
+// is lost and stops the machine, which trs80_getMemoryStats() reports.
+Trs80Machine *trs80_newMachine(int ramPages);
+void trs80_deleteMachine(Trs80Machine *machine);
+// Go back to the state after power-on. The callbacks, user data, and
+// settings are kept.
+void trs80_reset(Trs80Machine *machine);
+int trs80_main(Trs80Machine *machine);
+void trs80_exit(Trs80Machine *machine);
+// Pointer the caller can keep with the machine, for its callbacks.
+void trs80_setUserData(Trs80Machine *machine, void *userData);
+void *trs80_getUserData(Trs80Machine *machine);
+void trs80_setScreenCallback(Trs80Machine *machine,
+        void (*callback)(Trs80Machine *machine, int position, uint8_t ch));
+// Called instead of the screen callback when a block instruction changes
+// a run of characters at once, with the positions from begin up to (but not
+// including) end.
+void trs80_setScreenRangeCallback(Trs80Machine *machine,
+        void (*callback)(Trs80Machine *machine, int begin, int end));
+void trs80_setPollCallback(Trs80Machine *machine, void (*callback)(Trs80Machine *machine));
+// Called after each timer interrupt (Trs80TimerHz), between slices, once
+// the screen for that tick has been shown.
+void trs80_setTimerCallback(Trs80Machine *machine, void (*callback)(Trs80Machine *machine));
+// Whether to keep to the speed of the real machine (the default). When ahead
+// of real time, the sleep callback is asked to wait until it catches up,
+// which it may do early or late; without one we spin.
+void trs80_setThrottle(Trs80Machine *machine, bool throttle);
+void trs80_setSleepCallback(Trs80Machine *machine,
+        void (*callback)(Trs80Machine *machine, uint32_t micros));
+Trs80PacingStats trs80_getPacingStats(Trs80Machine *machine);
+// Print what the machine has logged. trs80_main() does this itself when
+// throttling and ahead of real time, at each timer tick when not throttling,
+// and before returning, so this is only needed between runs.
+void trs80_drainLog(Trs80Machine *machine);
+Trs80LogStats trs80_getLogStats(Trs80Machine *machine);
+clk_t trs80_getClock(Trs80Machine *machine);
+// Cycles skipped in idle loops since the last reset.
+clk_t trs80_getIdleClock(Trs80Machine *machine);
+Trs80BlockCacheStats trs80_getBlockCacheStats(Trs80Machine *machine);
+Trs80MemoryStats trs80_getMemoryStats(Trs80Machine *machine);
+// Save the state of the machine, or restore it after trs80_reset(). Restoring
+// redraws the whole screen through the screen callbacks, and returns false if
+// the snapshot is from another version or the machine runs out of pages for
+// it, in which case it must be reset.
+void trs80_saveSnapshot(Trs80Machine *machine, Trs80Snapshot *snapshot);
+bool trs80_restoreSnapshot(Trs80Machine *machine, Trs80Snapshot const *snapshot);
+// Like trs80_restoreSnapshot(), but the machine reads its RAM from the
+// snapshot, copying each page only when it's first written. This is quick and
+// lets many machines share a game, but the snapshot must not change or go
+// away until the machine is reset or shares another.
+bool trs80_shareSnapshot(Trs80Machine *machine, Trs80Snapshot const *snapshot);
+// Bring a snapshot up to date by only copying the pages of RAM that were
+// written since the last update, for keeping a snapshot current cheaply. The
+// machine tracks one set of written pages, so only one snapshot should be
+// kept this way, and it must have been up to date after the previous update.
+// Each page that changed is passed to the callback, if any, with the data,
+// its page number in the snapshot's RAM, and its contents before and after.
+void trs80_updateSnapshot(Trs80Machine *machine, Trs80Snapshot *snapshot,
+        void (*pageCallback)(void *data, int page, uint8_t const *before, uint8_t const *after),
+        void *data);
+// Run ahead to hide the frames a game takes to react to input. At each timer
+// tick the machine is saved to the snapshot, run that many more ticks with
+// the current input, and put back, and the screen callbacks are only told
+// about the screen as it was then, so it's always that far in the future.
+// This costs as many times the emulation as there are frames, plus copying
+// the pages written each frame, so ticks are skipped (and the screen shown as
+// it is) while throttling and behind real time. Zero frames turns it off and
+// the snapshot may be null; otherwise it's used until it's turned off.
+void trs80_setRunAhead(Trs80Machine *machine, int frames, Trs80Snapshot *snapshot);
+Trs80RunAheadStats trs80_getRunAheadStats(Trs80Machine *machine);
+bool loadCmdProgram(Trs80Machine *machine, uint8_t const *binary, size_t size);
+void queueEvent(Trs80Machine *machine, float seconds,
+        void (*callback)(Trs80Machine *machine, int data), int data);
+void handleKeypress(Trs80Machine *machine, int key, bool isPress);
+void writeMemoryByte(Trs80Machine *machine, uint16_t address, uint8_t value);
+uint8_t readMemoryByte(Trs80Machine *machine, uint16_t address);
+void jumpToAddress(Trs80Machine *machine, uint16_t pc);
+void setJoystick(Trs80Machine *machine, uint8_t joystick);
@@ -0,0 +1,53 @@
+
+#
+# Makes the direct-threaded dispatch tables for z80emu.c from the instruction
+# tables in tables.h. Each opcode maps straight to the address of its handler
+# label, so dispatch is a single indirect jump.
+#
+# Usage:
+#
+#     make_dispatch_tables.py src/z80emu/tables.h > src/z80emu/dispatch.h
+#
+
+import sys, re
+
+TABLES = [
+    ("INSTRUCTION_TABLE", "INSTRUCTION_DISPATCH_TABLE"),
+    ("CB_INSTRUCTION_TABLE", "CB_INSTRUCTION_DISPATCH_TABLE"),
+    ("ED_INSTRUCTION_TABLE", "ED_INSTRUCTION_DISPATCH_TABLE"),
+]
+
+def parse_table(source, name):
+    match = re.search(r"\b%s\[256\] = \{(.*?)\};" % name, source, re.DOTALL)
+    if match is None:
+        sys.stderr.write("Can't find %s\n" % name)
+        sys.exit(1)
+    instructions = re.findall(r"\b([A-Z_][A-Z0-9_]*)\b", match.group(1))
+    if len(instructions) != 256:
+        sys.stderr.write("%s has %d entries\n" % (name, len(instructions)))
+        sys.exit(1)
+    return instructions
+
+def main():
+    if len(sys.argv) < 2:
+        print("Usage: make_dispatch_tables.py TABLES_H")
+        sys.exit(1)
+
+    source = open(sys.argv[1]).read()
+
+    print("/* Generated by make_dispatch_tables.py from tables.h. Do not modify. */")
+    print("")
+    print("/* Expanded inside emulate(), since the handler labels are local to it. */")
+    print("")
+    lines = ["#define DECLARE_DISPATCH_TABLES"]
+    for name, dispatch_name in TABLES:
+        lines.append("static void * const %s[256] = {" % dispatch_name)
+        for instruction in parse_table(source, name):
+            lines.append("        &&%s_HANDLER," % instruction)
+        lines.append("};")
+
+    for line in lines[:-1]:
+        print(line + " " * (72 - len(line)) + "\\")
+    print(lines[-1])
+
+main()
@@ -0,0 +1,1025 @@
+
+#
+# Translates the Z80 code reachable in ROM and .CMD images into C++ functions
+# for the block cache (see src/z80emu/z80native.h). Code is traced from the
+# images' entry points, and the instructions that the block cache knows how
+# to run are grouped into regions, each becoming one function whose jumps
+# between its own instructions are gotos. The cycle counts, R register, bus
+# accesses, and stopping rules are the same as the micro-op handlers in
+# z80block_impl.h, so running a region gives exactly the same result as
+# running its blocks.
+#
+# Usage:
+#
+#     make_native_blocks.py [-o HEADER] IMAGE...
+#
+# Images ending in .rom are loaded at address 0, others are parsed as .CMD
+# files. The header goes to standard output without -o. The build runs this
+# itself when Z80_NATIVE_BLOCKS is on, so the header isn't kept in the tree.
+#
+
+import sys, os.path, io
+
+# Most instructions in one function.
+MAX_REGION_SIZE = 64
+
+BYTE_REGISTERS = ["B", "C", "D", "E", "H", "L", None, "A"]
+WORD_REGISTERS = ["BC", "DE", "HL", "SP"]
+STACK_REGISTERS = ["BC", "DE", "HL", "AF"]
+ALU_OPERATIONS = ["ADD", "ADC", "SUB", "SBC", "AND", "XOR", "OR", "CP"]
+SHIFT_OPERATIONS = ["RLC", "RRC", "RL", "RR_INSTRUCTION", "SLA", "SRA", "SLL", "SRL"]
+CONDITIONS = [
+    "!(F & Z80_Z_FLAG)", "F & Z80_Z_FLAG",
+    "!(F & Z80_C_FLAG)", "F & Z80_C_FLAG",
+    "!(F & Z80_P_FLAG)", "F & Z80_P_FLAG",
+    "!(F & Z80_S_FLAG)", "F & Z80_S_FLAG",
+]
+
+# Bodies of the instructions that z80block_impl.h handles with more than a
+# macro call. Keep these in sync with its micro-op handlers.
+HANDLERS = {
+    "ADD_HL": """{
+        int     x, y, z, f, c;
+
+        x = HL;
+        y = %(rr)s;
+        z = x + y;
+
+        c = x ^ y ^ z;
+        f = F & SZPV_FLAGS;
+
+#ifndef Z80_DOCUMENTED_FLAGS_ONLY
+
+        f |= (z >> 8) & YX_FLAGS;
+        f |= (c >> 8) & Z80_H_FLAG;
+
+#endif
+
+        f |= c >> (16 - Z80_C_FLAG_SHIFT);
+
+        HL = z;
+        F = f;
+}""",
+    "ADC_HL": """{
+        int     x, y, z, f, c;
+
+        x = HL;
+        y = %(rr)s;
+        z = x + y + (F & Z80_C_FLAG);
+
+        c = x ^ y ^ z;
+        f = z & 0xffff
+                ? (z >> 8) & SYX_FLAGS
+                : Z80_Z_FLAG;
+
+#ifndef Z80_DOCUMENTED_FLAGS_ONLY
+
+        f |= (c >> 8) & Z80_H_FLAG;
+
+#endif
+
+        f |= OVERFLOW_TABLE[c >> 15];
+        f |= z >> (16 - Z80_C_FLAG_SHIFT);
+
+        HL = z;
+        F = f;
+}""",
+    "SBC_HL": """{
+        int     x, y, z, f, c;
+
+        x = HL;
+        y = %(rr)s;
+        z = x - y - (F & Z80_C_FLAG);
+
+        c = x ^ y ^ z;
+        f = Z80_N_FLAG;
+        f |= z & 0xffff
+                ? (z >> 8) & SYX_FLAGS
+                : Z80_Z_FLAG;
+
+#ifndef Z80_DOCUMENTED_FLAGS_ONLY
+
+        f |= (c >> 8) & Z80_H_FLAG;
+
+#endif
+
+        c &= 0x018000;
+        f |= OVERFLOW_TABLE[c >> 15];
+        f |= c >> (16 - Z80_C_FLAG_SHIFT);
+
+        HL = z;
+        F = f;
+}""",
+    "DAA": """{
+        int     a, c, d;
+
+        a = A;
+        if (a > 0x99 || (F & Z80_C_FLAG)) {
+
+                c = Z80_C_FLAG;
+                d = 0x60;
+
+        } else
+
+                c = d = 0;
+
+        if ((a & 0x0f) > 0x09 || (F & Z80_H_FLAG))
+
+                d += 0x06;
+
+        A += F & Z80_N_FLAG ? -d : +d;
+        F = SZYXP_FLAGS_TABLE[A]
+                | ((A ^ a) & Z80_H_FLAG)
+                | (F & Z80_N_FLAG)
+                | c;
+}""",
+    "CPL": """{
+        A = ~A;
+        F = (F & (SZPV_FLAGS | Z80_C_FLAG))
+
+#ifndef Z80_DOCUMENTED_FLAGS_ONLY
+
+                | (A & YX_FLAGS)
+
+#endif
+
+                | Z80_H_FLAG | Z80_N_FLAG;
+}""",
+    "NEG": """{
+        int     a, f, z, c;
+
+        a = A;
+        z = -a;
+
+        c = a ^ z;
+        f = Z80_N_FLAG | (c & Z80_H_FLAG);
+        f |= SZYX_FLAGS_TABLE[z &= 0xff];
+        c &= 0x0180;
+        f |= OVERFLOW_TABLE[c >> 7];
+        f |= c >> (8 - Z80_C_FLAG_SHIFT);
+
+        A = z;
+        F = f;
+}""",
+    "CCF": """{
+        int     c;
+
+        c = F & Z80_C_FLAG;
+        F = (F & SZPV_FLAGS)
+                | (c << Z80_H_FLAG_SHIFT)
+
+#ifndef Z80_DOCUMENTED_FLAGS_ONLY
+
+                | (A & YX_FLAGS)
+
+#endif
+
+                | (c ^ Z80_C_FLAG);
+}""",
+    "SCF": """{
+        F = (F & SZPV_FLAGS)
+
+#ifndef Z80_DOCUMENTED_FLAGS_ONLY
+
+                | (A & YX_FLAGS)
+
+#endif
+
+                | Z80_C_FLAG;
+}""",
+    "RLCA": """{
+        A = (A << 1) | (A >> 7);
+        F = (F & SZPV_FLAGS)
+                | (A & (YX_FLAGS | Z80_C_FLAG));
+}""",
+    "RLA": """{
+        int     a, f;
+
+        a = A << 1;
+        f = (F & SZPV_FLAGS)
+
+#ifndef Z80_DOCUMENTED_FLAGS_ONLY
+
+                | (a & YX_FLAGS)
+
+#endif
+
+                | (A >> 7);
+        A = a | (F & Z80_C_FLAG);
+        F = f;
+}""",
+    "RRCA": """{
+        int     c;
+
+        c = A & 0x01;
+        A = (A >> 1) | (A << 7);
+        F = (F & SZPV_FLAGS)
+
+#ifndef Z80_DOCUMENTED_FLAGS_ONLY
+
+                | (A & YX_FLAGS)
+
+#endif
+
+                | c;
+}""",
+    "RRA": """{
+        int     c;
+
+        c = A & 0x01;
+        A = (A >> 1) | ((F & Z80_C_FLAG) << 7);
+        F = (F & SZPV_FLAGS)
+
+#ifndef Z80_DOCUMENTED_FLAGS_ONLY
+
+                | (A & YX_FLAGS)
+
+#endif
+
+                | c;
+}""",
+    "BIT_R": """{
+        int     x;
+
+        x = %(r)s & 0x%(mask)02x;
+        F = (x ? 0 : Z80_Z_FLAG | Z80_P_FLAG)
+
+#ifndef Z80_DOCUMENTED_FLAGS_ONLY
+
+                | (x & Z80_S_FLAG)
+                | (%(r)s & YX_FLAGS)
+
+#endif
+
+                | Z80_H_FLAG
+                | (F & Z80_C_FLAG);
+}""",
+    "BIT_MEM": """{
+        int     d, x;
+
+        d = HL;
+        Z80_READ_BYTE(d, x);
+        x &= 0x%(mask)02x;
+        F = (x ? 0 : Z80_Z_FLAG | Z80_P_FLAG)
+
+#ifndef Z80_DOCUMENTED_FLAGS_ONLY
+
+                | (x & Z80_S_FLAG)
+                | (d & YX_FLAGS)
+
+#endif
+
+                | Z80_H_FLAG
+                | (F & Z80_C_FLAG);
+}""",
+}
+
+class Image:
+    """Bytes loaded from one ROM or .CMD file."""
+
+    def __init__(self, pathname):
+        _, self.filename = os.path.split(pathname)
+        self.memory = {}
+        self.entries = []
+        binary = open(pathname, "rb").read()
+        if pathname.lower().endswith(".rom"):
+            for address, byte in enumerate(binary):
+                self.memory[address] = byte
+            # Reset, restarts, and the NMI.
+            self.entries = [0x0000, 0x0008, 0x0010, 0x0018, 0x0020, 0x0028, 0x0030, 0x0038, 0x0066]
+        else:
+            self.load_cmd(binary)
+
+    def load_cmd(self, binary):
+        # Same as loadCmdProgram() in trs80.cpp.
+        i = 0
+        while i + 2 <= len(binary):
+            chunk_type = binary[i]
+            chunk_length = binary[i + 1]
+            i += 2
+            if chunk_type == 0x01 and chunk_length <= 2:
+                chunk_length += 256
+            elif chunk_type == 0x05 and chunk_length == 0:
+                chunk_length = 256
+            data = binary[i:i + chunk_length]
+            i += chunk_length
+            if chunk_type == 0x01:
+                address = data[0] | (data[1] << 8)
+                for offset, byte in enumerate(data[2:]):
+                    self.memory[(address + offset) & 0xffff] = byte
+            elif chunk_type == 0x02:
+                self.entries.append(data[0] | (data[1] << 8))
+                break
+
+    def byte(self, address):
+        return self.memory.get(address & 0xffff)
+
+class Instruction:
+    """One decoded instruction. Flow is "next", "jump" (to target), "branch"
+    (to next or target), or "exit" (to a register or the stack). The body is
+    C code run after the cycles and R are counted. taken is C code run when
+    a branch is taken, before going to the target."""
+
+    def __init__(self, address, length, m1, cycles):
+        self.address = address
+        self.length = length
+        self.m1 = m1
+        self.cycles = cycles
+        self.body = ""
+        self.writes = False
+        self.flow = "next"
+        self.target = None
+        self.condition = None
+        self.taken = ""
+        self.taken_writes = False
+        self.call = False
+
+    @property
+    def next(self):
+        return (self.address + self.length) & 0xffff
+
+def byte_register(r):
+    return "state->registers.byte[Z80_%s]" % (BYTE_REGISTERS[r],)
+
+def word_register(name):
+    return "state->registers.word[Z80_%s]" % (name,)
+
+def signed(n):
+    return n - 256 if n >= 128 else n
+
+def instruction_length(image, address):
+    """Length of an instruction we don't translate, and whether execution
+    can go on to the next one, or None if we can't tell."""
+
+    opcode = image.byte(address)
+    if opcode is None:
+        return None
+    if opcode in (0xdd, 0xfd):
+        opcode = image.byte(address + 1)
+        if opcode is None or opcode in (0xdd, 0xfd, 0xed):
+            return None
+        if opcode == 0xcb:
+            return 4, True
+        base = instruction_length(image, address + 1)
+        if base is None or not base[1] or opcode in (0xe3, 0xe9):
+            return None
+        x, y, z = opcode >> 6, (opcode >> 3) & 7, opcode & 7
+        uses_memory = ((x == 1 and (y == 6 or z == 6) and opcode != 0x76)
+                or (x == 2 and z == 6)
+                or (x == 0 and z in (4, 5, 6) and y == 6))
+        return 1 + base[0] + (1 if uses_memory else 0), True
+    if opcode == 0xed:
+        second = image.byte(address + 1)
+        if second is None:
+            return None
+        if second & 0xc7 == 0x45:
+            # RETN, RETI.
+            return None
+        if second & 0xc7 == 0x43:
+            return 4, True
+        return 2, True
+    if opcode == 0xcb:
+        return 2, True
+    x, y, z, p, q = opcode >> 6, (opcode >> 3) & 7, opcode & 7, (opcode >> 4) & 3, (opcode >> 3) & 1
+    if opcode == 0x76:
+        # HALT, which carries on after an interrupt.
+        return 1, True
+    if x == 0:
+        if z == 0:
+            return (1 if y < 2 else 2), y != 3
+        if z == 1:
+            return (3 if q == 0 else 1), True
+        if z == 2:
+            return (1 if p < 2 else 3), True
+        if z == 6:
+            return 2, True
+        return 1, True
+    if x in (1, 2):
+        return 1, True
+    if z == 0:
+        return 1, True
+    if z == 1:
+        return 1, not (q == 1 and p in (0, 2))
+    if z == 2:
+        return 3, True
+    if z == 3:
+        if y == 0:
+            return None
+        if y in (2, 3):
+            return 2, True
+        return 1, True
+    if z == 4:
+        return 3, True
+    if z == 5:
+        return (1 if q == 0 else 3), q == 0
+    if z == 6:
+        return 2, True
+    return None
+
+def is_delay_loop(image, address, opcode):
+    """Whether DEC rr at address starts a loop that the block cache skips in
+    one step (see is_dec_rr_loop() in z80emu_impl.h)."""
+
+    if opcode & 0xcf != 0x0b or opcode == 0x3b:
+        return False
+    high = (opcode >> 3) & 0x06
+    low = high + 1
+    ld, or_, jr, e = [image.byte(address + i) for i in range(1, 5)]
+    return jr == 0x20 and e == 0xfb and (
+            (ld == 0x78 | high and or_ == 0xb0 | low)
+            or (ld == 0x78 | low and or_ == 0xb0 | high))
+
+def decode(image, address):
+    """Decode the instruction at address, or return None if the block cache
+    leaves it to emulate() or a special micro-op."""
+
+    def fetch(offset):
+        return image.byte(address + offset)
+
+    opcode = fetch(0)
+    if opcode is None:
+        return None
+    x, y, z, p, q = opcode >> 6, (opcode >> 3) & 7, opcode & 7, (opcode >> 4) & 3, (opcode >> 3) & 1
+
+    def immediate(offset):
+        n = fetch(offset)
+        if n is None:
+            raise KeyError
+        return n
+
+    def immediate_word(offset):
+        return immediate(offset) | (immediate(offset + 1) << 8)
+
+    try:
+        if opcode == 0xcb:
+            return decode_cb(image, address, immediate(1))
+        if opcode == 0xed:
+            return decode_ed(image, address, immediate(1), immediate_word)
+        if opcode in (0xdd, 0xfd):
+            return None
+
+        if x == 1:
+            if opcode == 0x76:
+                return None
+            if y == 6:
+                i = Instruction(address, 1, 1, 7)
+                i.body = "Z80_WRITE_BYTE(HL, %s);" % (byte_register(z),)
+                i.writes = True
+            elif z == 6:
+                i = Instruction(address, 1, 1, 7)
+                i.body = "Z80_READ_BYTE(HL, %s);" % (byte_register(y),)
+            else:
+                i = Instruction(address, 1, 1, 4)
+                i.body = "%s = %s;" % (byte_register(y), byte_register(z))
+            return i
+
+        if x == 2:
+            operation = ALU_OPERATIONS[y]
+            if z == 6:
+                i = Instruction(address, 1, 1, 7)
+                i.body = "{\n        int     x;\n\n        Z80_READ_BYTE(HL, x);\n        %s(x);\n}" % (operation,)
+            else:
+                i = Instruction(address, 1, 1, 4)
+                i.body = "%s(%s);" % (operation, byte_register(z))
+            return i
+
+        if x == 0:
+            if z == 0:
+                if y == 0:
+                    return Instruction(address, 1, 1, 4)
+                if y == 1:
+                    i = Instruction(address, 1, 1, 4)
+                    i.body = "EXCHANGE(AF, state->alternates[Z80_AF]);"
+                    return i
+                target = (address + 2 + signed(immediate(1))) & 0xffff
+                if y == 2:
+                    if target == address:
+                        # Left to the block cache, which skips the loop.
+                        return None
+                    i = Instruction(address, 2, 1, 8)
+                    i.flow = "branch"
+                    i.condition = "--B"
+                    i.taken = "elapsed_cycles += 5;"
+                elif y == 3:
+                    i = Instruction(address, 2, 1, 12)
+                    i.flow = "jump"
+                else:
+                    i = Instruction(address, 2, 1, 7)
+                    i.flow = "branch"
+                    i.condition = CONDITIONS[y - 4]
+                    i.taken = "elapsed_cycles += 5;"
+                i.target = target
+                return i
+            if z == 1:
+                if q == 0:
+                    i = Instruction(address, 3, 1, 10)
+                    i.body = "%s = 0x%04x;" % (WORD_REGISTERS[p], immediate_word(1))
+                else:
+                    i = Instruction(address, 1, 1, 11)
+                    i.body = HANDLERS["ADD_HL"] % {"rr": WORD_REGISTERS[p]}
+                return i
+            if z == 2:
+                if p < 2:
+                    i = Instruction(address, 1, 1, 7)
+                    pair = WORD_REGISTERS[p]
+                    if q == 0:
+                        i.body = "Z80_WRITE_BYTE(%s, A);" % (pair,)
+                        i.writes = True
+                    else:
+                        i.body = "Z80_READ_BYTE(%s, A);" % (pair,)
+                    return i
+                nn = immediate_word(1)
+                if p == 2:
+                    i = Instruction(address, 3, 1, 16)
+                    if q == 0:
+                        i.body = "Z80_WRITE_WORD(0x%04x, HL);" % (nn,)
+                        i.writes = True
+                    else:
+                        i.body = "Z80_READ_WORD(0x%04x, HL);" % (nn,)
+                    return i
+                i = Instruction(address, 3, 1, 13)
+                if q == 0:
+                    i.body = "Z80_WRITE_BYTE(0x%04x, A);" % (nn,)
+                    i.writes = True
+                else:
+                    i.body = "Z80_READ_BYTE(0x%04x, A);" % (nn,)
+                return i
+            if z == 3:
+                if q == 1 and is_delay_loop(image, address, opcode):
+                    # Left to the block cache, which skips the loop.
+                    return None
+                i = Instruction(address, 1, 1, 6)
+                i.body = "%s%s;" % (WORD_REGISTERS[p], "++" if q == 0 else "--")
+                return i
+            if z in (4, 5):
+                operation = "INC" if z == 4 else "DEC"
+                if y == 6:
+                    i = Instruction(address, 1, 1, 11)
+                    i.body = ("{\n        int     d, x;\n\n        d = HL;\n        Z80_READ_BYTE(d, x);\n"
+                            + "        %s(x);\n        Z80_WRITE_BYTE(d, x);\n}") % (operation,)
+                    i.writes = True
+                else:
+                    i = Instruction(address, 1, 1, 4)
+                    i.body = "%s(%s);" % (operation, byte_register(y))
+                return i
+            if z == 6:
+                n = immediate(1)
+                if y == 6:
+                    i = Instruction(address, 2, 1, 10)
+                    i.body = "Z80_WRITE_BYTE(HL, 0x%02x);" % (n,)
+                    i.writes = True
+                else:
+                    i = Instruction(address, 2, 1, 7)
+                    i.body = "%s = 0x%02x;" % (byte_register(y), n)
+                return i
+            i = Instruction(address, 1, 1, 4)
+            i.body = HANDLERS[["RLCA", "RRCA", "RLA", "RRA", "DAA", "CPL", "SCF", "CCF"][y]]
+            return i
+
+        # x == 3.
+        if z == 0:
+            i = Instruction(address, 1, 1, 5)
+            i.flow = "branch"
+            i.condition = CONDITIONS[y]
+            i.taken = "Z80_READ_WORD(SP, pc);\nSP += 2;\nelapsed_cycles += 6;"
+            return i
+        if z == 1:
+            if q == 0:
+                i = Instruction(address, 1, 1, 10)
+                i.body = "Z80_READ_WORD(SP, %s);\nSP += 2;" % (STACK_REGISTERS[p],)
+                return i
+            if p == 0:
+                i = Instruction(address, 1, 1, 10)
+                i.body = "Z80_READ_WORD(SP, pc);\nSP += 2;"
+                i.flow = "exit"
+                return i
+            if p == 1:
+                i = Instruction(address, 1, 1, 4)
+                i.body = ("EXCHANGE(BC, state->alternates[Z80_BC]);\n"
+                        + "EXCHANGE(DE, state->alternates[Z80_DE]);\n"
+                        + "EXCHANGE(HL, state->alternates[Z80_HL]);")
+                return i
+            if p == 2:
+                i = Instruction(address, 1, 1, 4)
+                i.body = "pc = HL;"
+                i.flow = "exit"
+                return i
+            i = Instruction(address, 1, 1, 6)
+            i.body = "SP = HL;"
+            return i
+        if z == 2:
+            i = Instruction(address, 3, 1, 10)
+            i.flow = "branch"
+            i.condition = CONDITIONS[y]
+            i.target = immediate_word(1)
+            return i
+        if z == 3:
+            if y == 0:
+                i = Instruction(address, 3, 1, 10)
+                i.flow = "jump"
+                i.target = immediate_word(1)
+                return i
+            if y in (2, 3):
+                i = Instruction(address, 2, 1, 11)
+                if y == 2:
+                    i.body = "Z80_OUTPUT_BYTE(0x%02x, A);" % (immediate(1),)
+                else:
+                    i.body = "Z80_INPUT_BYTE(0x%02x, A);" % (immediate(1),)
+                return i
+            if y == 5:
+                i = Instruction(address, 1, 1, 4)
+                i.body = "EXCHANGE(DE, HL);"
+                return i
+            if y in (6, 7):
+                i = Instruction(address, 1, 1, 4)
+                i.body = "state->iff1 = state->iff2 = %d;\nnumber_cycles += 4;" % (y - 6,)
+                if y == 7:
+                    i.body += "\nZ80_STOP_FOR_INTERRUPT(1);"
+                return i
+            return None
+        if z == 4:
+            i = Instruction(address, 3, 1, 10)
+            i.flow = "branch"
+            i.condition = CONDITIONS[y]
+            i.target = immediate_word(1)
+            i.taken = "SP -= 2;\npc = 0x%04x;\nZ80_WRITE_WORD(SP, pc);\nelapsed_cycles += 7;" % (i.next,)
+            i.taken_writes = True
+            return i
+        if z == 5:
+            if q == 0:
+                i = Instruction(address, 1, 1, 11)
+                i.body = "SP -= 2;\nZ80_WRITE_WORD(SP, %s);" % (STACK_REGISTERS[p],)
+                i.writes = True
+                return i
+            if p == 0:
+                i = Instruction(address, 3, 1, 17)
+                i.target = immediate_word(1)
+                i.body = "SP -= 2;\npc = 0x%04x;\nZ80_WRITE_WORD(SP, pc);" % (i.next,)
+                i.writes = True
+                i.flow = "jump"
+                i.call = True
+                return i
+            return None
+        if z == 6:
+            i = Instruction(address, 2, 1, 7)
+            i.body = "%s(0x%02x);" % (ALU_OPERATIONS[y], immediate(1))
+            return i
+        i = Instruction(address, 1, 1, 11)
+        i.target = y * 8
+        i.body = "SP -= 2;\npc = 0x%04x;\nZ80_WRITE_WORD(SP, pc);" % (i.next,)
+        i.writes = True
+        i.flow = "jump"
+        i.call = True
+        return i
+    except KeyError:
+        return None
+
+def decode_cb(image, address, opcode):
+    x, y, z = opcode >> 6, (opcode >> 3) & 7, opcode & 7
+    if z == 6:
+        if x == 1:
+            i = Instruction(address, 2, 2, 12)
+            i.body = HANDLERS["BIT_MEM"] % {"mask": 1 << y}
+            return i
+        i = Instruction(address, 2, 2, 15)
+        if x == 0:
+            operation = "%s(x);" % (SHIFT_OPERATIONS[y],)
+        elif x == 2:
+            operation = "x &= ~0x%02x;" % (1 << y,)
+        else:
+            operation = "x |= 0x%02x;" % (1 << y,)
+        i.body = ("{\n        int     d, x;\n\n        d = HL;\n        Z80_READ_BYTE(d, x);\n"
+                + "        %s\n        Z80_WRITE_BYTE(d, x);\n}") % (operation,)
+        i.writes = True
+        return i
+    i = Instruction(address, 2, 2, 8)
+    r = byte_register(z)
+    if x == 0:
+        i.body = "%s(%s);" % (SHIFT_OPERATIONS[y], r)
+    elif x == 1:
+        i.body = HANDLERS["BIT_R"] % {"r": r, "mask": 1 << y}
+    elif x == 2:
+        i.body = "%s &= ~0x%02x;" % (r, 1 << y)
+    else:
+        i.body = "%s |= 0x%02x;" % (r, 1 << y)
+    return i
+
+def decode_ed(image, address, opcode, immediate_word):
+    x, y, z, p, q = opcode >> 6, (opcode >> 3) & 7, opcode & 7, (opcode >> 4) & 3, (opcode >> 3) & 1
+    if x != 1:
+        return None
+    if z == 2:
+        i = Instruction(address, 2, 2, 15)
+        i.body = HANDLERS["SBC_HL" if q == 0 else "ADC_HL"] % {"rr": WORD_REGISTERS[p]}
+        return i
+    if z == 3:
+        nn = immediate_word(2)
+        i = Instruction(address, 4, 2, 20)
+        if q == 0:
+            i.body = "Z80_WRITE_WORD(0x%04x, %s);" % (nn, WORD_REGISTERS[p])
+            i.writes = True
+        else:
+            i.body = "Z80_READ_WORD(0x%04x, %s);" % (nn, WORD_REGISTERS[p])
+        return i
+    if z == 4:
+        i = Instruction(address, 2, 2, 8)
+        i.body = HANDLERS["NEG"]
+        return i
+    return None
+
+class Region:
+    """Instructions translated into one function."""
+
+    def __init__(self, index, image):
+        self.index = index
+        self.image = image
+        self.instructions = {}
+        self.entries = set()
+
+def trace(image):
+    """Find the reachable instructions of the image, and the addresses the
+    block cache may look them up at."""
+
+    instructions = {}
+    entries = set(image.entries)
+    pending = list(image.entries)
+    seen = set()
+    while pending:
+        address = pending.pop()
+        if address in seen:
+            continue
+        seen.add(address)
+        instruction = decode(image, address)
+        if instruction is None:
+            length = instruction_length(image, address)
+            if length is not None and length[1]:
+                following = (address + length[0]) & 0xffff
+                entries.add(following)
+                pending.append(following)
+            continue
+        instructions[address] = instruction
+        if instruction.flow in ("next", "branch"):
+            pending.append(instruction.next)
+        if instruction.target is not None:
+            pending.append(instruction.target)
+        if instruction.call:
+            # Calls return to the next instruction.
+            entries.add(instruction.next)
+            pending.append(instruction.next)
+    return instructions, entries
+
+def successors(instruction):
+    result = []
+    if instruction.flow in ("next", "branch"):
+        result.append(instruction.next)
+    if instruction.target is not None:
+        result.append(instruction.target)
+    return result
+
+def make_regions(image, first_index):
+    instructions, entries = trace(image)
+    region_of = {}
+    regions = []
+    roots = sorted(entries) + sorted(instructions)
+    for root in roots:
+        if root not in instructions or root in region_of:
+            continue
+        region = Region(first_index + len(regions), image)
+        regions.append(region)
+        pending = [root]
+        while pending and len(region.instructions) < MAX_REGION_SIZE:
+            address = pending.pop(0)
+            if address not in instructions or address in region_of:
+                continue
+            region_of[address] = region
+            region.instructions[address] = instructions[address]
+            pending.extend(successors(instructions[address]))
+        region.entries.add(root)
+
+    # Anything reached from outside the region is an entry.
+    for region in regions:
+        for instruction in region.instructions.values():
+            for address in successors(instruction):
+                other = region_of.get(address)
+                if other is not None and other is not region:
+                    other.entries.add(address)
+    for address in entries:
+        if address in region_of:
+            region_of[address].entries.add(address)
+
+    return regions
+
+def ranges(region):
+    """Contiguous runs of bytes of the region's instructions."""
+
+    result = []
+    for address in sorted(region.instructions):
+        end = address + region.instructions[address].length
+        if result and result[-1][1] >= address:
+            result[-1][1] = max(result[-1][1], end)
+        else:
+            result.append([address, end])
+    return result
+
+def indent(text, spaces):
+    lines = []
+    for line in text.split("\n"):
+        if line == "" or line.startswith("#"):
+            lines.append(line)
+        else:
+            lines.append(" "*spaces + line)
+    return "\n".join(lines)
+
+def write_region(out, region):
+    # Labels are only written for the instructions that something jumps to,
+    # so the body is kept as a list of lines and labels until the end.
+    lines = []
+    targets = set(region.entries)
+
+    def write(text):
+        lines.append(text)
+
+    def jump(target, pad):
+        targets.add(target)
+        write(pad + "goto L_%04x;\n" % (target,))
+
+    write("template <typename Bus>\n")
+    write("static void native_region_%d ([[maybe_unused]] Z80_STATE *state,\n" % (region.index,))
+    write("        [[maybe_unused]] Z80_BLOCK_CACHE *cache,\n")
+    write("        Z80_NATIVE_RUN *run,\n")
+    write("        [[maybe_unused]] Bus *context)\n")
+    write("{\n")
+    write("        int     elapsed_cycles, number_cycles, r, pc;\n")
+    write("\n")
+    write("        elapsed_cycles = run->elapsed_cycles;\n")
+    write("        number_cycles = run->number_cycles;\n")
+    write("        r = run->r;\n")
+    write("        switch (run->pc) {\n")
+    write("\n")
+    for address in sorted(region.entries):
+        write("                case 0x%04x: goto L_%04x;\n" % (address, address))
+    write("                default: pc = run->pc; goto done;\n")
+    write("\n")
+    write("        }\n")
+
+    addresses = sorted(region.instructions)
+    for position, address in enumerate(addresses):
+        instruction = region.instructions[address]
+        following = addresses[position + 1] if position + 1 < len(addresses) else None
+
+        def go(target, spaces):
+            # Same as NEXT_MICRO_OP() and BRANCH() in z80block_impl.h.
+            pad = " "*spaces
+            if target in region.instructions:
+                write(pad + "if (elapsed_cycles >= number_cycles) {\n")
+                write(pad + "        pc = 0x%04x;\n" % (target,))
+                write(pad + "        goto done;\n")
+                write(pad + "}\n")
+                if target != following or spaces != 8:
+                    jump(target, pad)
+            else:
+                write(pad + "pc = 0x%04x;\n" % (target,))
+                write(pad + "goto done;\n")
+
+        def check_written(target, spaces):
+            # Same as NEXT_MICRO_OP_AFTER_WRITE().
+            pad = " "*spaces
+            write(pad + "if (cache->invalidated) {\n")
+            write(pad + "        pc = 0x%04x;\n" % (target,))
+            write(pad + "        goto done;\n")
+            write(pad + "}\n")
+
+        write("\n")
+        lines.append(address)
+        write("        elapsed_cycles += %d;\n" % (instruction.cycles,))
+        write("        r += %d;\n" % (instruction.m1,))
+        if instruction.body:
+            write(indent(instruction.body, 8) + "\n")
+        if instruction.flow == "exit":
+            write("        goto done;\n")
+            continue
+        if instruction.flow == "branch":
+            write("        if (%s) {\n" % (instruction.condition,))
+            write(indent(instruction.taken, 16) + "\n")
+            if instruction.target is None:
+                write("                goto done;\n")
+            else:
+                if instruction.taken_writes:
+                    check_written(instruction.target, 16)
+                go(instruction.target, 16)
+            write("        }\n")
+            if instruction.writes:
+                check_written(instruction.next, 8)
+            go(instruction.next, 8)
+            continue
+        target = instruction.next if instruction.flow == "next" else instruction.target
+        if instruction.writes:
+            check_written(target, 8)
+        go(target, 8)
+
+    write("\n")
+    write("done:\n")
+    write("        run->pc = pc;\n")
+    write("        run->r = r;\n")
+    write("        run->elapsed_cycles = elapsed_cycles;\n")
+    write("        run->number_cycles = number_cycles;\n")
+    write("}\n")
+    write("\n")
+
+    for line in lines:
+        if isinstance(line, str):
+            out.write(line)
+        elif line in targets:
+            out.write("L_%04x:\n" % (line,))
+
+def main():
+    args = sys.argv[1:]
+    output_pathname = None
+    if len(args) >= 2 and args[0] == "-o":
+        output_pathname = args[1]
+        args = args[2:]
+    if not args:
+        print("Usage: make_native_blocks.py [-o HEADER] IMAGE...")
+        sys.exit(1)
+
+    images = [Image(pathname) for pathname in args]
+    regions = []
+    for image in images:
+        regions.extend(make_regions(image, len(regions)))
+
+    # Written all at once at the end, so a failure doesn't leave half a header
+    # that looks up to date.
+    out = io.StringIO()
+    out.write("/* Generated by make_native_blocks.py from %s. Do not modify. */\n"
+            % (", ".join(image.filename for image in images),))
+    out.write("\n")
+    out.write("/* Included by z80block_impl.h, see z80native.h. */\n")
+    out.write("\n")
+
+    for region in regions:
+        write_region(out, region)
+
+    # Entries, sorted by address.
+    entries = sorted((address, region.index) for region in regions for address in region.entries)
+    out.write("static const Z80_NATIVE_ENTRY NATIVE_ENTRIES[] = {\n")
+    out.write("\n")
+    for address, index in entries:
+        out.write("        { 0x%04x, %d },\n" % (address, index))
+    out.write("\n")
+    out.write("};\n")
+    out.write("\n")
+
+    # The bytes each region was translated from.
+    out.write("static const Z80_NATIVE_RANGE NATIVE_RANGES[] = {\n")
+    out.write("\n")
+    first_ranges = []
+    count = 0
+    offset = 0
+    for region in regions:
+        first_ranges.append(count)
+        for start, end in ranges(region):
+            out.write("        { 0x%04x, %d, %d },\n" % (start, end - start, offset))
+            offset += end - start
+            count += 1
+    out.write("\n")
+    out.write("};\n")
+    out.write("\n")
+
+    out.write("static const unsigned char NATIVE_BYTES[] = {\n")
+    out.write("\n")
+    data = []
+    for region in regions:
+        for start, end in ranges(region):
+            data.extend(region.image.byte(address) for address in range(start, end))
+    for i in range(0, len(data), 12):
+        out.write("        " + " ".join("0x%02x," % (b,) for b in data[i:i + 12]) + "\n")
+    out.write("\n")
+    out.write("};\n")
+    out.write("\n")
+
+    out.write("static const Z80_NATIVE_REGION NATIVE_REGIONS[] = {\n")
+    out.write("\n")
+    for region, first in zip(regions, first_ranges):
+        out.write("        { %d, %d },\n" % (first, len(ranges(region))))
+    out.write("\n")
+    out.write("};\n")
+    out.write("\n")
+
+    out.write("template <typename Bus>\n")
+    out.write("static const Z80_NATIVE_FUNCTION<Bus> NATIVE_FUNCTIONS[] = {\n")
+    out.write("\n")
+    for region in regions:
+        out.write("        native_region_%d<Bus>,\n" % (region.index,))
+    out.write("\n")
+    out.write("};\n")
+
+    if output_pathname is None:
+        sys.stdout.write(out.getvalue())
+    else:
+        with open(output_pathname, "w") as f:
+            f.write(out.getvalue())
+
+    sys.stderr.write("%d instructions in %d regions, %d entries, %d bytes\n"
+            % (sum(len(region.instructions) for region in regions), len(regions), len(entries), len(data)))
+
+main()
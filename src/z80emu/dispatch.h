@@ -0,0 +1,779 @@
+/* Generated by make_dispatch_tables.py from tables.h. Do not modify. */
+
+/* Expanded inside emulate(), since the handler labels are local to it. */
+
+#define DECLARE_DISPATCH_TABLES                                         \
+static void * const INSTRUCTION_DISPATCH_TABLE[256] = {                 \
+        &&NOP_HANDLER,                                                  \
+        &&LD_RR_NN_HANDLER,                                             \
+        &&LD_INDIRECT_BC_A_HANDLER,                                     \
+        &&INC_RR_HANDLER,                                               \
+        &&INC_R_HANDLER,                                                \
+        &&DEC_R_HANDLER,                                                \
+        &&LD_R_N_HANDLER,                                               \
+        &&RLCA_HANDLER,                                                 \
+        &&EX_AF_AF_PRIME_HANDLER,                                       \
+        &&ADD_HL_RR_HANDLER,                                            \
+        &&LD_A_INDIRECT_BC_HANDLER,                                     \
+        &&DEC_RR_HANDLER,                                               \
+        &&INC_R_HANDLER,                                                \
+        &&DEC_R_HANDLER,                                                \
+        &&LD_R_N_HANDLER,                                               \
+        &&RRCA_HANDLER,                                                 \
+        &&DJNZ_E_HANDLER,                                               \
+        &&LD_RR_NN_HANDLER,                                             \
+        &&LD_INDIRECT_DE_A_HANDLER,                                     \
+        &&INC_RR_HANDLER,                                               \
+        &&INC_R_HANDLER,                                                \
+        &&DEC_R_HANDLER,                                                \
+        &&LD_R_N_HANDLER,                                               \
+        &&RLA_HANDLER,                                                  \
+        &&JR_E_HANDLER,                                                 \
+        &&ADD_HL_RR_HANDLER,                                            \
+        &&LD_A_INDIRECT_DE_HANDLER,                                     \
+        &&DEC_RR_HANDLER,                                               \
+        &&INC_R_HANDLER,                                                \
+        &&DEC_R_HANDLER,                                                \
+        &&LD_R_N_HANDLER,                                               \
+        &&RRA_HANDLER,                                                  \
+        &&JR_DD_E_HANDLER,                                              \
+        &&LD_RR_NN_HANDLER,                                             \
+        &&LD_INDIRECT_NN_HL_HANDLER,                                    \
+        &&INC_RR_HANDLER,                                               \
+        &&INC_R_HANDLER,                                                \
+        &&DEC_R_HANDLER,                                                \
+        &&LD_R_N_HANDLER,                                               \
+        &&DAA_HANDLER,                                                  \
+        &&JR_DD_E_HANDLER,                                              \
+        &&ADD_HL_RR_HANDLER,                                            \
+        &&LD_HL_INDIRECT_NN_HANDLER,                                    \
+        &&DEC_RR_HANDLER,                                               \
+        &&INC_R_HANDLER,                                                \
+        &&DEC_R_HANDLER,                                                \
+        &&LD_R_N_HANDLER,                                               \
+        &&CPL_HANDLER,                                                  \
+        &&JR_DD_E_HANDLER,                                              \
+        &&LD_RR_NN_HANDLER,                                             \
+        &&LD_INDIRECT_NN_A_HANDLER,                                     \
+        &&INC_RR_HANDLER,                                               \
+        &&INC_INDIRECT_HL_HANDLER,                                      \
+        &&DEC_INDIRECT_HL_HANDLER,                                      \
+        &&LD_INDIRECT_HL_N_HANDLER,                                     \
+        &&SCF_HANDLER,                                                  \
+        &&JR_DD_E_HANDLER,                                              \
+        &&ADD_HL_RR_HANDLER,                                            \
+        &&LD_A_INDIRECT_NN_HANDLER,                                     \
+        &&DEC_RR_HANDLER,                                               \
+        &&INC_R_HANDLER,                                                \
+        &&DEC_R_HANDLER,                                                \
+        &&LD_R_N_HANDLER,                                               \
+        &&CCF_HANDLER,                                                  \
+        &&NOP_HANDLER,                                                  \
+        &&LD_R_R_HANDLER,                                               \
+        &&LD_R_R_HANDLER,                                               \
+        &&LD_R_R_HANDLER,                                               \
+        &&LD_R_R_HANDLER,                                               \
+        &&LD_R_R_HANDLER,                                               \
+        &&LD_R_INDIRECT_HL_HANDLER,                                     \
+        &&LD_R_R_HANDLER,                                               \
+        &&LD_R_R_HANDLER,                                               \
+        &&NOP_HANDLER,                                                  \
+        &&LD_R_R_HANDLER,                                               \
+        &&LD_R_R_HANDLER,                                               \
+        &&LD_R_R_HANDLER,                                               \
+        &&LD_R_R_HANDLER,                                               \
+        &&LD_R_INDIRECT_HL_HANDLER,                                     \
+        &&LD_R_R_HANDLER,                                               \
+        &&LD_R_R_HANDLER,                                               \
+        &&LD_R_R_HANDLER,                                               \
+        &&NOP_HANDLER,                                                  \
+        &&LD_R_R_HANDLER,                                               \
+        &&LD_R_R_HANDLER,                                               \
+        &&LD_R_R_HANDLER,                                               \
+        &&LD_R_INDIRECT_HL_HANDLER,                                     \
+        &&LD_R_R_HANDLER,                                               \
+        &&LD_R_R_HANDLER,                                               \
+        &&LD_R_R_HANDLER,                                               \
+        &&LD_R_R_HANDLER,                                               \
+        &&NOP_HANDLER,                                                  \
+        &&LD_R_R_HANDLER,                                               \
+        &&LD_R_R_HANDLER,                                               \
+        &&LD_R_INDIRECT_HL_HANDLER,                                     \
+        &&LD_R_R_HANDLER,                                               \
+        &&LD_R_R_HANDLER,                                               \
+        &&LD_R_R_HANDLER,                                               \
+        &&LD_R_R_HANDLER,                                               \
+        &&LD_R_R_HANDLER,                                               \
+        &&NOP_HANDLER,                                                  \
+        &&LD_R_R_HANDLER,                                               \
+        &&LD_R_INDIRECT_HL_HANDLER,                                     \
+        &&LD_R_R_HANDLER,                                               \
+        &&LD_R_R_HANDLER,                                               \
+        &&LD_R_R_HANDLER,                                               \
+        &&LD_R_R_HANDLER,                                               \
+        &&LD_R_R_HANDLER,                                               \
+        &&LD_R_R_HANDLER,                                               \
+        &&NOP_HANDLER,                                                  \
+        &&LD_R_INDIRECT_HL_HANDLER,                                     \
+        &&LD_R_R_HANDLER,                                               \
+        &&LD_INDIRECT_HL_R_HANDLER,                                     \
+        &&LD_INDIRECT_HL_R_HANDLER,                                     \
+        &&LD_INDIRECT_HL_R_HANDLER,                                     \
+        &&LD_INDIRECT_HL_R_HANDLER,                                     \
+        &&LD_INDIRECT_HL_R_HANDLER,                                     \
+        &&LD_INDIRECT_HL_R_HANDLER,                                     \
+        &&HALT_HANDLER,                                                 \
+        &&LD_INDIRECT_HL_R_HANDLER,                                     \
+        &&LD_R_R_HANDLER,                                               \
+        &&LD_R_R_HANDLER,                                               \
+        &&LD_R_R_HANDLER,                                               \
+        &&LD_R_R_HANDLER,                                               \
+        &&LD_R_R_HANDLER,                                               \
+        &&LD_R_R_HANDLER,                                               \
+        &&LD_R_INDIRECT_HL_HANDLER,                                     \
+        &&NOP_HANDLER,                                                  \
+        &&ADD_R_HANDLER,                                                \
+        &&ADD_R_HANDLER,                                                \
+        &&ADD_R_HANDLER,                                                \
+        &&ADD_R_HANDLER,                                                \
+        &&ADD_R_HANDLER,                                                \
+        &&ADD_R_HANDLER,                                                \
+        &&ADD_INDIRECT_HL_HANDLER,                                      \
+        &&ADD_R_HANDLER,                                                \
+        &&ADC_R_HANDLER,                                                \
+        &&ADC_R_HANDLER,                                                \
+        &&ADC_R_HANDLER,                                                \
+        &&ADC_R_HANDLER,                                                \
+        &&ADC_R_HANDLER,                                                \
+        &&ADC_R_HANDLER,                                                \
+        &&ADC_INDIRECT_HL_HANDLER,                                      \
+        &&ADC_R_HANDLER,                                                \
+        &&SUB_R_HANDLER,                                                \
+        &&SUB_R_HANDLER,                                                \
+        &&SUB_R_HANDLER,                                                \
+        &&SUB_R_HANDLER,                                                \
+        &&SUB_R_HANDLER,                                                \
+        &&SUB_R_HANDLER,                                                \
+        &&SUB_INDIRECT_HL_HANDLER,                                      \
+        &&SUB_R_HANDLER,                                                \
+        &&SBC_R_HANDLER,                                                \
+        &&SBC_R_HANDLER,                                                \
+        &&SBC_R_HANDLER,                                                \
+        &&SBC_R_HANDLER,                                                \
+        &&SBC_R_HANDLER,                                                \
+        &&SBC_R_HANDLER,                                                \
+        &&SBC_INDIRECT_HL_HANDLER,                                      \
+        &&SBC_R_HANDLER,                                                \
+        &&AND_R_HANDLER,                                                \
+        &&AND_R_HANDLER,                                                \
+        &&AND_R_HANDLER,                                                \
+        &&AND_R_HANDLER,                                                \
+        &&AND_R_HANDLER,                                                \
+        &&AND_R_HANDLER,                                                \
+        &&AND_INDIRECT_HL_HANDLER,                                      \
+        &&AND_R_HANDLER,                                                \
+        &&XOR_R_HANDLER,                                                \
+        &&XOR_R_HANDLER,                                                \
+        &&XOR_R_HANDLER,                                                \
+        &&XOR_R_HANDLER,                                                \
+        &&XOR_R_HANDLER,                                                \
+        &&XOR_R_HANDLER,                                                \
+        &&XOR_INDIRECT_HL_HANDLER,                                      \
+        &&XOR_R_HANDLER,                                                \
+        &&OR_R_HANDLER,                                                 \
+        &&OR_R_HANDLER,                                                 \
+        &&OR_R_HANDLER,                                                 \
+        &&OR_R_HANDLER,                                                 \
+        &&OR_R_HANDLER,                                                 \
+        &&OR_R_HANDLER,                                                 \
+        &&OR_INDIRECT_HL_HANDLER,                                       \
+        &&OR_R_HANDLER,                                                 \
+        &&CP_R_HANDLER,                                                 \
+        &&CP_R_HANDLER,                                                 \
+        &&CP_R_HANDLER,                                                 \
+        &&CP_R_HANDLER,                                                 \
+        &&CP_R_HANDLER,                                                 \
+        &&CP_R_HANDLER,                                                 \
+        &&CP_INDIRECT_HL_HANDLER,                                       \
+        &&CP_R_HANDLER,                                                 \
+        &&RET_CC_HANDLER,                                               \
+        &&POP_SS_HANDLER,                                               \
+        &&JP_CC_NN_HANDLER,                                             \
+        &&JP_NN_HANDLER,                                                \
+        &&CALL_CC_NN_HANDLER,                                           \
+        &&PUSH_SS_HANDLER,                                              \
+        &&ADD_N_HANDLER,                                                \
+        &&RST_P_HANDLER,                                                \
+        &&RET_CC_HANDLER,                                               \
+        &&RET_HANDLER,                                                  \
+        &&JP_CC_NN_HANDLER,                                             \
+        &&CB_PREFIX_HANDLER,                                            \
+        &&CALL_CC_NN_HANDLER,                                           \
+        &&CALL_NN_HANDLER,                                              \
+        &&ADC_N_HANDLER,                                                \
+        &&RST_P_HANDLER,                                                \
+        &&RET_CC_HANDLER,                                               \
+        &&POP_SS_HANDLER,                                               \
+        &&JP_CC_NN_HANDLER,                                             \
+        &&OUT_N_A_HANDLER,                                              \
+        &&CALL_CC_NN_HANDLER,                                           \
+        &&PUSH_SS_HANDLER,                                              \
+        &&SUB_N_HANDLER,                                                \
+        &&RST_P_HANDLER,                                                \
+        &&RET_CC_HANDLER,                                               \
+        &&EXX_HANDLER,                                                  \
+        &&JP_CC_NN_HANDLER,                                             \
+        &&IN_A_N_HANDLER,                                               \
+        &&CALL_CC_NN_HANDLER,                                           \
+        &&DD_PREFIX_HANDLER,                                            \
+        &&SBC_N_HANDLER,                                                \
+        &&RST_P_HANDLER,                                                \
+        &&RET_CC_HANDLER,                                               \
+        &&POP_SS_HANDLER,                                               \
+        &&JP_CC_NN_HANDLER,                                             \
+        &&EX_INDIRECT_SP_HL_HANDLER,                                    \
+        &&CALL_CC_NN_HANDLER,                                           \
+        &&PUSH_SS_HANDLER,                                              \
+        &&AND_N_HANDLER,                                                \
+        &&RST_P_HANDLER,                                                \
+        &&RET_CC_HANDLER,                                               \
+        &&JP_HL_HANDLER,                                                \
+        &&JP_CC_NN_HANDLER,                                             \
+        &&EX_DE_HL_HANDLER,                                             \
+        &&CALL_CC_NN_HANDLER,                                           \
+        &&ED_PREFIX_HANDLER,                                            \
+        &&XOR_N_HANDLER,                                                \
+        &&RST_P_HANDLER,                                                \
+        &&RET_CC_HANDLER,                                               \
+        &&POP_SS_HANDLER,                                               \
+        &&JP_CC_NN_HANDLER,                                             \
+        &&DI_HANDLER,                                                   \
+        &&CALL_CC_NN_HANDLER,                                           \
+        &&PUSH_SS_HANDLER,                                              \
+        &&OR_N_HANDLER,                                                 \
+        &&RST_P_HANDLER,                                                \
+        &&RET_CC_HANDLER,                                               \
+        &&LD_SP_HL_HANDLER,                                             \
+        &&JP_CC_NN_HANDLER,                                             \
+        &&EI_HANDLER,                                                   \
+        &&CALL_CC_NN_HANDLER,                                           \
+        &&FD_PREFIX_HANDLER,                                            \
+        &&CP_N_HANDLER,                                                 \
+        &&RST_P_HANDLER,                                                \
+};                                                                      \
+static void * const CB_INSTRUCTION_DISPATCH_TABLE[256] = {              \
+        &&RLC_R_HANDLER,                                                \
+        &&RLC_R_HANDLER,                                                \
+        &&RLC_R_HANDLER,                                                \
+        &&RLC_R_HANDLER,                                                \
+        &&RLC_R_HANDLER,                                                \
+        &&RLC_R_HANDLER,                                                \
+        &&RLC_INDIRECT_HL_HANDLER,                                      \
+        &&RLC_R_HANDLER,                                                \
+        &&RRC_R_HANDLER,                                                \
+        &&RRC_R_HANDLER,                                                \
+        &&RRC_R_HANDLER,                                                \
+        &&RRC_R_HANDLER,                                                \
+        &&RRC_R_HANDLER,                                                \
+        &&RRC_R_HANDLER,                                                \
+        &&RRC_INDIRECT_HL_HANDLER,                                      \
+        &&RRC_R_HANDLER,                                                \
+        &&RL_R_HANDLER,                                                 \
+        &&RL_R_HANDLER,                                                 \
+        &&RL_R_HANDLER,                                                 \
+        &&RL_R_HANDLER,                                                 \
+        &&RL_R_HANDLER,                                                 \
+        &&RL_R_HANDLER,                                                 \
+        &&RL_INDIRECT_HL_HANDLER,                                       \
+        &&RL_R_HANDLER,                                                 \
+        &&RR_R_HANDLER,                                                 \
+        &&RR_R_HANDLER,                                                 \
+        &&RR_R_HANDLER,                                                 \
+        &&RR_R_HANDLER,                                                 \
+        &&RR_R_HANDLER,                                                 \
+        &&RR_R_HANDLER,                                                 \
+        &&RR_INDIRECT_HL_HANDLER,                                       \
+        &&RR_R_HANDLER,                                                 \
+        &&SLA_R_HANDLER,                                                \
+        &&SLA_R_HANDLER,                                                \
+        &&SLA_R_HANDLER,                                                \
+        &&SLA_R_HANDLER,                                                \
+        &&SLA_R_HANDLER,                                                \
+        &&SLA_R_HANDLER,                                                \
+        &&SLA_INDIRECT_HL_HANDLER,                                      \
+        &&SLA_R_HANDLER,                                                \
+        &&SRA_R_HANDLER,                                                \
+        &&SRA_R_HANDLER,                                                \
+        &&SRA_R_HANDLER,                                                \
+        &&SRA_R_HANDLER,                                                \
+        &&SRA_R_HANDLER,                                                \
+        &&SRA_R_HANDLER,                                                \
+        &&SRA_INDIRECT_HL_HANDLER,                                      \
+        &&SRA_R_HANDLER,                                                \
+        &&SLL_R_HANDLER,                                                \
+        &&SLL_R_HANDLER,                                                \
+        &&SLL_R_HANDLER,                                                \
+        &&SLL_R_HANDLER,                                                \
+        &&SLL_R_HANDLER,                                                \
+        &&SLL_R_HANDLER,                                                \
+        &&SLL_INDIRECT_HL_HANDLER,                                      \
+        &&SLL_R_HANDLER,                                                \
+        &&SRL_R_HANDLER,                                                \
+        &&SRL_R_HANDLER,                                                \
+        &&SRL_R_HANDLER,                                                \
+        &&SRL_R_HANDLER,                                                \
+        &&SRL_R_HANDLER,                                                \
+        &&SRL_R_HANDLER,                                                \
+        &&SRL_INDIRECT_HL_HANDLER,                                      \
+        &&SRL_R_HANDLER,                                                \
+        &&BIT_B_R_HANDLER,                                              \
+        &&BIT_B_R_HANDLER,                                              \
+        &&BIT_B_R_HANDLER,                                              \
+        &&BIT_B_R_HANDLER,                                              \
+        &&BIT_B_R_HANDLER,                                              \
+        &&BIT_B_R_HANDLER,                                              \
+        &&BIT_B_INDIRECT_HL_HANDLER,                                    \
+        &&BIT_B_R_HANDLER,                                              \
+        &&BIT_B_R_HANDLER,                                              \
+        &&BIT_B_R_HANDLER,                                              \
+        &&BIT_B_R_HANDLER,                                              \
+        &&BIT_B_R_HANDLER,                                              \
+        &&BIT_B_R_HANDLER,                                              \
+        &&BIT_B_R_HANDLER,                                              \
+        &&BIT_B_INDIRECT_HL_HANDLER,                                    \
+        &&BIT_B_R_HANDLER,                                              \
+        &&BIT_B_R_HANDLER,                                              \
+        &&BIT_B_R_HANDLER,                                              \
+        &&BIT_B_R_HANDLER,                                              \
+        &&BIT_B_R_HANDLER,                                              \
+        &&BIT_B_R_HANDLER,                                              \
+        &&BIT_B_R_HANDLER,                                              \
+        &&BIT_B_INDIRECT_HL_HANDLER,                                    \
+        &&BIT_B_R_HANDLER,                                              \
+        &&BIT_B_R_HANDLER,                                              \
+        &&BIT_B_R_HANDLER,                                              \
+        &&BIT_B_R_HANDLER,                                              \
+        &&BIT_B_R_HANDLER,                                              \
+        &&BIT_B_R_HANDLER,                                              \
+        &&BIT_B_R_HANDLER,                                              \
+        &&BIT_B_INDIRECT_HL_HANDLER,                                    \
+        &&BIT_B_R_HANDLER,                                              \
+        &&BIT_B_R_HANDLER,                                              \
+        &&BIT_B_R_HANDLER,                                              \
+        &&BIT_B_R_HANDLER,                                              \
+        &&BIT_B_R_HANDLER,                                              \
+        &&BIT_B_R_HANDLER,                                              \
+        &&BIT_B_R_HANDLER,                                              \
+        &&BIT_B_INDIRECT_HL_HANDLER,                                    \
+        &&BIT_B_R_HANDLER,                                              \
+        &&BIT_B_R_HANDLER,                                              \
+        &&BIT_B_R_HANDLER,                                              \
+        &&BIT_B_R_HANDLER,                                              \
+        &&BIT_B_R_HANDLER,                                              \
+        &&BIT_B_R_HANDLER,                                              \
+        &&BIT_B_R_HANDLER,                                              \
+        &&BIT_B_INDIRECT_HL_HANDLER,                                    \
+        &&BIT_B_R_HANDLER,                                              \
+        &&BIT_B_R_HANDLER,                                              \
+        &&BIT_B_R_HANDLER,                                              \
+        &&BIT_B_R_HANDLER,                                              \
+        &&BIT_B_R_HANDLER,                                              \
+        &&BIT_B_R_HANDLER,                                              \
+        &&BIT_B_R_HANDLER,                                              \
+        &&BIT_B_INDIRECT_HL_HANDLER,                                    \
+        &&BIT_B_R_HANDLER,                                              \
+        &&BIT_B_R_HANDLER,                                              \
+        &&BIT_B_R_HANDLER,                                              \
+        &&BIT_B_R_HANDLER,                                              \
+        &&BIT_B_R_HANDLER,                                              \
+        &&BIT_B_R_HANDLER,                                              \
+        &&BIT_B_R_HANDLER,                                              \
+        &&BIT_B_INDIRECT_HL_HANDLER,                                    \
+        &&BIT_B_R_HANDLER,                                              \
+        &&RES_B_R_HANDLER,                                              \
+        &&RES_B_R_HANDLER,                                              \
+        &&RES_B_R_HANDLER,                                              \
+        &&RES_B_R_HANDLER,                                              \
+        &&RES_B_R_HANDLER,                                              \
+        &&RES_B_R_HANDLER,                                              \
+        &&RES_B_INDIRECT_HL_HANDLER,                                    \
+        &&RES_B_R_HANDLER,                                              \
+        &&RES_B_R_HANDLER,                                              \
+        &&RES_B_R_HANDLER,                                              \
+        &&RES_B_R_HANDLER,                                              \
+        &&RES_B_R_HANDLER,                                              \
+        &&RES_B_R_HANDLER,                                              \
+        &&RES_B_R_HANDLER,                                              \
+        &&RES_B_INDIRECT_HL_HANDLER,                                    \
+        &&RES_B_R_HANDLER,                                              \
+        &&RES_B_R_HANDLER,                                              \
+        &&RES_B_R_HANDLER,                                              \
+        &&RES_B_R_HANDLER,                                              \
+        &&RES_B_R_HANDLER,                                              \
+        &&RES_B_R_HANDLER,                                              \
+        &&RES_B_R_HANDLER,                                              \
+        &&RES_B_INDIRECT_HL_HANDLER,                                    \
+        &&RES_B_R_HANDLER,                                              \
+        &&RES_B_R_HANDLER,                                              \
+        &&RES_B_R_HANDLER,                                              \
+        &&RES_B_R_HANDLER,                                              \
+        &&RES_B_R_HANDLER,                                              \
+        &&RES_B_R_HANDLER,                                              \
+        &&RES_B_R_HANDLER,                                              \
+        &&RES_B_INDIRECT_HL_HANDLER,                                    \
+        &&RES_B_R_HANDLER,                                              \
+        &&RES_B_R_HANDLER,                                              \
+        &&RES_B_R_HANDLER,                                              \
+        &&RES_B_R_HANDLER,                                              \
+        &&RES_B_R_HANDLER,                                              \
+        &&RES_B_R_HANDLER,                                              \
+        &&RES_B_R_HANDLER,                                              \
+        &&RES_B_INDIRECT_HL_HANDLER,                                    \
+        &&RES_B_R_HANDLER,                                              \
+        &&RES_B_R_HANDLER,                                              \
+        &&RES_B_R_HANDLER,                                              \
+        &&RES_B_R_HANDLER,                                              \
+        &&RES_B_R_HANDLER,                                              \
+        &&RES_B_R_HANDLER,                                              \
+        &&RES_B_R_HANDLER,                                              \
+        &&RES_B_INDIRECT_HL_HANDLER,                                    \
+        &&RES_B_R_HANDLER,                                              \
+        &&RES_B_R_HANDLER,                                              \
+        &&RES_B_R_HANDLER,                                              \
+        &&RES_B_R_HANDLER,                                              \
+        &&RES_B_R_HANDLER,                                              \
+        &&RES_B_R_HANDLER,                                              \
+        &&RES_B_R_HANDLER,                                              \
+        &&RES_B_INDIRECT_HL_HANDLER,                                    \
+        &&RES_B_R_HANDLER,                                              \
+        &&RES_B_R_HANDLER,                                              \
+        &&RES_B_R_HANDLER,                                              \
+        &&RES_B_R_HANDLER,                                              \
+        &&RES_B_R_HANDLER,                                              \
+        &&RES_B_R_HANDLER,                                              \
+        &&RES_B_R_HANDLER,                                              \
+        &&RES_B_INDIRECT_HL_HANDLER,                                    \
+        &&RES_B_R_HANDLER,                                              \
+        &&SET_B_R_HANDLER,                                              \
+        &&SET_B_R_HANDLER,                                              \
+        &&SET_B_R_HANDLER,                                              \
+        &&SET_B_R_HANDLER,                                              \
+        &&SET_B_R_HANDLER,                                              \
+        &&SET_B_R_HANDLER,                                              \
+        &&SET_B_INDIRECT_HL_HANDLER,                                    \
+        &&SET_B_R_HANDLER,                                              \
+        &&SET_B_R_HANDLER,                                              \
+        &&SET_B_R_HANDLER,                                              \
+        &&SET_B_R_HANDLER,                                              \
+        &&SET_B_R_HANDLER,                                              \
+        &&SET_B_R_HANDLER,                                              \
+        &&SET_B_R_HANDLER,                                              \
+        &&SET_B_INDIRECT_HL_HANDLER,                                    \
+        &&SET_B_R_HANDLER,                                              \
+        &&SET_B_R_HANDLER,                                              \
+        &&SET_B_R_HANDLER,                                              \
+        &&SET_B_R_HANDLER,                                              \
+        &&SET_B_R_HANDLER,                                              \
+        &&SET_B_R_HANDLER,                                              \
+        &&SET_B_R_HANDLER,                                              \
+        &&SET_B_INDIRECT_HL_HANDLER,                                    \
+        &&SET_B_R_HANDLER,                                              \
+        &&SET_B_R_HANDLER,                                              \
+        &&SET_B_R_HANDLER,                                              \
+        &&SET_B_R_HANDLER,                                              \
+        &&SET_B_R_HANDLER,                                              \
+        &&SET_B_R_HANDLER,                                              \
+        &&SET_B_R_HANDLER,                                              \
+        &&SET_B_INDIRECT_HL_HANDLER,                                    \
+        &&SET_B_R_HANDLER,                                              \
+        &&SET_B_R_HANDLER,                                              \
+        &&SET_B_R_HANDLER,                                              \
+        &&SET_B_R_HANDLER,                                              \
+        &&SET_B_R_HANDLER,                                              \
+        &&SET_B_R_HANDLER,                                              \
+        &&SET_B_R_HANDLER,                                              \
+        &&SET_B_INDIRECT_HL_HANDLER,                                    \
+        &&SET_B_R_HANDLER,                                              \
+        &&SET_B_R_HANDLER,                                              \
+        &&SET_B_R_HANDLER,                                              \
+        &&SET_B_R_HANDLER,                                              \
+        &&SET_B_R_HANDLER,                                              \
+        &&SET_B_R_HANDLER,                                              \
+        &&SET_B_R_HANDLER,                                              \
+        &&SET_B_INDIRECT_HL_HANDLER,                                    \
+        &&SET_B_R_HANDLER,                                              \
+        &&SET_B_R_HANDLER,                                              \
+        &&SET_B_R_HANDLER,                                              \
+        &&SET_B_R_HANDLER,                                              \
+        &&SET_B_R_HANDLER,                                              \
+        &&SET_B_R_HANDLER,                                              \
+        &&SET_B_R_HANDLER,                                              \
+        &&SET_B_INDIRECT_HL_HANDLER,                                    \
+        &&SET_B_R_HANDLER,                                              \
+        &&SET_B_R_HANDLER,                                              \
+        &&SET_B_R_HANDLER,                                              \
+        &&SET_B_R_HANDLER,                                              \
+        &&SET_B_R_HANDLER,                                              \
+        &&SET_B_R_HANDLER,                                              \
+        &&SET_B_R_HANDLER,                                              \
+        &&SET_B_INDIRECT_HL_HANDLER,                                    \
+        &&SET_B_R_HANDLER,                                              \
+};                                                                      \
+static void * const ED_INSTRUCTION_DISPATCH_TABLE[256] = {              \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&IN_R_C_HANDLER,                                               \
+        &&OUT_C_R_HANDLER,                                              \
+        &&SBC_HL_RR_HANDLER,                                            \
+        &&LD_INDIRECT_NN_RR_HANDLER,                                    \
+        &&NEG_HANDLER,                                                  \
+        &&RETI_RETN_HANDLER,                                            \
+        &&IM_N_HANDLER,                                                 \
+        &&LD_I_A_LD_R_A_HANDLER,                                        \
+        &&IN_R_C_HANDLER,                                               \
+        &&OUT_C_R_HANDLER,                                              \
+        &&ADC_HL_RR_HANDLER,                                            \
+        &&LD_RR_INDIRECT_NN_HANDLER,                                    \
+        &&NEG_HANDLER,                                                  \
+        &&RETI_RETN_HANDLER,                                            \
+        &&IM_N_HANDLER,                                                 \
+        &&LD_I_A_LD_R_A_HANDLER,                                        \
+        &&IN_R_C_HANDLER,                                               \
+        &&OUT_C_R_HANDLER,                                              \
+        &&SBC_HL_RR_HANDLER,                                            \
+        &&LD_INDIRECT_NN_RR_HANDLER,                                    \
+        &&NEG_HANDLER,                                                  \
+        &&RETI_RETN_HANDLER,                                            \
+        &&IM_N_HANDLER,                                                 \
+        &&LD_A_I_LD_A_R_HANDLER,                                        \
+        &&IN_R_C_HANDLER,                                               \
+        &&OUT_C_R_HANDLER,                                              \
+        &&ADC_HL_RR_HANDLER,                                            \
+        &&LD_RR_INDIRECT_NN_HANDLER,                                    \
+        &&NEG_HANDLER,                                                  \
+        &&RETI_RETN_HANDLER,                                            \
+        &&IM_N_HANDLER,                                                 \
+        &&LD_A_I_LD_A_R_HANDLER,                                        \
+        &&IN_R_C_HANDLER,                                               \
+        &&OUT_C_R_HANDLER,                                              \
+        &&SBC_HL_RR_HANDLER,                                            \
+        &&LD_INDIRECT_NN_RR_HANDLER,                                    \
+        &&NEG_HANDLER,                                                  \
+        &&RETI_RETN_HANDLER,                                            \
+        &&IM_N_HANDLER,                                                 \
+        &&RLD_RRD_HANDLER,                                              \
+        &&IN_R_C_HANDLER,                                               \
+        &&OUT_C_R_HANDLER,                                              \
+        &&ADC_HL_RR_HANDLER,                                            \
+        &&LD_RR_INDIRECT_NN_HANDLER,                                    \
+        &&NEG_HANDLER,                                                  \
+        &&RETI_RETN_HANDLER,                                            \
+        &&IM_N_HANDLER,                                                 \
+        &&RLD_RRD_HANDLER,                                              \
+        &&IN_R_C_HANDLER,                                               \
+        &&OUT_C_R_HANDLER,                                              \
+        &&SBC_HL_RR_HANDLER,                                            \
+        &&LD_INDIRECT_NN_RR_HANDLER,                                    \
+        &&NEG_HANDLER,                                                  \
+        &&RETI_RETN_HANDLER,                                            \
+        &&IM_N_HANDLER,                                                 \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&IN_R_C_HANDLER,                                               \
+        &&OUT_C_R_HANDLER,                                              \
+        &&ADC_HL_RR_HANDLER,                                            \
+        &&LD_RR_INDIRECT_NN_HANDLER,                                    \
+        &&NEG_HANDLER,                                                  \
+        &&RETI_RETN_HANDLER,                                            \
+        &&IM_N_HANDLER,                                                 \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&LDI_LDD_HANDLER,                                              \
+        &&CPI_CPD_HANDLER,                                              \
+        &&INI_IND_HANDLER,                                              \
+        &&OUTI_OUTD_HANDLER,                                            \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&LDI_LDD_HANDLER,                                              \
+        &&CPI_CPD_HANDLER,                                              \
+        &&INI_IND_HANDLER,                                              \
+        &&OUTI_OUTD_HANDLER,                                            \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&LDIR_LDDR_HANDLER,                                            \
+        &&CPIR_CPDR_HANDLER,                                            \
+        &&INIR_INDR_HANDLER,                                            \
+        &&OTIR_OTDR_HANDLER,                                            \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&LDIR_LDDR_HANDLER,                                            \
+        &&CPIR_CPDR_HANDLER,                                            \
+        &&INIR_INDR_HANDLER,                                            \
+        &&OTIR_OTDR_HANDLER,                                            \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+        &&ED_UNDEFINED_HANDLER,                                         \
+};
@@ -26,7 +26,9 @@
 #define HL              (state->registers.word[Z80_HL])
 #define SP              (state->registers.word[Z80_SP])
 
-#define HL_IX_IY        *((unsigned short *) registers[6])
+/* HL, IX, or IY, depending on the prefix, looked up at run time. */
+
+#define HL_IX_IY        (state->registers.word[registers[6]])
 
 /* Opcode decoding macros.  Y() is bits 5-3 of the opcode, Z() is bits 2-0,
  * P() bits 5-4, and Q() bits 4-3.
@@ -37,14 +39,14 @@
 #define P(opcode)       (((opcode) >> 4) & 0x03)
 #define Q(opcode)       (((opcode) >> 3) & 0x03)
 
-/* Registers and conditions are decoded using tables in encodings.h.  S() is
- * for the special cases "LD H/L, (IX/Y + d)" and "LD (IX/Y + d), H/L".
+/* Registers and conditions are decoded using the tables in z80emu_impl.h.  
+ * S() is for the special cases "LD H/L, (IX/Y + d)" and "LD (IX/Y + d), H/L".
  */
 
-#define R(r)            *((unsigned char *) (registers[(r)]))
-#define S(s)            *((unsigned char *) state->register_table[(s)])
-#define RR(rr)          *((unsigned short *) registers[(rr) + 8])
-#define SS(ss)          *((unsigned short *) registers[(ss) + 12])
+#define R(r)            (state->registers.byte[registers[(r)]])
+#define S(s)            (state->registers.byte[REGISTER_TABLE[(s)]])
+#define RR(rr)          (state->registers.word[registers[(rr) + 8]])
+#define SS(ss)          (state->registers.word[registers[(ss) + 12]])
 #define CC(cc)          ((F ^ XOR_CONDITION_TABLE[(cc)])                \
                                 & AND_CONDITION_TABLE[(cc)])
 #define DD(dd)          CC(dd)
@@ -105,7 +107,7 @@
                                                 
 #define READ_INDIRECT_HL(x)                                             \
 {                                                                       \
-        if (registers == state->register_table) {			\
+        if (registers == REGISTER_TABLE) {			\
                                                                         \
                 READ_BYTE(HL, (x));                                     \
                                                                         \
@@ -124,7 +126,7 @@
 
 #define WRITE_INDIRECT_HL(x)                                            \
 {                                                                       \
-        if (registers == state->register_table) {			\
+        if (registers == REGISTER_TABLE) {			\
                                                                         \
                 WRITE_BYTE(HL, (x));                                    \
                                                                         \
@@ -0,0 +1,161 @@
+/* z80block.h
+ * Cache of predecoded basic blocks for z80emu. Runs of Z80 code
+ * are decoded once into compact micro-op records, keyed by the address of
+ * their first instruction, and then executed without fetching, prefix
+ * decoding, or register table lookups. Instructions the cache doesn't know
+ * how to decode are handed to the regular emulate() one at a time.
+ *
+ * Blocks run through unconditional jumps and calls, and stop at the first
+ * instruction whose target isn't known when decoding, such as RET.
+ *
+ * The bus helps keep the cache coherent: every write to a byte for which
+ * Z80BlockCacheIsCode() is true must be reported to Z80BlockCacheWrite(),
+ * which empties the cache. Bytes that are overwritten more than once are
+ * assumed to be self-modifying code, and their instructions are always left
+ * to emulate(), so this rarely happens more than a few times per program.
+ */
+
+#ifndef __Z80BLOCK_INCLUDED__
+#define __Z80BLOCK_INCLUDED__
+
+#include "z80emu.h"
+
+/* Number of blocks and micro-ops the cache can hold. The number of blocks
+ * must be a power of two. When the micro-ops run out the whole cache is
+ * flushed. The defaults make the cache about 72 KB; the firmware build sets
+ * smaller numbers to fit the Pico's RAM.
+ */
+
+#ifndef Z80_BLOCK_CACHE_BLOCKS
+#       define Z80_BLOCK_CACHE_BLOCKS   1024
+#endif
+
+#ifndef Z80_BLOCK_CACHE_OPS
+#       define Z80_BLOCK_CACHE_OPS      4096
+#endif
+
+/* Maximum number of instructions in a block. */
+
+#define Z80_BLOCK_MAX_OPS               32
+
+/* One decoded instruction. The meaning of x, y, and n depends on the kind of
+ * micro-op (see z80block_impl.h): register offsets, condition masks,
+ * immediate values, addresses, and displacements are all resolved when the
+ * instruction is decoded.
+ */
+
+typedef struct Z80_MICRO_OP {
+
+        unsigned char   kind;
+
+        /* Cycles taken, not counting the extra cycles of taken branches. */
+
+        unsigned char   cycles;
+
+        unsigned char   x, y;
+        unsigned short  n;
+
+        /* Address of the next instruction. */
+
+        unsigned short  next;
+
+        /* Opcode fetches from the start of the block through this
+         * instruction, for the R register.
+         */
+
+        unsigned char   fetches;
+
+        /* For branches back into the block, the index of the micro-op 
+         * they go to plus one, or zero.
+         */
+
+        unsigned char   loop;
+
+} Z80_MICRO_OP;
+
+typedef struct Z80_BLOCK {
+
+        /* Address of the first instruction, or Z80_NO_BLOCK if the slot is
+         * empty.
+         */
+
+        unsigned int    pc;
+
+        /* Index of the first micro-op. */
+
+        unsigned int    op;
+
+} Z80_BLOCK;
+
+#define Z80_NO_BLOCK    0xffffffff
+
+typedef struct Z80_BLOCK_CACHE {
+
+        Z80_BLOCK       blocks[Z80_BLOCK_CACHE_BLOCKS];
+        Z80_MICRO_OP    ops[Z80_BLOCK_CACHE_OPS];
+        int             op_count;
+
+        /* One bit per byte of memory that's part of a decoded instruction. */
+
+        unsigned char   code[0x10000 / 8];
+
+        /* Code bytes that were overwritten once, and those overwritten 
+         * again. The latter are assumed to be self-modifying code, whose
+         * instructions are left to emulate() rather than decoded.
+         */
+
+        unsigned char   rewritten[0x10000 / 8];
+        unsigned char   volatile_code[0x10000 / 8];
+
+        /* Set when decoded code is overwritten, so that the block being
+         * executed, which is gone, can be left.
+         */
+
+        int             invalidated;
+
+        /* Statistics. */
+
+        unsigned long   hits;           /* Blocks found already decoded. */
+        unsigned long   misses;         /* Blocks decoded. */
+        unsigned long   invalidations;  /* Writes to decoded code. */
+        unsigned long   fallbacks;      /* Instructions given to emulate(). */
+        unsigned long   flushes;        /* Times the cache filled up. */
+        unsigned long   natives;        /* Blocks run as native code. */
+
+} Z80_BLOCK_CACHE;
+
+/* Empty the cache and clear its statistics. Call it whenever memory is
+ * changed behind the bus's back.
+ */
+
+extern void     Z80ResetBlockCache (Z80_BLOCK_CACHE *cache);
+
+/* Empty the cache but remember which code is self-modifying, for when
+ * memory is put back to an earlier state of the same program.
+ */
+
+extern void     Z80FlushBlockCache (Z80_BLOCK_CACHE *cache);
+
+/* Whether address is part of a decoded instruction. */
+
+static inline int Z80BlockCacheIsCode (const Z80_BLOCK_CACHE *cache,
+                        int address)
+{
+        return cache->code[(address & 0xffff) >> 3] & (1 << (address & 0x07));
+}
+
+/* Tell the cache that the Z80 wrote to address, which is part of a decoded
+ * instruction. All blocks are invalidated.
+ */
+
+extern void     Z80BlockCacheWrite (Z80_BLOCK_CACHE *cache, int address);
+
+/* Same as Z80Emulate(), but run decoded blocks from the cache. */
+
+template <typename Bus>
+int             Z80EmulateBlocks (Z80_STATE *state,
+			Z80_BLOCK_CACHE *cache,
+			int number_cycles,
+			Bus *context);
+
+#endif
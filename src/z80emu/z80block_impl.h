@@ -0,0 +1,2325 @@
+/* z80block_impl.h
+ * Block cache for z80emu (see z80block.h). This is included by z80emu_impl.h
+ * when Z80_BLOCK_CACHE is defined, and uses its helper macros and tables. The
+ * micro-op handlers below must behave exactly like the instruction handlers
+ * in z80emu_impl.h, down to the cycle counts and the order of bus accesses.
+ */
+
+#include <string.h>
+
+#include "z80block.h"
+
+/* Micro-op kinds. Byte and word registers are offsets into Z80_STATE's
+ * registers arrays, resolved from the register tables at decode time so that
+ * prefixed instructions need no special handling. Memory operands ("MEM")
+ * are at word register y plus displacement n, which covers (HL), (BC), (DE),
+ * (IX + d), and (IY + d). Conditions are an xor mask in x and an and mask in
+ * y, see CC() in macros.h.
+ */
+
+#define Z80_MICRO_OPS(X)                                                \
+        X(LD_R_R)               /* x = y */                             \
+        X(LD_R_N)               /* x = n */                             \
+        X(LD_R_MEM)             /* x = (y + n) */                       \
+        X(LD_MEM_R)             /* (y + n) = x */                       \
+        X(LD_MEM_N)             /* (y + n) = x */                       \
+        X(LD_R_ABS)             /* x = (n) */                           \
+        X(LD_ABS_R)             /* (n) = x */                           \
+        X(LD_RR_NN)             /* xx = n */                            \
+        X(LD_RR_ABS)            /* xx = (n) */                          \
+        X(LD_ABS_RR)            /* (n) = xx */                          \
+        X(LD_RR_RR)             /* xx = yy */                           \
+        X(PUSH)                 /* xx */                                \
+        X(POP)                  /* xx */                                \
+        X(PUSH_NN)              /* n, for calls the block follows */    \
+        X(EX_DE_HL)                                                     \
+        X(EX_AF_AF_PRIME)                                               \
+        X(EXX)                                                          \
+        X(ADD_R) X(ADD_N) X(ADD_MEM)                                    \
+        X(ADC_R) X(ADC_N) X(ADC_MEM)                                    \
+        X(SUB_R) X(SUB_N) X(SUB_MEM)                                    \
+        X(SBC_R) X(SBC_N) X(SBC_MEM)                                    \
+        X(AND_R) X(AND_N) X(AND_MEM)                                    \
+        X(XOR_R) X(XOR_N) X(XOR_MEM)                                    \
+        X(OR_R) X(OR_N) X(OR_MEM)                                       \
+        X(CP_R) X(CP_N) X(CP_MEM)                                       \
+        X(INC_R) X(INC_MEM)                                             \
+        X(DEC_R) X(DEC_MEM)                                             \
+        X(ADD_RR_RR)            /* xx += yy */                          \
+        X(ADC_HL_RR)            /* HL += yy + carry */                  \
+        X(SBC_HL_RR)            /* HL -= yy + carry */                  \
+        X(INC_RR)               /* xx */                                \
+        X(DEC_RR)               /* xx */                                \
+        X(DEC_RR_LOOP)          /* xx, y = opcode */                    \
+        X(DAA)                                                          \
+        X(CPL)                                                          \
+        X(NEG)                                                          \
+        X(CCF)                                                          \
+        X(SCF)                                                          \
+        X(NOP)                                                          \
+        X(HALT)                                                         \
+        X(DI)                                                           \
+        X(EI)                                                           \
+        X(RLCA) X(RLA) X(RRCA) X(RRA)                                   \
+        X(RLC_R) X(RLC_MEM)                                             \
+        X(RL_R) X(RL_MEM)                                               \
+        X(RRC_R) X(RRC_MEM)                                             \
+        X(RR_R) X(RR_MEM)                                               \
+        X(SLA_R) X(SLA_MEM)                                             \
+        X(SLL_R) X(SLL_MEM)                                             \
+        X(SRA_R) X(SRA_MEM)                                             \
+        X(SRL_R) X(SRL_MEM)                                             \
+        X(BIT_R) X(BIT_MEM)     /* Bit mask in y, or x for MEM. */      \
+        X(SET_R) X(SET_MEM)                                             \
+        X(RES_R) X(RES_MEM)                                             \
+        X(JP)                   /* n, also JR */                        \
+        X(JP_CC)                /* n */                                 \
+        X(JR_CC)                /* n */                                 \
+        X(JP_RR)                /* xx */                                \
+        X(DJNZ)                 /* n */                                 \
+        X(CALL)                 /* n, also RST */                       \
+        X(CALL_CC)              /* n */                                 \
+        X(RET)                                                          \
+        X(RET_CC)                                                       \
+        X(LDIR_LDDR)            /* x: LDIR rather than LDDR, n: address \
+                                 * of the instruction after any prefix. \
+                                 */                                     \
+        X(IN_A_N)               /* n */                                 \
+        X(OUT_N_A)              /* n */                                 \
+        X(END)                  /* Continue with the next block. */     \
+        X(FALLBACK)             /* Run the instruction at n with          \
+                                 * emulate().                           \
+                                 */                                     \
+        X(EMULATE)              /* Same, but carry on with the block if \
+                                 * it falls through to next.            \
+                                 */                                     \
+        Z80_NATIVE_MICRO_OPS(X)
+
+/* The whole block is native code, see z80native.h. */
+
+#ifdef Z80_NATIVE_BLOCKS
+#       define Z80_NATIVE_MICRO_OPS(X)  X(NATIVE) /* n: region */
+#else
+#       define Z80_NATIVE_MICRO_OPS(X)
+#endif
+
+#define MICRO_OP_ENUM(name)     MICRO_OP_##name,
+
+enum {
+
+        Z80_MICRO_OPS(MICRO_OP_ENUM)
+
+};
+
+#define BYTE_REGISTER(o)        (state->registers.byte[(o)])
+#define WORD_REGISTER(o)        (state->registers.word[(o)])
+#define MEMORY_OPERAND(op)      (WORD_REGISTER((op)->y) + (op)->n)
+#define CONDITION(op)           ((F ^ (op)->x) & (op)->y)
+#define NEXT_PC(op)             ((op)->next)
+
+#define BLOCK_INDEX(pc)         (((pc) ^ ((pc) >> 7)) & (Z80_BLOCK_CACHE_BLOCKS - 1))
+
+static void flush_block_cache (Z80_BLOCK_CACHE *cache)
+{
+        int     i;
+
+        for (i = 0; i < Z80_BLOCK_CACHE_BLOCKS; i++)
+
+                cache->blocks[i].pc = Z80_NO_BLOCK;
+
+        cache->op_count = 0;
+        memset(cache->code, 0, sizeof(cache->code));
+}
+
+void Z80ResetBlockCache (Z80_BLOCK_CACHE *cache)
+{
+        flush_block_cache(cache);
+
+        memset(cache->rewritten, 0, sizeof(cache->rewritten));
+        memset(cache->volatile_code, 0, sizeof(cache->volatile_code));
+        cache->invalidated = 0;
+        cache->hits = cache->misses = 0;
+        cache->invalidations = cache->fallbacks = cache->flushes = 0;
+        cache->natives = 0;
+}
+
+void Z80FlushBlockCache (Z80_BLOCK_CACHE *cache)
+{
+        flush_block_cache(cache);
+}
+
+void Z80BlockCacheWrite (Z80_BLOCK_CACHE *cache, int address)
+{
+        int     byte, bit;
+
+        address &= 0xffff;
+        byte = address >> 3;
+        bit = 1 << (address & 0x07);
+        if (cache->rewritten[byte] & bit)
+
+                cache->volatile_code[byte] |= bit;
+
+        else
+
+                cache->rewritten[byte] |= bit;
+
+        flush_block_cache(cache);
+        cache->invalidated = 1;
+        cache->invalidations++;
+}
+
+/* Decode the instruction at *pc_pointer into op, and advance *pc_pointer and
+ * *fetches past it. Returns non-zero if the instruction ends the block. Cycles are 4
+ * per opcode fetch, plus what the instruction's handler in z80emu_impl.h adds
+ * to elapsed_cycles.
+ */
+
+template <typename Bus>
+static int decode_instruction (Z80_MICRO_OP *op,
+        int *pc_pointer, int *fetches,
+        Bus *context)
+{
+        const unsigned char     *registers;
+        int     pc, start, opcode, instruction, indexed, m1, extra, n, ends;
+
+        pc = start = *pc_pointer;
+        registers = REGISTER_TABLE;
+        m1 = 0;
+        ends = 0;
+        extra = 0;
+        n = 0;
+
+        for ( ; ; ) {
+
+                Z80_FETCH_BYTE(pc, opcode);
+                pc++;
+                m1++;
+                if (opcode == 0xdd)
+
+                        registers = DD_REGISTER_TABLE;
+
+                else if (opcode == 0xfd)
+
+                        registers = FD_REGISTER_TABLE;
+
+                else
+
+                        break;
+
+                if (pc - start > 4)
+
+                        goto fallback;
+
+        }
+
+        instruction = INSTRUCTION_TABLE[opcode];
+        if (instruction == CB_PREFIX) {
+
+                /* Leave the 0xdd 0xcb and 0xfd 0xcb instructions, with their
+                 * odd displacement and register copies, to emulate().
+                 */
+
+                if (registers != REGISTER_TABLE)
+
+                        goto fallback;
+
+                Z80_FETCH_BYTE(pc, opcode);
+                pc++;
+                m1++;
+                instruction = CB_INSTRUCTION_TABLE[opcode];
+
+        } else if (instruction == ED_PREFIX) {
+
+                registers = REGISTER_TABLE;
+                Z80_FETCH_BYTE(pc, opcode);
+                pc++;
+                m1++;
+                instruction = ED_INSTRUCTION_TABLE[opcode];
+
+        }
+        indexed = registers != REGISTER_TABLE;
+
+/* Decode an (HL), (IX + d), or (IY + d) operand. The indexed forms also add
+ * the displacement fetch and the cycles given.
+ */
+
+#define DECODE_INDIRECT_HL(indexed_extra)                               \
+{                                                                       \
+        if (indexed) {                                                  \
+                                                                        \
+                int     d;                                              \
+                                                                        \
+                Z80_FETCH_BYTE(pc, d);                                  \
+                pc++;                                                   \
+                op->y = registers[6];                                   \
+                op->n = (signed char) d;                                \
+                extra += 3 + (indexed_extra);                           \
+                                                                        \
+        } else {                                                        \
+                                                                        \
+                op->y = Z80_HL;                                         \
+                op->n = 0;                                              \
+                                                                        \
+        }                                                               \
+}
+
+#define DECODE_N()                                                      \
+{                                                                       \
+        Z80_FETCH_BYTE(pc, n);                                          \
+        pc++;                                                           \
+        extra += 3;                                                     \
+}
+
+#define DECODE_NN()                                                     \
+{                                                                       \
+        Z80_FETCH_WORD(pc, n);                                          \
+        pc += 2;                                                        \
+        extra += 6;                                                     \
+}
+
+#define DECODE_E()                                                      \
+{                                                                       \
+        Z80_FETCH_BYTE(pc, n);                                          \
+        pc++;                                                           \
+        n = (pc + (signed char) n) & 0xffff;                            \
+}
+
+#define DECODE_CONDITION(cc)                                            \
+{                                                                       \
+        op->x = XOR_CONDITION_TABLE[(cc)];                              \
+        op->y = AND_CONDITION_TABLE[(cc)];                              \
+}
+
+        switch (instruction) {
+
+                case LD_R_R: {
+
+                        op->kind = MICRO_OP_LD_R_R;
+                        op->x = registers[Y(opcode)];
+                        op->y = registers[Z(opcode)];
+                        break;
+
+                }
+
+                case LD_R_N: {
+
+                        op->kind = MICRO_OP_LD_R_N;
+                        op->x = registers[Y(opcode)];
+                        DECODE_N();
+                        op->n = n;
+                        break;
+
+                }
+
+                case LD_R_INDIRECT_HL: {
+
+                        op->kind = MICRO_OP_LD_R_MEM;
+                        op->x = REGISTER_TABLE[Y(opcode)];
+                        DECODE_INDIRECT_HL(5);
+                        extra += 3;
+                        break;
+
+                }
+
+                case LD_INDIRECT_HL_R: {
+
+                        op->kind = MICRO_OP_LD_MEM_R;
+                        op->x = REGISTER_TABLE[Z(opcode)];
+                        DECODE_INDIRECT_HL(5);
+                        extra += 3;
+                        break;
+
+                }
+
+                case LD_INDIRECT_HL_N: {
+
+                        op->kind = MICRO_OP_LD_MEM_N;
+                        DECODE_INDIRECT_HL(2);
+                        DECODE_N();
+                        op->x = n;
+                        extra += 3;
+                        break;
+
+                }
+
+                case LD_A_INDIRECT_BC:
+                case LD_A_INDIRECT_DE: {
+
+                        op->kind = MICRO_OP_LD_R_MEM;
+                        op->x = Z80_A;
+                        op->y = instruction == LD_A_INDIRECT_BC
+                                ? Z80_BC
+                                : Z80_DE;
+                        op->n = 0;
+                        extra += 3;
+                        break;
+
+                }
+
+                case LD_INDIRECT_BC_A:
+                case LD_INDIRECT_DE_A: {
+
+                        op->kind = MICRO_OP_LD_MEM_R;
+                        op->x = Z80_A;
+                        op->y = instruction == LD_INDIRECT_BC_A
+                                ? Z80_BC
+                                : Z80_DE;
+                        op->n = 0;
+                        extra += 3;
+                        break;
+
+                }
+
+                case LD_A_INDIRECT_NN: {
+
+                        op->kind = MICRO_OP_LD_R_ABS;
+                        op->x = Z80_A;
+                        DECODE_NN();
+                        op->n = n;
+                        extra += 3;
+                        break;
+
+                }
+
+                case LD_INDIRECT_NN_A: {
+
+                        op->kind = MICRO_OP_LD_ABS_R;
+                        op->x = Z80_A;
+                        DECODE_NN();
+                        op->n = n;
+                        extra += 3;
+                        break;
+
+                }
+
+                case LD_RR_NN: {
+
+                        op->kind = MICRO_OP_LD_RR_NN;
+                        op->x = registers[P(opcode) + 8];
+                        DECODE_NN();
+                        op->n = n;
+                        break;
+
+                }
+
+                case LD_HL_INDIRECT_NN:
+                case LD_RR_INDIRECT_NN: {
+
+                        op->kind = MICRO_OP_LD_RR_ABS;
+                        op->x = instruction == LD_HL_INDIRECT_NN
+                                ? registers[6]
+                                : registers[P(opcode) + 8];
+                        DECODE_NN();
+                        op->n = n;
+                        extra += 6;
+                        break;
+
+                }
+
+                case LD_INDIRECT_NN_HL:
+                case LD_INDIRECT_NN_RR: {
+
+                        op->kind = MICRO_OP_LD_ABS_RR;
+                        op->x = instruction == LD_INDIRECT_NN_HL
+                                ? registers[6]
+                                : registers[P(opcode) + 8];
+                        DECODE_NN();
+                        op->n = n;
+                        extra += 6;
+                        break;
+
+                }
+
+                case LD_SP_HL: {
+
+                        op->kind = MICRO_OP_LD_RR_RR;
+                        op->x = Z80_SP;
+                        op->y = registers[6];
+                        extra += 2;
+                        break;
+
+                }
+
+                case PUSH_SS: {
+
+                        op->kind = MICRO_OP_PUSH;
+                        op->x = registers[P(opcode) + 12];
+                        extra += 6 + 1;
+                        break;
+
+                }
+
+                case POP_SS: {
+
+                        op->kind = MICRO_OP_POP;
+                        op->x = registers[P(opcode) + 12];
+                        extra += 6;
+                        break;
+
+                }
+
+                case EX_DE_HL: {
+
+                        op->kind = MICRO_OP_EX_DE_HL;
+                        break;
+
+                }
+
+                case EX_AF_AF_PRIME: {
+
+                        op->kind = MICRO_OP_EX_AF_AF_PRIME;
+                        break;
+
+                }
+
+                case EXX: {
+
+                        op->kind = MICRO_OP_EXX;
+                        break;
+
+                }
+
+#define DECODE_ALU(name)                                                \
+                case name##_R: {                                        \
+                                                                        \
+                        op->kind = MICRO_OP_##name##_R;                 \
+                        op->x = registers[Z(opcode)];                   \
+                        break;                                          \
+                                                                        \
+                }                                                       \
+                                                                        \
+                case name##_N: {                                        \
+                                                                        \
+                        op->kind = MICRO_OP_##name##_N;                 \
+                        DECODE_N();                                     \
+                        op->n = n;                                      \
+                        break;                                          \
+                                                                        \
+                }                                                       \
+                                                                        \
+                case name##_INDIRECT_HL: {                              \
+                                                                        \
+                        op->kind = MICRO_OP_##name##_MEM;               \
+                        DECODE_INDIRECT_HL(5);                          \
+                        extra += 3;                                     \
+                        break;                                          \
+                                                                        \
+                }
+
+                DECODE_ALU(ADD)
+                DECODE_ALU(ADC)
+                DECODE_ALU(SUB)
+                DECODE_ALU(SBC)
+                DECODE_ALU(AND)
+                DECODE_ALU(XOR)
+                DECODE_ALU(OR)
+                DECODE_ALU(CP)
+
+                case INC_R:
+                case DEC_R: {
+
+                        op->kind = instruction == INC_R
+                                ? MICRO_OP_INC_R
+                                : MICRO_OP_DEC_R;
+                        op->x = registers[Y(opcode)];
+                        break;
+
+                }
+
+                case INC_INDIRECT_HL:
+                case DEC_INDIRECT_HL: {
+
+                        op->kind = instruction == INC_INDIRECT_HL
+                                ? MICRO_OP_INC_MEM
+                                : MICRO_OP_DEC_MEM;
+                        DECODE_INDIRECT_HL(6);
+                        extra += indexed ? 3 + 3 : 3 + 3 + 1;
+                        break;
+
+                }
+
+                case ADD_HL_RR: {
+
+                        op->kind = MICRO_OP_ADD_RR_RR;
+                        op->x = registers[6];
+                        op->y = registers[P(opcode) + 8];
+                        extra += 7;
+                        break;
+
+                }
+
+                case ADC_HL_RR:
+                case SBC_HL_RR: {
+
+                        op->kind = instruction == ADC_HL_RR
+                                ? MICRO_OP_ADC_HL_RR
+                                : MICRO_OP_SBC_HL_RR;
+                        op->y = registers[P(opcode) + 8];
+                        extra += 7;
+                        break;
+
+                }
+
+                case INC_RR:
+                case DEC_RR: {
+
+                        op->kind = instruction == INC_RR
+                                ? MICRO_OP_INC_RR
+                                : MICRO_OP_DEC_RR;
+                        op->x = registers[P(opcode) + 8];
+
+#ifdef Z80_SKIP_DELAY_LOOPS
+
+                        if (instruction == DEC_RR && !indexed
+                                && is_dec_rr_loop(opcode, pc, context)) {
+
+                                op->kind = MICRO_OP_DEC_RR_LOOP;
+                                op->y = opcode;
+
+                        }
+
+#endif
+
+                        extra += 2;
+                        break;
+
+                }
+
+                case DAA: op->kind = MICRO_OP_DAA; break;
+                case CPL: op->kind = MICRO_OP_CPL; break;
+                case NEG: op->kind = MICRO_OP_NEG; break;
+                case CCF: op->kind = MICRO_OP_CCF; break;
+                case SCF: op->kind = MICRO_OP_SCF; break;
+                case NOP: op->kind = MICRO_OP_NOP; break;
+                case DI: op->kind = MICRO_OP_DI; break;
+                case EI: op->kind = MICRO_OP_EI; break;
+                case RLCA: op->kind = MICRO_OP_RLCA; break;
+                case RLA: op->kind = MICRO_OP_RLA; break;
+                case RRCA: op->kind = MICRO_OP_RRCA; break;
+                case RRA: op->kind = MICRO_OP_RRA; break;
+
+                case HALT: {
+
+                        op->kind = MICRO_OP_HALT;
+                        ends = 1;
+                        break;
+
+                }
+
+#define DECODE_SHIFT(name)                                              \
+                case name##_R: {                                        \
+                                                                        \
+                        op->kind = MICRO_OP_##name##_R;                 \
+                        op->x = registers[Z(opcode)];                   \
+                        break;                                          \
+                                                                        \
+                }                                                       \
+                                                                        \
+                case name##_INDIRECT_HL: {                              \
+                                                                        \
+                        op->kind = MICRO_OP_##name##_MEM;               \
+                        op->y = Z80_HL;                                 \
+                        op->n = 0;                                      \
+                        extra += 3 + 3 + 1;                             \
+                        break;                                          \
+                                                                        \
+                }
+
+                DECODE_SHIFT(RLC)
+                DECODE_SHIFT(RL)
+                DECODE_SHIFT(RRC)
+                DECODE_SHIFT(RR)
+                DECODE_SHIFT(SLA)
+                DECODE_SHIFT(SLL)
+                DECODE_SHIFT(SRA)
+                DECODE_SHIFT(SRL)
+
+                case BIT_B_R:
+                case SET_B_R:
+                case RES_B_R: {
+
+                        op->kind = instruction == BIT_B_R
+                                ? MICRO_OP_BIT_R
+                                : instruction == SET_B_R
+                                ? MICRO_OP_SET_R
+                                : MICRO_OP_RES_R;
+                        op->x = registers[Z(opcode)];
+                        op->y = 1 << Y(opcode);
+                        break;
+
+                }
+
+                case BIT_B_INDIRECT_HL: {
+
+                        op->kind = MICRO_OP_BIT_MEM;
+                        op->x = 1 << Y(opcode);
+                        op->y = Z80_HL;
+                        op->n = 0;
+                        extra += 1 + 3;
+                        break;
+
+                }
+
+                case SET_B_INDIRECT_HL:
+                case RES_B_INDIRECT_HL: {
+
+                        op->kind = instruction == SET_B_INDIRECT_HL
+                                ? MICRO_OP_SET_MEM
+                                : MICRO_OP_RES_MEM;
+                        op->x = 1 << Y(opcode);
+                        op->y = Z80_HL;
+                        op->n = 0;
+                        extra += 3 + 3 + 1;
+                        break;
+
+                }
+
+                case JP_NN: {
+
+                        op->kind = MICRO_OP_JP;
+                        DECODE_NN();
+                        op->n = n;
+                        ends = 1;
+                        break;
+
+                }
+
+                case JP_CC_NN: {
+
+                        op->kind = MICRO_OP_JP_CC;
+                        DECODE_CONDITION(Y(opcode));
+                        DECODE_NN();
+                        op->n = n;
+                        break;
+
+                }
+
+                case JR_E: {
+
+                        op->kind = MICRO_OP_JP;
+                        DECODE_E();
+                        op->n = n;
+                        extra += 8;
+                        ends = 1;
+                        break;
+
+                }
+
+                case JR_DD_E: {
+
+                        op->kind = MICRO_OP_JR_CC;
+                        DECODE_CONDITION(Q(opcode));
+                        DECODE_E();
+                        op->n = n;
+                        extra += 3;
+                        break;
+
+                }
+
+                case JP_HL: {
+
+                        op->kind = MICRO_OP_JP_RR;
+                        op->x = registers[6];
+                        ends = 1;
+                        break;
+
+                }
+
+                case DJNZ_E: {
+
+                        op->kind = MICRO_OP_DJNZ;
+                        DECODE_E();
+                        op->n = n;
+                        extra += 4;
+                        break;
+
+                }
+
+                case CALL_NN: {
+
+                        op->kind = MICRO_OP_CALL;
+                        DECODE_NN();
+                        op->n = n;
+                        extra += 6 + 1;
+                        ends = 1;
+                        break;
+
+                }
+
+                case CALL_CC_NN: {
+
+                        op->kind = MICRO_OP_CALL_CC;
+                        DECODE_CONDITION(Y(opcode));
+                        DECODE_NN();
+                        op->n = n;
+                        break;
+
+                }
+
+                case RET: {
+
+                        op->kind = MICRO_OP_RET;
+                        extra += 6;
+                        ends = 1;
+                        break;
+
+                }
+
+                case RET_CC: {
+
+                        op->kind = MICRO_OP_RET_CC;
+                        DECODE_CONDITION(Y(opcode));
+                        extra += 1;
+                        break;
+
+                }
+
+                case RST_P: {
+
+                        op->kind = MICRO_OP_CALL;
+                        op->n = RST_TABLE[Y(opcode)];
+                        extra += 6 + 1;
+                        ends = 1;
+                        break;
+
+                }
+
+                case LDIR_LDDR: {
+
+                        op->kind = MICRO_OP_LDIR_LDDR;
+                        op->x = opcode == OPCODE_LDIR;
+                        op->n = (pc - 2) & 0xffff;
+                        break;
+
+                }
+
+                case IN_A_N:
+                case OUT_N_A: {
+
+                        op->kind = instruction == IN_A_N
+                                ? MICRO_OP_IN_A_N
+                                : MICRO_OP_OUT_N_A;
+                        DECODE_N();
+                        op->n = n;
+                        extra += 4;
+                        break;
+
+                }
+
+                default:
+
+                        goto fallback;
+
+        }
+
+        op->cycles = 4 * m1 + extra;
+        *fetches += m1;
+        *pc_pointer = pc;
+        return ends;
+
+fallback:
+
+        /* Not worth a micro-op: the instruction is rare, or has to check
+         * number_cycles itself. Run it with emulate() instead.
+         */
+
+        op->kind = MICRO_OP_FALLBACK;
+        op->cycles = 0;
+        op->n = start & 0xffff;
+        return 1;
+
+#undef DECODE_INDIRECT_HL
+#undef DECODE_N
+#undef DECODE_NN
+#undef DECODE_E
+#undef DECODE_CONDITION
+#undef DECODE_ALU
+#undef DECODE_SHIFT
+}
+
+/* Whether any of the bytes from start up to end is self-modifying code. */
+
+static int is_volatile_code (Z80_BLOCK_CACHE *cache, int start, int end)
+{
+        int     address;
+
+        for (address = start; address < end; address++) {
+
+                int     a;
+
+                a = address & 0xffff;
+                if (cache->volatile_code[a >> 3] & (1 << (a & 0x07)))
+
+                        return 1;
+
+        }
+
+        return 0;
+}
+
+#ifdef Z80_NATIVE_BLOCKS
+
+#include "z80native.h"
+#include Z80_NATIVE_BLOCKS
+
+/* Whether the bytes of the region are still the ones it was translated
+ * from, and none of them is self-modifying code.
+ */
+
+template <typename Bus>
+static int is_native_region_loaded (Z80_BLOCK_CACHE *cache,
+        const Z80_NATIVE_REGION *region,
+        Bus *context)
+{
+        const Z80_NATIVE_RANGE  *range, *end;
+
+        range = &NATIVE_RANGES[region->range];
+        end = range + region->range_count;
+        for ( ; range != end; range++) {
+
+                const unsigned char     *bytes;
+                int                     i, x;
+
+                if (is_volatile_code(cache, range->address, 
+                        range->address + range->length))
+
+                        return 0;
+
+                bytes = &NATIVE_BYTES[range->offset];
+                for (i = 0; i < range->length; i++) {
+
+                        Z80_FETCH_BYTE(range->address + i, x);
+                        if (x != bytes[i])
+
+                                return 0;
+
+                }
+
+        }
+
+        return 1;
+}
+
+/* Make op run the native region entered at pc, if there is one that's still
+ * loaded. Returns whether there was.
+ */
+
+template <typename Bus>
+static int decode_native_block (Z80_BLOCK_CACHE *cache,
+        Z80_MICRO_OP *op,
+        int pc,
+        Bus *context)
+{
+        const Z80_NATIVE_ENTRY  *entry, *end;
+        int                     count;
+
+        /* Find the first entry at pc. */
+
+        entry = NATIVE_ENTRIES;
+        count = sizeof(NATIVE_ENTRIES) / sizeof(NATIVE_ENTRIES[0]);
+        while (count > 0) {
+
+                int     half;
+
+                half = count / 2;
+                if (entry[half].pc < pc) {
+
+                        entry += half + 1;
+                        count -= half + 1;
+
+                } else
+
+                        count = half;
+
+        }
+
+        end = NATIVE_ENTRIES + sizeof(NATIVE_ENTRIES) / sizeof(NATIVE_ENTRIES[0]);
+        for ( ; entry != end && entry->pc == pc; entry++) {
+
+                const Z80_NATIVE_REGION         *region;
+                const Z80_NATIVE_RANGE          *range;
+                unsigned int                    i;
+
+                region = &NATIVE_REGIONS[entry->region];
+                if (!is_native_region_loaded(cache, region, context))
+
+                        continue;
+
+                /* Watch the region's bytes for writes. */
+
+                range = &NATIVE_RANGES[region->range];
+                for (i = 0; i < region->range_count; i++, range++) {
+
+                        int     address;
+
+                        for (address = range->address;
+                                address < range->address + range->length;
+                                address++) {
+
+                                int     a;
+
+                                a = address & 0xffff;
+                                cache->code[a >> 3] |= 1 << (a & 0x07);
+
+                        }
+
+                }
+
+                op->kind = MICRO_OP_NATIVE;
+                op->cycles = 0;
+                op->n = entry->region;
+                op->next = pc;
+                op->fetches = 0;
+                op->loop = 0;
+                cache->natives++;
+                return 1;
+
+        }
+
+        return 0;
+}
+
+#endif
+
+/* Decode the block starting at block_pc into the given slot. Unconditional
+ * jumps and calls are followed, unless they go back into the block, which
+ * the executor loops on directly.
+ */
+
+template <typename Bus>
+static void decode_block (Z80_BLOCK_CACHE *cache,
+        Z80_BLOCK *block,
+        int block_pc,
+        Bus *context)
+{
+        Z80_MICRO_OP    *op;
+        int             pc, fetches, count, ends;
+
+        if (cache->op_count + Z80_BLOCK_MAX_OPS > Z80_BLOCK_CACHE_OPS) {
+
+                flush_block_cache(cache);
+                cache->flushes++;
+
+        }
+
+        op = &cache->ops[cache->op_count];
+
+#ifdef Z80_NATIVE_BLOCKS
+
+        if (decode_native_block(cache, op, block_pc, context)) {
+
+                block->pc = block_pc;
+                block->op = cache->op_count;
+                cache->op_count++;
+                return;
+
+        }
+
+#endif
+
+        pc = block_pc;
+        fetches = 0;
+        count = 0;
+        do {
+
+                int     start, start_fetches, address;
+
+                start = pc;
+                start_fetches = fetches;
+                ends = decode_instruction(op, &pc, &fetches, context);
+                if (is_volatile_code(cache, start, pc)) {
+
+                        /* Read it afresh every time, and don't watch its
+                         * bytes.
+                         */
+
+                        op->kind = ends 
+                                ? MICRO_OP_FALLBACK 
+                                : MICRO_OP_EMULATE;
+                        op->cycles = 0;
+                        op->n = start;
+                        fetches = start_fetches;
+                        if (ends)
+
+                                pc = start;
+
+                        start = pc;
+
+                }
+                op->fetches = fetches;
+                op->loop = 0;
+                switch (op->kind) {
+
+                        case MICRO_OP_JP:
+                        case MICRO_OP_JP_CC:
+                        case MICRO_OP_JR_CC:
+                        case MICRO_OP_DJNZ:
+                        case MICRO_OP_CALL_CC: {
+
+                                Z80_MICRO_OP    *other;
+                                int             address;
+
+                                /* Look for the target among the 
+                                 * instructions decoded so far, this one
+                                 * included.
+                                 */
+
+                                other = op - count;
+                                address = block_pc;
+                                while (address != op->n && other != op)
+
+                                        address = (other++)->next;
+
+                                if (address == op->n)
+
+                                        op->loop = other - (op - count) + 1;
+
+                                break;
+
+                        }
+
+                        default:
+
+                                break;
+
+                }
+                count++;
+
+                /* Watch the instruction's bytes for writes. */
+
+                for (address = start; address < pc; address++) {
+
+                        int     a;
+
+                        a = address & 0xffff;
+                        cache->code[a >> 3] |= 1 << (a & 0x07);
+
+                }
+
+                pc &= 0xffff;
+                if ((op->kind == MICRO_OP_JP || op->kind == MICRO_OP_CALL)
+                        && !op->loop) {
+
+                        int     target;
+
+                        /* Keep going at the target. A call just pushes
+                         * the return address.
+                         */
+
+                        target = op->n;
+                        if (op->kind == MICRO_OP_CALL) {
+
+                                op->kind = MICRO_OP_PUSH_NN;
+                                op->n = pc;
+
+                        } else
+
+                                op->kind = MICRO_OP_NOP;
+
+                        pc = target;
+                        ends = 0;
+
+                }
+                op->next = pc;
+
+                op++;
+
+        } while (!ends && count < Z80_BLOCK_MAX_OPS - 1);
+
+        if (!ends) {
+
+                op->kind = MICRO_OP_END;
+                op->cycles = 0;
+                op->next = pc;
+                op->fetches = fetches;
+                count++;
+
+        }
+
+        block->pc = block_pc;
+        block->op = cache->op_count;
+        cache->op_count += count;
+}
+
+/* Handlers either go on to the next micro-op in the block, or leave the block
+ * after setting pc. Like emulate(), the block stops as soon as number_cycles
+ * is reached, and can be left early when a write hits decoded code.
+ */
+
+#ifdef Z80_THREADED_DISPATCH
+
+#       define MICRO_OP(name)           MICRO_OP_##name##_HANDLER
+#       define MICRO_OP_ADDRESS(name)   &&MICRO_OP_##name##_HANDLER,
+
+#       define DISPATCH_MICRO_OP()                                      \
+{                                                                       \
+        elapsed_cycles += op->cycles;                                   \
+        goto *MICRO_OP_DISPATCH_TABLE[op->kind];                        \
+}
+
+#       define RESTART_MICRO_OP()       DISPATCH_MICRO_OP()
+
+#       define NEXT_MICRO_OP()                                          \
+{                                                                       \
+        if (elapsed_cycles >= number_cycles)                            \
+                                                                        \
+                goto stop_in_block;                                     \
+                                                                        \
+        op++;                                                           \
+        DISPATCH_MICRO_OP();                                            \
+}
+
+#else
+
+#       define MICRO_OP(name)           case MICRO_OP_##name
+
+#       define NEXT_MICRO_OP()                                          \
+{                                                                       \
+        if (elapsed_cycles >= number_cycles)                            \
+                                                                        \
+                goto stop_in_block;                                     \
+                                                                        \
+        op++;                                                           \
+        continue;                                                       \
+}
+
+#       define RESTART_MICRO_OP()       continue
+
+#endif
+
+#define NEXT_MICRO_OP_AFTER_WRITE()                                     \
+{                                                                       \
+        if (cache->invalidated) {                                       \
+                                                                        \
+                pc = NEXT_PC(op);                                       \
+                goto leave_block;                                       \
+                                                                        \
+        }                                                               \
+        NEXT_MICRO_OP();                                                \
+}
+
+#define LEAVE_BLOCK()   goto leave_block
+
+/* Loops within the block skip the lookup. */
+
+#define BRANCH(target)                                                  \
+{                                                                       \
+        pc = (target);                                                  \
+        if (!op->loop || cache->invalidated)                            \
+                                                                        \
+                goto leave_block;                                       \
+                                                                        \
+        r += op->fetches;                                               \
+        if (elapsed_cycles >= number_cycles)                            \
+                                                                        \
+                goto stop_emulation;                                    \
+                                                                        \
+        op = first_op + op->loop - 1;                                   \
+        if (op != first_op)                                             \
+                                                                        \
+                r -= op[-1].fetches;                                    \
+                                                                        \
+        RESTART_MICRO_OP();                                             \
+}
+
+template <typename Bus>
+int Z80EmulateBlocks (Z80_STATE *state,
+        Z80_BLOCK_CACHE *cache,
+        int number_cycles,
+        Bus *context)
+{
+        const Z80_MICRO_OP      *op, *first_op;
+        int                     elapsed_cycles, pc, r;
+
+#ifdef Z80_THREADED_DISPATCH
+
+        static void * const MICRO_OP_DISPATCH_TABLE[] = {
+
+                Z80_MICRO_OPS(MICRO_OP_ADDRESS)
+
+        };
+
+#endif
+
+        state->status = 0;
+        elapsed_cycles = 0;
+        pc = state->pc & 0xffff;
+        r = state->r & 0x7f;
+
+next_block:
+
+        {
+                Z80_BLOCK       *block;
+
+                block = &cache->blocks[BLOCK_INDEX(pc)];
+                if (block->pc == (unsigned int) pc)
+
+                        cache->hits++;
+
+                else {
+
+                        decode_block(cache, block, pc, context);
+                        cache->misses++;
+
+                }
+
+                op = first_op = &cache->ops[block->op];
+                cache->invalidated = 0;
+        }
+
+#ifdef Z80_THREADED_DISPATCH
+
+        DISPATCH_MICRO_OP();
+
+        {
+
+#else
+
+        for ( ; ; ) {
+
+                elapsed_cycles += op->cycles;
+                switch (op->kind) {
+
+#endif
+
+                        /* Loads. */
+
+                        MICRO_OP(LD_R_R): {
+
+                                BYTE_REGISTER(op->x) = BYTE_REGISTER(op->y);
+                                NEXT_MICRO_OP();
+
+                        }
+
+                        MICRO_OP(LD_R_N): {
+
+                                BYTE_REGISTER(op->x) = op->n;
+                                NEXT_MICRO_OP();
+
+                        }
+
+                        MICRO_OP(LD_R_MEM): {
+
+                                Z80_READ_BYTE(MEMORY_OPERAND(op), 
+                                        BYTE_REGISTER(op->x));
+                                NEXT_MICRO_OP();
+
+                        }
+
+                        MICRO_OP(LD_MEM_R): {
+
+                                Z80_WRITE_BYTE(MEMORY_OPERAND(op), 
+                                        BYTE_REGISTER(op->x));
+                                NEXT_MICRO_OP_AFTER_WRITE();
+
+                        }
+
+                        MICRO_OP(LD_MEM_N): {
+
+                                Z80_WRITE_BYTE(MEMORY_OPERAND(op), op->x);
+                                NEXT_MICRO_OP_AFTER_WRITE();
+
+                        }
+
+                        MICRO_OP(LD_R_ABS): {
+
+                                Z80_READ_BYTE(op->n, BYTE_REGISTER(op->x));
+                                NEXT_MICRO_OP();
+
+                        }
+
+                        MICRO_OP(LD_ABS_R): {
+
+                                Z80_WRITE_BYTE(op->n, BYTE_REGISTER(op->x));
+                                NEXT_MICRO_OP_AFTER_WRITE();
+
+                        }
+
+                        MICRO_OP(LD_RR_NN): {
+
+                                WORD_REGISTER(op->x) = op->n;
+                                NEXT_MICRO_OP();
+
+                        }
+
+                        MICRO_OP(LD_RR_ABS): {
+
+                                Z80_READ_WORD(op->n, WORD_REGISTER(op->x));
+                                NEXT_MICRO_OP();
+
+                        }
+
+                        MICRO_OP(LD_ABS_RR): {
+
+                                Z80_WRITE_WORD(op->n, WORD_REGISTER(op->x));
+                                NEXT_MICRO_OP_AFTER_WRITE();
+
+                        }
+
+                        MICRO_OP(LD_RR_RR): {
+
+                                WORD_REGISTER(op->x) = WORD_REGISTER(op->y);
+                                NEXT_MICRO_OP();
+
+                        }
+
+                        MICRO_OP(PUSH): {
+
+                                SP -= 2;
+                                Z80_WRITE_WORD(SP, WORD_REGISTER(op->x));
+                                NEXT_MICRO_OP_AFTER_WRITE();
+
+                        }
+
+                        MICRO_OP(PUSH_NN): {
+
+                                SP -= 2;
+                                Z80_WRITE_WORD(SP, op->n);
+                                NEXT_MICRO_OP_AFTER_WRITE();
+
+                        }
+
+                        MICRO_OP(POP): {
+
+                                Z80_READ_WORD(SP, WORD_REGISTER(op->x));
+                                SP += 2;
+                                NEXT_MICRO_OP();
+
+                        }
+
+                        MICRO_OP(EX_DE_HL): {
+
+                                EXCHANGE(DE, HL);
+                                NEXT_MICRO_OP();
+
+                        }
+
+                        MICRO_OP(EX_AF_AF_PRIME): {
+
+                                EXCHANGE(AF, state->alternates[Z80_AF]);
+                                NEXT_MICRO_OP();
+
+                        }
+
+                        MICRO_OP(EXX): {
+
+                                EXCHANGE(BC, state->alternates[Z80_BC]);
+                                EXCHANGE(DE, state->alternates[Z80_DE]);
+                                EXCHANGE(HL, state->alternates[Z80_HL]);
+                                NEXT_MICRO_OP();
+
+                        }
+
+                        /* 8-bit arithmetic and logic. */
+
+#define ALU_MICRO_OPS(name)                                             \
+                        MICRO_OP(name##_R): {                           \
+                                                                        \
+                                name(BYTE_REGISTER(op->x));             \
+                                NEXT_MICRO_OP();                        \
+                                                                        \
+                        }                                               \
+                                                                        \
+                        MICRO_OP(name##_N): {                           \
+                                                                        \
+                                int     n;                              \
+                                                                        \
+                                n = op->n;                              \
+                                name(n);                                \
+                                NEXT_MICRO_OP();                        \
+                                                                        \
+                        }                                               \
+                                                                        \
+                        MICRO_OP(name##_MEM): {                         \
+                                                                        \
+                                int     x;                              \
+                                                                        \
+                                Z80_READ_BYTE(MEMORY_OPERAND(op), x);   \
+                                name(x);                                \
+                                NEXT_MICRO_OP();                        \
+                                                                        \
+                        }
+
+                        ALU_MICRO_OPS(ADD)
+                        ALU_MICRO_OPS(ADC)
+                        ALU_MICRO_OPS(SUB)
+                        ALU_MICRO_OPS(SBC)
+                        ALU_MICRO_OPS(AND)
+                        ALU_MICRO_OPS(XOR)
+                        ALU_MICRO_OPS(OR)
+                        ALU_MICRO_OPS(CP)
+
+                        MICRO_OP(INC_R): {
+
+                                INC(BYTE_REGISTER(op->x));
+                                NEXT_MICRO_OP();
+
+                        }
+
+                        MICRO_OP(INC_MEM): {
+
+                                int     d, x;
+
+                                d = MEMORY_OPERAND(op);
+                                Z80_READ_BYTE(d, x);
+                                INC(x);
+                                Z80_WRITE_BYTE(d, x);
+                                NEXT_MICRO_OP_AFTER_WRITE();
+
+                        }
+
+                        MICRO_OP(DEC_R): {
+
+                                DEC(BYTE_REGISTER(op->x));
+                                NEXT_MICRO_OP();
+
+                        }
+
+                        MICRO_OP(DEC_MEM): {
+
+                                int     d, x;
+
+                                d = MEMORY_OPERAND(op);
+                                Z80_READ_BYTE(d, x);
+                                DEC(x);
+                                Z80_WRITE_BYTE(d, x);
+                                NEXT_MICRO_OP_AFTER_WRITE();
+
+                        }
+
+                        /* 16-bit arithmetic. */
+
+                        MICRO_OP(ADD_RR_RR): {
+
+                                int     x, y, z, f, c;
+
+                                x = WORD_REGISTER(op->x);
+                                y = WORD_REGISTER(op->y);
+                                z = x + y;
+
+                                c = x ^ y ^ z;
+                                f = F & SZPV_FLAGS;
+
+#ifndef Z80_DOCUMENTED_FLAGS_ONLY
+
+                                f |= (z >> 8) & YX_FLAGS;
+                                f |= (c >> 8) & Z80_H_FLAG;
+
+#endif
+
+                                f |= c >> (16 - Z80_C_FLAG_SHIFT);
+
+                                WORD_REGISTER(op->x) = z;
+                                F = f;
+
+                                NEXT_MICRO_OP();
+
+                        }
+
+                        MICRO_OP(ADC_HL_RR): {
+
+                                int     x, y, z, f, c;
+
+                                x = HL;
+                                y = WORD_REGISTER(op->y);
+                                z = x + y + (F & Z80_C_FLAG);
+
+                                c = x ^ y ^ z;
+                                f = z & 0xffff
+                                        ? (z >> 8) & SYX_FLAGS 
+                                        : Z80_Z_FLAG;
+
+#ifndef Z80_DOCUMENTED_FLAGS_ONLY
+
+                                f |= (c >> 8) & Z80_H_FLAG;
+
+#endif
+
+                                f |= OVERFLOW_TABLE[c >> 15];
+                                f |= z >> (16 - Z80_C_FLAG_SHIFT);
+
+                                HL = z;
+                                F = f;  
+
+                                NEXT_MICRO_OP();
+
+                        }
+
+                        MICRO_OP(SBC_HL_RR): {
+
+                                int     x, y, z, f, c;
+
+                                x = HL;
+                                y = WORD_REGISTER(op->y);
+                                z = x - y - (F & Z80_C_FLAG);
+
+                                c = x ^ y ^ z;
+                                f = Z80_N_FLAG;
+                                f |= z & 0xffff
+                                        ? (z >> 8) & SYX_FLAGS 
+                                        : Z80_Z_FLAG;
+
+#ifndef Z80_DOCUMENTED_FLAGS_ONLY
+
+                                f |= (c >> 8) & Z80_H_FLAG;
+
+#endif
+
+                                c &= 0x018000;
+                                f |= OVERFLOW_TABLE[c >> 15];
+                                f |= c >> (16 - Z80_C_FLAG_SHIFT);
+
+                                HL = z;
+                                F = f;  
+
+                                NEXT_MICRO_OP();
+
+                        }
+
+                        MICRO_OP(INC_RR): {
+
+                                WORD_REGISTER(op->x)++;
+                                NEXT_MICRO_OP();
+
+                        }
+
+                        MICRO_OP(DEC_RR): {
+
+                                WORD_REGISTER(op->x)--;
+                                NEXT_MICRO_OP();
+
+                        }
+
+                        MICRO_OP(DEC_RR_LOOP): {
+
+                                int     x;
+
+                                /* Same as DEC_RR in z80emu_impl.h. The loop's
+                                 * bytes aren't all watched if the block ends
+                                 * early, so check them again.
+                                 */
+
+                                x = WORD_REGISTER(op->x);
+
+#ifdef Z80_SKIP_DELAY_LOOPS
+
+                                if (is_dec_rr_loop(op->y, NEXT_PC(op), context)) {
+
+                                        int     n;
+
+                                        n = passes_before_stop((x - 1) & 0xffff,
+                                                DEC_RR_LOOP_CYCLES,
+                                                elapsed_cycles - op->cycles,
+                                                number_cycles);
+                                        if (n) {
+
+                                                x = (x - n) & 0xffff;
+                                                A = (x | (x >> 8)) & 0xff;
+                                                F = SZYXP_FLAGS_TABLE[A];
+                                                elapsed_cycles += n * DEC_RR_LOOP_CYCLES;
+                                                r += 4 * n;
+
+                                        }
+
+                                }
+
+#endif
+
+                                WORD_REGISTER(op->x) = x - 1;
+                                NEXT_MICRO_OP();
+
+                        }
+
+                        /* General-purpose arithmetic and CPU control. */
+
+                        MICRO_OP(DAA): {
+
+                                int     a, c, d;
+
+                                a = A;
+                                if (a > 0x99 || (F & Z80_C_FLAG)) {
+
+                                        c = Z80_C_FLAG;
+                                        d = 0x60;
+
+                                } else
+
+                                        c = d = 0;
+
+                                if ((a & 0x0f) > 0x09 || (F & Z80_H_FLAG))
+
+                                        d += 0x06;
+
+                                A += F & Z80_N_FLAG ? -d : +d;
+                                F = SZYXP_FLAGS_TABLE[A] 
+                                        | ((A ^ a) & Z80_H_FLAG)
+                                        | (F & Z80_N_FLAG)
+                                        | c;
+
+                                NEXT_MICRO_OP();
+
+                        }
+
+                        MICRO_OP(CPL): {
+
+                                A = ~A;
+                                F = (F & (SZPV_FLAGS | Z80_C_FLAG))
+
+#ifndef Z80_DOCUMENTED_FLAGS_ONLY
+
+                                        | (A & YX_FLAGS)
+
+#endif
+
+                                        | Z80_H_FLAG | Z80_N_FLAG;
+
+                                NEXT_MICRO_OP();
+
+                        }
+
+                        MICRO_OP(NEG): {
+
+                                int     a, f, z, c;
+
+                                a = A;
+                                z = -a;
+
+                                c = a ^ z;
+                                f = Z80_N_FLAG | (c & Z80_H_FLAG);
+                                f |= SZYX_FLAGS_TABLE[z &= 0xff];
+                                c &= 0x0180;
+                                f |= OVERFLOW_TABLE[c >> 7];
+                                f |= c >> (8 - Z80_C_FLAG_SHIFT);
+
+                                A = z;
+                                F = f;
+
+                                NEXT_MICRO_OP();
+
+                        }
+
+                        MICRO_OP(CCF): {
+
+                                int     c;
+
+                                c = F & Z80_C_FLAG;
+                                F = (F & SZPV_FLAGS)
+                                        | (c << Z80_H_FLAG_SHIFT)
+
+#ifndef Z80_DOCUMENTED_FLAGS_ONLY
+
+                                        | (A & YX_FLAGS)
+
+#endif
+
+                                        | (c ^ Z80_C_FLAG);
+
+                                NEXT_MICRO_OP();
+
+                        }
+
+                        MICRO_OP(SCF): {
+
+                                F = (F & SZPV_FLAGS)
+
+#ifndef Z80_DOCUMENTED_FLAGS_ONLY
+
+                                        | (A & YX_FLAGS)
+
+#endif
+
+                                        | Z80_C_FLAG;
+
+                                NEXT_MICRO_OP();
+
+                        }
+
+                        MICRO_OP(NOP): {
+
+                                NEXT_MICRO_OP();
+
+                        }
+
+                        MICRO_OP(HALT): {
+
+                                /* See HALT in z80emu_impl.h. */
+
+#ifdef Z80_CATCH_HALT
+
+                                state->status = Z80_STATUS_HALT;
+
+#else
+
+                                if (elapsed_cycles < number_cycles)
+
+                                        elapsed_cycles = number_cycles;
+
+#endif
+
+                                pc = NEXT_PC(op);
+                                r += op->fetches;
+                                goto stop_emulation;
+
+                        }
+
+                        MICRO_OP(DI): {
+
+                                /* See DI in z80emu_impl.h. */
+
+                                state->iff1 = state->iff2 = 0;
+                                number_cycles += 4;
+                                NEXT_MICRO_OP();
+
+                        }
+
+                        MICRO_OP(EI): {
+
+                                state->iff1 = state->iff2 = 1;
+                                number_cycles += 4;
+                                Z80_STOP_FOR_INTERRUPT(1);
+                                NEXT_MICRO_OP();
+
+                        }
+
+                        /* Rotates and shifts. */
+
+                        MICRO_OP(RLCA): {
+
+                                A = (A << 1) | (A >> 7);
+                                F = (F & SZPV_FLAGS)
+                                        | (A & (YX_FLAGS | Z80_C_FLAG));
+                                NEXT_MICRO_OP();
+
+                        }
+
+                        MICRO_OP(RLA): {
+
+                                int     a, f;
+
+                                a = A << 1;
+                                f = (F & SZPV_FLAGS)
+
+#ifndef Z80_DOCUMENTED_FLAGS_ONLY
+
+                                        | (a & YX_FLAGS)
+
+#endif
+
+                                        | (A >> 7);
+                                A = a | (F & Z80_C_FLAG); 
+                                F = f;
+
+                                NEXT_MICRO_OP();
+
+                        }
+
+                        MICRO_OP(RRCA): {
+
+                                int     c;
+
+                                c = A & 0x01;
+                                A = (A >> 1) | (A << 7);
+                                F = (F & SZPV_FLAGS)
+
+#ifndef Z80_DOCUMENTED_FLAGS_ONLY
+
+                                        | (A & YX_FLAGS)
+
+#endif
+
+                                        | c;
+
+                                NEXT_MICRO_OP();
+
+                        }
+
+                        MICRO_OP(RRA): {
+
+                                int     c;
+
+                                c = A & 0x01;
+                                A = (A >> 1) | ((F & Z80_C_FLAG) << 7);
+                                F = (F & SZPV_FLAGS)
+
+#ifndef Z80_DOCUMENTED_FLAGS_ONLY
+
+                                        | (A & YX_FLAGS)
+
+#endif
+
+                                        | c;
+
+                                NEXT_MICRO_OP();
+
+                        }
+
+#define SHIFT_MICRO_OPS(name, operation)                                \
+                        MICRO_OP(name##_R): {                           \
+                                                                        \
+                                operation(BYTE_REGISTER(op->x));        \
+                                NEXT_MICRO_OP();                        \
+                                                                        \
+                        }                                               \
+                                                                        \
+                        MICRO_OP(name##_MEM): {                         \
+                                                                        \
+                                int     d, x;                           \
+                                                                        \
+                                d = MEMORY_OPERAND(op);                 \
+                                Z80_READ_BYTE(d, x);                    \
+                                operation(x);                           \
+                                Z80_WRITE_BYTE(d, x);                   \
+                                NEXT_MICRO_OP_AFTER_WRITE();            \
+                                                                        \
+                        }
+
+                        SHIFT_MICRO_OPS(RLC, RLC)
+                        SHIFT_MICRO_OPS(RL, RL)
+                        SHIFT_MICRO_OPS(RRC, RRC)
+                        SHIFT_MICRO_OPS(RR, RR_INSTRUCTION)
+                        SHIFT_MICRO_OPS(SLA, SLA)
+                        SHIFT_MICRO_OPS(SLL, SLL)
+                        SHIFT_MICRO_OPS(SRA, SRA)
+                        SHIFT_MICRO_OPS(SRL, SRL)
+
+                        /* Bit set, reset, and test. */
+
+                        MICRO_OP(BIT_R): {
+
+                                int     x;
+
+                                x = BYTE_REGISTER(op->x) & op->y;
+                                F = (x ? 0 : Z80_Z_FLAG | Z80_P_FLAG)
+
+#ifndef Z80_DOCUMENTED_FLAGS_ONLY
+
+                                        | (x & Z80_S_FLAG)
+                                        | (BYTE_REGISTER(op->x) & YX_FLAGS)
+
+#endif
+
+                                        | Z80_H_FLAG
+                                        | (F & Z80_C_FLAG);
+
+                                NEXT_MICRO_OP();
+
+                        }
+
+                        MICRO_OP(BIT_MEM): {
+
+                                int     d, x;
+
+                                d = MEMORY_OPERAND(op);
+                                Z80_READ_BYTE(d, x);
+                                x &= op->x;
+                                F = (x ? 0 : Z80_Z_FLAG | Z80_P_FLAG)
+
+#ifndef Z80_DOCUMENTED_FLAGS_ONLY
+
+                                        | (x & Z80_S_FLAG)
+                                        | (d & YX_FLAGS)
+
+#endif
+
+                                        | Z80_H_FLAG
+                                        | (F & Z80_C_FLAG);
+
+                                NEXT_MICRO_OP();
+
+                        }
+
+                        MICRO_OP(SET_R): {
+
+                                BYTE_REGISTER(op->x) |= op->y;
+                                NEXT_MICRO_OP();
+
+                        }
+
+                        MICRO_OP(SET_MEM): {
+
+                                int     d, x;
+
+                                d = MEMORY_OPERAND(op);
+                                Z80_READ_BYTE(d, x);
+                                x |= op->x;
+                                Z80_WRITE_BYTE(d, x);
+                                NEXT_MICRO_OP_AFTER_WRITE();
+
+                        }
+
+                        MICRO_OP(RES_R): {
+
+                                BYTE_REGISTER(op->x) &= ~op->y;
+                                NEXT_MICRO_OP();
+
+                        }
+
+                        MICRO_OP(RES_MEM): {
+
+                                int     d, x;
+
+                                d = MEMORY_OPERAND(op);
+                                Z80_READ_BYTE(d, x);
+                                x &= ~op->x;
+                                Z80_WRITE_BYTE(d, x);
+                                NEXT_MICRO_OP_AFTER_WRITE();
+
+                        }
+
+                        /* Jumps, calls, and returns. These all end the
+                         * block.
+                         */
+
+                        MICRO_OP(JP): {
+
+                                BRANCH(op->n);
+
+                        }
+
+                        MICRO_OP(JP_CC): {
+
+                                if (CONDITION(op))
+
+                                        BRANCH(op->n);
+
+                                NEXT_MICRO_OP();
+
+                        }
+
+                        MICRO_OP(JR_CC): {
+
+                                if (CONDITION(op)) {
+
+                                        elapsed_cycles += 5;
+                                        BRANCH(op->n);
+
+                                }
+                                NEXT_MICRO_OP();
+
+                        }
+
+                        MICRO_OP(JP_RR): {
+
+                                pc = WORD_REGISTER(op->x);
+                                LEAVE_BLOCK();
+
+                        }
+
+                        MICRO_OP(DJNZ): {
+
+#ifdef Z80_SKIP_DELAY_LOOPS
+
+                                if (op->n == ((NEXT_PC(op) - 2) & 0xffff)) {
+
+                                        int     n;
+
+                                        /* Same as DJNZ_E in z80emu_impl.h. */
+
+                                        n = passes_before_stop((B - 1) & 0xff,
+                                                DJNZ_LOOP_CYCLES,
+                                                elapsed_cycles - op->cycles,
+                                                number_cycles);
+                                        B -= n;
+                                        elapsed_cycles += n * DJNZ_LOOP_CYCLES;
+                                        r += n;
+
+                                }
+
+#endif
+
+                                if (--B) {
+
+                                        elapsed_cycles += 5;
+                                        BRANCH(op->n);
+
+                                }
+                                NEXT_MICRO_OP();
+
+                        }
+
+                        MICRO_OP(CALL): {
+
+                                SP -= 2;
+                                Z80_WRITE_WORD(SP, NEXT_PC(op));
+                                pc = op->n;
+                                LEAVE_BLOCK();
+
+                        }
+
+                        MICRO_OP(CALL_CC): {
+
+                                if (CONDITION(op)) {
+
+                                        SP -= 2;
+                                        Z80_WRITE_WORD(SP, NEXT_PC(op));
+                                        elapsed_cycles += 7;
+                                        BRANCH(op->n);
+
+                                }
+                                NEXT_MICRO_OP();
+
+                        }
+
+                        MICRO_OP(RET): {
+
+                                Z80_READ_WORD(SP, pc);
+                                SP += 2;
+                                LEAVE_BLOCK();
+
+                        }
+
+                        MICRO_OP(RET_CC): {
+
+                                if (CONDITION(op)) {
+
+                                        Z80_READ_WORD(SP, pc);
+                                        SP += 2;
+                                        elapsed_cycles += 6;
+                                        BRANCH(pc);
+
+                                }
+                                NEXT_MICRO_OP();
+
+                        }
+
+                        /* Block transfers. */
+
+                        MICRO_OP(LDIR_LDDR): {
+
+                                int     d, f, bc, de, hl, n;
+
+                                /* Same as LDIR_LDDR in z80emu_impl.h, 
+                                 * repeating until number_cycles is reached.
+                                 */
+
+                                d = op->x ? +1 : -1;
+
+                                f = F & SZC_FLAGS;
+                                bc = BC;
+                                de = DE;
+                                hl = HL;
+
+                                r -= 2;
+                                elapsed_cycles -= 8;
+
+#ifdef Z80_BULK_BLOCK_INSTRUCTIONS
+
+                                n = passes_before_stop((bc - 1) & 0xffff, 21,
+                                        elapsed_cycles, number_cycles);
+                                n = context->moveBytes(de & 0xffff, 
+                                        hl & 0xffff, n, d);
+                                hl += d * n;
+                                de += d * n;
+                                bc -= n;
+                                elapsed_cycles += 21 * n;
+                                r += 2 * n;
+
+#endif
+
+                                for ( ; ; ) {
+
+                                        r += 2;
+
+                                        Z80_READ_BYTE(hl, n);
+                                        Z80_WRITE_BYTE(de, n);
+
+                                        hl += d;
+                                        de += d;
+
+                                        if (--bc)
+
+                                                elapsed_cycles += 21;
+
+                                        else {
+
+                                                elapsed_cycles += 16;
+                                                break;
+
+                                        }
+
+                                        if (elapsed_cycles < number_cycles)
+
+                                                continue;
+
+                                        else {
+
+                                                f |= Z80_P_FLAG;
+                                                break;
+
+                                        }
+
+                                }
+
+                                HL = hl;
+                                DE = de;
+                                BC = bc;
+
+#ifndef Z80_DOCUMENTED_FLAGS_ONLY
+
+                                n += A;
+                                f |= n & Z80_X_FLAG;
+                                f |= (n << (Z80_Y_FLAG_SHIFT - 1)) 
+                                        & Z80_Y_FLAG;
+
+#endif
+
+                                F = f;
+
+                                if (bc) {
+
+                                        /* Not done, run it again. */
+
+                                        pc = op->n;
+                                        r += op->fetches;
+                                        goto stop_emulation;
+
+                                }
+                                NEXT_MICRO_OP_AFTER_WRITE();
+
+                        }
+
+                        /* Input and output. */
+
+                        MICRO_OP(IN_A_N): {
+
+                                Z80_INPUT_BYTE(op->n, A);
+                                NEXT_MICRO_OP();
+
+                        }
+
+                        MICRO_OP(OUT_N_A): {
+
+                                Z80_OUTPUT_BYTE(op->n, A);
+                                NEXT_MICRO_OP();
+
+                        }
+
+                        /* Block boundaries. */
+
+                        MICRO_OP(END): {
+
+                                pc = NEXT_PC(op);
+                                LEAVE_BLOCK();
+
+                        }
+
+                        MICRO_OP(EMULATE):
+                        MICRO_OP(FALLBACK): {
+
+                                int     opcode;
+
+                                /* Run exactly one instruction: any 
+                                 * instruction takes more than one cycle.
+                                 */
+
+                                r += op->fetches;
+                                state->r = (state->r & 0x80) | (r & 0x7f);
+                                state->pc = op->n + 1;
+                                Z80_FETCH_BYTE(op->n, opcode);
+                                elapsed_cycles = emulate(state, opcode,
+                                        elapsed_cycles, elapsed_cycles + 1,
+                                        context);
+                                pc = state->pc;
+                                r = state->r & 0x7f;
+                                cache->fallbacks++;
+
+                                /* The instruction may have made an 
+                                 * interrupt acceptable, as RETN or output 
+                                 * do, but it stopped emulate() and not us.
+                                 */
+
+                                Z80_STOP_FOR_INTERRUPT(0);
+
+                                if (elapsed_cycles >= number_cycles)
+
+                                        goto stop_emulation;
+
+                                if (op->kind == MICRO_OP_EMULATE 
+                                        && pc == NEXT_PC(op)
+                                        && !cache->invalidated) {
+
+                                        r -= op->fetches;
+                                        op++;
+                                        RESTART_MICRO_OP();
+
+                                }
+                                goto next_block;
+
+                        }
+
+#ifdef Z80_NATIVE_BLOCKS
+
+                        MICRO_OP(NATIVE): {
+
+                                Z80_NATIVE_RUN  run;
+
+                                /* The block starts at NEXT_PC(op). */
+
+                                run.pc = NEXT_PC(op);
+                                run.r = r;
+                                run.elapsed_cycles = elapsed_cycles;
+                                run.number_cycles = number_cycles;
+                                NATIVE_FUNCTIONS<Bus>[op->n](state, cache, 
+                                        &run, context);
+                                pc = run.pc;
+                                r = run.r;
+                                elapsed_cycles = run.elapsed_cycles;
+                                number_cycles = run.number_cycles;
+                                LEAVE_BLOCK();
+
+                        }
+
+#endif
+
+#ifdef Z80_THREADED_DISPATCH
+
+        }
+
+#else
+
+                }
+
+        }
+
+#endif
+
+stop_in_block:
+
+        pc = NEXT_PC(op);
+        r += op->fetches;
+        goto stop_emulation;
+
+leave_block:
+
+        r += op->fetches;
+        if (elapsed_cycles < number_cycles)
+
+                goto next_block;
+
+stop_emulation:
+
+        state->r = (state->r & 0x80) | (r & 0x7f);
+        state->pc = pc & 0xffff;
+
+        return elapsed_cycles;
+}
+
+#undef Z80_MICRO_OPS
+#undef Z80_NATIVE_MICRO_OPS
+#undef MICRO_OP_ENUM
+#undef BYTE_REGISTER
+#undef WORD_REGISTER
+#undef MEMORY_OPERAND
+#undef CONDITION
+#undef NEXT_PC
+#undef BLOCK_INDEX
+#undef MICRO_OP
+#undef MICRO_OP_ADDRESS
+#undef DISPATCH_MICRO_OP
+#undef NEXT_MICRO_OP
+#undef NEXT_MICRO_OP_AFTER_WRITE
+#undef LEAVE_BLOCK
+#undef BRANCH
+#undef RESTART_MICRO_OP
+#undef ALU_MICRO_OPS
+#undef SHIFT_MICRO_OPS
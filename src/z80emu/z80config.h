@@ -19,6 +19,12 @@
 
 /* #define Z80_DOCUMENTED_FLAGS_ONLY */
 
+/* Flags are always worked out as each instruction runs. Working them out 
+ * only when F is read was tried in the block cache and was no faster, since 
+ * most arithmetic is followed straight away by a conditional jump that reads 
+ * F, so there's no option for it.
+ */
+
 /* HALT, DI, EI, RETI, and RETN instructions can be catched. When such an
  * instruction is catched, the emulator is stopped and the PC register points
  * at the opcode to be executed next. The catched instruction can be determined
@@ -26,8 +32,13 @@
  * accepted at the instruction right after a DI or EI on an actual processor. 
  */
 
-/*      
+/* The TRS-80 catches HALT to keep the Z80 halted from one slice to the next 
+ * until an interrupt (see runSlice() in trs80.cpp).
+ */
+
 #define Z80_CATCH_HALT
+
+/*      
 #define Z80_CATCH_DI
 #define Z80_CATCH_EI
 #define Z80_CATCH_RETI
@@ -69,6 +80,60 @@
 
 /* #define Z80_HANDLE_SELF_MODIFYING_CODE */
 
+/* By default, instructions are decoded through INSTRUCTION_TABLE and then a 
+ * switch statement. With GCC or Clang, defining this macro instead jumps 
+ * directly from each opcode to its handler using computed gotos (see 
+ * dispatch.h), saving the table hop and the switch's bounds check on every 
+ * instruction. The build sets it with the Z80_THREADED_DISPATCH option.
+ */
+
+/* #define Z80_THREADED_DISPATCH */
+
+#if defined(Z80_THREADED_DISPATCH) && !defined(__GNUC__)
+#       undef Z80_THREADED_DISPATCH
+#endif
+
+/* Define this macro to build the cache of predecoded blocks in z80block.h, 
+ * and its Z80EmulateBlocks() function. The build sets it with the 
+ * Z80_USE_BLOCK_CACHE option.
+ */
+
+/* #define Z80_USE_BLOCK_CACHE */
+
+/* Define this macro to recognize the common delay loops (see 
+ * is_dec_rr_loop() in z80emu_impl.h) and skip their passes in one step, 
+ * computing the registers and elapsed cycles they would have left. The 
+ * build sets it with the Z80_SKIP_DELAY_LOOPS option.
+ */
+
+/* #define Z80_SKIP_DELAY_LOOPS */
+
+/* Define this macro to let the Bus do the bulk of LDIR, LDDR, CPIR, and CPDR
+ * instructions at once with its moveBytes() and scanBytes() functions (see 
+ * z80user.h), rather than one byte at a time. It can't be used with 
+ * Z80_HANDLE_SELF_MODIFYING_CODE. The build sets it with the 
+ * Z80_BULK_BLOCK_INSTRUCTIONS option.
+ */
+
+/* #define Z80_BULK_BLOCK_INSTRUCTIONS */
+
+#if defined(Z80_BULK_BLOCK_INSTRUCTIONS) \
+        && defined(Z80_HANDLE_SELF_MODIFYING_CODE)
+#       undef Z80_BULK_BLOCK_INSTRUCTIONS
+#endif
+
+/* Define this macro as the name of a header made by make_native_blocks.py to
+ * run the code it translated as native code in the block cache (see 
+ * z80native.h). It needs Z80_USE_BLOCK_CACHE. The build sets it with the 
+ * Z80_NATIVE_BLOCKS option.
+ */
+
+/* #define Z80_NATIVE_BLOCKS "native_blocks.h" */
+
+#if defined(Z80_NATIVE_BLOCKS) && !defined(Z80_USE_BLOCK_CACHE)
+#       undef Z80_NATIVE_BLOCKS
+#endif
+
 /* For interrupt mode 2, bit 0 of the 16-bit address to the interrupt vector 
  * can be masked to zero. Some documentation states that this bit is forced to 
  * zero. For instance, Zilog's application note about interrupts, states that
@@ -84,5 +149,8 @@
 #define Z80Interrupt Trs80Z80Interrupt
 #define Z80NonMaskableInterrupt Trs80Z80NonMaskableInterrupt
 #define Z80Emulate Trs80Z80Emulate
+#define Z80EmulateBlocks Trs80Z80EmulateBlocks
+#define Z80ResetBlockCache Trs80Z80ResetBlockCache
+#define Z80BlockCacheWrite Trs80Z80BlockCacheWrite
 
 #endif
@@ -10,10 +10,6 @@
 #ifndef __Z80EMU_INCLUDED__
 #define __Z80EMU_INCLUDED__
 
-#ifdef __cplusplus
-extern "C" {
-#endif
-
 #include "z80config.h"
 
 /* If Z80_STATE's status is non-zero, the emulation has been stopped for some 
@@ -118,8 +114,8 @@ enum {
 };
 
 /* Z80 processor's state. You may add your own members if needed. However, it
- * is rather suggested to use the context pointer passed to the emulation 
- * functions for that purpose. See z80user.h.
+ * is rather suggested to use the bus passed to the emulation functions for 
+ * that purpose. See z80user.h.
  */ 
 
 typedef struct Z80_STATE {
@@ -136,15 +132,15 @@ typedef struct Z80_STATE {
         unsigned short  alternates[4];
 
         int             i, r, pc, iff1, iff2, im;
-        
-        /* Register decoding tables. */
-
-        void            *register_table[16], 
-                        *dd_register_table[16], 
-                        *fd_register_table[16];        
 
 } Z80_STATE;
 
+/* The emulation functions are templates on the Bus type the processor is 
+ * connected to, so that memory and I/O accesses (see z80user.h) can be inlined
+ * into the interpreter loop. Their definitions are in z80emu_impl.h, which must
+ * be included in the one translation unit that defines the Bus.
+ */
+
 /* Initialize processor's state to power-on default. */
 
 extern void     Z80Reset (Z80_STATE *state);
@@ -155,15 +151,17 @@ extern void     Z80Reset (Z80_STATE *state);
  * byte opcode.
  */
 
-extern int      Z80Interrupt (Z80_STATE *state, 
+template <typename Bus>
+int             Z80Interrupt (Z80_STATE *state, 
 			int data_on_bus, 
-			void *context);
+			Bus *context);
 
 /* Trigger a non maskable interrupt, then return the number of cycles elapsed
  * to accept it.
  */
 
-extern int      Z80NonMaskableInterrupt (Z80_STATE *state, void *context);
+template <typename Bus>
+int             Z80NonMaskableInterrupt (Z80_STATE *state, Bus *context);
 
 /* Execute instructions as long as the number of elapsed cycles is smaller than
  * number_cycles, and return the number of cycles emulated. The emulator can be
@@ -171,12 +169,9 @@ extern int      Z80NonMaskableInterrupt (Z80_STATE *state, void *context);
  * (see z80user.h) also control the emulation.
  */
 
-extern int      Z80Emulate (Z80_STATE *state, 
+template <typename Bus>
+int             Z80Emulate (Z80_STATE *state, 
 			int number_cycles, 
-			void *context);
-
-#ifdef __cplusplus
-}
-#endif
+			Bus *context);
 
 #endif
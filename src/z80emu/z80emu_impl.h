@@ -1,5 +1,7 @@
-/* z80emu.c
- * Z80 processor emulator. 
+/* z80emu_impl.h
+ * Z80 processor emulator. This is included in the translation unit that 
+ * defines the Bus the processor is connected to (see z80user.h), so that all
+ * bus accesses are inlined into emulate(). Include it only once per program.
  *
  * Copyright (c) 2012-2017 Lin Ke-Fong
  *
@@ -12,6 +14,20 @@
 #include "macros.h"
 #include "tables.h"
 
+#ifdef Z80_THREADED_DISPATCH
+#       include "dispatch.h"
+#endif
+
+/* Instruction handlers are either cases of one big switch, or labels jumped to
+ * directly through the tables in dispatch.h (see z80config.h).
+ */
+
+#ifdef Z80_THREADED_DISPATCH
+#       define INSTRUCTION(name)        name##_HANDLER
+#else
+#       define INSTRUCTION(name)        case name
+#endif
+
 /* Indirect (HL) or prefixed indexed (IX + d) and (IY + d) memory operands are
  * encoded using the 3 bits "110" (0x06).
  */
@@ -63,6 +79,49 @@ static const int RST_TABLE[8] = {
 
 };      
 
+/* Register decoding tables for both 3-bit encoded 8-bit registers and 2-bit
+ * encoded 16-bit registers, as indexes into Z80_STATE's registers. When an 
+ * opcode is prefixed by 0xdd, HL is replaced by IX. When 0xfd prefixed, HL is
+ * replaced by IY. Entries 0 to 7 are byte indexes of the 8-bit "R" registers,
+ * except entry 6 (used for indexed memory operands and direct HL or IX/IY 
+ * register access), which is a word index like entries 8 to 11 ("regular" 
+ * 16-bit "RR" registers) and 12 to 15 (16-bit "SS" registers for PUSH and POP
+ * instructions, where SP is replaced by AF).
+ *
+ * emulate() picks the table for each instruction when it reads the prefix,
+ * so R(), RR(), SS(), and HL_IX_IY still look up the register at run time. 
+ * The tables are constant, which only spares the compiler from reloading 
+ * them after register writes and keeps pointers out of the state. Hot code 
+ * runs from the block cache (see z80block_impl.h), which looks the 
+ * registers up once when it decodes an instruction. With the cache on, this 
+ * only runs the few instructions the cache falls back on, hardly any of them 
+ * prefixed, so a copy of the handlers for each prefix isn't worth its flash.
+ */
+
+static const unsigned char REGISTER_TABLE[16] = {
+
+        Z80_B, Z80_C, Z80_D, Z80_E, Z80_H, Z80_L, Z80_HL, Z80_A,
+        Z80_BC, Z80_DE, Z80_HL, Z80_SP,
+        Z80_BC, Z80_DE, Z80_HL, Z80_AF,
+
+};
+
+static const unsigned char DD_REGISTER_TABLE[16] = {
+
+        Z80_B, Z80_C, Z80_D, Z80_E, Z80_IXH, Z80_IXL, Z80_IX, Z80_A,
+        Z80_BC, Z80_DE, Z80_IX, Z80_SP,
+        Z80_BC, Z80_DE, Z80_IX, Z80_AF,
+
+};
+
+static const unsigned char FD_REGISTER_TABLE[16] = {
+
+        Z80_B, Z80_C, Z80_D, Z80_E, Z80_IYH, Z80_IYL, Z80_IY, Z80_A,
+        Z80_BC, Z80_DE, Z80_IY, Z80_SP,
+        Z80_BC, Z80_DE, Z80_IY, Z80_AF,
+
+};
+
 /* There is an overflow if the xor of the carry out and the carry of the most
  * significant bit is not zero.
  */
@@ -76,81 +135,90 @@ static const int OVERFLOW_TABLE[4] = {
 
 };
 
+template <typename Bus>
 static int	emulate (Z80_STATE * state, 
 			int opcode,
 			int elapsed_cycles, int number_cycles,
-			void *context);
+			Bus *context);
+
+#if defined(Z80_SKIP_DELAY_LOOPS) || defined(Z80_BULK_BLOCK_INSTRUCTIONS)
+
+/* Number of passes of a loop, at most the given number, that can be done at
+ * once from elapsed_cycles in: each pass must end before number_cycles, 
+ * since emulate() checks after each one whether to stop.
+ */
+
+static int passes_before_stop (int passes, int pass_cycles, 
+        int elapsed_cycles, int number_cycles)
+{
+        int     n;
+
+        n = (number_cycles - elapsed_cycles - 1) / pass_cycles;
+
+        return n < 0 ? 0 : n < passes ? n : passes;
+}
+
+#endif
+
+#ifdef Z80_SKIP_DELAY_LOOPS
+
+/* Delay loops are recognized and their passes skipped in one go:
+ *
+ *      loop:   DEC     rr              ; 6 cycles
+ *              LD      A, high         ; 4
+ *              OR      low             ; 4
+ *              JR      NZ, loop        ; 12 if taken
+ *
+ * with rr one of BC, DE, or HL (or LD A, low and OR high), and:
+ *
+ *      loop:   DJNZ    loop            ; 13 if taken
+ *
+ * Only passes that loop back and end before number_cycles is reached are 
+ * skipped. The rest is emulated as usual, so the emulation stops at the same
+ * instruction with the same elapsed_cycles as it would otherwise.
+ */
+
+#define DEC_RR_LOOP_CYCLES      26
+#define DJNZ_LOOP_CYCLES        13
+
+/* Whether the unprefixed DEC rr opcode, followed by the byte at pc, starts a
+ * delay loop.
+ */
+
+template <typename Bus>
+static int is_dec_rr_loop (int opcode, int pc, Bus *context)
+{
+        int     high, low, ld, or_, jr, e;
+
+        if ((opcode & 0xcf) != 0x0b || opcode == 0x3b)
+
+                return 0;
+
+        high = (opcode >> 3) & 0x06;
+        low = high + 1;
+        Z80_FETCH_BYTE(pc, ld);
+        Z80_FETCH_BYTE(pc + 1, or_);
+        Z80_FETCH_BYTE(pc + 2, jr);
+        Z80_FETCH_BYTE(pc + 3, e);
+
+        return jr == 0x20 && e == 0xfb
+                && ((ld == (0x78 | high) && or_ == (0xb0 | low))
+                        || (ld == (0x78 | low) && or_ == (0xb0 | high)));
+}
+
+#endif
 
 void Z80Reset (Z80_STATE *state)
 {
-        int     i;
-        
         state->status = 0;
         AF = 0xffff;
         SP = 0xffff;
         state->i = state->pc = state->iff1 = state->iff2 = 0;
         state->im = Z80_INTERRUPT_MODE_0;
-        
-        /* Build register decoding tables for both 3-bit encoded 8-bit
-         * registers and 2-bit encoded 16-bit registers. When an opcode is 
-         * prefixed by 0xdd, HL is replaced by IX. When 0xfd prefixed, HL is
-         * replaced by IY.
-         */
-
-        /* 8-bit "R" registers. */
-
-        state->register_table[0] = &state->registers.byte[Z80_B];
-        state->register_table[1] = &state->registers.byte[Z80_C];
-        state->register_table[2] = &state->registers.byte[Z80_D];
-        state->register_table[3] = &state->registers.byte[Z80_E];
-        state->register_table[4] = &state->registers.byte[Z80_H];
-        state->register_table[5] = &state->registers.byte[Z80_L];
-
-        /* Encoding 0x06 is used for indexed memory operands and direct HL or
-         * IX/IY register access.
-         */
-
-        state->register_table[6] = &state->registers.word[Z80_HL];
-        state->register_table[7] = &state->registers.byte[Z80_A];
-               
-        /* "Regular" 16-bit "RR" registers. */
-
-        state->register_table[8] = &state->registers.word[Z80_BC];
-        state->register_table[9] = &state->registers.word[Z80_DE];
-        state->register_table[10] = &state->registers.word[Z80_HL];
-        state->register_table[11] = &state->registers.word[Z80_SP];
-        
-        /* 16-bit "SS" registers for PUSH and POP instructions (note that SP is
-         * replaced by AF). 
-         */
-
-        state->register_table[12] = &state->registers.word[Z80_BC];
-        state->register_table[13] = &state->registers.word[Z80_DE];
-        state->register_table[14] = &state->registers.word[Z80_HL];
-        state->register_table[15] = &state->registers.word[Z80_AF];
-
-        /* 0xdd and 0xfd prefixed register decoding tables. */
-
-        for (i = 0; i < 16; i++)
-
-                state->dd_register_table[i] 
-                        = state->fd_register_table[i] 
-                        = state->register_table[i];
-
-        state->dd_register_table[4] = &state->registers.byte[Z80_IXH];
-        state->dd_register_table[5] = &state->registers.byte[Z80_IXL];
-        state->dd_register_table[6] = &state->registers.word[Z80_IX];
-        state->dd_register_table[10] = &state->registers.word[Z80_IX];
-        state->dd_register_table[14] = &state->registers.word[Z80_IX];
-
-        state->fd_register_table[4] = &state->registers.byte[Z80_IYH];
-        state->fd_register_table[5] = &state->registers.byte[Z80_IYL];
-        state->fd_register_table[6] = &state->registers.word[Z80_IY];
-        state->fd_register_table[10] = &state->registers.word[Z80_IY];
-        state->fd_register_table[14] = &state->registers.word[Z80_IY];        
 }
 
-int Z80Interrupt (Z80_STATE *state, int data_on_bus, void *context)
+template <typename Bus>
+int Z80Interrupt (Z80_STATE *state, int data_on_bus, Bus *context)
 {
         state->status = 0;
         if (state->iff1) {
@@ -213,7 +281,8 @@ int Z80Interrupt (Z80_STATE *state, int data_on_bus, void *context)
                 return 0;
 }
 
-int Z80NonMaskableInterrupt (Z80_STATE *state, void *context)
+template <typename Bus>
+int Z80NonMaskableInterrupt (Z80_STATE *state, Bus *context)
 {
 	int	elapsed_cycles;
 
@@ -231,7 +300,8 @@ int Z80NonMaskableInterrupt (Z80_STATE *state, void *context)
         return elapsed_cycles + 11;
 }
 
-int Z80Emulate (Z80_STATE *state, int number_cycles, void *context)
+template <typename Bus>
+int Z80Emulate (Z80_STATE *state, int number_cycles, Bus *context)
 {
         int     elapsed_cycles, pc, opcode;
 
@@ -248,31 +318,57 @@ int Z80Emulate (Z80_STATE *state, int number_cycles, void *context)
  * needed by Z80Interrupt() for interrupt mode 0.
  */
 
+template <typename Bus>
 static int emulate (Z80_STATE * state, 
 	int opcode, 
 	int elapsed_cycles, int number_cycles, 
-	void *context)
+	Bus *context)
 {
         int	pc, r;
 
+#ifdef Z80_THREADED_DISPATCH
+
+        DECLARE_DISPATCH_TABLES
+
+#endif
+
         pc = state->pc;
         r = state->r & 0x7f;
         goto start_emulation;
 
         for ( ; ; ) {   
 
-                void    **registers; 
+                const unsigned char     *registers;
+
+#ifndef Z80_THREADED_DISPATCH
+
                 int     instruction;
 
+#endif
+
                 Z80_FETCH_BYTE(pc, opcode);
                 pc++;
 
 start_emulation:                
 
-                registers = state->register_table;
+                registers = REGISTER_TABLE;
 
 emulate_next_opcode:
 
+#ifdef Z80_THREADED_DISPATCH
+
+                elapsed_cycles += 4;
+                r++;
+                goto *INSTRUCTION_DISPATCH_TABLE[opcode];
+
+                /* The do-while only gives the handlers' break statements 
+                 * something to break out of, it's never entered from the top.
+                 */
+
+                do {
+
+#else
+
                 instruction = INSTRUCTION_TABLE[opcode];
 
 emulate_next_instruction:
@@ -281,25 +377,27 @@ emulate_next_instruction:
                 r++;
                 switch (instruction) {
 
+#endif
+
                         /* 8-bit load group. */
 
-                        case LD_R_R: {
+                        INSTRUCTION(LD_R_R): {
 
                                 R(Y(opcode)) = R(Z(opcode));
                                 break;
 
                         }
 
-                        case LD_R_N: {
+                        INSTRUCTION(LD_R_N): {
 
                                 READ_N(R(Y(opcode)));
                                 break;
 
                         }
 
-                        case LD_R_INDIRECT_HL: {
+                        INSTRUCTION(LD_R_INDIRECT_HL): {
 
-                                if (registers == state->register_table) {
+                                if (registers == REGISTER_TABLE) {
 
                                         READ_BYTE(HL, R(Y(opcode)));
 
@@ -318,9 +416,9 @@ emulate_next_instruction:
 
                         }
 
-                        case LD_INDIRECT_HL_R: {
+                        INSTRUCTION(LD_INDIRECT_HL_R): {
 
-                                if (registers == state->register_table) {
+                                if (registers == REGISTER_TABLE) {
 
                                         WRITE_BYTE(HL, R(Z(opcode)));
 
@@ -339,11 +437,11 @@ emulate_next_instruction:
 
                         }
 
-                        case LD_INDIRECT_HL_N: {
+                        INSTRUCTION(LD_INDIRECT_HL_N): {
 
                                 int     n;
 
-                                if (registers == state->register_table) {
+                                if (registers == REGISTER_TABLE) {
 
                                         READ_N(n);
                                         WRITE_BYTE(HL, n);
@@ -365,21 +463,21 @@ emulate_next_instruction:
 
                         }
 
-                        case LD_A_INDIRECT_BC: {
+                        INSTRUCTION(LD_A_INDIRECT_BC): {
 
                                 READ_BYTE(BC, A);
                                 break;
 
                         }
 
-                        case LD_A_INDIRECT_DE: {
+                        INSTRUCTION(LD_A_INDIRECT_DE): {
 
                                 READ_BYTE(DE, A);
                                 break;
 
                         }
 
-                        case LD_A_INDIRECT_NN: {
+                        INSTRUCTION(LD_A_INDIRECT_NN): {
 
                                 int     nn;
 
@@ -389,21 +487,21 @@ emulate_next_instruction:
 
                         }
 
-                        case LD_INDIRECT_BC_A: {
+                        INSTRUCTION(LD_INDIRECT_BC_A): {
 
                                 WRITE_BYTE(BC, A);
                                 break;
 
                         }
 
-                        case LD_INDIRECT_DE_A: {
+                        INSTRUCTION(LD_INDIRECT_DE_A): {
 
                                 WRITE_BYTE(DE, A);
                                 break;
 
                         }
 
-                        case LD_INDIRECT_NN_A: {
+                        INSTRUCTION(LD_INDIRECT_NN_A): {
 
                                 int     nn;
 
@@ -413,7 +511,7 @@ emulate_next_instruction:
 
                         }
 
-                        case LD_A_I_LD_A_R: {
+                        INSTRUCTION(LD_A_I_LD_A_R): {
 
                                 int     a, f;
 
@@ -439,7 +537,7 @@ emulate_next_instruction:
 
                         }
 
-                        case LD_I_A_LD_R_A: {
+                        INSTRUCTION(LD_I_A_LD_R_A): {
 
                                 if (opcode == OPCODE_LD_I_A)
 
@@ -460,14 +558,14 @@ emulate_next_instruction:
 
                         /* 16-bit load group. */
 
-                        case LD_RR_NN: {
+                        INSTRUCTION(LD_RR_NN): {
 
                                 READ_NN(RR(P(opcode)));
                                 break;
 
                         }
 
-                        case LD_HL_INDIRECT_NN: {
+                        INSTRUCTION(LD_HL_INDIRECT_NN): {
 
                                 int     nn;
 
@@ -477,7 +575,7 @@ emulate_next_instruction:
 
                         }
 
-                        case LD_RR_INDIRECT_NN: {
+                        INSTRUCTION(LD_RR_INDIRECT_NN): {
 
                                 int     nn;
 
@@ -487,7 +585,7 @@ emulate_next_instruction:
 
                         }
 
-                        case LD_INDIRECT_NN_HL: {
+                        INSTRUCTION(LD_INDIRECT_NN_HL): {
 
                                 int     nn;
 
@@ -497,7 +595,7 @@ emulate_next_instruction:
 
                         }
 
-                        case LD_INDIRECT_NN_RR: {
+                        INSTRUCTION(LD_INDIRECT_NN_RR): {
 
                                 int     nn;
 
@@ -507,7 +605,7 @@ emulate_next_instruction:
 
                         }
 
-                        case LD_SP_HL: {
+                        INSTRUCTION(LD_SP_HL): {
 
                                 SP = HL_IX_IY;
                                 elapsed_cycles += 2;
@@ -515,7 +613,7 @@ emulate_next_instruction:
 
                         }
 
-                        case PUSH_SS: {
+                        INSTRUCTION(PUSH_SS): {
 
                                 PUSH(SS(P(opcode)));
                                 elapsed_cycles++;
@@ -523,7 +621,7 @@ emulate_next_instruction:
 
                         }
 
-                        case POP_SS: {
+                        INSTRUCTION(POP_SS): {
 
                                 POP(SS(P(opcode)));
                                 break;
@@ -532,21 +630,21 @@ emulate_next_instruction:
 
                         /* Exchange, block transfer and search group. */
 
-                        case EX_DE_HL: {
+                        INSTRUCTION(EX_DE_HL): {
 
                                 EXCHANGE(DE, HL);
                                 break;                          
 
                         }
 
-                        case EX_AF_AF_PRIME: {
+                        INSTRUCTION(EX_AF_AF_PRIME): {
 
                                 EXCHANGE(AF, state->alternates[Z80_AF]);
                                 break;
 
                         }
 
-                        case EXX: {
+                        INSTRUCTION(EXX): {
 
                                 EXCHANGE(BC, state->alternates[Z80_BC]);
                                 EXCHANGE(DE, state->alternates[Z80_DE]);
@@ -555,7 +653,7 @@ emulate_next_instruction:
 
                         }                                               
 
-                        case EX_INDIRECT_SP_HL: {
+                        INSTRUCTION(EX_INDIRECT_SP_HL): {
 
                                 int     t;
 
@@ -568,7 +666,7 @@ emulate_next_instruction:
                                 break;                                               
                         }
 
-                        case LDI_LDD: {
+                        INSTRUCTION(LDI_LDD): {
 
                                 int     n, f, d;
 
@@ -599,7 +697,7 @@ emulate_next_instruction:
 
                         }
 
-                        case LDIR_LDDR: {
+                        INSTRUCTION(LDIR_LDDR): {
 
                                 int     d, f, bc, de, hl, n;
                                 
@@ -621,6 +719,25 @@ emulate_next_instruction:
 
                                 r -= 2;
                                 elapsed_cycles -= 8;
+
+#ifdef Z80_BULK_BLOCK_INSTRUCTIONS
+
+                                /* Let the bus move all but the last byte at
+                                 * once if it can, and finish with the loop.
+                                 */
+
+                                n = passes_before_stop((bc - 1) & 0xffff, 21,
+                                        elapsed_cycles, number_cycles);
+                                n = context->moveBytes(de & 0xffff, 
+                                        hl & 0xffff, n, d);
+                                hl += d * n;
+                                de += d * n;
+                                bc -= n;
+                                elapsed_cycles += 21 * n;
+                                r += 2 * n;
+
+#endif
+
                                 for ( ; ; ) {
 
                                         r += 2;
@@ -688,7 +805,7 @@ emulate_next_instruction:
 
                         }
 
-                        case CPI_CPD: {
+                        INSTRUCTION(CPI_CPD): {
 
                                 int     a, n, z, f;
 
@@ -719,7 +836,7 @@ emulate_next_instruction:
 
                         }
 
-                        case CPIR_CPDR: {
+                        INSTRUCTION(CPIR_CPDR): {
                                         
                                 int     d, a, bc, hl, n, z, f;
 
@@ -731,6 +848,23 @@ emulate_next_instruction:
 
                                 r -= 2;
                                 elapsed_cycles -= 8;
+
+#ifdef Z80_BULK_BLOCK_INSTRUCTIONS
+
+                                /* Let the bus skip the bytes before the 
+                                 * match at once if it can.
+                                 */
+
+                                n = passes_before_stop((bc - 1) & 0xffff, 21,
+                                        elapsed_cycles, number_cycles);
+                                n = context->scanBytes(hl & 0xffff, n, d, a);
+                                hl += d * n;
+                                bc -= n;
+                                elapsed_cycles += 21 * n;
+                                r += 2 * n;
+
+#endif
+
                                 for ( ; ; ) {
 
                                         r += 2;
@@ -787,14 +921,14 @@ emulate_next_instruction:
 
                         /* 8-bit arithmetic and logical group. */
 
-                        case ADD_R: {
+                        INSTRUCTION(ADD_R): {
 
                                 ADD(R(Z(opcode)));
                                 break;
 
                         }
 
-                        case ADD_N: {
+                        INSTRUCTION(ADD_N): {
 
                                 int     n;
 
@@ -804,7 +938,7 @@ emulate_next_instruction:
 
                         }
 
-                        case ADD_INDIRECT_HL: {
+                        INSTRUCTION(ADD_INDIRECT_HL): {
 
                                 int     x;
 
@@ -814,14 +948,14 @@ emulate_next_instruction:
 
                         }
 
-                        case ADC_R: {
+                        INSTRUCTION(ADC_R): {
 
                                 ADC(R(Z(opcode)));
                                 break;
 
                         }
 
-                        case ADC_N: {
+                        INSTRUCTION(ADC_N): {
 
                                 int     n;
 
@@ -831,7 +965,7 @@ emulate_next_instruction:
 
                         }
 
-                        case ADC_INDIRECT_HL: {
+                        INSTRUCTION(ADC_INDIRECT_HL): {
 
                                 int     x;
 
@@ -841,14 +975,14 @@ emulate_next_instruction:
 
                         }
 
-                        case SUB_R: {
+                        INSTRUCTION(SUB_R): {
 
                                 SUB(R(Z(opcode)));
                                 break;
 
                         }
 
-                        case SUB_N: {
+                        INSTRUCTION(SUB_N): {
 
                                 int     n;
 
@@ -858,7 +992,7 @@ emulate_next_instruction:
 
                         }
 
-                        case SUB_INDIRECT_HL: {
+                        INSTRUCTION(SUB_INDIRECT_HL): {
 
                                 int     x;
 
@@ -868,14 +1002,14 @@ emulate_next_instruction:
 
                         }
 
-                        case SBC_R: {
+                        INSTRUCTION(SBC_R): {
 
                                 SBC(R(Z(opcode)));
                                 break;
 
                         }
 
-                        case SBC_N: {
+                        INSTRUCTION(SBC_N): {
 
                                 int     n;
 
@@ -885,7 +1019,7 @@ emulate_next_instruction:
 
                         }
 
-                        case SBC_INDIRECT_HL: {
+                        INSTRUCTION(SBC_INDIRECT_HL): {
 
                                 int     x;
 
@@ -895,14 +1029,14 @@ emulate_next_instruction:
 
                         }
 
-                        case AND_R: {
+                        INSTRUCTION(AND_R): {
 
                                 AND(R(Z(opcode)));
                                 break;
 
                         }
 
-                        case AND_N: {
+                        INSTRUCTION(AND_N): {
 
                                 int     n;
 
@@ -912,7 +1046,7 @@ emulate_next_instruction:
 
                         }
 
-                        case AND_INDIRECT_HL: {
+                        INSTRUCTION(AND_INDIRECT_HL): {
 
                                 int     x;
 
@@ -922,14 +1056,14 @@ emulate_next_instruction:
 
                         }
 
-                        case OR_R: {
+                        INSTRUCTION(OR_R): {
 
                                 OR(R(Z(opcode)));
                                 break;
 
                         }
 
-                        case OR_N: {
+                        INSTRUCTION(OR_N): {
 
                                 int     n;
 
@@ -939,7 +1073,7 @@ emulate_next_instruction:
 
                         }
 
-                        case OR_INDIRECT_HL: {
+                        INSTRUCTION(OR_INDIRECT_HL): {
 
                                 int     x;
 
@@ -949,14 +1083,14 @@ emulate_next_instruction:
 
                         }
 
-                        case XOR_R: {
+                        INSTRUCTION(XOR_R): {
 
                                 XOR(R(Z(opcode)));
                                 break;
 
                         }
 
-                        case XOR_N: {
+                        INSTRUCTION(XOR_N): {
 
                                 int     n;
 
@@ -966,7 +1100,7 @@ emulate_next_instruction:
 
                         }
 
-                        case XOR_INDIRECT_HL: {
+                        INSTRUCTION(XOR_INDIRECT_HL): {
 
                                 int     x;
 
@@ -976,14 +1110,14 @@ emulate_next_instruction:
 
                         }
 
-                        case CP_R: {
+                        INSTRUCTION(CP_R): {
 
                                 CP(R(Z(opcode)));
                                 break;
 
                         }
 
-                        case CP_N: {
+                        INSTRUCTION(CP_N): {
 
                                 int     n;
 
@@ -993,7 +1127,7 @@ emulate_next_instruction:
 
                         }
 
-                        case CP_INDIRECT_HL: {
+                        INSTRUCTION(CP_INDIRECT_HL): {
 
                                 int     x;
 
@@ -1003,18 +1137,18 @@ emulate_next_instruction:
 
                         }
 
-                        case INC_R: {
+                        INSTRUCTION(INC_R): {
 
                                 INC(R(Y(opcode)));
                                 break;
 
                         }
 
-                        case INC_INDIRECT_HL: {
+                        INSTRUCTION(INC_INDIRECT_HL): {
 
                                 int     x;
 
-                                if (registers == state->register_table) {
+                                if (registers == REGISTER_TABLE) {
 
                                         READ_BYTE(HL, x);
                                         INC(x);
@@ -1039,18 +1173,18 @@ emulate_next_instruction:
 
                         }
 
-                        case DEC_R: {
+                        INSTRUCTION(DEC_R): {
 
                                 DEC(R(Y(opcode)));
                                 break;
 
                         }
 
-                        case DEC_INDIRECT_HL: {
+                        INSTRUCTION(DEC_INDIRECT_HL): {
 
                                 int     x;
 
-                                if (registers == state->register_table) {
+                                if (registers == REGISTER_TABLE) {
 
                                         READ_BYTE(HL, x);
                                         DEC(x);
@@ -1077,7 +1211,7 @@ emulate_next_instruction:
 
                         /* General-purpose arithmetic and CPU control group. */
 
-                        case DAA: {
+                        INSTRUCTION(DAA): {
                         
                                 int     a, c, d;
 
@@ -1109,7 +1243,7 @@ emulate_next_instruction:
 
                         }
 
-                        case CPL: {
+                        INSTRUCTION(CPL): {
 
                                 A = ~A;
                                 F = (F & (SZPV_FLAGS | Z80_C_FLAG))
@@ -1126,7 +1260,7 @@ emulate_next_instruction:
 
                         }
 
-                        case NEG: {
+                        INSTRUCTION(NEG): {
 
                                 int     a, f, z, c;
 
@@ -1147,7 +1281,7 @@ emulate_next_instruction:
 
                         }
 
-                        case CCF: {
+                        INSTRUCTION(CCF): {
 
                                 int     c;
 
@@ -1167,7 +1301,7 @@ emulate_next_instruction:
 
                         }
 
-                        case SCF: {
+                        INSTRUCTION(SCF): {
 
                                 F = (F & SZPV_FLAGS) 
 
@@ -1183,17 +1317,17 @@ emulate_next_instruction:
 
                         }
 
-                        case NOP: {
+                        INSTRUCTION(NOP): {
 
                                 break;
 
                         }
 
-                        case HALT: {
+                        INSTRUCTION(HALT): {
 
 #ifdef Z80_CATCH_HALT
 
-                                state->status = Z80_STATUS_FLAG_HALT;
+                                state->status = Z80_STATUS_HALT;
 
 #else
 
@@ -1213,7 +1347,7 @@ emulate_next_instruction:
 
                         }
 
-                        case DI: {
+                        INSTRUCTION(DI): {
 
 				state->iff1 = state->iff2 = 0;
 
@@ -1242,7 +1376,7 @@ emulate_next_instruction:
 
                         }
 
-                        case EI: {
+                        INSTRUCTION(EI): {
 
                                 state->iff1 = state->iff2 = 1;
 
@@ -1256,13 +1390,14 @@ emulate_next_instruction:
                                 /* See comment for DI. */
 
                                 number_cycles += 4;
+                                Z80_STOP_FOR_INTERRUPT(1);
                                 break;
 
 #endif
 
                         }
 
-                        case IM_N: {
+                        INSTRUCTION(IM_N): {
 
                                 /* "IM 0/1" (0xed prefixed opcodes 0x4e and
                                  * 0x6e) is treated like a "IM 0".
@@ -1286,7 +1421,7 @@ emulate_next_instruction:
 
                         /* 16-bit arithmetic group. */
 
-                        case ADD_HL_RR: {
+                        INSTRUCTION(ADD_HL_RR): {
 
                                 int     x, y, z, f, c;
 
@@ -1315,7 +1450,7 @@ emulate_next_instruction:
 
                         }
 
-                        case ADC_HL_RR: {
+                        INSTRUCTION(ADC_HL_RR): {
 
                                 int     x, y, z, f, c;
                         
@@ -1346,7 +1481,7 @@ emulate_next_instruction:
 
                         }
 
-                        case SBC_HL_RR: {
+                        INSTRUCTION(SBC_HL_RR): {
 
                                 int     x, y, z, f, c;
                         
@@ -1379,7 +1514,7 @@ emulate_next_instruction:
 
                         }
 
-                        case INC_RR: {
+                        INSTRUCTION(INC_RR): {
 
                                 int     x;
 
@@ -1393,11 +1528,37 @@ emulate_next_instruction:
 
                         }
 
-                        case DEC_RR: {
+                        INSTRUCTION(DEC_RR): {
 
                                 int     x;
 
                                 x = RR(P(opcode));
+
+#ifdef Z80_SKIP_DELAY_LOOPS
+
+                                if (registers == REGISTER_TABLE
+                                        && is_dec_rr_loop(opcode, pc, context)) {
+
+                                        int     n;
+
+                                        n = passes_before_stop((x - 1) & 0xffff,
+                                                DEC_RR_LOOP_CYCLES,
+                                                elapsed_cycles - 4, 
+                                                number_cycles);
+                                        if (n) {
+
+                                                x = (x - n) & 0xffff;
+                                                A = (x | (x >> 8)) & 0xff;
+                                                F = SZYXP_FLAGS_TABLE[A];
+                                                elapsed_cycles += n * DEC_RR_LOOP_CYCLES;
+                                                r += 4 * n;
+
+                                        }
+
+                                }
+
+#endif
+
                                 x--;
                                 RR(P(opcode)) = x;
 
@@ -1409,7 +1570,7 @@ emulate_next_instruction:
 
                         /* Rotate and shift group. */
 
-                        case RLCA: {
+                        INSTRUCTION(RLCA): {
                         
                                 A = (A << 1) | (A >> 7);
                                 F = (F & SZPV_FLAGS)
@@ -1418,7 +1579,7 @@ emulate_next_instruction:
 
                         }
 
-                        case RLA: {
+                        INSTRUCTION(RLA): {
 
                                 int     a, f;
 
@@ -1439,7 +1600,7 @@ emulate_next_instruction:
 
                         }
 
-                        case RRCA: {
+                        INSTRUCTION(RRCA): {
 
                                 int     c;
 
@@ -1459,7 +1620,7 @@ emulate_next_instruction:
 
                         }
 
-                        case RRA: {
+                        INSTRUCTION(RRA): {
 
                                 int     c;
 
@@ -1479,18 +1640,18 @@ emulate_next_instruction:
 
                         }
 
-                        case RLC_R: {
+                        INSTRUCTION(RLC_R): {
 
                                 RLC(R(Z(opcode)));
                                 break;
 
                         }
 
-                        case RLC_INDIRECT_HL: {
+                        INSTRUCTION(RLC_INDIRECT_HL): {
 
                                 int     x;
 
-                                if (registers == state->register_table) {
+                                if (registers == REGISTER_TABLE) {
 
                                         READ_BYTE(HL, x);
                                         RLC(x);
@@ -1523,18 +1684,18 @@ emulate_next_instruction:
 
                         }
 
-                        case RL_R: {
+                        INSTRUCTION(RL_R): {
 
                                 RL(R(Z(opcode)));
                                 break;
 
                         }
 
-                        case RL_INDIRECT_HL: {
+                        INSTRUCTION(RL_INDIRECT_HL): {
 
                                 int     x;
 
-                                if (registers == state->register_table) {
+                                if (registers == REGISTER_TABLE) {
 
                                         READ_BYTE(HL, x);
                                         RL(x);
@@ -1566,18 +1727,18 @@ emulate_next_instruction:
 
                         }
 
-                        case RRC_R: {
+                        INSTRUCTION(RRC_R): {
 
                                 RRC(R(Z(opcode)));
                                 break;
 
                         }
 
-                        case RRC_INDIRECT_HL: {
+                        INSTRUCTION(RRC_INDIRECT_HL): {
 
                                 int     x;
 
-                                if (registers == state->register_table) {
+                                if (registers == REGISTER_TABLE) {
 
                                         READ_BYTE(HL, x);
                                         RRC(x);
@@ -1609,18 +1770,18 @@ emulate_next_instruction:
 
                         }
 
-                        case RR_R: {
+                        INSTRUCTION(RR_R): {
 
                                 RR_INSTRUCTION(R(Z(opcode)));
                                 break;
 
                         }
 
-                        case RR_INDIRECT_HL: {
+                        INSTRUCTION(RR_INDIRECT_HL): {
 
                                 int     x;
 
-                                if (registers == state->register_table) {
+                                if (registers == REGISTER_TABLE) {
 
                                         READ_BYTE(HL, x);
                                         RR_INSTRUCTION(x);
@@ -1652,18 +1813,18 @@ emulate_next_instruction:
 
                         }
 
-                        case SLA_R: {
+                        INSTRUCTION(SLA_R): {
 
                                 SLA(R(Z(opcode)));
                                 break;
 
                         }
 
-                        case SLA_INDIRECT_HL: {
+                        INSTRUCTION(SLA_INDIRECT_HL): {
 
                                 int     x;      
 
-                                if (registers == state->register_table) {
+                                if (registers == REGISTER_TABLE) {
 
                                         READ_BYTE(HL, x);
                                         SLA(x);
@@ -1695,18 +1856,18 @@ emulate_next_instruction:
 
                         }
 
-                        case SLL_R: {
+                        INSTRUCTION(SLL_R): {
 
                                 SLL(R(Z(opcode)));
                                 break;
 
                         }
 
-                        case SLL_INDIRECT_HL: {
+                        INSTRUCTION(SLL_INDIRECT_HL): {
 
                                 int     x;
 
-                                if (registers == state->register_table) {
+                                if (registers == REGISTER_TABLE) {
 
                                         READ_BYTE(HL, x);
                                         SLL(x);
@@ -1738,18 +1899,18 @@ emulate_next_instruction:
 
                         }
 
-                        case SRA_R: {
+                        INSTRUCTION(SRA_R): {
 
                                 SRA(R(Z(opcode)));
                                 break;
 
                         }
 
-                        case SRA_INDIRECT_HL: {
+                        INSTRUCTION(SRA_INDIRECT_HL): {
 
                                 int     x;
 
-                                if (registers == state->register_table) {
+                                if (registers == REGISTER_TABLE) {
 
                                         READ_BYTE(HL, x);
                                         SRA(x);
@@ -1781,18 +1942,18 @@ emulate_next_instruction:
 
                         }
 
-                        case SRL_R: {
+                        INSTRUCTION(SRL_R): {
 
                                 SRL(R(Z(opcode)));
                                 break;
 
                         }
 
-                        case SRL_INDIRECT_HL: {
+                        INSTRUCTION(SRL_INDIRECT_HL): {
 
                                 int     x;
 
-                                if (registers == state->register_table) {
+                                if (registers == REGISTER_TABLE) {
 
                                         READ_BYTE(HL, x);
                                         SRL(x);
@@ -1824,7 +1985,7 @@ emulate_next_instruction:
 
                         }
 
-                        case RLD_RRD: {
+                        INSTRUCTION(RLD_RRD): {
 
                                 int     x, y;
 
@@ -1849,7 +2010,7 @@ emulate_next_instruction:
 
                         /* Bit set, reset, and test group. */
 
-                        case BIT_B_R: {
+                        INSTRUCTION(BIT_B_R): {
 
                                 int     x;
 
@@ -1870,11 +2031,11 @@ emulate_next_instruction:
 
                         }                               
 
-                        case BIT_B_INDIRECT_HL: {
+                        INSTRUCTION(BIT_B_INDIRECT_HL): {
 
                                 int     d, x;
                                         
-                                if (registers == state->register_table) {
+                                if (registers == REGISTER_TABLE) {
 
                                         d = HL;
 
@@ -1909,18 +2070,18 @@ emulate_next_instruction:
 
                         }
 
-                        case SET_B_R: {
+                        INSTRUCTION(SET_B_R): {
 
                                 R(Z(opcode)) |= 1 << Y(opcode);
                                 break;
 
                         }
 
-                        case SET_B_INDIRECT_HL: {
+                        INSTRUCTION(SET_B_INDIRECT_HL): {
 
                                 int     x;
 
-                                if (registers == state->register_table) {
+                                if (registers == REGISTER_TABLE) {
 
                                         READ_BYTE(HL, x);
                                         x |= 1 << Y(opcode);
@@ -1952,18 +2113,18 @@ emulate_next_instruction:
 
                         }
 
-                        case RES_B_R: {
+                        INSTRUCTION(RES_B_R): {
 
                                 R(Z(opcode)) &= ~(1 << Y(opcode));
                                 break;
 
                         }       
 
-                        case RES_B_INDIRECT_HL: {
+                        INSTRUCTION(RES_B_INDIRECT_HL): {
 
                                 int     x;
 
-                                if (registers == state->register_table) {
+                                if (registers == REGISTER_TABLE) {
 
                                         READ_BYTE(HL, x);
                                         x &= ~(1 << Y(opcode));
@@ -1997,7 +2158,7 @@ emulate_next_instruction:
 
                         /* Jump group. */
 
-                        case JP_NN: {
+                        INSTRUCTION(JP_NN): {
 
                                 int     nn;
 
@@ -2010,7 +2171,7 @@ emulate_next_instruction:
 
                         }
 
-                        case JP_CC_NN: {
+                        INSTRUCTION(JP_CC_NN): {
 
                                 int     nn;
 
@@ -2037,7 +2198,7 @@ emulate_next_instruction:
 
                         }                               
 
-                        case JR_E: {
+                        INSTRUCTION(JR_E): {
 
                                 int     e;
                                 
@@ -2050,7 +2211,7 @@ emulate_next_instruction:
 
                         }
 
-                        case JR_DD_E: {
+                        INSTRUCTION(JR_DD_E): {
 
                                 int     e;
 
@@ -2078,16 +2239,35 @@ emulate_next_instruction:
 
                         }                                            
 
-                        case JP_HL: {
+                        INSTRUCTION(JP_HL): {
 
                                 pc = HL_IX_IY;
                                 break;
 
                         }                       
 
-                        case DJNZ_E: {
+                        INSTRUCTION(DJNZ_E): {
 
                                 int     e;
+
+#ifdef Z80_SKIP_DELAY_LOOPS
+
+                                Z80_FETCH_BYTE(pc, e);
+                                if (e == 0xfe) {
+
+                                        int     n;
+
+                                        n = passes_before_stop((B - 1) & 0xff,
+                                                DJNZ_LOOP_CYCLES,
+                                                elapsed_cycles - 4, 
+                                                number_cycles);
+                                        B -= n;
+                                        elapsed_cycles += n * DJNZ_LOOP_CYCLES;
+                                        r += n;
+
+                                }
+
+#endif
                                 
                                 if (--B) {
                                 
@@ -2115,7 +2295,7 @@ emulate_next_instruction:
 
                         /* Call and return group. */
 
-                        case CALL_NN: {
+                        INSTRUCTION(CALL_NN): {
 
                                 int     nn;
 
@@ -2129,7 +2309,7 @@ emulate_next_instruction:
 
                         }
 
-                        case CALL_CC_NN: {
+                        INSTRUCTION(CALL_CC_NN): {
 
                                 int     nn;
 
@@ -2158,14 +2338,14 @@ emulate_next_instruction:
 
                         }
 
-                        case RET: {
+                        INSTRUCTION(RET): {
 
                                 POP(pc);
                                 break;
 
                         }
                                                   
-                        case RET_CC: {
+                        INSTRUCTION(RET_CC): {
 
                                 if (CC(Y(opcode))) {
 
@@ -2177,7 +2357,7 @@ emulate_next_instruction:
 
                         }
 
-                        case RETI_RETN: {
+                        INSTRUCTION(RETI_RETN): {
 
                                 state->iff1 = state->iff2;
                                 POP(pc);        
@@ -2201,13 +2381,14 @@ emulate_next_instruction:
 
 #else
 
+                                Z80_STOP_FOR_INTERRUPT(0);
                                 break;
 
 #endif
 
                         }
 
-                        case RST_P: {
+                        INSTRUCTION(RST_P): {
 
                                 PUSH(pc);
                                 pc = RST_TABLE[Y(opcode)];
@@ -2218,7 +2399,7 @@ emulate_next_instruction:
 
                         /* Input and output group. */
 
-                        case IN_A_N: {
+                        INSTRUCTION(IN_A_N): {
 
                                 int     n;
 
@@ -2231,7 +2412,7 @@ emulate_next_instruction:
 
                         }       
 
-                        case IN_R_C: {
+                        INSTRUCTION(IN_R_C): {
 
                                 int     x;                                           
                                 Z80_INPUT_BYTE(C, x);
@@ -2254,7 +2435,7 @@ emulate_next_instruction:
                          * Undocumented Z80 Documented Version 0.91". 
                          */
 
-                        case INI_IND: {
+                        INSTRUCTION(INI_IND): {
 
                                 int     x, f;
 
@@ -2285,7 +2466,7 @@ emulate_next_instruction:
 
                         }
 
-                        case INIR_INDR: {
+                        INSTRUCTION(INIR_INDR): {
 
                                 int     d, b, hl, x, f;
 
@@ -2367,7 +2548,7 @@ emulate_next_instruction:
 
                         }
 
-                        case OUT_N_A: {
+                        INSTRUCTION(OUT_N_A): {
 
                                 int     n;
 
@@ -2380,7 +2561,7 @@ emulate_next_instruction:
 
                         }       
 
-                        case OUT_C_R: {
+                        INSTRUCTION(OUT_C_R): {
 
                                 int     x;
 
@@ -2395,7 +2576,7 @@ emulate_next_instruction:
 
                         }
 
-                        case OUTI_OUTD: {
+                        INSTRUCTION(OUTI_OUTD): {
 
                                 int     x, f;
 
@@ -2416,7 +2597,7 @@ emulate_next_instruction:
 
                         }
 
-                        case OTIR_OTDR: {
+                        INSTRUCTION(OTIR_OTDR): {
 
                                 int     d, b, hl, x, f;
 
@@ -2477,13 +2658,13 @@ emulate_next_instruction:
 
                         /* Prefix group. */
 
-                        case CB_PREFIX: {
+                        INSTRUCTION(CB_PREFIX): {
 
                                 /* Special handling if the 0xcb prefix is 
                                  * prefixed by a 0xdd or 0xfd prefix.
                                  */
 
-                                if (registers != state->register_table) {
+                                if (registers != REGISTER_TABLE) {
 
                                         r--;
 
@@ -2499,15 +2680,25 @@ emulate_next_instruction:
                                         pc++;
 
                                 }
+#ifdef Z80_THREADED_DISPATCH
+
+                                elapsed_cycles += 4;
+                                r++;
+                                goto *CB_INSTRUCTION_DISPATCH_TABLE[opcode];
+
+#else
+
                                 instruction = CB_INSTRUCTION_TABLE[opcode];
 
                                 goto emulate_next_instruction;
 
+#endif
+
                         }
 
-                        case DD_PREFIX: {
+                        INSTRUCTION(DD_PREFIX): {
 
-                                registers = state->dd_register_table;
+                                registers = DD_REGISTER_TABLE;
 
 #ifdef Z80_PREFIX_FAILSAFE
 
@@ -2540,9 +2731,9 @@ emulate_next_instruction:
 
                         }
 
-                        case FD_PREFIX: {
+                        INSTRUCTION(FD_PREFIX): {
 
-                                registers = state->fd_register_table;
+                                registers = FD_REGISTER_TABLE;
 
 #ifdef Z80_PREFIX_FAILSAFE
 
@@ -2571,20 +2762,30 @@ emulate_next_instruction:
 
                         }
 
-                        case ED_PREFIX: {
+                        INSTRUCTION(ED_PREFIX): {
 
-                                registers = state->register_table;
+                                registers = REGISTER_TABLE;
                                 Z80_FETCH_BYTE(pc, opcode);
                                 pc++;
+#ifdef Z80_THREADED_DISPATCH
+
+                                elapsed_cycles += 4;
+                                r++;
+                                goto *ED_INSTRUCTION_DISPATCH_TABLE[opcode];
+
+#else
+
                                 instruction = ED_INSTRUCTION_TABLE[opcode];
 
                                 goto emulate_next_instruction;
 
+#endif
+
                         }
 
                         /* Special/pseudo instruction group. */
 
-                        case ED_UNDEFINED: {
+                        INSTRUCTION(ED_UNDEFINED): {
 
 #ifdef Z80_CATCH_ED_UNDEFINED
 
@@ -2600,8 +2801,16 @@ emulate_next_instruction:
 
                         }
 
+#ifdef Z80_THREADED_DISPATCH
+
+                } while (0);
+
+#else
+
                 }
 
+#endif
+
                 if (elapsed_cycles >= number_cycles)
 
                         goto stop_emulation;
@@ -2615,3 +2824,74 @@ stop_emulation:
 
         return elapsed_cycles;
 }
+
+#ifdef Z80_USE_BLOCK_CACHE
+#       include "z80block_impl.h"
+#endif
+
+/* Don't leak the helper macros into the rest of the including file. */
+
+#ifdef Z80_SKIP_DELAY_LOOPS
+#       undef DEC_RR_LOOP_CYCLES
+#       undef DJNZ_LOOP_CYCLES
+#endif
+
+#undef INSTRUCTION
+#undef INDIRECT_HL
+
+#undef SZC_FLAGS
+#undef YX_FLAGS
+#undef SZ_FLAGS
+#undef SZPV_FLAGS
+#undef SYX_FLAGS
+#undef HC_FLAGS
+#undef A
+#undef F
+#undef B
+#undef C
+#undef AF
+#undef BC
+#undef DE
+#undef HL
+#undef SP
+#undef HL_IX_IY
+#undef Y
+#undef Z
+#undef P
+#undef Q
+#undef R
+#undef S
+#undef RR
+#undef SS
+#undef CC
+#undef DD
+#undef READ_N
+#undef READ_NN
+#undef READ_D
+#undef READ_BYTE
+#undef WRITE_BYTE
+#undef READ_WORD
+#undef WRITE_WORD
+#undef READ_INDIRECT_HL
+#undef WRITE_INDIRECT_HL
+#undef PUSH
+#undef POP
+#undef EXCHANGE
+#undef ADD
+#undef ADC
+#undef SUB
+#undef SBC
+#undef AND
+#undef OR
+#undef XOR
+#undef CP
+#undef INC
+#undef DEC
+#undef RLC
+#undef RL
+#undef RRC
+#undef RR_INSTRUCTION
+#undef SLA
+#undef SLL
+#undef SRA
+#undef SRL
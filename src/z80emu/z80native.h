@@ -0,0 +1,78 @@
+/* z80native.h
+ * Native code for the block cache (see z80block.h). Z80 code that is known
+ * when building, such as a ROM or the programs bundled with an emulator, can
+ * be translated ahead of time into C++ functions by
+ * src/tools/make_native_blocks.py. Each function runs a region of
+ * instructions, with the jumps between them turned into gotos.
+ *
+ * When the block cache is about to decode a block whose address is an entry
+ * into a region, and the bytes in memory are still the ones the region was
+ * translated from, it runs the region's function instead. The region's bytes
+ * are then watched like those of any decoded block, so that writing to them
+ * sends the code back to the regular decoder. Anything that wasn't
+ * translated, or was changed, runs as before.
+ *
+ * The generated header, named by Z80_NATIVE_BLOCKS (see z80config.h), is
+ * included by z80block_impl.h and defines the tables below.
+ */
+
+#ifndef __Z80NATIVE_INCLUDED__
+#define __Z80NATIVE_INCLUDED__
+
+#include "z80block.h"
+
+/* Registers of Z80EmulateBlocks() that a region's function updates. On entry
+ * pc is the address of the first instruction to run, on return that of the
+ * next one. The function stops like a block would, that is when
+ * elapsed_cycles reaches number_cycles, when decoded code is written to, or
+ * when it leaves the region.
+ */
+
+typedef struct Z80_NATIVE_RUN {
+
+        int     pc, r, elapsed_cycles, number_cycles;
+
+} Z80_NATIVE_RUN;
+
+template <typename Bus>
+using Z80_NATIVE_FUNCTION = void (*)(Z80_STATE *state,
+        Z80_BLOCK_CACHE *cache,
+        Z80_NATIVE_RUN *run,
+        Bus *context);
+
+/* Address where a region may be entered, sorted by address. Different
+ * regions may share an address, for instance programs loaded at the same
+ * place.
+ */
+
+typedef struct Z80_NATIVE_ENTRY {
+
+        unsigned short  pc;
+        unsigned short  region;
+
+} Z80_NATIVE_ENTRY;
+
+/* Run of bytes that a region was translated from, and the offset of their
+ * expected values in NATIVE_BYTES.
+ */
+
+typedef struct Z80_NATIVE_RANGE {
+
+        unsigned short  address;
+        unsigned short  length;
+        unsigned int    offset;
+
+} Z80_NATIVE_RANGE;
+
+/* First range of a region in NATIVE_RANGES, and the number of ranges. The
+ * region's function is at the same index in NATIVE_FUNCTIONS.
+ */
+
+typedef struct Z80_NATIVE_REGION {
+
+        unsigned int    range;
+        unsigned int    range_count;
+
+} Z80_NATIVE_REGION;
+
+#endif
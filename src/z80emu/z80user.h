@@ -1,6 +1,5 @@
 /* z80user.h
- * Add your code here to interface the emulated system with z80emu. See towards
- * the end of the file for an example for running zextest.
+ * Add your code here to interface the emulated system with z80emu.
  *
  * Copyright (c) 2016, 2017 Lin Ke-Fong
  *
@@ -10,12 +9,6 @@
 #ifndef __Z80USER_INCLUDED__
 #define __Z80USER_INCLUDED__
 
-#include <stdint.h>
-
-#ifdef __cplusplus
-extern "C" {
-#endif
-
 /* Write the following macros for memory access and input/output on the Z80. 
  *
  * Z80_FETCH_BYTE() and Z80_FETCH_WORD() are used by the emulator to read the
@@ -50,8 +43,39 @@ extern "C" {
  *                      instruction, this number is only precise up to the 
  *                      previous one.
  *
- *      context         This is the (void *) context passed to the emulation 
- *                      functions.
+ *      context         This is the (Bus *) context passed to the emulation 
+ *                      functions. The macros below forward to its member
+ *                      functions, which are expected to be inline: 
+ *
+ *                              uint8_t fetchByte(uint16_t address);
+ *                              uint8_t readByte(uint16_t address);
+ *                              void writeByte(uint16_t address, uint8_t x);
+ *                              uint8_t readPort(uint8_t port);
+ *                              void writePort(uint8_t port, uint8_t x);
+ *
+ *                      With the block cache (see z80block.h), writeByte()
+ *                      must also report writes to decoded code with 
+ *                      Z80BlockCacheWrite().
+ *
+ *                      With Z80_BULK_BLOCK_INSTRUCTIONS, it must also have:
+ *
+ *                              int moveBytes(uint16_t destination, 
+ *                                      uint16_t source, int count, int step);
+ *                              int scanBytes(uint16_t address, int count,
+ *                                      int step, uint8_t value);
+ *
+ *                      moveBytes() copies count bytes one at a time like 
+ *                      LDIR (step +1) or LDDR (step -1), and scanBytes() 
+ *                      counts the bytes before the first one equal to value 
+ *                      like CPIR or CPDR, stopping after count bytes. Either
+ *                      may decline by returning 0, for instance if the bytes
+ *                      aren't plain memory, and the processor then reads and
+ *                      writes them one at a time.
+ *                      It must also have:
+ *                              bool interruptPending();
+ *                      which says whether an interrupt is waiting that the
+ *                      processor would accept now. See 
+ *                      Z80_STOP_FOR_INTERRUPT() below.
  *
  * Except for Z80_READ_WORD_INTERRUPT and Z80_WRITE_WORD_INTERRUPT, all macros 
  * also have access to: 
@@ -67,9 +91,9 @@ extern "C" {
  *      registers       Current register decoding table, use it to determine if
  *                      the current instruction is prefixed. It points on:
  *                      
- *                              state->dd_register_table for 0xdd prefixes; 
- *                              state->fd_register_table for 0xfd prefixes;
- *                              state->register_table otherwise.
+ *                              DD_REGISTER_TABLE for 0xdd prefixes; 
+ *                              FD_REGISTER_TABLE for 0xfd prefixes;
+ *                              REGISTER_TABLE otherwise.
  *
  *      pc              Current PC register (upper bits are undefined), points
  *                      on the opcode, the displacement or constant to read for
@@ -86,45 +110,35 @@ extern "C" {
  *                      instructions.h for a list.
  */
 
-#define TRS80_DEBUG 0
-#define MEMSIZE (64*1024)
-#define ROMSIZE (14*1024)
-
-typedef struct Trs80Machine Trs80Machine;
-
-extern uint8_t Trs80ReadByte(Trs80Machine *machine, uint16_t address);
-extern void Trs80WriteByte(Trs80Machine *machine, uint16_t address, uint8_t value);
-extern uint8_t Trs80ReadPort(Trs80Machine *machine, uint8_t address);
-extern void Trs80WritePort(Trs80Machine *machine, uint8_t address, uint8_t value);
-
-#include <stdio.h>
 #define Z80_READ_BYTE(address, x)                                       \
 {                                                                       \
-    (x) = Trs80ReadByte((Trs80Machine *) context, address);             \
-    if (TRS80_DEBUG) {                                                  \
-        printf("Reading %02x from %04x\n", (x), (address) & 0xffff);    \
-    }                                                                   \
+        (x) = context->readByte((address) & 0xffff);                    \
 }
 
-#define Z80_FETCH_BYTE(address, x)              Z80_READ_BYTE((address), (x))
+#define Z80_FETCH_BYTE(address, x)                                      \
+{                                                                       \
+        (x) = context->fetchByte((address) & 0xffff);                   \
+}
 
 #define Z80_READ_WORD(address, x)                                       \
 {                                                                       \
-    (x) = Trs80ReadByte((Trs80Machine *) context, address) |            \
-        (Trs80ReadByte((Trs80Machine *) context, (address) + 1) << 8);  \
-    if (TRS80_DEBUG) {                                                  \
-        printf("Reading %04x from %04x\n", (x), (address) & 0xffff);    \
-    }                                                                   \
+        int     low;                                                    \
+                                                                        \
+        low = context->readByte((address) & 0xffff);                    \
+        (x) = low | (context->readByte(((address) + 1) & 0xffff) << 8); \
 }
 
-#define Z80_FETCH_WORD(address, x)              Z80_READ_WORD((address), (x))
+#define Z80_FETCH_WORD(address, x)                                      \
+{                                                                       \
+        int     low;                                                    \
+                                                                        \
+        low = context->fetchByte((address) & 0xffff);                   \
+        (x) = low | (context->fetchByte(((address) + 1) & 0xffff) << 8); \
+}
 
 #define Z80_WRITE_BYTE(address, x)                                      \
 {                                                                       \
-    if (TRS80_DEBUG) {                                                  \
-        printf("Writing %02x to %04x\n", (x), (address) & 0xFFFF);      \
-    }                                                                   \
-    Trs80WriteByte((Trs80Machine *) context, address, x);               \
+        context->writeByte((address) & 0xffff, (x));                    \
 }
 
 #define Z80_WRITE_WORD(address, x)                                      \
@@ -139,22 +153,28 @@ extern void Trs80WritePort(Trs80Machine *machine, uint8_t address, uint8_t value
 
 #define Z80_INPUT_BYTE(port, x)                                         \
 {                                                                       \
-    (x) = Trs80ReadPort((Trs80Machine *) context, port);                \
-    if (TRS80_DEBUG) {                                                  \
-        printf("Reading %02x from port %02x\n", x, port);               \
-    }                                                                   \
+        (x) = context->readPort(port);                                  \
 }
 
-#define Z80_OUTPUT_BYTE(port, x)                                        \
+/* Z80_STOP_FOR_INTERRUPT() is used where an interrupt may have just become
+ * acceptable in the middle of a run: after EI, RETI, and RETN, and after 
+ * output, which may unmask one. If one is pending, the emulation stops once
+ * cycles more have elapsed, so that the caller takes it on its exact cycle
+ * instead of when the run would have ended. EI passes 1, since no interrupt
+ * is accepted until the instruction after it is done.
+ */
+
+#define Z80_STOP_FOR_INTERRUPT(cycles)                                  \
 {                                                                       \
-    if (TRS80_DEBUG) {                                                  \
-        printf("Writing %02x to port %02x\n", x, port);                 \
-    }                                                                   \
-    Trs80WritePort((Trs80Machine *) context, port, x);                  \
+        if (context->interruptPending())                                \
+                                                                        \
+                number_cycles = elapsed_cycles + (cycles);              \
 }
 
-#ifdef __cplusplus
+#define Z80_OUTPUT_BYTE(port, x)                                        \
+{                                                                       \
+        context->writePort((port), (x));                                \
+        Z80_STOP_FOR_INTERRUPT(0);                                      \
 }
-#endif
 
 #endif